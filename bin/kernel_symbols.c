@@ -0,0 +1,1617 @@
+// Generated by tools/symbols.sh, do not edit
+
+#include <symbols.h>
+
+const uint64_t symbol_count = 803;
+
+const symbol_t symbol_table[] = {
+	{ 0xffffffffffe02000, 0 },
+	{ 0xffffffffffe02011, 7 },
+	{ 0xffffffffffe02030, 20 },
+	{ 0xffffffffffe02077, 34 },
+	{ 0xffffffffffe020bf, 52 },
+	{ 0xffffffffffe021f5, 63 },
+	{ 0xffffffffffe02355, 73 },
+	{ 0xffffffffffe023cc, 89 },
+	{ 0xffffffffffe02409, 97 },
+	{ 0xffffffffffe02453, 111 },
+	{ 0xffffffffffe0248d, 123 },
+	{ 0xffffffffffe024a5, 130 },
+	{ 0xffffffffffe024be, 144 },
+	{ 0xffffffffffe02521, 154 },
+	{ 0xffffffffffe02586, 165 },
+	{ 0xffffffffffe0259c, 174 },
+	{ 0xffffffffffe02678, 188 },
+	{ 0xffffffffffe0274c, 200 },
+	{ 0xffffffffffe028fc, 221 },
+	{ 0xffffffffffe0296a, 241 },
+	{ 0xffffffffffe029ee, 260 },
+	{ 0xffffffffffe02a13, 276 },
+	{ 0xffffffffffe02b2f, 286 },
+	{ 0xffffffffffe02b79, 300 },
+	{ 0xffffffffffe02bb3, 312 },
+	{ 0xffffffffffe02bd5, 327 },
+	{ 0xffffffffffe02c0d, 337 },
+	{ 0xffffffffffe02c30, 349 },
+	{ 0xffffffffffe02c62, 372 },
+	{ 0xffffffffffe02c8d, 395 },
+	{ 0xffffffffffe02ca5, 402 },
+	{ 0xffffffffffe02dc9, 417 },
+	{ 0xffffffffffe02e36, 428 },
+	{ 0xffffffffffe02f9f, 445 },
+	{ 0xffffffffffe02fe6, 455 },
+	{ 0xffffffffffe0301b, 468 },
+	{ 0xffffffffffe031ca, 487 },
+	{ 0xffffffffffe03244, 501 },
+	{ 0xffffffffffe033c3, 516 },
+	{ 0xffffffffffe0342d, 538 },
+	{ 0xffffffffffe034f0, 554 },
+	{ 0xffffffffffe036b3, 566 },
+	{ 0xffffffffffe03733, 585 },
+	{ 0xffffffffffe0395b, 602 },
+	{ 0xffffffffffe03a8f, 615 },
+	{ 0xffffffffffe03abc, 632 },
+	{ 0xffffffffffe03b18, 650 },
+	{ 0xffffffffffe03bc6, 661 },
+	{ 0xffffffffffe03c4a, 676 },
+	{ 0xffffffffffe03d4b, 690 },
+	{ 0xffffffffffe03e03, 705 },
+	{ 0xffffffffffe03e39, 716 },
+	{ 0xffffffffffe03e6f, 728 },
+	{ 0xffffffffffe03faa, 747 },
+	{ 0xffffffffffe03fde, 758 },
+	{ 0xffffffffffe04028, 772 },
+	{ 0xffffffffffe04062, 784 },
+	{ 0xffffffffffe04084, 799 },
+	{ 0xffffffffffe040bc, 809 },
+	{ 0xffffffffffe040df, 821 },
+	{ 0xffffffffffe040fe, 834 },
+	{ 0xffffffffffe04116, 841 },
+	{ 0xffffffffffe0414c, 867 },
+	{ 0xffffffffffe04183, 890 },
+	{ 0xffffffffffe041dc, 908 },
+	{ 0xffffffffffe04216, 929 },
+	{ 0xffffffffffe042a4, 952 },
+	{ 0xffffffffffe044c9, 968 },
+	{ 0xffffffffffe0451a, 986 },
+	{ 0xffffffffffe04794, 1004 },
+	{ 0xffffffffffe04a79, 1029 },
+	{ 0xffffffffffe04c52, 1048 },
+	{ 0xffffffffffe04c96, 1066 },
+	{ 0xffffffffffe04dc8, 1083 },
+	{ 0xffffffffffe04e5d, 1101 },
+	{ 0xffffffffffe04ed1, 1120 },
+	{ 0xffffffffffe04fd2, 1141 },
+	{ 0xffffffffffe05049, 1162 },
+	{ 0xffffffffffe051d5, 1180 },
+	{ 0xffffffffffe0538f, 1199 },
+	{ 0xffffffffffe053e1, 1217 },
+	{ 0xffffffffffe05600, 1235 },
+	{ 0xffffffffffe05648, 1253 },
+	{ 0xffffffffffe05660, 1260 },
+	{ 0xffffffffffe05bcf, 1278 },
+	{ 0xffffffffffe05bf1, 1293 },
+	{ 0xffffffffffe05c29, 1303 },
+	{ 0xffffffffffe05c4c, 1315 },
+	{ 0xffffffffffe05c8f, 1326 },
+	{ 0xffffffffffe05cfa, 1337 },
+	{ 0xffffffffffe05d32, 1350 },
+	{ 0xffffffffffe05d91, 1361 },
+	{ 0xffffffffffe05e1a, 1373 },
+	{ 0xffffffffffe05e8f, 1385 },
+	{ 0xffffffffffe0618e, 1406 },
+	{ 0xffffffffffe061ad, 1421 },
+	{ 0xffffffffffe061e5, 1431 },
+	{ 0xffffffffffe06208, 1443 },
+	{ 0xffffffffffe0623a, 1455 },
+	{ 0xffffffffffe06256, 1464 },
+	{ 0xffffffffffe06281, 1476 },
+	{ 0xffffffffffe062a7, 1488 },
+	{ 0xffffffffffe064d7, 1499 },
+	{ 0xffffffffffe064f2, 1514 },
+	{ 0xffffffffffe06572, 1533 },
+	{ 0xffffffffffe06788, 1549 },
+	{ 0xffffffffffe067af, 1565 },
+	{ 0xffffffffffe067f0, 1583 },
+	{ 0xffffffffffe06887, 1602 },
+	{ 0xffffffffffe068d6, 1619 },
+	{ 0xffffffffffe06a2a, 1636 },
+	{ 0xffffffffffe06ac1, 1654 },
+	{ 0xffffffffffe06c52, 1671 },
+	{ 0xffffffffffe06d2c, 1687 },
+	{ 0xffffffffffe06f5c, 1704 },
+	{ 0xffffffffffe07043, 1720 },
+	{ 0xffffffffffe07100, 1737 },
+	{ 0xffffffffffe071af, 1753 },
+	{ 0xffffffffffe0722a, 1763 },
+	{ 0xffffffffffe07270, 1773 },
+	{ 0xffffffffffe07315, 1787 },
+	{ 0xffffffffffe074e7, 1801 },
+	{ 0xffffffffffe075a3, 1816 },
+	{ 0xffffffffffe076dc, 1833 },
+	{ 0xffffffffffe077ac, 1847 },
+	{ 0xffffffffffe07b31, 1857 },
+	{ 0xffffffffffe07e82, 1871 },
+	{ 0xffffffffffe07f04, 1889 },
+	{ 0xffffffffffe080b5, 1905 },
+	{ 0xffffffffffe083eb, 1920 },
+	{ 0xffffffffffe0857c, 1931 },
+	{ 0xffffffffffe086ce, 1943 },
+	{ 0xffffffffffe08734, 1956 },
+	{ 0xffffffffffe0896f, 1966 },
+	{ 0xffffffffffe08a8c, 1977 },
+	{ 0xffffffffffe08afa, 1987 },
+	{ 0xffffffffffe08b18, 2003 },
+	{ 0xffffffffffe08e99, 2019 },
+	{ 0xffffffffffe08ffe, 2036 },
+	{ 0xffffffffffe092c1, 2055 },
+	{ 0xffffffffffe0935d, 2070 },
+	{ 0xffffffffffe093c4, 2087 },
+	{ 0xffffffffffe0941b, 2103 },
+	{ 0xffffffffffe0959c, 2113 },
+	{ 0xffffffffffe09a5c, 2124 },
+	{ 0xffffffffffe09aee, 2140 },
+	{ 0xffffffffffe09b26, 2150 },
+	{ 0xffffffffffe09b49, 2162 },
+	{ 0xffffffffffe09b74, 2173 },
+	{ 0xffffffffffe09bae, 2184 },
+	{ 0xffffffffffe09c77, 2194 },
+	{ 0xffffffffffe09dac, 2204 },
+	{ 0xffffffffffe09f1e, 2213 },
+	{ 0xffffffffffe0a0e0, 2228 },
+	{ 0xffffffffffe0a175, 2241 },
+	{ 0xffffffffffe0a56a, 2259 },
+	{ 0xffffffffffe0a5a5, 2273 },
+	{ 0xffffffffffe0a80c, 2289 },
+	{ 0xffffffffffe0a992, 2302 },
+	{ 0xffffffffffe0a9ba, 2312 },
+	{ 0xffffffffffe0aa50, 2327 },
+	{ 0xffffffffffe0ab3b, 2342 },
+	{ 0xffffffffffe0ab88, 2355 },
+	{ 0xffffffffffe0add7, 2370 },
+	{ 0xffffffffffe0aeb7, 2385 },
+	{ 0xffffffffffe0afe7, 2396 },
+	{ 0xffffffffffe0b09f, 2405 },
+	{ 0xffffffffffe0b368, 2414 },
+	{ 0xffffffffffe0b7fd, 2424 },
+	{ 0xffffffffffe0b88f, 2439 },
+	{ 0xffffffffffe0b8cc, 2447 },
+	{ 0xffffffffffe0b8e4, 2454 },
+	{ 0xffffffffffe0b92e, 2468 },
+	{ 0xffffffffffe0b968, 2480 },
+	{ 0xffffffffffe0b9ed, 2489 },
+	{ 0xffffffffffe0ba5c, 2501 },
+	{ 0xffffffffffe0ba82, 2512 },
+	{ 0xffffffffffe0bbfb, 2531 },
+	{ 0xffffffffffe0bce7, 2546 },
+	{ 0xffffffffffe0be2d, 2555 },
+	{ 0xffffffffffe0bebb, 2572 },
+	{ 0xffffffffffe0bf5c, 2583 },
+	{ 0xffffffffffe0bfce, 2603 },
+	{ 0xffffffffffe0c0a2, 2612 },
+	{ 0xffffffffffe0c157, 2629 },
+	{ 0xffffffffffe0c180, 2644 },
+	{ 0xffffffffffe0c275, 2660 },
+	{ 0xffffffffffe0c30f, 2672 },
+	{ 0xffffffffffe0c40e, 2681 },
+	{ 0xffffffffffe0c41b, 2691 },
+	{ 0xffffffffffe0c458, 2699 },
+	{ 0xffffffffffe0c470, 2706 },
+	{ 0xffffffffffe0c4d5, 2728 },
+	{ 0xffffffffffe0c54f, 2738 },
+	{ 0xffffffffffe0c600, 2754 },
+	{ 0xffffffffffe0c69b, 2768 },
+	{ 0xffffffffffe0c78d, 2779 },
+	{ 0xffffffffffe0c7fc, 2788 },
+	{ 0xffffffffffe0c825, 2800 },
+	{ 0xffffffffffe0c84e, 2812 },
+	{ 0xffffffffffe0c9c3, 2829 },
+	{ 0xffffffffffe0c9fb, 2839 },
+	{ 0xffffffffffe0ca1e, 2851 },
+	{ 0xffffffffffe0ca5a, 2859 },
+	{ 0xffffffffffe0ca96, 2867 },
+	{ 0xffffffffffe0cad2, 2875 },
+	{ 0xffffffffffe0cb0e, 2883 },
+	{ 0xffffffffffe0cb4a, 2891 },
+	{ 0xffffffffffe0cb86, 2899 },
+	{ 0xffffffffffe0cbc2, 2907 },
+	{ 0xffffffffffe0cbfe, 2915 },
+	{ 0xffffffffffe0cc3a, 2923 },
+	{ 0xffffffffffe0cc76, 2931 },
+	{ 0xffffffffffe0ccb2, 2939 },
+	{ 0xffffffffffe0ccee, 2947 },
+	{ 0xffffffffffe0cd2a, 2955 },
+	{ 0xffffffffffe0cd66, 2963 },
+	{ 0xffffffffffe0cda2, 2971 },
+	{ 0xffffffffffe0cdde, 2979 },
+	{ 0xffffffffffe0ce1a, 2987 },
+	{ 0xffffffffffe0ce56, 2995 },
+	{ 0xffffffffffe0ce92, 3003 },
+	{ 0xffffffffffe0cece, 3011 },
+	{ 0xffffffffffe0cf0a, 3019 },
+	{ 0xffffffffffe0cf46, 3027 },
+	{ 0xffffffffffe0cf82, 3035 },
+	{ 0xffffffffffe0cfbe, 3043 },
+	{ 0xffffffffffe0cffa, 3058 },
+	{ 0xffffffffffe0d036, 3073 },
+	{ 0xffffffffffe0d072, 3088 },
+	{ 0xffffffffffe0d0ae, 3103 },
+	{ 0xffffffffffe0d0ea, 3118 },
+	{ 0xffffffffffe0d126, 3133 },
+	{ 0xffffffffffe0d162, 3148 },
+	{ 0xffffffffffe0d19e, 3163 },
+	{ 0xffffffffffe0d1da, 3178 },
+	{ 0xffffffffffe0d216, 3193 },
+	{ 0xffffffffffe0d252, 3208 },
+	{ 0xffffffffffe0d28e, 3223 },
+	{ 0xffffffffffe0d2ca, 3238 },
+	{ 0xffffffffffe0d306, 3253 },
+	{ 0xffffffffffe0d342, 3268 },
+	{ 0xffffffffffe0d37e, 3283 },
+	{ 0xffffffffffe0d3ba, 3298 },
+	{ 0xffffffffffe0d3f6, 3313 },
+	{ 0xffffffffffe0d432, 3328 },
+	{ 0xffffffffffe0d46e, 3343 },
+	{ 0xffffffffffe0d4aa, 3358 },
+	{ 0xffffffffffe0d4e6, 3373 },
+	{ 0xffffffffffe0d522, 3388 },
+	{ 0xffffffffffe0d55e, 3403 },
+	{ 0xffffffffffe0d59a, 3418 },
+	{ 0xffffffffffe0d5d6, 3433 },
+	{ 0xffffffffffe0d612, 3448 },
+	{ 0xffffffffffe0d64e, 3463 },
+	{ 0xffffffffffe0d68a, 3478 },
+	{ 0xffffffffffe0d6c6, 3493 },
+	{ 0xffffffffffe0d702, 3508 },
+	{ 0xffffffffffe0d73e, 3523 },
+	{ 0xffffffffffe0d77a, 3538 },
+	{ 0xffffffffffe0d7b6, 3553 },
+	{ 0xffffffffffe0d7f2, 3568 },
+	{ 0xffffffffffe0d82e, 3583 },
+	{ 0xffffffffffe0d86a, 3598 },
+	{ 0xffffffffffe0d8a6, 3613 },
+	{ 0xffffffffffe0d8e2, 3628 },
+	{ 0xffffffffffe0d91e, 3643 },
+	{ 0xffffffffffe0d95a, 3658 },
+	{ 0xffffffffffe0d996, 3673 },
+	{ 0xffffffffffe0d9d2, 3688 },
+	{ 0xffffffffffe0da0e, 3703 },
+	{ 0xffffffffffe0da4a, 3719 },
+	{ 0xffffffffffe0da86, 3735 },
+	{ 0xffffffffffe0dac2, 3751 },
+	{ 0xffffffffffe0dafe, 3767 },
+	{ 0xffffffffffe0db3a, 3783 },
+	{ 0xffffffffffe0db76, 3799 },
+	{ 0xffffffffffe0dbb2, 3815 },
+	{ 0xffffffffffe0dbee, 3831 },
+	{ 0xffffffffffe0dc2a, 3847 },
+	{ 0xffffffffffe0dc66, 3863 },
+	{ 0xffffffffffe0dca2, 3879 },
+	{ 0xffffffffffe0dcde, 3895 },
+	{ 0xffffffffffe0dd1a, 3911 },
+	{ 0xffffffffffe0dd56, 3927 },
+	{ 0xffffffffffe0dd92, 3943 },
+	{ 0xffffffffffe0ddce, 3959 },
+	{ 0xffffffffffe0de0a, 3975 },
+	{ 0xffffffffffe0de46, 3991 },
+	{ 0xffffffffffe0de82, 4007 },
+	{ 0xffffffffffe0debe, 4023 },
+	{ 0xffffffffffe0defa, 4039 },
+	{ 0xffffffffffe0df36, 4055 },
+	{ 0xffffffffffe0df72, 4071 },
+	{ 0xffffffffffe0dfae, 4087 },
+	{ 0xffffffffffe0dfea, 4103 },
+	{ 0xffffffffffe0e026, 4119 },
+	{ 0xffffffffffe0e062, 4135 },
+	{ 0xffffffffffe0e09e, 4151 },
+	{ 0xffffffffffe0e0da, 4167 },
+	{ 0xffffffffffe0e116, 4183 },
+	{ 0xffffffffffe0e152, 4199 },
+	{ 0xffffffffffe0e18e, 4215 },
+	{ 0xffffffffffe0e1ca, 4231 },
+	{ 0xffffffffffe0e206, 4247 },
+	{ 0xffffffffffe0e242, 4263 },
+	{ 0xffffffffffe0e27e, 4279 },
+	{ 0xffffffffffe0e2ba, 4295 },
+	{ 0xffffffffffe0e2f6, 4311 },
+	{ 0xffffffffffe0e332, 4327 },
+	{ 0xffffffffffe0e36e, 4343 },
+	{ 0xffffffffffe0e3aa, 4359 },
+	{ 0xffffffffffe0e3e6, 4375 },
+	{ 0xffffffffffe0e422, 4391 },
+	{ 0xffffffffffe0e45e, 4407 },
+	{ 0xffffffffffe0e49a, 4423 },
+	{ 0xffffffffffe0e4d6, 4439 },
+	{ 0xffffffffffe0e512, 4455 },
+	{ 0xffffffffffe0e54e, 4471 },
+	{ 0xffffffffffe0e58a, 4487 },
+	{ 0xffffffffffe0e5c6, 4503 },
+	{ 0xffffffffffe0e602, 4519 },
+	{ 0xffffffffffe0e63e, 4535 },
+	{ 0xffffffffffe0e67a, 4551 },
+	{ 0xffffffffffe0e6b6, 4567 },
+	{ 0xffffffffffe0e6f2, 4583 },
+	{ 0xffffffffffe0e72e, 4599 },
+	{ 0xffffffffffe0e76a, 4615 },
+	{ 0xffffffffffe0e7a6, 4631 },
+	{ 0xffffffffffe0e7e2, 4647 },
+	{ 0xffffffffffe0e81e, 4663 },
+	{ 0xffffffffffe0e85a, 4679 },
+	{ 0xffffffffffe0e896, 4695 },
+	{ 0xffffffffffe0e8d2, 4711 },
+	{ 0xffffffffffe0e90e, 4727 },
+	{ 0xffffffffffe0e94a, 4743 },
+	{ 0xffffffffffe0e986, 4759 },
+	{ 0xffffffffffe0e9c2, 4775 },
+	{ 0xffffffffffe0e9fe, 4791 },
+	{ 0xffffffffffe0ea3a, 4807 },
+	{ 0xffffffffffe0ea76, 4823 },
+	{ 0xffffffffffe0eab2, 4839 },
+	{ 0xffffffffffe0eaee, 4855 },
+	{ 0xffffffffffe0eb2a, 4871 },
+	{ 0xffffffffffe0eb66, 4887 },
+	{ 0xffffffffffe0eba2, 4903 },
+	{ 0xffffffffffe0ebde, 4919 },
+	{ 0xffffffffffe0ec1a, 4935 },
+	{ 0xffffffffffe0ec56, 4951 },
+	{ 0xffffffffffe0ec92, 4967 },
+	{ 0xffffffffffe0ecce, 4983 },
+	{ 0xffffffffffe0ed0a, 4999 },
+	{ 0xffffffffffe0ed46, 5015 },
+	{ 0xffffffffffe0ed82, 5031 },
+	{ 0xffffffffffe0edbe, 5047 },
+	{ 0xffffffffffe0edfa, 5063 },
+	{ 0xffffffffffe0ee36, 5079 },
+	{ 0xffffffffffe0ee72, 5095 },
+	{ 0xffffffffffe0eeae, 5111 },
+	{ 0xffffffffffe0eeea, 5127 },
+	{ 0xffffffffffe0ef26, 5143 },
+	{ 0xffffffffffe0ef62, 5159 },
+	{ 0xffffffffffe0ef9e, 5175 },
+	{ 0xffffffffffe0efda, 5191 },
+	{ 0xffffffffffe0f016, 5207 },
+	{ 0xffffffffffe0f052, 5223 },
+	{ 0xffffffffffe0f08e, 5239 },
+	{ 0xffffffffffe0f0ca, 5255 },
+	{ 0xffffffffffe0f106, 5271 },
+	{ 0xffffffffffe0f142, 5287 },
+	{ 0xffffffffffe0f17e, 5303 },
+	{ 0xffffffffffe0f1ba, 5319 },
+	{ 0xffffffffffe0f1f6, 5335 },
+	{ 0xffffffffffe0f232, 5351 },
+	{ 0xffffffffffe0f26e, 5367 },
+	{ 0xffffffffffe0f2aa, 5383 },
+	{ 0xffffffffffe0f2e6, 5399 },
+	{ 0xffffffffffe0f322, 5415 },
+	{ 0xffffffffffe0f35e, 5431 },
+	{ 0xffffffffffe0f39a, 5447 },
+	{ 0xffffffffffe0f3d6, 5463 },
+	{ 0xffffffffffe0f412, 5479 },
+	{ 0xffffffffffe0f44e, 5495 },
+	{ 0xffffffffffe0f48a, 5511 },
+	{ 0xffffffffffe0f4c6, 5527 },
+	{ 0xffffffffffe0f502, 5543 },
+	{ 0xffffffffffe0f53e, 5559 },
+	{ 0xffffffffffe0f57a, 5575 },
+	{ 0xffffffffffe0f5b6, 5591 },
+	{ 0xffffffffffe0f5f2, 5607 },
+	{ 0xffffffffffe0f62e, 5623 },
+	{ 0xffffffffffe0f66a, 5639 },
+	{ 0xffffffffffe0f6a6, 5655 },
+	{ 0xffffffffffe0f6e2, 5671 },
+	{ 0xffffffffffe0f71e, 5687 },
+	{ 0xffffffffffe0f75a, 5703 },
+	{ 0xffffffffffe0f796, 5719 },
+	{ 0xffffffffffe0f7d2, 5735 },
+	{ 0xffffffffffe0f80e, 5751 },
+	{ 0xffffffffffe0f84a, 5767 },
+	{ 0xffffffffffe0f886, 5783 },
+	{ 0xffffffffffe0f8c2, 5799 },
+	{ 0xffffffffffe0f8fe, 5815 },
+	{ 0xffffffffffe0f93a, 5831 },
+	{ 0xffffffffffe0f976, 5847 },
+	{ 0xffffffffffe0f9b2, 5863 },
+	{ 0xffffffffffe0f9ee, 5879 },
+	{ 0xffffffffffe0fa2a, 5895 },
+	{ 0xffffffffffe0fa66, 5911 },
+	{ 0xffffffffffe0faa2, 5927 },
+	{ 0xffffffffffe0fd4d, 5942 },
+	{ 0xffffffffffe0fe1b, 5961 },
+	{ 0xffffffffffe0fe74, 5980 },
+	{ 0xffffffffffe0feb6, 6001 },
+	{ 0xffffffffffe10000, 6019 },
+	{ 0xffffffffffe100fd, 6045 },
+	{ 0xffffffffffe10277, 6068 },
+	{ 0xffffffffffe10367, 6090 },
+	{ 0xffffffffffe10465, 6114 },
+	{ 0xffffffffffe10536, 6129 },
+	{ 0xffffffffffe1060b, 6146 },
+	{ 0xffffffffffe1063e, 6167 },
+	{ 0xffffffffffe107f8, 6186 },
+	{ 0xffffffffffe1082a, 6206 },
+	{ 0xffffffffffe10919, 6229 },
+	{ 0xffffffffffe10947, 6252 },
+	{ 0xffffffffffe10974, 6273 },
+	{ 0xffffffffffe10a7b, 6294 },
+	{ 0xffffffffffe10ab9, 6312 },
+	{ 0xffffffffffe10ad1, 6319 },
+	{ 0xffffffffffe10b1b, 6346 },
+	{ 0xffffffffffe10c0f, 6364 },
+	{ 0xffffffffffe10c6e, 6378 },
+	{ 0xffffffffffe10d6e, 6390 },
+	{ 0xffffffffffe10d96, 6410 },
+	{ 0xffffffffffe10e06, 6432 },
+	{ 0xffffffffffe10e2a, 6453 },
+	{ 0xffffffffffe11032, 6481 },
+	{ 0xffffffffffe110eb, 6510 },
+	{ 0xffffffffffe1148d, 6539 },
+	{ 0xffffffffffe114ee, 6560 },
+	{ 0xffffffffffe11533, 6583 },
+	{ 0xffffffffffe1157d, 6597 },
+	{ 0xffffffffffe115b7, 6609 },
+	{ 0xffffffffffe115d9, 6624 },
+	{ 0xffffffffffe11611, 6634 },
+	{ 0xffffffffffe11634, 6646 },
+	{ 0xffffffffffe11666, 6669 },
+	{ 0xffffffffffe11691, 6692 },
+	{ 0xffffffffffe116bb, 6704 },
+	{ 0xffffffffffe116ec, 6717 },
+	{ 0xffffffffffe117a8, 6727 },
+	{ 0xffffffffffe11a72, 6739 },
+	{ 0xffffffffffe11a97, 6757 },
+	{ 0xffffffffffe11af8, 6775 },
+	{ 0xffffffffffe11c14, 6788 },
+	{ 0xffffffffffe11cde, 6806 },
+	{ 0xffffffffffe11d7a, 6829 },
+	{ 0xffffffffffe11d92, 6836 },
+	{ 0xffffffffffe11dca, 6846 },
+	{ 0xffffffffffe11ded, 6858 },
+	{ 0xffffffffffe11e0f, 6874 },
+	{ 0xffffffffffe11f24, 6891 },
+	{ 0xffffffffffe12340, 6903 },
+	{ 0xffffffffffe12358, 6910 },
+	{ 0xffffffffffe127d7, 6917 },
+	{ 0xffffffffffe12833, 6930 },
+	{ 0xffffffffffe12945, 6939 },
+	{ 0xffffffffffe12b45, 6950 },
+	{ 0xffffffffffe12ba1, 6962 },
+	{ 0xffffffffffe12be4, 6983 },
+	{ 0xffffffffffe12cd8, 6993 },
+	{ 0xffffffffffe12d3e, 7003 },
+	{ 0xffffffffffe12dd8, 7013 },
+	{ 0xffffffffffe12e3c, 7033 },
+	{ 0xffffffffffe12e86, 7047 },
+	{ 0xffffffffffe12ec0, 7059 },
+	{ 0xffffffffffe12ef8, 7069 },
+	{ 0xffffffffffe12f1b, 7081 },
+	{ 0xffffffffffe12f4d, 7104 },
+	{ 0xffffffffffe12f78, 7127 },
+	{ 0xffffffffffe12f97, 7140 },
+	{ 0xffffffffffe12fb9, 7153 },
+	{ 0xffffffffffe1304c, 7166 },
+	{ 0xffffffffffe130fc, 7180 },
+	{ 0xffffffffffe13206, 7188 },
+	{ 0xffffffffffe13261, 7196 },
+	{ 0xffffffffffe13341, 7202 },
+	{ 0xffffffffffe13379, 7212 },
+	{ 0xffffffffffe1339c, 7224 },
+	{ 0xffffffffffe133bb, 7237 },
+	{ 0xffffffffffe13403, 7249 },
+	{ 0xffffffffffe1346a, 7268 },
+	{ 0xffffffffffe13541, 7282 },
+	{ 0xffffffffffe1359b, 7303 },
+	{ 0xffffffffffe135b8, 7319 },
+	{ 0xffffffffffe13606, 7339 },
+	{ 0xffffffffffe136c1, 7352 },
+	{ 0xffffffffffe13756, 7372 },
+	{ 0xffffffffffe1389a, 7383 },
+	{ 0xffffffffffe13a56, 7395 },
+	{ 0xffffffffffe13b88, 7408 },
+	{ 0xffffffffffe13c8f, 7421 },
+	{ 0xffffffffffe13e11, 7436 },
+	{ 0xffffffffffe13e49, 7455 },
+	{ 0xffffffffffe14223, 7471 },
+	{ 0xffffffffffe149e6, 7483 },
+	{ 0xffffffffffe14a29, 7497 },
+	{ 0xffffffffffe14b82, 7509 },
+	{ 0xffffffffffe14bef, 7526 },
+	{ 0xffffffffffe14c88, 7538 },
+	{ 0xffffffffffe14cba, 7559 },
+	{ 0xffffffffffe14d1d, 7577 },
+	{ 0xffffffffffe14d94, 7589 },
+	{ 0xffffffffffe14dcb, 7606 },
+	{ 0xffffffffffe14fc2, 7617 },
+	{ 0xffffffffffe1506b, 7629 },
+	{ 0xffffffffffe152d3, 7641 },
+	{ 0xffffffffffe15336, 7657 },
+	{ 0xffffffffffe15482, 7668 },
+	{ 0xffffffffffe1551b, 7686 },
+	{ 0xffffffffffe1559c, 7706 },
+	{ 0xffffffffffe15611, 7720 },
+	{ 0xffffffffffe15712, 7735 },
+	{ 0xffffffffffe1589b, 7751 },
+	{ 0xffffffffffe1599a, 7767 },
+	{ 0xffffffffffe15b4c, 7777 },
+	{ 0xffffffffffe15bc0, 7791 },
+	{ 0xffffffffffe15c5f, 7810 },
+	{ 0xffffffffffe15c8c, 7824 },
+	{ 0xffffffffffe15cd6, 7838 },
+	{ 0xffffffffffe15d10, 7850 },
+	{ 0xffffffffffe15d32, 7865 },
+	{ 0xffffffffffe15d6a, 7875 },
+	{ 0xffffffffffe15d8d, 7887 },
+	{ 0xffffffffffe15dbf, 7910 },
+	{ 0xffffffffffe15dea, 7933 },
+	{ 0xffffffffffe15e09, 7946 },
+	{ 0xffffffffffe15e35, 7964 },
+	{ 0xffffffffffe15e8e, 7980 },
+	{ 0xffffffffffe15f0c, 7996 },
+	{ 0xffffffffffe15fa3, 8012 },
+	{ 0xffffffffffe16117, 8027 },
+	{ 0xffffffffffe161be, 8042 },
+	{ 0xffffffffffe16222, 8061 },
+	{ 0xffffffffffe162e2, 8082 },
+	{ 0xffffffffffe1643c, 8104 },
+	{ 0xffffffffffe1650f, 8128 },
+	{ 0xffffffffffe16641, 8146 },
+	{ 0xffffffffffe1671d, 8165 },
+	{ 0xffffffffffe16767, 8179 },
+	{ 0xffffffffffe167a1, 8191 },
+	{ 0xffffffffffe167c3, 8206 },
+	{ 0xffffffffffe167fb, 8216 },
+	{ 0xffffffffffe1681e, 8228 },
+	{ 0xffffffffffe16850, 8251 },
+	{ 0xffffffffffe1687b, 8274 },
+	{ 0xffffffffffe168a4, 8286 },
+	{ 0xffffffffffe168c3, 8299 },
+	{ 0xffffffffffe16900, 8307 },
+	{ 0xffffffffffe16918, 8314 },
+	{ 0xffffffffffe1693c, 8325 },
+	{ 0xffffffffffe16947, 8344 },
+	{ 0xffffffffffe16b4e, 8368 },
+	{ 0xffffffffffe16d4c, 8380 },
+	{ 0xffffffffffe16e29, 8394 },
+	{ 0xffffffffffe16eec, 8412 },
+	{ 0xffffffffffe16f1f, 8427 },
+	{ 0xffffffffffe1703d, 8439 },
+	{ 0xffffffffffe17143, 8450 },
+	{ 0xffffffffffe1720b, 8469 },
+	{ 0xffffffffffe17276, 8482 },
+	{ 0xffffffffffe172fe, 8495 },
+	{ 0xffffffffffe1742a, 8510 },
+	{ 0xffffffffffe17512, 8527 },
+	{ 0xffffffffffe17562, 8537 },
+	{ 0xffffffffffe17606, 8557 },
+	{ 0xffffffffffe179c4, 8576 },
+	{ 0xffffffffffe17a21, 8594 },
+	{ 0xffffffffffe17c35, 8608 },
+	{ 0xffffffffffe17cfc, 8624 },
+	{ 0xffffffffffe17d17, 8639 },
+	{ 0xffffffffffe17d61, 8653 },
+	{ 0xffffffffffe17d9b, 8665 },
+	{ 0xffffffffffe17dd3, 8675 },
+	{ 0xffffffffffe17df6, 8687 },
+	{ 0xffffffffffe17e28, 8710 },
+	{ 0xffffffffffe17e53, 8733 },
+	{ 0xffffffffffe17e6c, 8749 },
+	{ 0xffffffffffe17f3b, 8761 },
+	{ 0xffffffffffe1806f, 8777 },
+	{ 0xffffffffffe180b7, 8796 },
+	{ 0xffffffffffe1823d, 8812 },
+	{ 0xffffffffffe183f1, 8829 },
+	{ 0xffffffffffe18444, 8839 },
+	{ 0xffffffffffe18497, 8850 },
+	{ 0xffffffffffe184ea, 8861 },
+	{ 0xffffffffffe18550, 8872 },
+	{ 0xffffffffffe185b7, 8884 },
+	{ 0xffffffffffe18618, 8896 },
+	{ 0xffffffffffe18657, 8907 },
+	{ 0xffffffffffe1873a, 8932 },
+	{ 0xffffffffffe18762, 8952 },
+	{ 0xffffffffffe189a8, 8960 },
+	{ 0xffffffffffe18a1f, 8976 },
+	{ 0xffffffffffe18bf1, 8993 },
+	{ 0xffffffffffe18d90, 9006 },
+	{ 0xffffffffffe18e4f, 9023 },
+	{ 0xffffffffffe19062, 9040 },
+	{ 0xffffffffffe19241, 9049 },
+	{ 0xffffffffffe1935e, 9066 },
+	{ 0xffffffffffe19494, 9076 },
+	{ 0xffffffffffe19529, 9086 },
+	{ 0xffffffffffe1969e, 9104 },
+	{ 0xffffffffffe1982a, 9116 },
+	{ 0xffffffffffe19842, 9126 },
+	{ 0xffffffffffe1988c, 9140 },
+	{ 0xffffffffffe198c6, 9152 },
+	{ 0xffffffffffe198fe, 9162 },
+	{ 0xffffffffffe19921, 9174 },
+	{ 0xffffffffffe19953, 9197 },
+	{ 0xffffffffffe1997e, 9220 },
+	{ 0xffffffffffe1999d, 9233 },
+	{ 0xffffffffffe199b5, 9244 },
+	{ 0xffffffffffe199e4, 9254 },
+	{ 0xffffffffffe19a21, 9263 },
+	{ 0xffffffffffe19b42, 9272 },
+	{ 0xffffffffffe19e94, 9281 },
+	{ 0xffffffffffe19ffa, 9296 },
+	{ 0xffffffffffe1a11c, 9305 },
+	{ 0xffffffffffe1a1fa, 9321 },
+	{ 0xffffffffffe1a29a, 9337 },
+	{ 0xffffffffffe1a35a, 9352 },
+	{ 0xffffffffffe1a410, 9366 },
+	{ 0xffffffffffe1a46c, 9383 },
+	{ 0xffffffffffe1a54e, 9398 },
+	{ 0xffffffffffe1a597, 9418 },
+	{ 0xffffffffffe1a608, 9435 },
+	{ 0xffffffffffe1a784, 9451 },
+	{ 0xffffffffffe1a854, 9464 },
+	{ 0xffffffffffe1a9fd, 9485 },
+	{ 0xffffffffffe1aa2e, 9501 },
+	{ 0xffffffffffe1aae5, 9516 },
+	{ 0xffffffffffe1abdf, 9530 },
+	{ 0xffffffffffe1abfe, 9543 },
+	{ 0xffffffffffe1ac3d, 9556 },
+	{ 0xffffffffffe1ac59, 9571 },
+	{ 0xffffffffffe1ac91, 9581 },
+	{ 0xffffffffffe1acb4, 9593 },
+	{ 0xffffffffffe1ae7a, 9607 },
+	{ 0xffffffffffe1aebc, 9622 },
+	{ 0xffffffffffe1af3f, 9634 },
+	{ 0xffffffffffe1afb3, 9646 },
+	{ 0xffffffffffe1b0bf, 9662 },
+	{ 0xffffffffffe1b11e, 9675 },
+	{ 0xffffffffffe1b1f1, 9692 },
+	{ 0xffffffffffe1b27a, 9709 },
+	{ 0xffffffffffe1b2c4, 9723 },
+	{ 0xffffffffffe1b2fe, 9735 },
+	{ 0xffffffffffe1b31d, 9748 },
+	{ 0xffffffffffe1b35a, 9765 },
+	{ 0xffffffffffe1b459, 9783 },
+	{ 0xffffffffffe1b54d, 9797 },
+	{ 0xffffffffffe1b5cc, 9810 },
+	{ 0xffffffffffe1b5f5, 9829 },
+	{ 0xffffffffffe1b620, 9843 },
+	{ 0xffffffffffe1b6b6, 9861 },
+	{ 0xffffffffffe1b96f, 9874 },
+	{ 0xffffffffffe1b987, 9881 },
+	{ 0xffffffffffe1b9d1, 9895 },
+	{ 0xffffffffffe1ba0b, 9907 },
+	{ 0xffffffffffe1bae5, 9928 },
+	{ 0xffffffffffe1bb62, 9943 },
+	{ 0xffffffffffe1bcb6, 9963 },
+	{ 0xffffffffffe1bd19, 9978 },
+	{ 0xffffffffffe1bd63, 9992 },
+	{ 0xffffffffffe1bddb, 10006 },
+	{ 0xffffffffffe1be49, 10019 },
+	{ 0xffffffffffe1be82, 10035 },
+	{ 0xffffffffffe1bf0d, 10044 },
+	{ 0xffffffffffe1bfa4, 10056 },
+	{ 0xffffffffffe1bfc5, 10072 },
+	{ 0xffffffffffe1bfed, 10084 },
+	{ 0xffffffffffe1c00e, 10102 },
+	{ 0xffffffffffe1c042, 10115 },
+	{ 0xffffffffffe1c081, 10135 },
+	{ 0xffffffffffe1c0ab, 10152 },
+	{ 0xffffffffffe1c152, 10164 },
+	{ 0xffffffffffe1c1a1, 10178 },
+	{ 0xffffffffffe1c1c3, 10188 },
+	{ 0xffffffffffe1c20e, 10197 },
+	{ 0xffffffffffe1c22b, 10210 },
+	{ 0xffffffffffe1c275, 10224 },
+	{ 0xffffffffffe1c2af, 10236 },
+	{ 0xffffffffffe1c2e7, 10246 },
+	{ 0xffffffffffe1c30a, 10258 },
+	{ 0xffffffffffe1c329, 10271 },
+	{ 0xffffffffffe1c341, 10278 },
+	{ 0xffffffffffe1c3a6, 10299 },
+	{ 0xffffffffffe1c465, 10320 },
+	{ 0xffffffffffe1c485, 10336 },
+	{ 0xffffffffffe1c4f2, 10353 },
+	{ 0xffffffffffe1c58d, 10370 },
+	{ 0xffffffffffe1c6ea, 10385 },
+	{ 0xffffffffffe1c70a, 10403 },
+	{ 0xffffffffffe1c72a, 10422 },
+	{ 0xffffffffffe1c767, 10430 },
+	{ 0xffffffffffe1c7b8, 10442 },
+	{ 0xffffffffffe1c834, 10452 },
+	{ 0xffffffffffe1c89f, 10461 },
+	{ 0xffffffffffe1c8c0, 10473 },
+	{ 0xffffffffffe1c90b, 10485 },
+	{ 0xffffffffffe1c9c0, 10501 },
+	{ 0xffffffffffe1cacf, 10511 },
+	{ 0xffffffffffe1cb14, 10523 },
+	{ 0xffffffffffe1cbaf, 10539 },
+	{ 0xffffffffffe1cc9c, 10549 },
+	{ 0xffffffffffe1cd15, 10556 },
+	{ 0xffffffffffe1cd87, 10563 },
+	{ 0xffffffffffe1ce87, 10571 },
+	{ 0xffffffffffe1cf19, 10578 },
+	{ 0xffffffffffe1cf3e, 10589 },
+	{ 0xffffffffffe1cf69, 10599 },
+	{ 0xffffffffffe1cf9c, 10606 },
+	{ 0xffffffffffe1cfef, 10613 },
+	{ 0xffffffffffe1d07d, 10621 },
+	{ 0xffffffffffe1d12f, 10633 },
+	{ 0xffffffffffe1d1a6, 10647 },
+	{ 0xffffffffffe1d1b3, 10666 },
+	{ 0xffffffffffe1d2ab, 10682 },
+	{ 0xffffffffffe1d393, 10695 },
+	{ 0xffffffffffe1d406, 10712 },
+	{ 0xffffffffffe1d45f, 10731 },
+	{ 0xffffffffffe1d498, 10747 },
+	{ 0xffffffffffe1d4e2, 10761 },
+	{ 0xffffffffffe1d51c, 10773 },
+	{ 0xffffffffffe1d534, 10780 },
+	{ 0xffffffffffe1d5a8, 10804 },
+	{ 0xffffffffffe1d5c8, 10813 },
+	{ 0xffffffffffe1d647, 10828 },
+	{ 0xffffffffffe1d698, 10843 },
+	{ 0xffffffffffe1d7d9, 10857 },
+	{ 0xffffffffffe1d896, 10876 },
+	{ 0xffffffffffe1da4a, 10892 },
+	{ 0xffffffffffe1da94, 10906 },
+	{ 0xffffffffffe1dace, 10918 },
+	{ 0xffffffffffe1daed, 10931 },
+	{ 0xffffffffffe1db05, 10938 },
+	{ 0xffffffffffe1dbf1, 10951 },
+	{ 0xffffffffffe1dca6, 10963 },
+	{ 0xffffffffffe1dcbc, 10974 },
+	{ 0xffffffffffe1dce3, 10986 },
+	{ 0xffffffffffe1de10, 10997 },
+	{ 0xffffffffffe1de5a, 11011 },
+	{ 0xffffffffffe1de94, 11023 },
+	{ 0xffffffffffe1decc, 11033 },
+	{ 0xffffffffffe1deef, 11045 },
+	{ 0xffffffffffe1df21, 11068 },
+	{ 0xffffffffffe1df4c, 11091 },
+	{ 0xffffffffffe1df83, 11100 },
+	{ 0xffffffffffe1df9d, 11110 },
+	{ 0xffffffffffe1dfb7, 11120 },
+	{ 0xffffffffffe1dfd1, 11137 },
+	{ 0xffffffffffe1dfeb, 11154 },
+	{ 0xffffffffffe1dffa, 11171 },
+	{ 0xffffffffffe1e009, 11188 },
+	{ 0xffffffffffe1e109, 11204 },
+	{ 0xffffffffffe1e23a, 11215 },
+	{ 0xffffffffffe1e31f, 11230 },
+	{ 0xffffffffffe1e3b5, 11247 },
+	{ 0xffffffffffe1e41e, 11259 },
+	{ 0xffffffffffe1e55d, 11283 },
+	{ 0xffffffffffe1e595, 11293 },
+	{ 0xffffffffffe1e5b8, 11305 },
+	{ 0xffffffffffe1e6dd, 11313 },
+	{ 0xffffffffffe1e79c, 11322 },
+	{ 0xffffffffffe1e7fe, 11330 },
+	{ 0xffffffffffe1e880, 11341 },
+	{ 0xffffffffffe1e9bc, 11351 },
+	{ 0xffffffffffe1ea51, 11360 },
+	{ 0xffffffffffe1ebaa, 11372 },
+	{ 0xffffffffffe1ed0a, 11381 },
+	{ 0xffffffffffe1ed6b, 11391 },
+	{ 0xffffffffffe1eef6, 11407 },
+	{ 0xffffffffffe1f080, 11418 },
+	{ 0xffffffffffe1f160, 11429 },
+	{ 0xffffffffffe1f198, 11439 },
+	{ 0xffffffffffe1f1bb, 11451 },
+	{ 0xffffffffffe1f202, 11464 },
+	{ 0xffffffffffe1f21c, 11476 },
+	{ 0xffffffffffe1f2b1, 11487 },
+	{ 0xffffffffffe1f2cb, 11500 },
+	{ 0xffffffffffe1f2ea, 11513 },
+	{ 0xffffffffffe1f300, 11522 },
+	{ 0xffffffffffe1f344, 11537 },
+	{ 0xffffffffffe1f39d, 11546 },
+	{ 0xffffffffffe1f521, 11554 },
+	{ 0xffffffffffe1f64b, 11570 },
+	{ 0xffffffffffe1f889, 11580 },
+	{ 0xffffffffffe1fb0a, 11590 },
+	{ 0xffffffffffe1fb40, 11602 },
+	{ 0xffffffffffe1fcf4, 11620 },
+	{ 0xffffffffffe1fe64, 11634 },
+};
+
+const char symbol_names[] =
+	"_start\0"
+	"phys_to_virt\0"
+	"acpi_checksum\0"
+	"acpi_signature_of\0"
+	"acpi_index\0"
+	"acpi_init\0"
+	"acpi_find_table\0"
+	"cpu_has\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"cpu_id\0"
+	"apic_spurious\0"
+	"apic_read\0"
+	"apic_write\0"
+	"apic_eoi\0"
+	"apic_send_ipi\0"
+	"apic_enable\0"
+	"apic_timer_calibrate\0"
+	"apic_timer_periodic\0"
+	"apic_timer_oneshot\0"
+	"apic_timer_stop\0"
+	"apic_init\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"cpu_id\0"
+	"block_register\0"
+	"block_find\0"
+	"block_add_buffer\0"
+	"block_end\0"
+	"block_commit\0"
+	"block_run_software\0"
+	"block_restart\0"
+	"block_dispatch\0"
+	"block_merged_complete\0"
+	"block_can_merge\0"
+	"block_merge\0"
+	"block_sorts_before\0"
+	"block_flush_plug\0"
+	"block_submit\0"
+	"block_start_plug\0"
+	"block_finish_plug\0"
+	"block_wait\0"
+	"block_complete\0"
+	"block_softirq\0"
+	"block_transfer\0"
+	"block_read\0"
+	"block_write\0"
+	"block_show_devices\0"
+	"block_init\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"phys_to_virt\0"
+	"cpu_id\0"
+	"buffer_cache_page_sectors\0"
+	"buffer_cache_age_ticks\0"
+	"buffer_cache_over\0"
+	"buffer_cache_redirty\0"
+	"buffer_cache_read_page\0"
+	"buffer_cache_of\0"
+	"buffer_cache_trim\0"
+	"buffer_cache_fill\0"
+	"buffer_cache_write_batch\0"
+	"buffer_cache_flush\0"
+	"buffer_cache_wake\0"
+	"buffer_cache_arm\0"
+	"buffer_cache_tick\0"
+	"buffer_cache_timer\0"
+	"buffer_cache_flusher\0"
+	"buffer_cache_dirtied\0"
+	"buffer_cache_read\0"
+	"buffer_cache_write\0"
+	"buffer_cache_sync\0"
+	"buffer_cache_show\0"
+	"buffer_cache_init\0"
+	"cpu_id\0"
+	"cpu_features_init\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"devfs_hash\0"
+	"devfs_find\0"
+	"devfs_lookup\0"
+	"devfs_init\0"
+	"devfs_check\0"
+	"devfs_taken\0"
+	"devfs_register_nodes\0"
+	"devfs_register\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"ext2_sector\0"
+	"ext2_now\0"
+	"ext2_read16\0"
+	"ext2_offset\0"
+	"ext2_flush\0"
+	"ext2_writeback\0"
+	"ext2_buffer_unhash\0"
+	"ext2_buffer_get\0"
+	"ext2_buffer_put\0"
+	"ext2_buffer_dirty\0"
+	"ext2_buffer_forget\0"
+	"ext2_group_dirty\0"
+	"ext2_bitmap_take\0"
+	"ext2_bitmap_clear\0"
+	"ext2_alloc_block\0"
+	"ext2_free_block\0"
+	"ext2_alloc_inode\0"
+	"ext2_free_inode\0"
+	"ext2_inode_block\0"
+	"ext2_node_store\0"
+	"ext2_type\0"
+	"ext2_size\0"
+	"ext2_set_size\0"
+	"ext2_node_get\0"
+	"ext2_free_tree\0"
+	"ext2_node_delete\0"
+	"ext2_node_put\0"
+	"ext2_bmap\0"
+	"ext2_transfer\0"
+	"ext2_dirent_valid\0"
+	"ext2_find_entry\0"
+	"ext2_add_entry\0"
+	"ext2_empty\0"
+	"ext2_lookup\0"
+	"ext2_release\0"
+	"ext2_read\0"
+	"ext2_write\0"
+	"ext2_sync\0"
+	"ext2_sync_inode\0"
+	"ext2_make_inode\0"
+	"ext2_make_dentry\0"
+	"ext2_remove_dentry\0"
+	"ext2_find_name\0"
+	"ext2_volume_free\0"
+	"ext2_read_super\0"
+	"ext2_find\0"
+	"ext2_mount\0"
+	"ext2_mount_root\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"fat_read16\0"
+	"fat_read32\0"
+	"fat_valid\0"
+	"fat_chunk\0"
+	"fat_next\0"
+	"fat_build_runs\0"
+	"fat_find_run\0"
+	"fat_read_clusters\0"
+	"fat_node_free\0"
+	"fat_node_create\0"
+	"fat_node_get\0"
+	"fat_lower\0"
+	"fat_name_equal\0"
+	"fat_short_name\0"
+	"fat_checksum\0"
+	"fat_find_entry\0"
+	"fat_open_entry\0"
+	"fat_lookup\0"
+	"fat_read\0"
+	"fat_find\0"
+	"fat_mount\0"
+	"fat_mount_boot\0"
+	"cpu_has\0"
+	"cpu_id\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"fpu_save\0"
+	"fpu_restore\0"
+	"fpu_set_ts\0"
+	"fpu_setup_features\0"
+	"fpu_setup_size\0"
+	"fpu_init\0"
+	"fpu_context_init\0"
+	"fpu_switch\0"
+	"fpu_context_release\0"
+	"fpu_trap\0"
+	"kernel_fpu_begin\0"
+	"kernel_fpu_end\0"
+	"gdt_set_segment\0"
+	"gdt_set_tss\0"
+	"gdt_init\0"
+	"flush_end\0"
+	"cpu_has\0"
+	"cpu_id\0"
+	"idle_wakeup_interrupt\0"
+	"idle_init\0"
+	"idle_queue_work\0"
+	"idle_run_work\0"
+	"idle_sleep\0"
+	"idle_run\0"
+	"idle_cycles\0"
+	"idle_sleeps\0"
+	"idle_print_stats\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"stub_32\0"
+	"stub_33\0"
+	"stub_34\0"
+	"stub_35\0"
+	"stub_36\0"
+	"stub_37\0"
+	"stub_38\0"
+	"stub_39\0"
+	"stub_40\0"
+	"stub_41\0"
+	"stub_42\0"
+	"stub_43\0"
+	"stub_44\0"
+	"stub_45\0"
+	"stub_46\0"
+	"stub_47\0"
+	"stub_48\0"
+	"stub_49\0"
+	"stub_50\0"
+	"stub_51\0"
+	"stub_52\0"
+	"stub_53\0"
+	"stub_54\0"
+	"stub_55\0"
+	"vector_stub_56\0"
+	"vector_stub_57\0"
+	"vector_stub_58\0"
+	"vector_stub_59\0"
+	"vector_stub_60\0"
+	"vector_stub_61\0"
+	"vector_stub_62\0"
+	"vector_stub_63\0"
+	"vector_stub_64\0"
+	"vector_stub_65\0"
+	"vector_stub_66\0"
+	"vector_stub_67\0"
+	"vector_stub_68\0"
+	"vector_stub_69\0"
+	"vector_stub_70\0"
+	"vector_stub_71\0"
+	"vector_stub_72\0"
+	"vector_stub_73\0"
+	"vector_stub_74\0"
+	"vector_stub_75\0"
+	"vector_stub_76\0"
+	"vector_stub_77\0"
+	"vector_stub_78\0"
+	"vector_stub_79\0"
+	"vector_stub_80\0"
+	"vector_stub_81\0"
+	"vector_stub_82\0"
+	"vector_stub_83\0"
+	"vector_stub_84\0"
+	"vector_stub_85\0"
+	"vector_stub_86\0"
+	"vector_stub_87\0"
+	"vector_stub_88\0"
+	"vector_stub_89\0"
+	"vector_stub_90\0"
+	"vector_stub_91\0"
+	"vector_stub_92\0"
+	"vector_stub_93\0"
+	"vector_stub_94\0"
+	"vector_stub_95\0"
+	"vector_stub_96\0"
+	"vector_stub_97\0"
+	"vector_stub_98\0"
+	"vector_stub_99\0"
+	"vector_stub_100\0"
+	"vector_stub_101\0"
+	"vector_stub_102\0"
+	"vector_stub_103\0"
+	"vector_stub_104\0"
+	"vector_stub_105\0"
+	"vector_stub_106\0"
+	"vector_stub_107\0"
+	"vector_stub_108\0"
+	"vector_stub_109\0"
+	"vector_stub_110\0"
+	"vector_stub_111\0"
+	"vector_stub_112\0"
+	"vector_stub_113\0"
+	"vector_stub_114\0"
+	"vector_stub_115\0"
+	"vector_stub_116\0"
+	"vector_stub_117\0"
+	"vector_stub_118\0"
+	"vector_stub_119\0"
+	"vector_stub_120\0"
+	"vector_stub_121\0"
+	"vector_stub_122\0"
+	"vector_stub_123\0"
+	"vector_stub_124\0"
+	"vector_stub_125\0"
+	"vector_stub_126\0"
+	"vector_stub_127\0"
+	"vector_stub_129\0"
+	"vector_stub_130\0"
+	"vector_stub_131\0"
+	"vector_stub_132\0"
+	"vector_stub_133\0"
+	"vector_stub_134\0"
+	"vector_stub_135\0"
+	"vector_stub_136\0"
+	"vector_stub_137\0"
+	"vector_stub_138\0"
+	"vector_stub_139\0"
+	"vector_stub_140\0"
+	"vector_stub_141\0"
+	"vector_stub_142\0"
+	"vector_stub_143\0"
+	"vector_stub_144\0"
+	"vector_stub_145\0"
+	"vector_stub_146\0"
+	"vector_stub_147\0"
+	"vector_stub_148\0"
+	"vector_stub_149\0"
+	"vector_stub_150\0"
+	"vector_stub_151\0"
+	"vector_stub_152\0"
+	"vector_stub_153\0"
+	"vector_stub_154\0"
+	"vector_stub_155\0"
+	"vector_stub_156\0"
+	"vector_stub_157\0"
+	"vector_stub_158\0"
+	"vector_stub_159\0"
+	"vector_stub_160\0"
+	"vector_stub_161\0"
+	"vector_stub_162\0"
+	"vector_stub_163\0"
+	"vector_stub_164\0"
+	"vector_stub_165\0"
+	"vector_stub_166\0"
+	"vector_stub_167\0"
+	"vector_stub_168\0"
+	"vector_stub_169\0"
+	"vector_stub_170\0"
+	"vector_stub_171\0"
+	"vector_stub_172\0"
+	"vector_stub_173\0"
+	"vector_stub_174\0"
+	"vector_stub_175\0"
+	"vector_stub_176\0"
+	"vector_stub_177\0"
+	"vector_stub_178\0"
+	"vector_stub_179\0"
+	"vector_stub_180\0"
+	"vector_stub_181\0"
+	"vector_stub_182\0"
+	"vector_stub_183\0"
+	"vector_stub_184\0"
+	"vector_stub_185\0"
+	"vector_stub_186\0"
+	"vector_stub_187\0"
+	"vector_stub_188\0"
+	"vector_stub_189\0"
+	"vector_stub_190\0"
+	"vector_stub_191\0"
+	"vector_stub_192\0"
+	"vector_stub_193\0"
+	"vector_stub_194\0"
+	"vector_stub_195\0"
+	"vector_stub_196\0"
+	"vector_stub_197\0"
+	"vector_stub_198\0"
+	"vector_stub_199\0"
+	"vector_stub_200\0"
+	"vector_stub_201\0"
+	"vector_stub_202\0"
+	"vector_stub_203\0"
+	"vector_stub_204\0"
+	"vector_stub_205\0"
+	"vector_stub_206\0"
+	"vector_stub_207\0"
+	"vector_stub_208\0"
+	"vector_stub_209\0"
+	"vector_stub_210\0"
+	"vector_stub_211\0"
+	"vector_stub_212\0"
+	"vector_stub_213\0"
+	"vector_stub_214\0"
+	"vector_stub_215\0"
+	"vector_stub_216\0"
+	"vector_stub_217\0"
+	"vector_stub_218\0"
+	"vector_stub_219\0"
+	"vector_stub_220\0"
+	"vector_stub_221\0"
+	"vector_stub_222\0"
+	"vector_stub_223\0"
+	"vector_stub_224\0"
+	"vector_stub_225\0"
+	"vector_stub_226\0"
+	"vector_stub_227\0"
+	"vector_stub_228\0"
+	"vector_stub_229\0"
+	"vector_stub_230\0"
+	"vector_stub_231\0"
+	"vector_stub_232\0"
+	"vector_stub_233\0"
+	"vector_stub_234\0"
+	"vector_stub_235\0"
+	"vector_stub_236\0"
+	"vector_stub_237\0"
+	"vector_stub_238\0"
+	"vector_stub_239\0"
+	"interrupt_init\0"
+	"interrupt_set_gate\0"
+	"interrupt_register\0"
+	"interrupt_unregister\0"
+	"interrupt_handler\0"
+	"interrupt_vector_dispatch\0"
+	"interrupt_alloc_vector\0"
+	"interrupt_free_vector\0"
+	"interrupt_show_affinity\0"
+	"interrupt_mask\0"
+	"interrupt_unmask\0"
+	"interrupt_load_table\0"
+	"interrupt_set_mode\0"
+	"interrupt_first_cpu\0"
+	"interrupt_set_affinity\0"
+	"interrupt_get_affinity\0"
+	"interrupt_get_target\0"
+	"interrupt_set_target\0"
+	"interrupt_end_pic\0"
+	"cpu_id\0"
+	"interrupt_histogram_bucket\0"
+	"interrupt_account\0"
+	"irq_off_begin\0"
+	"irq_off_end\0"
+	"interrupt_stats_cpu\0"
+	"interrupt_vector_name\0"
+	"interrupt_stats_cpus\0"
+	"interrupt_stats_show_counts\0"
+	"interrupt_stats_show_buckets\0"
+	"interrupt_stats_show_latency\0"
+	"interrupt_stats_init\0"
+	"irq_off_tracking_start\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"ioapic_read\0"
+	"ioapic_write\0"
+	"ioapic_of\0"
+	"ioapic_init\0"
+	"ioapic_irq_to_gsi\0"
+	"ioapic_gsi_to_irq\0"
+	"ioapic_route\0"
+	"ioapic_set_masked\0"
+	"ioapic_set_destination\0"
+	"cpu_id\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"irq_balance_run\0"
+	"irq_balance_tick\0"
+	"irq_balance\0"
+	"cpu_id\0"
+	"kernel\0"
+	"double_fault\0"
+	"gp_fault\0"
+	"page_fault\0"
+	"div_0_fault\0"
+	"invalid_opcode_fault\0"
+	"print_val\0"
+	"print_hex\0"
+	"print_dec\0"
+	"octal_string_to_int\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"phys_to_virt\0"
+	"virt_to_phys\0"
+	"kmalloc_grow\0"
+	"kmalloc_large\0"
+	"kmalloc\0"
+	"kzalloc\0"
+	"kfree\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"phys_to_virt\0"
+	"module_hash\0"
+	"module_symbol_find\0"
+	"module_export\0"
+	"module_symbol_lookup\0"
+	"module_sections\0"
+	"module_section_name\0"
+	"module_check\0"
+	"module_find_section\0"
+	"module_add\0"
+	"module_init\0"
+	"module_unmap\0"
+	"module_alloc\0"
+	"module_resolve\0"
+	"module_fits_signed\0"
+	"module_relocate\0"
+	"module_link\0"
+	"module_finish\0"
+	"module_load\0"
+	"module_load_boot\0"
+	"module_find\0"
+	"module_call_function\0"
+	"module_send_value\0"
+	"msi_address\0"
+	"msi_disable_intx\0"
+	"msi_enable\0"
+	"msi_disable\0"
+	"msix_enable\0"
+	"msix_set_masked\0"
+	"msix_route\0"
+	"msix_route_queues\0"
+	"numa_node_of_domain\0"
+	"numa_add_apic\0"
+	"numa_add_range\0"
+	"numa_parse_srat\0"
+	"numa_parse_slit\0"
+	"numa_init\0"
+	"numa_cpu_init\0"
+	"numa_node_of_frame\0"
+	"numa_distance\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"phys_to_virt\0"
+	"page_cache_bucket\0"
+	"page_cache_find\0"
+	"page_cache_init\0"
+	"page_cache_peek\0"
+	"page_cache_add\0"
+	"page_cache_get\0"
+	"page_cache_get_new\0"
+	"page_cache_set_dirty\0"
+	"page_cache_take_dirty\0"
+	"page_cache_oldest_dirty\0"
+	"page_cache_shrink\0"
+	"page_cache_release\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock_init\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"rwlock_init\0"
+	"phys_to_virt\0"
+	"cpu_has\0"
+	"cpu_id\0"
+	"table_virt\0"
+	"paging_alloc_table\0"
+	"paging_build_direct_map\0"
+	"paging_init\0"
+	"paging_create\0"
+	"paging_free_table\0"
+	"paging_destroy\0"
+	"paging_walk\0"
+	"paging_map\0"
+	"paging_unmap_batch\0"
+	"paging_unmap\0"
+	"paging_entry\0"
+	"paging_replace\0"
+	"paging_translate\0"
+	"pcid_find\0"
+	"paging_flush_global\0"
+	"paging_flush_local\0"
+	"paging_invalidate\0"
+	"paging_switch\0"
+	"paging_map_mmio\0"
+	"paging_current\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"pci_driver_hash\0"
+	"pci_ecam_of\0"
+	"pci_ecam_config\0"
+	"pci_legacy_address\0"
+	"pci_config_read\0"
+	"pci_config_write\0"
+	"pci_read8\0"
+	"pci_read16\0"
+	"pci_read32\0"
+	"pci_write8\0"
+	"pci_write16\0"
+	"pci_write32\0"
+	"pci_enable\0"
+	"pci_find_next_capability\0"
+	"pci_find_capability\0"
+	"pci_bar\0"
+	"pci_find_device\0"
+	"pci_add_function\0"
+	"pci_scan_bus\0"
+	"pci_scan_segment\0"
+	"pci_show_devices\0"
+	"pci_init\0"
+	"pci_hash_drivers\0"
+	"pci_match\0"
+	"pci_probe\0"
+	"pci_probe_drivers\0"
+	"percpu_init\0"
+	"numa_node\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"phys_to_virt\0"
+	"pmm_bitmap\0"
+	"pmm_count\0"
+	"pmm_test\0"
+	"pmm_mark\0"
+	"pmm_init\0"
+	"pmm_take_range\0"
+	"pmm_take\0"
+	"pmm_lower_hints\0"
+	"pmm_alloc_batch\0"
+	"pmm_free_batch\0"
+	"pmm_zero_take\0"
+	"pmm_zero_reclaim\0"
+	"pmm_alloc_page\0"
+	"pmm_alloc_page_node\0"
+	"pmm_alloc_zeroed\0"
+	"pmm_zero_refill\0"
+	"pmm_take_run\0"
+	"pmm_alloc_pages_node\0"
+	"pmm_alloc_pages\0"
+	"pmm_free_pages\0"
+	"pmm_free_page\0"
+	"pmm_page_get\0"
+	"pmm_page_put\0"
+	"pmm_page_count\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"procfs_lookup\0"
+	"procfs_release\0"
+	"procfs_read\0"
+	"procfs_init\0"
+	"procfs_register\0"
+	"procfs_print\0"
+	"procfs_print_dec\0"
+	"procfs_print_hex\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"phys_to_virt\0"
+	"profile_stop_cpu\0"
+	"profile_interrupt\0"
+	"profile_start\0"
+	"profile_stop\0"
+	"profile_owns_timer\0"
+	"profile_print\0"
+	"profile_print_dec\0"
+	"profile_dump\0"
+	"cpu_id\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"rcu_update_completed\0"
+	"rcu_cpu_online\0"
+	"rcu_quiescent_state\0"
+	"rcu_idle_enter\0"
+	"rcu_idle_exit\0"
+	"rcu_irq_enter\0"
+	"rcu_irq_exit\0"
+	"synchronize_rcu\0"
+	"call_rcu\0"
+	"serial_init\0"
+	"serial_received\0"
+	"serial_read\0"
+	"is_transmit_empty\0"
+	"serial_write\0"
+	"serial_write_string\0"
+	"softirq_register\0"
+	"softirq_run\0"
+	"softirq_raise\0"
+	"irq_enter\0"
+	"irq_exit\0"
+	"in_interrupt\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"phys_to_virt\0"
+	"cpu_id\0"
+	"static_key_serialize\0"
+	"static_key_interrupt\0"
+	"static_key_init\0"
+	"static_key_write\0"
+	"static_key_patch\0"
+	"static_key_set\0"
+	"static_key_enable\0"
+	"static_key_disable\0"
+	"cpu_has\0"
+	"string_init\0"
+	"copy_tail\0"
+	"set_tail\0"
+	"set_pattern\0"
+	"memcpy_erms\0"
+	"memcpy_unrolled\0"
+	"memcpy_nt\0"
+	"memset_erms\0"
+	"memset_unrolled\0"
+	"memset_nt\0"
+	"memcpy\0"
+	"memset\0"
+	"memmove\0"
+	"memcmp\0"
+	"clear_page\0"
+	"copy_page\0"
+	"strlen\0"
+	"strcmp\0"
+	"strncmp\0"
+	"symbol_find\0"
+	"symbol_lookup\0"
+	"syscall_and_return\0"
+	"execute_syscall\0"
+	"syscall_init\0"
+	"syscall_register\0"
+	"syscall_unregister\0"
+	"syscall_wrapper\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"cpu_id\0"
+	"tlb_shootdown_interrupt\0"
+	"tlb_init\0"
+	"tlb_cpu_online\0"
+	"tlb_batch_init\0"
+	"tlb_batch_add\0"
+	"tlb_shootdown_poll\0"
+	"tlb_batch_flush\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"phys_to_virt\0"
+	"cpu_id\0"
+	"trace_record\0"
+	"trace_start\0"
+	"trace_stop\0"
+	"trace_write\0"
+	"trace_dump\0"
+	"irq_save_site\0"
+	"irq_restore\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"spin_lock_irqsave_site\0"
+	"spin_unlock_irqrestore\0"
+	"tty_init\0"
+	"tty_set_x\0"
+	"tty_set_y\0"
+	"tty_set_fg_color\0"
+	"tty_set_bg_color\0"
+	"tty_get_fg_color\0"
+	"tty_get_bg_color\0"
+	"tty_put_char_at\0"
+	"tty_scroll\0"
+	"tty_print_char\0"
+	"tty_print_string\0"
+	"puts_at_pos\0"
+	"puts_at_pos_transparent\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"read_fs\0"
+	"write_fs\0"
+	"sync_fs\0"
+	"mount_root\0"
+	"vfs_mount\0"
+	"vfs_sync\0"
+	"vfs_resolve\0"
+	"vfs_open\0"
+	"vfs_close\0"
+	"vfs_open_parent\0"
+	"vfs_create\0"
+	"vfs_remove\0"
+	"spin_lock\0"
+	"spin_unlock\0"
+	"read_trylock\0"
+	"read_unlock\0"
+	"write_lock\0"
+	"write_unlock\0"
+	"phys_to_virt\0"
+	"vmm_init\0"
+	"vmm_page_flags\0"
+	"vmm_find\0"
+	"vmm_map\0"
+	"vmm_unmap_pages\0"
+	"vmm_unmap\0"
+	"vmm_clone\0"
+	"vmm_destroy\0"
+	"vmm_fault_missing\0"
+	"vmm_fault_cow\0"
+	"vmm_handle_fault\0"
+	"";
@@ -0,0 +1,783 @@
+/*
+ * evan-os/drivers/ahci.c
+ *
+ * AHCI SATA driver. Every port has a list of 32 command slots, and disks
+ * supporting Native Command Queuing get all of them at once: each slot is
+ * a READ or WRITE FPDMA QUEUED command tagged with its slot number, which
+ * the disk may finish in any order. Each command's PRDT points straight
+ * at the physical segments of its block request.
+ *
+ * Completions are found by comparing the slots in use against the ones
+ * the port still has active, either from the controller's interrupt or
+ * from polling when interrupts are turned off. An error stops the port,
+ * and restarting it can take seconds, so the interrupt only marks it
+ * stopped and leaves the restart to idle work or to a polling waiter.
+ *
+ */
+
+#include <apic.h>
+#include <asm.h>
+#include <block.h>
+#include <idle.h>
+#include <interrupt.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <msi.h>
+#include <paging.h>
+#include <pci.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tty.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Generic host control registers, in bytes
+#define AHCI_CAP  0x00
+#define AHCI_GHC  0x04
+#define AHCI_IS   0x08
+#define AHCI_PI   0x0c
+#define AHCI_CAP2 0x24
+#define AHCI_BOHC 0x28
+
+#define AHCI_CAP_SNCQ  (1u << 30)
+#define AHCI_CAP_S64A  (1u << 31)
+#define AHCI_GHC_IE    (1u << 1)
+#define AHCI_GHC_AE    (1u << 31)
+#define AHCI_CAP2_BOH  (1u << 0)
+#define AHCI_BOHC_BOS  (1u << 0)
+#define AHCI_BOHC_OOS  (1u << 1)
+
+// Port registers, 0x80 bytes for each port from 0x100
+#define AHCI_PORTS     0x100
+#define AHCI_PORT_SIZE 0x80
+
+#define AHCI_PX_CLB  0x00
+#define AHCI_PX_CLBU 0x04
+#define AHCI_PX_FB   0x08
+#define AHCI_PX_FBU  0x0c
+#define AHCI_PX_IS   0x10
+#define AHCI_PX_IE   0x14
+#define AHCI_PX_CMD  0x18
+#define AHCI_PX_TFD  0x20
+#define AHCI_PX_SIG  0x24
+#define AHCI_PX_SSTS 0x28
+#define AHCI_PX_SCTL 0x2c
+#define AHCI_PX_SERR 0x30
+#define AHCI_PX_SACT 0x34
+#define AHCI_PX_CI   0x38
+
+#define AHCI_CMD_ST  (1u << 0)
+#define AHCI_CMD_FRE (1u << 4)
+#define AHCI_CMD_FR  (1u << 14)
+#define AHCI_CMD_CR  (1u << 15)
+
+#define AHCI_TFD_BSY (1u << 7)
+#define AHCI_TFD_DRQ (1u << 3)
+
+#define AHCI_SSTS_DET_PRESENT 0x3
+#define AHCI_SCTL_DET_MASK    0xf
+#define AHCI_SCTL_DET_RESET   0x1 // COMRESET, held for at least 1 ms
+#define AHCI_SIG_ATA          0x00000101
+
+// Port interrupts: completions, and the errors that stop the port
+#define AHCI_IS_DHRS (1u << 0)
+#define AHCI_IS_PSS  (1u << 1)
+#define AHCI_IS_DSS  (1u << 2)
+#define AHCI_IS_SDBS (1u << 3)
+#define AHCI_IS_IFS  (1u << 27)
+#define AHCI_IS_HBDS (1u << 28)
+#define AHCI_IS_HBFS (1u << 29)
+#define AHCI_IS_TFES (1u << 30)
+
+#define AHCI_IS_ERRORS (AHCI_IS_IFS | AHCI_IS_HBDS | AHCI_IS_HBFS | AHCI_IS_TFES)
+#define AHCI_IS_ENABLE (AHCI_IS_DHRS | AHCI_IS_PSS | AHCI_IS_DSS | AHCI_IS_SDBS | AHCI_IS_ERRORS)
+
+#define AHCI_SLOTS_MAX 32
+
+// Command header flags
+#define AHCI_HEADER_FIS_LENGTH 5 // Dwords in a host to device FIS
+#define AHCI_HEADER_WRITE      (1 << 6)
+
+// A command table with its PRDT fills one page
+#define AHCI_PRDT_MAX ((PAGE_SIZE - 128) / 16)
+#define AHCI_PRD_MAX  (4 * 1024 * 1024) // Bytes in one entry
+
+// ATA commands
+#define ATA_IDENTIFY          0xec
+#define ATA_READ_DMA_EXT      0x25
+#define ATA_WRITE_DMA_EXT     0x35
+#define ATA_READ_FPDMA_QUEUED  0x60
+#define ATA_WRITE_FPDMA_QUEUED 0x61
+
+#define ATA_DEVICE_LBA (1 << 6)
+
+#define FIS_TYPE_H2D    0x27
+#define FIS_H2D_COMMAND 0x80
+
+// Sectors in one command, the most a 16 bit count can hold
+#define AHCI_SECTORS_MAX 0xffff
+
+#define AHCI_TIMEOUT_MS 1000
+
+// Port states
+#define AHCI_PORT_RUNNING    0
+#define AHCI_PORT_STOPPED    1 // Stopped by an error, waiting for ahci_port_recover
+#define AHCI_PORT_RESTARTING 2
+#define AHCI_PORT_BROKEN     3 // Could not be restarted, so every request fails
+
+typedef struct ahci_command_header_t {
+	uint16_t          flags;
+	uint16_t          prdt_length;
+	volatile uint32_t transferred;
+	uint64_t          table;
+	uint32_t          reserved[4];
+} __attribute__((packed)) ahci_command_header_t;
+
+typedef struct ahci_prd_t {
+	uint64_t address;
+	uint32_t reserved;
+	uint32_t count; // Bytes minus 1
+} __attribute__((packed)) ahci_prd_t;
+
+typedef struct ahci_fis_h2d_t {
+	uint8_t  type;
+	uint8_t  flags;
+	uint8_t  command;
+	uint8_t  feature_low;
+	uint8_t  lba0;
+	uint8_t  lba1;
+	uint8_t  lba2;
+	uint8_t  device;
+	uint8_t  lba3;
+	uint8_t  lba4;
+	uint8_t  lba5;
+	uint8_t  feature_high;
+	uint8_t  count_low;
+	uint8_t  count_high;
+	uint8_t  icc;
+	uint8_t  control;
+	uint32_t reserved;
+} __attribute__((packed)) ahci_fis_h2d_t;
+
+typedef struct ahci_command_table_t {
+	uint8_t    fis[64];
+	uint8_t    atapi[16];
+	uint8_t    reserved[48];
+	ahci_prd_t prdt[AHCI_PRDT_MAX];
+} __attribute__((packed)) ahci_command_table_t;
+
+typedef struct ahci_controller_t ahci_controller_t;
+
+typedef struct ahci_port_t {
+	ahci_controller_t*     controller;
+	volatile uint32_t*     registers;
+	ahci_command_header_t* commands;
+	ahci_command_table_t*  tables[AHCI_SLOTS_MAX];
+	block_request_t*       requests[AHCI_SLOTS_MAX];
+	uint32_t               slots;  // Usable slots
+	uint32_t               issued; // Slots holding a request
+	uint32_t               batched; // Of those, slots waiting for the rest of their batch
+	bool                   ncq;
+	volatile uint8_t       state;
+	idle_work_t            recovery;
+	volatile bool          recovery_queued;
+	spinlock_t             lock;
+	block_device_t         device;
+} ahci_port_t;
+
+struct ahci_controller_t {
+	pci_device_t*      pci;
+	volatile uint32_t* registers;
+	uint32_t           slots;
+	bool               addresses_64;
+	ahci_port_t*       ports[32];
+	ahci_controller_t* next;
+};
+
+// Controllers sharing the legacy interrupt line, if they have no MSI
+ahci_controller_t* ahci_controllers;
+spinlock_t ahci_controllers_lock;
+
+volatile uint32_t ahci_disks;
+
+uint8_t ahci_probe(pci_device_t* device);
+
+__attribute__((section(".driverinfo"), used))
+driver_info_t ahci_driver_info = {
+	.name = "ahci",
+	.type = DEV_IDE,
+	.subtype = DEV_IDE_HDD,
+	.connection_type = DEV_CONNECTION_PCI,
+	.connection_data.pci = {
+		.vendor = PCI_ANY_ID,
+		.device = PCI_ANY_ID,
+		.probe = ahci_probe,
+		.class_code = 0x010601, // Mass storage, SATA, AHCI 1.0
+	},
+};
+
+static inline uint32_t ahci_read(volatile uint32_t* registers, uint32_t offset) {
+	return registers[offset / 4];
+}
+
+static inline void ahci_write(volatile uint32_t* registers, uint32_t offset, uint32_t value) {
+	registers[offset / 4] = value;
+}
+
+// Wait for the bits in mask to be clear. Returns false after timeout_ms
+static bool ahci_wait_clear(volatile uint32_t* registers, uint32_t offset, uint32_t mask, uint64_t timeout_ms) {
+
+	uint64_t deadline = rdtsc() + tsc_frequency / 1000 * timeout_ms;
+
+	while (ahci_read(registers, offset) & mask) {
+		if (rdtsc() > deadline) {
+			return false;
+		}
+		pause();
+	}
+
+	return true;
+}
+
+static bool ahci_port_stop(ahci_port_t* port) {
+	ahci_write(port->registers, AHCI_PX_CMD, ahci_read(port->registers, AHCI_PX_CMD) & ~(AHCI_CMD_ST | AHCI_CMD_FRE));
+	return ahci_wait_clear(port->registers, AHCI_PX_CMD, AHCI_CMD_CR | AHCI_CMD_FR, AHCI_TIMEOUT_MS);
+}
+
+static void ahci_port_start(ahci_port_t* port) {
+	ahci_wait_clear(port->registers, AHCI_PX_CMD, AHCI_CMD_CR, AHCI_TIMEOUT_MS);
+	ahci_write(port->registers, AHCI_PX_CMD, ahci_read(port->registers, AHCI_PX_CMD) | AHCI_CMD_FRE);
+	ahci_write(port->registers, AHCI_PX_CMD, ahci_read(port->registers, AHCI_PX_CMD) | AHCI_CMD_ST);
+}
+
+// Reset the link with a COMRESET, for a port that would not stop. Returns false if the
+// port still has not stopped, or the disk does not come back
+static bool ahci_port_reset(ahci_port_t* port) {
+
+	uint32_t control = ahci_read(port->registers, AHCI_PX_SCTL) & ~AHCI_SCTL_DET_MASK;
+	ahci_write(port->registers, AHCI_PX_SCTL, control | AHCI_SCTL_DET_RESET);
+
+	uint64_t start = rdtsc();
+	while (rdtsc() - start < tsc_frequency / 1000 * 2) {
+		pause();
+	}
+
+	ahci_write(port->registers, AHCI_PX_SCTL, control);
+
+	uint64_t deadline = rdtsc() + tsc_frequency / 1000 * AHCI_TIMEOUT_MS;
+	while ((ahci_read(port->registers, AHCI_PX_SSTS) & 0xf) != AHCI_SSTS_DET_PRESENT) {
+		if (rdtsc() > deadline) {
+			return false;
+		}
+		pause();
+	}
+
+	ahci_write(port->registers, AHCI_PX_SERR, 0xffffffff);
+
+	return ahci_wait_clear(port->registers, AHCI_PX_CMD, AHCI_CMD_CR | AHCI_CMD_FR, AHCI_TIMEOUT_MS) &&
+		ahci_wait_clear(port->registers, AHCI_PX_TFD, AHCI_TFD_BSY | AHCI_TFD_DRQ, AHCI_TIMEOUT_MS);
+}
+
+// Fill in a slot's command for a transfer. Returns false if a segment can not be used
+static bool ahci_build(ahci_port_t* port, uint32_t slot, uint8_t command, uint64_t sector, uint32_t sectors,
+		block_segment_t* segments, uint32_t segment_count, bool write) {
+
+	ahci_command_table_t* table = port->tables[slot];
+	uint32_t prds = 0;
+
+	for (uint32_t i = 0; i < segment_count; i++) {
+		uint64_t phys = segments[i].phys;
+		uint64_t length = segments[i].length;
+
+		if ((phys >> 32) != 0 && !port->controller->addresses_64) {
+			return false;
+		}
+
+		// Entries hold up to 4 MiB each, and an even number of bytes
+		while (length != 0) {
+			uint32_t chunk = length > AHCI_PRD_MAX ? AHCI_PRD_MAX : length;
+			if (prds == AHCI_PRDT_MAX || (chunk & 1)) {
+				return false;
+			}
+
+			table->prdt[prds].address = phys;
+			table->prdt[prds].reserved = 0;
+			table->prdt[prds].count = chunk - 1;
+			prds++;
+
+			phys += chunk;
+			length -= chunk;
+		}
+	}
+
+	ahci_fis_h2d_t* fis = (ahci_fis_h2d_t*)table->fis;
+	memset(fis, 0, sizeof(ahci_fis_h2d_t));
+
+	fis->type = FIS_TYPE_H2D;
+	fis->flags = FIS_H2D_COMMAND;
+	fis->command = command;
+	fis->device = ATA_DEVICE_LBA;
+	fis->lba0 = sector;
+	fis->lba1 = sector >> 8;
+	fis->lba2 = sector >> 16;
+	fis->lba3 = sector >> 24;
+	fis->lba4 = sector >> 32;
+	fis->lba5 = sector >> 40;
+
+	// Queued commands move the count into the features, and the tag into the count
+	if (command == ATA_READ_FPDMA_QUEUED || command == ATA_WRITE_FPDMA_QUEUED) {
+		fis->feature_low = sectors;
+		fis->feature_high = sectors >> 8;
+		fis->count_low = slot << 3;
+	}
+	else {
+		fis->count_low = sectors;
+		fis->count_high = sectors >> 8;
+	}
+
+	ahci_command_header_t* header = &port->commands[slot];
+	header->flags = AHCI_HEADER_FIS_LENGTH | (write ? AHCI_HEADER_WRITE : 0);
+	header->prdt_length = prds;
+	header->transferred = 0;
+	header->table = virt_to_phys(table);
+
+	return true;
+}
+
+// Issue every command waiting for the end of its batch with a single write. Port lock held
+static void ahci_issue(ahci_port_t* port) {
+	if (port->batched != 0) {
+		ahci_write(port->registers, AHCI_PX_CI, port->batched);
+		port->batched = 0;
+	}
+}
+
+static uint8_t ahci_submit(block_device_t* device, __attribute__((unused)) uint32_t queue, block_request_t* request, bool last) {
+
+	ahci_port_t* port = device->driver_data;
+
+	if (request->sectors == 0 || request->sectors > AHCI_SECTORS_MAX) {
+		return BLOCK_ERROR_SEGMENT;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&port->lock);
+
+	// Requests wait while the port restarts, and fail once it could not be
+	if (port->state != AHCI_PORT_RUNNING) {
+		uint8_t status = port->state == AHCI_PORT_BROKEN ? BLOCK_ERROR_IO : BLOCK_ERROR_BUSY;
+		spin_unlock_irqrestore(&port->lock, flags);
+		return status;
+	}
+
+	uint32_t free = port->slots & ~port->issued;
+	if (free == 0) {
+		spin_unlock_irqrestore(&port->lock, flags);
+		return BLOCK_ERROR_BUSY;
+	}
+
+	uint32_t slot = __builtin_ctz(free);
+
+	uint8_t command;
+	if (port->ncq) {
+		command = request->write ? ATA_WRITE_FPDMA_QUEUED : ATA_READ_FPDMA_QUEUED;
+	}
+	else {
+		command = request->write ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+	}
+
+	if (!ahci_build(port, slot, command, request->sector, request->sectors, request->segments, request->segment_count, request->write)) {
+		spin_unlock_irqrestore(&port->lock, flags);
+		return BLOCK_ERROR_SEGMENT;
+	}
+
+	port->issued |= 1u << slot;
+	port->batched |= 1u << slot;
+	port->requests[slot] = request;
+
+	// A queued command is marked active before it is issued
+	if (port->ncq) {
+		ahci_write(port->registers, AHCI_PX_SACT, 1u << slot);
+	}
+	if (last) {
+		ahci_issue(port);
+	}
+
+	spin_unlock_irqrestore(&port->lock, flags);
+	return BLOCK_SUCCESS;
+}
+
+static void ahci_commit(block_device_t* device, __attribute__((unused)) uint32_t queue) {
+
+	ahci_port_t* port = device->driver_data;
+
+	uint64_t flags = spin_lock_irqsave(&port->lock);
+	ahci_issue(port);
+	spin_unlock_irqrestore(&port->lock, flags);
+}
+
+// Free the slots and take their requests, chained through next to be completed once the
+// lock is dropped. Port lock held
+static block_request_t* ahci_take(ahci_port_t* port, uint32_t finished) {
+
+	block_request_t* done = 0;
+	for (uint32_t slots = finished; slots != 0; slots &= slots - 1) {
+		uint32_t slot = __builtin_ctz(slots);
+		block_request_t* request = port->requests[slot];
+		port->requests[slot] = 0;
+
+		request->next = done;
+		done = request;
+	}
+	port->issued &= ~finished;
+
+	return done;
+}
+
+// Restart a port stopped by an error. Takes up to seconds, so it runs outside the port lock,
+// from idle work or from polling, whichever gets to it first. The restart drops everything
+// the port had, so every request in flight fails once it is done
+static void ahci_port_recover(ahci_port_t* port) {
+
+	uint8_t expected = AHCI_PORT_STOPPED;
+	if (!__atomic_compare_exchange_n(&port->state, &expected, AHCI_PORT_RESTARTING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	// Setting ST again on a port that never stopped is not allowed, so that takes a COMRESET
+	bool working = ahci_port_stop(port) || ahci_port_reset(port);
+
+	ahci_write(port->registers, AHCI_PX_SERR, 0xffffffff);
+	ahci_write(port->registers, AHCI_PX_IS, 0xffffffff);
+
+	if (working) {
+		ahci_port_start(port);
+	}
+	else {
+		tty_print_string("AHCI: ");
+		tty_print_string(port->device.name);
+		tty_print_string(" could not be restarted\n");
+	}
+
+	uint64_t flags = spin_lock_irqsave(&port->lock);
+	block_request_t* done = ahci_take(port, port->issued);
+	__atomic_store_n(&port->state, working ? AHCI_PORT_RUNNING : AHCI_PORT_BROKEN, __ATOMIC_RELEASE);
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	while (done != 0) {
+		block_request_t* next = done->next;
+		block_complete(done, BLOCK_ERROR_IO);
+		done = next;
+	}
+}
+
+static void ahci_recovery_work(void* arg) {
+	ahci_port_t* port = arg;
+	__atomic_store_n(&port->recovery_queued, false, __ATOMIC_SEQ_CST);
+	ahci_port_recover(port);
+}
+
+// Complete every request the port has finished. An error only stops the port, leaving
+// its requests to fail once ahci_port_recover has restarted it
+static void ahci_port_complete(ahci_port_t* port) {
+
+	uint64_t flags = spin_lock_irqsave(&port->lock);
+
+	uint32_t status = ahci_read(port->registers, AHCI_PX_IS);
+	ahci_write(port->registers, AHCI_PX_IS, status);
+
+	// Already stopped, and nothing in flight can finish any more
+	if (port->state != AHCI_PORT_RUNNING) {
+		spin_unlock_irqrestore(&port->lock, flags);
+		return;
+	}
+
+	if (status & AHCI_IS_ERRORS) {
+		port->batched = 0;
+		ahci_write(port->registers, AHCI_PX_SERR, 0xffffffff);
+		__atomic_store_n(&port->state, AHCI_PORT_STOPPED, __ATOMIC_RELEASE);
+		spin_unlock_irqrestore(&port->lock, flags);
+
+		if (!__atomic_exchange_n(&port->recovery_queued, true, __ATOMIC_SEQ_CST)) {
+			idle_queue_work(cpu_id(), &port->recovery);
+		}
+		return;
+	}
+
+	uint32_t active = ahci_read(port->registers, AHCI_PX_CI);
+	if (port->ncq) {
+		active |= ahci_read(port->registers, AHCI_PX_SACT);
+	}
+	block_request_t* done = ahci_take(port, port->issued & ~port->batched & ~active);
+
+	spin_unlock_irqrestore(&port->lock, flags);
+
+	while (done != 0) {
+		block_request_t* next = done->next;
+		block_complete(done, BLOCK_SUCCESS);
+		done = next;
+	}
+}
+
+static void ahci_poll(block_device_t* device, __attribute__((unused)) uint32_t queue) {
+
+	ahci_port_t* port = device->driver_data;
+	ahci_port_complete(port);
+
+	// A waiter polling on the core the restart was queued on would otherwise never see it run
+	if (__atomic_load_n(&port->state, __ATOMIC_ACQUIRE) == AHCI_PORT_STOPPED) {
+		ahci_port_recover(port);
+	}
+}
+
+static void ahci_set_polling(block_device_t* device, bool polling) {
+	ahci_port_t* port = device->driver_data;
+	ahci_write(port->registers, AHCI_PX_IE, polling ? 0 : AHCI_IS_ENABLE);
+}
+
+static void ahci_interrupt(void* arg) {
+
+	ahci_controller_t* controller = arg;
+
+	uint32_t pending = ahci_read(controller->registers, AHCI_IS);
+
+	// Port status is cleared before the controller's, or the interrupt would be raised again
+	for (uint32_t ports = pending; ports != 0; ports &= ports - 1) {
+		ahci_port_t* port = controller->ports[__builtin_ctz(ports)];
+		if (port != 0) {
+			ahci_port_complete(port);
+		}
+	}
+
+	ahci_write(controller->registers, AHCI_IS, pending);
+}
+
+// The shared legacy line, for controllers without MSI
+static void ahci_legacy_interrupt(void) {
+	for (ahci_controller_t* controller = ahci_controllers; controller != 0; controller = controller->next) {
+		ahci_interrupt(controller);
+	}
+}
+
+// Run a command on slot 0 and wait for it, before the port is handed to the block layer
+static bool ahci_command_sync(ahci_port_t* port, uint8_t command, void* buffer, uint32_t length) {
+
+	block_segment_t segment = { virt_to_phys(buffer), length };
+
+	if (!ahci_build(port, 0, command, 0, 0, &segment, 1, false)) {
+		return false;
+	}
+
+	ahci_write(port->registers, AHCI_PX_IS, 0xffffffff);
+	ahci_write(port->registers, AHCI_PX_CI, 1);
+
+	if (!ahci_wait_clear(port->registers, AHCI_PX_CI, 1, AHCI_TIMEOUT_MS)) {
+		return false;
+	}
+
+	return !(ahci_read(port->registers, AHCI_PX_IS) & AHCI_IS_ERRORS);
+}
+
+// Free what a port that could not be set up holds, once the controller no longer uses its pages. Returns 0
+static ahci_port_t* ahci_port_free(ahci_port_t* port, uint64_t list, uint64_t identify) {
+
+	if (port != 0) {
+		for (uint32_t slot = 0; slot < AHCI_SLOTS_MAX; slot++) {
+			if (port->tables[slot] != 0) {
+				pmm_free_page(virt_to_phys(port->tables[slot]));
+			}
+		}
+		kfree(port);
+	}
+
+	if (list != 0) {
+		pmm_free_page(list);
+	}
+	if (identify != 0) {
+		pmm_free_page(identify);
+	}
+
+	return 0;
+}
+
+static ahci_port_t* ahci_port_init(ahci_controller_t* controller, uint32_t number) {
+
+	volatile uint32_t* registers = (volatile uint32_t*)((uint8_t*)controller->registers + AHCI_PORTS + number * AHCI_PORT_SIZE);
+
+	// Only ports with an ATA disk attached and talking
+	if ((ahci_read(registers, AHCI_PX_SSTS) & 0xf) != AHCI_SSTS_DET_PRESENT || ahci_read(registers, AHCI_PX_SIG) != AHCI_SIG_ATA) {
+		return 0;
+	}
+
+	ahci_port_t* port = kzalloc(sizeof(ahci_port_t));
+	uint64_t list = pmm_alloc_page();
+	uint64_t identify = pmm_alloc_page();
+	if (port == 0 || list == 0 || identify == 0) {
+		return ahci_port_free(port, list, identify);
+	}
+
+	port->controller = controller;
+	port->registers = registers;
+	port->recovery.func = &ahci_recovery_work;
+	port->recovery.arg = port;
+	spin_lock_init(&port->lock);
+
+	// The controller is still using the firmware's command list, not this one
+	if (!ahci_port_stop(port)) {
+		return ahci_port_free(port, list, identify);
+	}
+
+	// The command list takes the first 1 KiB of its page, and received FISes the next 256 bytes
+	memset(phys_to_virt(list), 0, PAGE_SIZE);
+	port->commands = phys_to_virt(list);
+
+	for (uint32_t slot = 0; slot < controller->slots; slot++) {
+		uint64_t table = pmm_alloc_page();
+		if (table == 0) {
+			return ahci_port_free(port, list, identify);
+		}
+		memset(phys_to_virt(table), 0, PAGE_SIZE);
+		port->tables[slot] = phys_to_virt(table);
+	}
+
+	ahci_write(registers, AHCI_PX_CLB, list);
+	ahci_write(registers, AHCI_PX_CLBU, list >> 32);
+	ahci_write(registers, AHCI_PX_FB, list + 1024);
+	ahci_write(registers, AHCI_PX_FBU, (list + 1024) >> 32);
+	ahci_write(registers, AHCI_PX_SERR, 0xffffffff);
+	ahci_write(registers, AHCI_PX_IS, 0xffffffff);
+	ahci_write(registers, AHCI_PX_IE, 0);
+
+	ahci_port_start(port);
+
+	uint16_t* words = phys_to_virt(identify);
+	if (!ahci_command_sync(port, ATA_IDENTIFY, words, 512)) {
+
+		// A port that will not stop may still write to its pages, so they are left to it
+		if (!ahci_port_stop(port)) {
+			kfree(port);
+			return 0;
+		}
+		return ahci_port_free(port, list, identify);
+	}
+
+	// 48 bit addressing (word 83 bit 10) has a 64 bit sector count, otherwise it is 28 bits
+	uint64_t sectors;
+	if (words[83] & (1 << 10)) {
+		sectors = (uint64_t)words[100] | (uint64_t)words[101] << 16 | (uint64_t)words[102] << 32 | (uint64_t)words[103] << 48;
+	}
+	else {
+		sectors = (uint64_t)words[60] | (uint64_t)words[61] << 16;
+	}
+
+	// Native Command Queuing (word 76 bit 8) with a queue depth in word 75
+	uint32_t depth = controller->slots;
+	port->ncq = (words[76] & (1 << 8)) && (ahci_read(controller->registers, AHCI_CAP) & AHCI_CAP_SNCQ);
+	if (port->ncq && (uint32_t)(words[75] & 0x1f) + 1 < depth) {
+		depth = (words[75] & 0x1f) + 1;
+	}
+	port->slots = depth == 32 ? 0xffffffff : (1u << depth) - 1;
+
+	pmm_free_page(identify);
+
+	block_device_t* device = &port->device;
+	uint32_t disk = __atomic_fetch_add(&ahci_disks, 1, __ATOMIC_RELAXED);
+	memcpy(device->name, "sata", 4);
+
+	// Every digit of the index, so no two disks share a name
+	char digits[10];
+	uint32_t count = 0;
+	do {
+		digits[count++] = '0' + disk % 10;
+		disk /= 10;
+	} while (disk != 0);
+
+	for (uint32_t i = 0; i < count; i++) {
+		device->name[4 + i] = digits[count - 1 - i];
+	}
+	device->sectors = sectors;
+	device->queues = 1;
+	device->depth = depth;
+	device->sectors_max = AHCI_SECTORS_MAX;
+	device->submit = &ahci_submit;
+	device->commit = &ahci_commit;
+	device->poll = &ahci_poll;
+	device->set_polling = &ahci_set_polling;
+	device->driver_data = port;
+
+	ahci_write(registers, AHCI_PX_IS, 0xffffffff);
+	ahci_write(registers, AHCI_PX_IE, AHCI_IS_ENABLE);
+
+	return port;
+}
+
+uint8_t ahci_probe(pci_device_t* pci) {
+
+	uint64_t size;
+	uint64_t bar = pci_bar(pci, 5, &size);
+	if (bar == 0 || size == 0) {
+		return 1;
+	}
+
+	ahci_controller_t* controller = kzalloc(sizeof(ahci_controller_t));
+	if (controller == 0) {
+		return 1;
+	}
+
+	pci_enable(pci);
+	controller->pci = pci;
+	controller->registers = paging_map_mmio(bar, size);
+	if (controller->registers == 0) {
+		kfree(controller);
+		return 1;
+	}
+
+	// Take the controller from the firmware if it says it owns it
+	if (ahci_read(controller->registers, AHCI_CAP2) & AHCI_CAP2_BOH) {
+		ahci_write(controller->registers, AHCI_BOHC, ahci_read(controller->registers, AHCI_BOHC) | AHCI_BOHC_OOS);
+		ahci_wait_clear(controller->registers, AHCI_BOHC, AHCI_BOHC_BOS, AHCI_TIMEOUT_MS);
+	}
+
+	ahci_write(controller->registers, AHCI_GHC, ahci_read(controller->registers, AHCI_GHC) | AHCI_GHC_AE);
+
+	uint32_t cap = ahci_read(controller->registers, AHCI_CAP);
+	controller->slots = ((cap >> 8) & 0x1f) + 1;
+	controller->addresses_64 = cap & AHCI_CAP_S64A;
+
+	// Interrupts go to the core that probed the controller, through MSI if it can
+	if (!msi_enable(pci, cpu_id(), &ahci_interrupt, controller)) {
+		if (pci->interrupt_pin == 0 || pci->interrupt_line >= INTERRUPT_IRQ_COUNT) {
+			kfree(controller);
+			return 1;
+		}
+
+		spin_lock(&ahci_controllers_lock);
+		controller->next = ahci_controllers;
+		ahci_controllers = controller;
+		spin_unlock(&ahci_controllers_lock);
+
+		interrupt_register(INTERRUPT_IRQ_BASE + pci->interrupt_line, &ahci_legacy_interrupt);
+		interrupt_unmask(pci->interrupt_line);
+	}
+
+	uint32_t implemented = ahci_read(controller->registers, AHCI_PI);
+	for (uint32_t number = 0; number < 32; number++) {
+		if (implemented & (1u << number)) {
+			controller->ports[number] = ahci_port_init(controller, number);
+		}
+	}
+
+	ahci_write(controller->registers, AHCI_IS, 0xffffffff);
+	ahci_write(controller->registers, AHCI_GHC, ahci_read(controller->registers, AHCI_GHC) | AHCI_GHC_IE);
+
+	// Registered once interrupts are on, since they are how requests complete
+	for (uint32_t number = 0; number < 32; number++) {
+		if (controller->ports[number] != 0) {
+			block_register(&controller->ports[number]->device);
+		}
+	}
+
+	return 0;
+}
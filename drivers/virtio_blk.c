@@ -0,0 +1,608 @@
+/*
+ * evan-os/drivers/virtio_blk.c
+ *
+ * Virtio block driver, for the modern virtio-pci interface. The device
+ * gets a split virtqueue for each core, up to as many as it offers, and
+ * each queue's MSI-X entry interrupts the core that submits to it.
+ *
+ * Every request takes one descriptor in the ring, pointing at an indirect
+ * table holding the request header, its data segments and the status
+ * byte. With event idx the device says which avail index it wants to be
+ * notified at, so requests added while it is still working through the
+ * ring need no doorbell write, and the driver says which used index it
+ * wants an interrupt at in the same way. A batch from the block layer is
+ * published entry by entry but checked for a notification only once.
+ *
+ */
+
+#include <apic.h>
+#include <asm.h>
+#include <block.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <msi.h>
+#include <paging.h>
+#include <pci.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <spinlock.h>
+#include <string.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VIRTIO_VENDOR                 0x1af4
+#define VIRTIO_DEVICE_BLK_TRANSITIONAL 0x1001
+#define VIRTIO_DEVICE_BLK             0x1042
+
+// Vendor capabilities locating each structure in a BAR
+#define VIRTIO_CAP_TYPE   3
+#define VIRTIO_CAP_BAR    4
+#define VIRTIO_CAP_OFFSET 8
+#define VIRTIO_CAP_LENGTH 12
+#define VIRTIO_CAP_NOTIFY_MULTIPLIER 16
+
+#define VIRTIO_CAP_COMMON 1
+#define VIRTIO_CAP_NOTIFY 2
+#define VIRTIO_CAP_DEVICE 4
+
+// Common configuration, in bytes
+#define VIRTIO_COMMON_DEVICE_FEATURE_SELECT 0
+#define VIRTIO_COMMON_DEVICE_FEATURE        4
+#define VIRTIO_COMMON_DRIVER_FEATURE_SELECT 8
+#define VIRTIO_COMMON_DRIVER_FEATURE        12
+#define VIRTIO_COMMON_MSIX_CONFIG           16
+#define VIRTIO_COMMON_NUM_QUEUES            18
+#define VIRTIO_COMMON_STATUS                20
+#define VIRTIO_COMMON_CONFIG_GENERATION     21
+#define VIRTIO_COMMON_QUEUE_SELECT          22
+#define VIRTIO_COMMON_QUEUE_SIZE            24
+#define VIRTIO_COMMON_QUEUE_MSIX_VECTOR     26
+#define VIRTIO_COMMON_QUEUE_ENABLE          28
+#define VIRTIO_COMMON_QUEUE_NOTIFY_OFF      30
+#define VIRTIO_COMMON_QUEUE_DESC            32
+#define VIRTIO_COMMON_QUEUE_DRIVER          40
+#define VIRTIO_COMMON_QUEUE_DEVICE          48
+
+#define VIRTIO_MSI_NO_VECTOR 0xffff
+
+// Device status
+#define VIRTIO_STATUS_ACKNOWLEDGE 1
+#define VIRTIO_STATUS_DRIVER      2
+#define VIRTIO_STATUS_DRIVER_OK   4
+#define VIRTIO_STATUS_FEATURES_OK 8
+#define VIRTIO_STATUS_FAILED      0x80
+
+// How long the device gets to finish a reset
+#define VIRTIO_BLK_TIMEOUT_MS 1000
+
+// Feature bits
+#define VIRTIO_BLK_F_SEG_MAX       (1ull << 2)
+#define VIRTIO_BLK_F_RO            (1ull << 5)
+#define VIRTIO_BLK_F_MQ            (1ull << 12)
+#define VIRTIO_F_INDIRECT_DESC     (1ull << 28)
+#define VIRTIO_F_EVENT_IDX         (1ull << 29)
+#define VIRTIO_F_VERSION_1         (1ull << 32)
+
+#define VIRTIO_BLK_FEATURES_REQUIRED (VIRTIO_F_VERSION_1 | VIRTIO_F_INDIRECT_DESC | VIRTIO_F_EVENT_IDX)
+#define VIRTIO_BLK_FEATURES_OPTIONAL (VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO | VIRTIO_BLK_F_MQ)
+
+// Block device configuration, in bytes
+#define VIRTIO_BLK_CONFIG_CAPACITY   0
+#define VIRTIO_BLK_CONFIG_SEG_MAX    12
+#define VIRTIO_BLK_CONFIG_NUM_QUEUES 34
+
+// Request types and statuses
+#define VIRTIO_BLK_T_IN  0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_S_OK  0
+
+// Descriptor flags
+#define VIRTQ_DESC_F_NEXT     1
+#define VIRTQ_DESC_F_WRITE    2 // Written by the device
+#define VIRTQ_DESC_F_INDIRECT 4
+
+// Ring entries in each queue, each ring fitting in a page
+#define VIRTIO_BLK_QUEUE_SIZE_MAX 256
+
+// Requests in flight on each queue, each with an indirect table
+#define VIRTIO_BLK_DEPTH 128
+
+typedef struct virtq_desc_t {
+	uint64_t address;
+	uint32_t length;
+	uint16_t flags;
+	uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct virtq_avail_t {
+	uint16_t flags;
+	volatile uint16_t index;
+	uint16_t ring[]; // Followed by used_event
+} virtq_avail_t;
+
+typedef struct virtq_used_elem_t {
+	uint32_t id;
+	uint32_t length;
+} virtq_used_elem_t;
+
+typedef struct virtq_used_t {
+	uint16_t flags;
+	volatile uint16_t index;
+	virtq_used_elem_t ring[]; // Followed by avail_event
+} virtq_used_t;
+
+typedef struct virtio_blk_header_t {
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t sector;
+} __attribute__((packed)) virtio_blk_header_t;
+
+// What each request in flight needs, with the ring descriptor of the same number pointing at its table
+typedef struct virtio_blk_slot_t {
+	virtio_blk_header_t header;
+	volatile uint8_t    status;
+	uint8_t             reserved[47];
+	virtq_desc_t        table[BLOCK_SEGMENTS_MAX + 2];
+} __attribute__((packed)) virtio_blk_slot_t;
+
+typedef struct virtio_blk_t virtio_blk_t;
+
+typedef struct virtio_blk_queue_t {
+	virtio_blk_t*      disk;
+	uint16_t           index;
+	uint16_t           size;
+	virtq_desc_t*      desc;
+	virtq_avail_t*     avail;
+	virtq_used_t*      used;
+	volatile uint16_t* used_event;
+	volatile uint16_t* avail_event;
+	volatile uint16_t* notify;
+
+	uint16_t           avail_index; // Next to publish
+	uint16_t           notified;    // Avail index when the device was last checked for a notification
+	uint16_t           used_index;  // Next to complete
+
+	virtio_blk_slot_t* slots;
+	block_request_t**  requests;
+	uint16_t*          free;
+	uint32_t           free_count;
+	spinlock_t         lock;
+} virtio_blk_queue_t;
+
+struct virtio_blk_t {
+	pci_device_t*       pci;
+	volatile uint8_t*   common;
+	volatile uint8_t*   config;
+	volatile uint8_t*   notify;
+	uint32_t            notify_multiplier;
+	msix_t*             msix;
+	uint64_t            features;
+	uint32_t            segments_max;
+	virtio_blk_queue_t* queues;
+	block_device_t      device;
+};
+
+volatile uint32_t virtio_blk_disks;
+
+uint8_t virtio_blk_probe(pci_device_t* device);
+
+__attribute__((section(".driverinfo"), used))
+driver_info_t virtio_blk_driver_info = {
+	.name = "virtio_blk",
+	.type = DEV_IDE,
+	.subtype = DEV_IDE_HDD,
+	.connection_type = DEV_CONNECTION_PCI,
+	.connection_data.pci = {
+		.vendor = VIRTIO_VENDOR,
+		.device = PCI_ANY_ID, // Checked in the probe, since there is a transitional and a modern id
+		.probe = virtio_blk_probe,
+	},
+};
+
+#define virtio_read8(base, offset)   (*(volatile uint8_t*)((base) + (offset)))
+#define virtio_read16(base, offset)  (*(volatile uint16_t*)((base) + (offset)))
+#define virtio_read32(base, offset)  (*(volatile uint32_t*)((base) + (offset)))
+#define virtio_write8(base, offset, value)  (*(volatile uint8_t*)((base) + (offset)) = (value))
+#define virtio_write16(base, offset, value) (*(volatile uint16_t*)((base) + (offset)) = (value))
+#define virtio_write32(base, offset, value) (*(volatile uint32_t*)((base) + (offset)) = (value))
+
+// 64 bit fields are written as two halves, low first
+static void virtio_write64(volatile uint8_t* base, uint32_t offset, uint64_t value) {
+	virtio_write32(base, offset, value);
+	virtio_write32(base, offset + 4, value >> 32);
+}
+
+// Whether the other side asked to hear about index event, now that index moved from old to new
+static inline bool virtio_need_event(uint16_t event, uint16_t new, uint16_t old) {
+	return (uint16_t)(new - event - 1) < (uint16_t)(new - old);
+}
+
+// Map the structure a vendor capability points at
+static volatile uint8_t* virtio_map_capability(pci_device_t* pci, uint16_t capability) {
+
+	uint8_t bar = pci_read8(pci, capability + VIRTIO_CAP_BAR);
+	uint32_t offset = pci_read32(pci, capability + VIRTIO_CAP_OFFSET);
+	uint32_t length = pci_read32(pci, capability + VIRTIO_CAP_LENGTH);
+
+	uint64_t base = pci_bar(pci, bar, 0);
+	if (base == 0 || length == 0) {
+		return 0;
+	}
+
+	return paging_map_mmio(base + offset, length);
+}
+
+static bool virtio_blk_find_structures(virtio_blk_t* disk) {
+
+	pci_device_t* pci = disk->pci;
+
+	for (uint16_t capability = pci_find_capability(pci, PCI_CAPABILITY_VENDOR); capability != 0;
+			capability = pci_find_next_capability(pci, capability, PCI_CAPABILITY_VENDOR)) {
+
+		// The first of each type is the one to use
+		switch (pci_read8(pci, capability + VIRTIO_CAP_TYPE)) {
+		case VIRTIO_CAP_COMMON:
+			if (disk->common == 0) {
+				disk->common = virtio_map_capability(pci, capability);
+			}
+			break;
+		case VIRTIO_CAP_NOTIFY:
+			if (disk->notify == 0) {
+				disk->notify = virtio_map_capability(pci, capability);
+				disk->notify_multiplier = pci_read32(pci, capability + VIRTIO_CAP_NOTIFY_MULTIPLIER);
+			}
+			break;
+		case VIRTIO_CAP_DEVICE:
+			if (disk->config == 0) {
+				disk->config = virtio_map_capability(pci, capability);
+			}
+			break;
+		}
+	}
+
+	return disk->common != 0 && disk->notify != 0 && disk->config != 0;
+}
+
+// Whether the device wants to hear about the requests published since it was last checked,
+// once for a whole batch. Queue lock held
+static bool virtio_blk_need_notify(virtio_blk_queue_t* queue) {
+
+	// The published index is visible before the device's event is read
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	bool notify = virtio_need_event(*queue->avail_event, queue->avail_index, queue->notified);
+	queue->notified = queue->avail_index;
+
+	return notify;
+}
+
+static uint8_t virtio_blk_submit(block_device_t* device, uint32_t index, block_request_t* request, bool last) {
+
+	virtio_blk_t* disk = device->driver_data;
+	virtio_blk_queue_t* queue = &disk->queues[index];
+
+	if (request->segment_count > disk->segments_max) {
+		return BLOCK_ERROR_SEGMENT;
+	}
+	if (request->write && (disk->features & VIRTIO_BLK_F_RO)) {
+		return BLOCK_ERROR_IO;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&queue->lock);
+
+	if (queue->free_count == 0) {
+		spin_unlock_irqrestore(&queue->lock, flags);
+		return BLOCK_ERROR_BUSY;
+	}
+
+	uint16_t slot = queue->free[--queue->free_count];
+	virtio_blk_slot_t* entry = &queue->slots[slot];
+
+	entry->header.type = request->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	entry->header.reserved = 0;
+	entry->header.sector = request->sector;
+	entry->status = 0xff;
+
+	// Header, then the data, then the status byte for the device to fill in
+	uint32_t count = request->segment_count + 2;
+
+	entry->table[0] = (virtq_desc_t){ virt_to_phys(&entry->header), sizeof(virtio_blk_header_t), VIRTQ_DESC_F_NEXT, 1 };
+	for (uint32_t i = 0; i < request->segment_count; i++) {
+		uint16_t access = request->write ? 0 : VIRTQ_DESC_F_WRITE;
+		entry->table[i + 1] = (virtq_desc_t){ request->segments[i].phys, request->segments[i].length, VIRTQ_DESC_F_NEXT | access, i + 2 };
+	}
+	entry->table[count - 1] = (virtq_desc_t){ virt_to_phys((void*)&entry->status), 1, VIRTQ_DESC_F_WRITE, 0 };
+
+	queue->desc[slot].length = count * sizeof(virtq_desc_t);
+	queue->requests[slot] = request;
+
+	queue->avail->ring[queue->avail_index % queue->size] = slot;
+	queue->avail_index++;
+
+	// The entry is visible before the index
+	__atomic_store_n(&queue->avail->index, queue->avail_index, __ATOMIC_RELEASE);
+
+	bool notify = last && virtio_blk_need_notify(queue);
+
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	if (notify) {
+		*queue->notify = queue->index;
+	}
+
+	return BLOCK_SUCCESS;
+}
+
+static void virtio_blk_commit(block_device_t* device, uint32_t index) {
+
+	virtio_blk_t* disk = device->driver_data;
+	virtio_blk_queue_t* queue = &disk->queues[index];
+
+	uint64_t flags = spin_lock_irqsave(&queue->lock);
+	bool notify = virtio_blk_need_notify(queue);
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	if (notify) {
+		*queue->notify = queue->index;
+	}
+}
+
+static void virtio_blk_complete(virtio_blk_queue_t* queue) {
+
+	uint64_t flags = spin_lock_irqsave(&queue->lock);
+
+	for (;;) {
+		if (queue->used_index == __atomic_load_n(&queue->used->index, __ATOMIC_ACQUIRE)) {
+			// Ask for an interrupt at the next completion, then look again for one that came first
+			*queue->used_event = queue->used_index;
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+			if (queue->used_index == queue->used->index) {
+				break;
+			}
+			continue;
+		}
+
+		uint16_t slot = queue->used->ring[queue->used_index % queue->size].id;
+		queue->used_index++;
+
+		block_request_t* request = queue->requests[slot];
+		uint8_t status = queue->slots[slot].status == VIRTIO_BLK_S_OK ? BLOCK_SUCCESS : BLOCK_ERROR_IO;
+
+		queue->requests[slot] = 0;
+		queue->free[queue->free_count++] = slot;
+
+		// Completing may submit again, to this same queue
+		spin_unlock_irqrestore(&queue->lock, flags);
+		block_complete(request, status);
+		flags = spin_lock_irqsave(&queue->lock);
+	}
+
+	spin_unlock_irqrestore(&queue->lock, flags);
+}
+
+static void virtio_blk_interrupt(void* arg) {
+	virtio_blk_complete(arg);
+}
+
+static void virtio_blk_poll(block_device_t* device, uint32_t index) {
+	virtio_blk_t* disk = device->driver_data;
+	virtio_blk_complete(&disk->queues[index]);
+}
+
+// Masked entries hold their messages, so one may arrive when polling stops
+static void virtio_blk_set_polling(block_device_t* device, bool polling) {
+	virtio_blk_t* disk = device->driver_data;
+	for (uint32_t index = 0; index < device->queues; index++) {
+		msix_set_masked(disk->msix, index, polling);
+	}
+}
+
+static bool virtio_blk_queue_init(virtio_blk_t* disk, uint16_t index) {
+
+	virtio_blk_queue_t* queue = &disk->queues[index];
+	volatile uint8_t* common = disk->common;
+
+	virtio_write16(common, VIRTIO_COMMON_QUEUE_SELECT, index);
+
+	uint16_t size = virtio_read16(common, VIRTIO_COMMON_QUEUE_SIZE);
+	if (size == 0) {
+		return false;
+	}
+	if (size > VIRTIO_BLK_QUEUE_SIZE_MAX) {
+		size = VIRTIO_BLK_QUEUE_SIZE_MAX;
+	}
+
+	uint32_t depth = size < VIRTIO_BLK_DEPTH ? size : VIRTIO_BLK_DEPTH;
+	uint64_t slot_pages = (depth * sizeof(virtio_blk_slot_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	uint64_t desc = pmm_alloc_page();
+	uint64_t avail = pmm_alloc_page();
+	uint64_t used = pmm_alloc_page();
+	uint64_t slots = pmm_alloc_pages(slot_pages);
+	queue->requests = kzalloc(depth * sizeof(block_request_t*));
+	queue->free = kzalloc(depth * sizeof(uint16_t));
+
+	if (desc == 0 || avail == 0 || used == 0 || slots == 0 || queue->requests == 0 || queue->free == 0) {
+		return false;
+	}
+
+	memset(phys_to_virt(desc), 0, PAGE_SIZE);
+	memset(phys_to_virt(avail), 0, PAGE_SIZE);
+	memset(phys_to_virt(used), 0, PAGE_SIZE);
+	memset(phys_to_virt(slots), 0, slot_pages * PAGE_SIZE);
+
+	queue->disk = disk;
+	queue->index = index;
+	queue->size = size;
+	queue->desc = phys_to_virt(desc);
+	queue->avail = phys_to_virt(avail);
+	queue->used = phys_to_virt(used);
+	queue->used_event = &queue->avail->ring[size];
+	queue->avail_event = (volatile uint16_t*)&queue->used->ring[size];
+	queue->slots = phys_to_virt(slots);
+	spin_lock_init(&queue->lock);
+
+	// Ring descriptors are only ever indirect, so each points at its slot's table for good
+	for (uint32_t slot = 0; slot < depth; slot++) {
+		queue->desc[slot].address = virt_to_phys(queue->slots[slot].table);
+		queue->desc[slot].flags = VIRTQ_DESC_F_INDIRECT;
+		queue->free[queue->free_count++] = depth - 1 - slot;
+	}
+
+	virtio_write16(common, VIRTIO_COMMON_QUEUE_SIZE, size);
+	virtio_write64(common, VIRTIO_COMMON_QUEUE_DESC, desc);
+	virtio_write64(common, VIRTIO_COMMON_QUEUE_DRIVER, avail);
+	virtio_write64(common, VIRTIO_COMMON_QUEUE_DEVICE, used);
+
+	// Queue n interrupts core n, which is the core submitting to it
+	if (!msix_route(disk->msix, index, index % cpu_count, &virtio_blk_interrupt, queue)) {
+		return false;
+	}
+
+	virtio_write16(common, VIRTIO_COMMON_QUEUE_MSIX_VECTOR, index);
+	if (virtio_read16(common, VIRTIO_COMMON_QUEUE_MSIX_VECTOR) != index) {
+		return false;
+	}
+
+	uint16_t notify_offset = virtio_read16(common, VIRTIO_COMMON_QUEUE_NOTIFY_OFF);
+	queue->notify = (volatile uint16_t*)(disk->notify + notify_offset * disk->notify_multiplier);
+
+	virtio_write16(common, VIRTIO_COMMON_QUEUE_ENABLE, 1);
+
+	return true;
+}
+
+// Give up on the device, telling it so
+static uint8_t virtio_blk_fail(virtio_blk_t* disk) {
+	virtio_write8(disk->common, VIRTIO_COMMON_STATUS, virtio_read8(disk->common, VIRTIO_COMMON_STATUS) | VIRTIO_STATUS_FAILED);
+	return 1;
+}
+
+uint8_t virtio_blk_probe(pci_device_t* pci) {
+
+	if (pci->device != VIRTIO_DEVICE_BLK && pci->device != VIRTIO_DEVICE_BLK_TRANSITIONAL) {
+		return 1;
+	}
+
+	virtio_blk_t* disk = kzalloc(sizeof(virtio_blk_t));
+	if (disk == 0) {
+		return 1;
+	}
+
+	disk->pci = pci;
+	pci_enable(pci);
+
+	// Transitional devices without the modern structures are not supported
+	if (!virtio_blk_find_structures(disk)) {
+		return 1;
+	}
+
+	volatile uint8_t* common = disk->common;
+
+	// A device that never finishes resetting would hold up the probing core for good
+	uint64_t deadline = rdtsc() + tsc_frequency / 1000 * VIRTIO_BLK_TIMEOUT_MS;
+
+	virtio_write8(common, VIRTIO_COMMON_STATUS, 0);
+	while (virtio_read8(common, VIRTIO_COMMON_STATUS) != 0) {
+		if (rdtsc() > deadline) {
+			return virtio_blk_fail(disk);
+		}
+		pause();
+	}
+
+	virtio_write8(common, VIRTIO_COMMON_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+	virtio_write8(common, VIRTIO_COMMON_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+	virtio_write32(common, VIRTIO_COMMON_DEVICE_FEATURE_SELECT, 0);
+	uint64_t offered = virtio_read32(common, VIRTIO_COMMON_DEVICE_FEATURE);
+	virtio_write32(common, VIRTIO_COMMON_DEVICE_FEATURE_SELECT, 1);
+	offered |= (uint64_t)virtio_read32(common, VIRTIO_COMMON_DEVICE_FEATURE) << 32;
+
+	if ((offered & VIRTIO_BLK_FEATURES_REQUIRED) != VIRTIO_BLK_FEATURES_REQUIRED) {
+		return virtio_blk_fail(disk);
+	}
+
+	disk->features = offered & (VIRTIO_BLK_FEATURES_REQUIRED | VIRTIO_BLK_FEATURES_OPTIONAL);
+
+	virtio_write32(common, VIRTIO_COMMON_DRIVER_FEATURE_SELECT, 0);
+	virtio_write32(common, VIRTIO_COMMON_DRIVER_FEATURE, disk->features);
+	virtio_write32(common, VIRTIO_COMMON_DRIVER_FEATURE_SELECT, 1);
+	virtio_write32(common, VIRTIO_COMMON_DRIVER_FEATURE, disk->features >> 32);
+
+	virtio_write8(common, VIRTIO_COMMON_STATUS, virtio_read8(common, VIRTIO_COMMON_STATUS) | VIRTIO_STATUS_FEATURES_OK);
+	if (!(virtio_read8(common, VIRTIO_COMMON_STATUS) & VIRTIO_STATUS_FEATURES_OK)) {
+		return virtio_blk_fail(disk);
+	}
+
+	// The capacity is read twice over if the device changed it part way through
+	uint64_t sectors;
+	uint8_t generation;
+	do {
+		generation = virtio_read8(common, VIRTIO_COMMON_CONFIG_GENERATION);
+		sectors = virtio_read32(disk->config, VIRTIO_BLK_CONFIG_CAPACITY);
+		sectors |= (uint64_t)virtio_read32(disk->config, VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32;
+	} while (generation != virtio_read8(common, VIRTIO_COMMON_CONFIG_GENERATION));
+
+	disk->segments_max = BLOCK_SEGMENTS_MAX;
+	if (disk->features & VIRTIO_BLK_F_SEG_MAX) {
+		uint32_t segments = virtio_read32(disk->config, VIRTIO_BLK_CONFIG_SEG_MAX);
+		if (segments != 0 && segments < disk->segments_max) {
+			disk->segments_max = segments;
+		}
+	}
+
+	// A queue for each core, as far as the device and its MSI-X table go
+	disk->msix = msix_enable(pci);
+	if (disk->msix == 0) {
+		return virtio_blk_fail(disk);
+	}
+
+	uint32_t queues = 1;
+	if (disk->features & VIRTIO_BLK_F_MQ) {
+		queues = virtio_read16(disk->config, VIRTIO_BLK_CONFIG_NUM_QUEUES);
+	}
+	if (queues > virtio_read16(common, VIRTIO_COMMON_NUM_QUEUES)) {
+		queues = virtio_read16(common, VIRTIO_COMMON_NUM_QUEUES);
+	}
+	if (queues > cpu_count) {
+		queues = cpu_count;
+	}
+	if (queues > disk->msix->entries) {
+		queues = disk->msix->entries;
+	}
+
+	disk->queues = kzalloc(queues * sizeof(virtio_blk_queue_t));
+	if (queues == 0 || disk->queues == 0) {
+		return virtio_blk_fail(disk);
+	}
+
+	// Nothing is done on configuration changes
+	virtio_write16(common, VIRTIO_COMMON_MSIX_CONFIG, VIRTIO_MSI_NO_VECTOR);
+
+	for (uint16_t index = 0; index < queues; index++) {
+		if (!virtio_blk_queue_init(disk, index)) {
+			return virtio_blk_fail(disk);
+		}
+	}
+
+	virtio_write8(common, VIRTIO_COMMON_STATUS, virtio_read8(common, VIRTIO_COMMON_STATUS) | VIRTIO_STATUS_DRIVER_OK);
+
+	block_device_t* device = &disk->device;
+	uint32_t number = __atomic_fetch_add(&virtio_blk_disks, 1, __ATOMIC_RELAXED);
+	memcpy(device->name, "virtio", 6);
+	device->name[6] = '0' + number % 10;
+	device->sectors = sectors;
+	device->queues = queues;
+	device->depth = disk->queues[0].free_count;
+	device->segments_max = disk->segments_max;
+	device->submit = &virtio_blk_submit;
+	device->commit = &virtio_blk_commit;
+	device->poll = &virtio_blk_poll;
+	device->set_polling = &virtio_blk_set_polling;
+	device->driver_data = disk;
+
+	block_register(device);
+	return 0;
+}
@@ -1,16 +1,62 @@
 /*
  * evan-os/drivers/zero.c
- * 
- * A driver that creates a virtual file that allows programs to 
- * read streams of 0s, where all writing is ignored 
- * 
+ *
+ * A driver that creates a virtual file that allows programs to
+ * read streams of 0s, where all writing is ignored, along with
+ * /dev/null, which reads as empty
+ *
  */
 
+#include <devfs.h>
+#include <module.h>
+#include <string.h>
+#include <vfs.h>
+
 #include <stdint.h>
 
-uint8_t init(void) {
+uint8_t zero_init(void);
+
+__attribute__((section(".driverinfo"), used))
+driver_info_t zero_driver_info = {
+	.name = "zero",
+	.connection_type = DEV_CONNECTION_DEV,
+	.init = zero_init,
+};
+
+static uint64_t zero_read(__attribute__((unused)) inode_t* inode, __attribute__((unused)) uint32_t offset, uint32_t size, uint8_t* buffer) {
+	memset(buffer, 0, size);
+	return FS_ERROR_SUCCESS;
+}
+
+static uint64_t null_read(__attribute__((unused)) inode_t* inode, __attribute__((unused)) uint32_t offset, __attribute__((unused)) uint32_t size, __attribute__((unused)) uint8_t* buffer) {
+	return FS_ERROR_END_OF_FILE;
+}
+
+static uint64_t zero_write(__attribute__((unused)) inode_t* inode, __attribute__((unused)) uint32_t offset, __attribute__((unused)) uint32_t size, __attribute__((unused)) uint8_t* buffer) {
+	return FS_ERROR_SUCCESS;
+}
+
+static devfs_node_t zero_node = {
+	.name = "zero",
+	.type = FS_CHARDEVICE,
+	.read = zero_read,
+	.write = zero_write,
+};
+
+static devfs_node_t null_node = {
+	.name = "null",
+	.type = FS_CHARDEVICE,
+	.read = null_read,
+	.write = zero_write,
+};
 
-	// file_create("/dev/zero");
+uint8_t zero_init(void) {
 
+	// Together, so a failure can not leave one of them behind
+	devfs_node_t* nodes[] = { &zero_node, &null_node };
+	if (devfs_register_nodes(nodes, 2) != FS_ERROR_SUCCESS) {
+		return 1;
+	}
 
-}
\ No newline at end of file
+	return 0;
+}
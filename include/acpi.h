@@ -1,7 +1,60 @@
+/*
+ * evan-os/include/acpi.h
+ *
+ * Declares ACPI table discovery. The XSDT (or RSDT on ACPI 1.0 systems)
+ * is walked once at boot, and the signature and address of every table
+ * it lists is kept in an index, so looking a table up later does not
+ * have to map and check each one again.
+ *
+ */
 
 #ifndef ACPI_H
 #define ACPI_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-#endif
\ No newline at end of file
+// The most tables kept in the index
+#define ACPI_TABLE_MAX 64
+
+// Build a signature from its 4 characters, e.g. ACPI_SIGNATURE('S', 'R', 'A', 'T')
+#define ACPI_SIGNATURE(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// Header at the start of every system description table
+typedef struct acpi_header_t {
+	char     signature[4];
+	uint32_t length; // Of the whole table, including this header
+	uint8_t  revision;
+	uint8_t  checksum;
+	char     oem_id[6];
+	char     oem_table_id[8];
+	uint32_t oem_revision;
+	uint32_t creator_id;
+	uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+typedef struct acpi_rsdp_t {
+	char     signature[8]; // "RSD PTR "
+	uint8_t  checksum;     // Of the first 20 bytes
+	char     oem_id[6];
+	uint8_t  revision;     // 0 for ACPI 1.0, which has no XSDT
+	uint32_t rsdt_address;
+	// ACPI 2.0 and later
+	uint32_t length;
+	uint64_t xsdt_address;
+	uint8_t  extended_checksum;
+	uint8_t  reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Tables in the index
+extern uint32_t acpi_table_count;
+
+// Find the tables from the pointer bootboot passes. Called by the bootstrap core before pmm_init.
+// Returns false if there is no valid root table
+bool acpi_init(void);
+
+// The index-th table (counting from 0) with a signature, or 0 if there are not that many.
+// Tables like the SSDT can appear more than once
+acpi_header_t* acpi_find_table(uint32_t signature, uint32_t index);
+
+#endif // ACPI_H
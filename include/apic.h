@@ -0,0 +1,66 @@
+/*
+ * evan-os/include/apic.h
+ *
+ * Declares the local APIC driver. Each core has its own local APIC, which
+ * delivers its interrupts and sends inter-processor interrupts (IPIs).
+ * x2APIC mode is used when supported, where the registers are MSRs,
+ * otherwise the registers are memory mapped.
+ *
+ */
+
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Register offsets, as in the memory mapped layout
+#define APIC_REG_ID          0x20
+#define APIC_REG_VERSION     0x30
+#define APIC_REG_TPR         0x80  // Task priority
+#define APIC_REG_EOI         0xB0
+#define APIC_REG_SPURIOUS    0xF0
+#define APIC_REG_ICR_LOW     0x300 // Interrupt command
+#define APIC_REG_ICR_HIGH    0x310
+#define APIC_REG_LVT_TIMER   0x320
+#define APIC_REG_LVT_LINT0   0x350
+#define APIC_REG_LVT_LINT1   0x360
+#define APIC_REG_LVT_ERROR   0x370
+#define APIC_REG_TIMER_INIT  0x380
+#define APIC_REG_TIMER_COUNT 0x390
+#define APIC_REG_TIMER_DIV   0x3E0
+
+#define APIC_LVT_MASKED   (1 << 16)
+#define APIC_LVT_PERIODIC (1 << 17) // Timer mode that reloads the initial count
+
+// Whether the local APICs run in x2APIC mode
+extern bool apic_x2apic;
+
+// Cores whose local APIC is enabled and can receive IPIs
+extern volatile uint64_t apic_online;
+
+// Timer ticks per second, measured against the PIT by the bootstrap core
+extern uint64_t apic_timer_frequency;
+// Time stamp counter ticks per second, measured along with the timer
+extern uint64_t tsc_frequency;
+
+// Enable this core's local APIC. Called by every core after paging_init
+void apic_init(void);
+
+uint32_t apic_read(uint32_t reg);
+void apic_write(uint32_t reg, uint32_t value);
+
+// Signal the end of an interrupt, needed by every handler except the spurious one
+void apic_eoi(void);
+
+// Send a fixed interrupt to one core, by its cpu id
+void apic_send_ipi(uint32_t cpu, uint8_t vector);
+
+// Interrupt this core hz times a second with vector, or stop its timer
+void apic_timer_periodic(uint8_t vector, uint32_t hz);
+void apic_timer_stop(void);
+
+// Interrupt this core once with vector after about us microseconds, replacing any timer it has
+void apic_timer_oneshot(uint8_t vector, uint64_t us);
+
+#endif // APIC_H
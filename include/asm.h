@@ -1,8 +1,9 @@
 /*
  * evan-os/src/asm.h
- * 
- * Defines functions that represent single assembly commands used by the OS and drivers
- * 
+ *
+ * Defines functions that represent single assembly commands used by the OS and drivers.
+ * They are always inlined, so using them costs no more than the instruction itself
+ *
  */
 
 #ifndef ASM_H
@@ -10,30 +11,227 @@
 
 #include <stdint.h>
 
+#define ASM_INLINE static inline __attribute__((always_inline))
+
 // Interrupts
 
-void sti(void); // Enable interrupts
-void cli(void); // Disable interrupts
+ASM_INLINE void sti(void) { // Enable interrupts
+	asm volatile ("sti" ::: "memory");
+}
+
+ASM_INLINE void cli(void) { // Disable interrupts
+	asm volatile ("cli" ::: "memory");
+}
+
+ASM_INLINE void hlt(void) { // Stop the computer until the next interrupt
+	asm volatile ("hlt" ::: "memory");
+}
+
+ASM_INLINE void sti_hlt(void) { // Enable interrupts and halt, with no window for an interrupt in between
+	asm volatile ("sti; hlt" ::: "memory");
+}
+
+// Monitor and mwait
+
+ASM_INLINE void monitor(const volatile void* address) { // Arm a wakeup on writes to the cache line holding address
+	asm volatile ("monitor" : : "a"(address), "c"(0), "d"(0) : "memory");
+}
+
+ASM_INLINE void sti_mwait(uint32_t hint) { // Enable interrupts and wait for the monitored line to be written, or an interrupt
+	asm volatile ("sti; mwait" : : "a"(hint), "c"(0) : "memory");
+}
+
+// Processor identification and timing
+
+ASM_INLINE void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+	asm volatile ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(subleaf));
+}
+
+ASM_INLINE uint64_t rdtsc(void) { // Read the time stamp counter
+	uint32_t low, high;
+	asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+
+	return ((uint64_t)high << 32) | low;
+}
+
+ASM_INLINE uint64_t rdtscp(uint32_t* aux) { // Read the time stamp counter after earlier instructions finish
+	uint32_t low, high;
+	asm volatile ("rdtscp" : "=a"(low), "=d"(high), "=c"(*aux));
+
+	return ((uint64_t)high << 32) | low;
+}
 
-void hlt(void); // Stop the computer
+ASM_INLINE void pause(void) { // Spin-wait loop hint
+	asm volatile ("pause" ::: "memory");
+}
+
+// Memory ordering
+
+ASM_INLINE void mfence(void) {
+	asm volatile ("mfence" ::: "memory");
+}
+
+ASM_INLINE void sfence(void) { // Orders non-temporal stores
+	asm volatile ("sfence" ::: "memory");
+}
 
 // Model Specific Register manupulation
 
-void     wrmsr(uint32_t msr_id, uint32_t low, uint32_t high);
-uint64_t rdmsr(uint32_t msr_id);
-uint32_t rdmsr_low(uint32_t msr_id);
-uint32_t rdmsr_high(uint32_t msr_id);
+ASM_INLINE void wrmsr(uint32_t msr_id, uint32_t low, uint32_t high) {
+	asm volatile ("wrmsr" : : "c"(msr_id), "a"(low), "d"(high) : "memory");
+}
+
+ASM_INLINE uint64_t rdmsr(uint32_t msr_id) {
+	uint32_t low, high;
+	asm volatile ("rdmsr" : "=a"(low), "=d"(high) : "c"(msr_id));
+
+	return ((uint64_t)high << 32) | low;
+}
+
+ASM_INLINE uint32_t rdmsr_low(uint32_t msr_id) {
+	return (uint32_t)rdmsr(msr_id);
+}
+
+ASM_INLINE uint32_t rdmsr_high(uint32_t msr_id) {
+	return (uint32_t)(rdmsr(msr_id) >> 32);
+}
+
+// Control registers and the TLB
+
+ASM_INLINE uint64_t read_cr0(void) {
+	uint64_t value;
+	asm volatile ("mov %%cr0, %0" : "=r"(value));
+	return value;
+}
+
+ASM_INLINE void write_cr0(uint64_t value) {
+	asm volatile ("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+ASM_INLINE uint64_t read_cr2(void) { // The address that caused the last page fault
+	uint64_t value;
+	asm volatile ("mov %%cr2, %0" : "=r"(value));
+	return value;
+}
+
+ASM_INLINE uint64_t read_cr3(void) {
+	uint64_t value;
+	asm volatile ("mov %%cr3, %0" : "=r"(value));
+	return value;
+}
+
+ASM_INLINE void write_cr3(uint64_t value) {
+	asm volatile ("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+ASM_INLINE uint64_t read_cr4(void) {
+	uint64_t value;
+	asm volatile ("mov %%cr4, %0" : "=r"(value));
+	return value;
+}
+
+ASM_INLINE void write_cr4(uint64_t value) {
+	asm volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+ASM_INLINE void clts(void) { // Clear the task switched flag, allowing FPU and SIMD instructions
+	asm volatile ("clts" ::: "memory");
+}
+
+// Extended control registers (XCR0 selects the state components saved by xsave)
+
+ASM_INLINE uint64_t xgetbv(uint32_t xcr) {
+	uint32_t low, high;
+	asm volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(xcr));
+
+	return ((uint64_t)high << 32) | low;
+}
+
+ASM_INLINE void xsetbv(uint32_t xcr, uint64_t value) {
+	asm volatile ("xsetbv" : : "c"(xcr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+ASM_INLINE void invlpg(void* address) { // Remove one page from the TLB
+	asm volatile ("invlpg (%0)" : : "r"(address) : "memory");
+}
+
+#define INVPCID_ADDRESS     0 // One address in one PCID
+#define INVPCID_CONTEXT     1 // Every non-global address in one PCID
+#define INVPCID_ALL_GLOBAL  2 // Every address in every PCID, including global pages
+#define INVPCID_ALL         3 // Every non-global address in every PCID
+
+ASM_INLINE void invpcid(uint64_t type, uint64_t pcid, void* address) {
+	struct {
+		uint64_t pcid;
+		void*    address;
+	} descriptor = { pcid, address };
+
+	asm volatile ("invpcid %0, %1" : : "m"(descriptor), "r"(type) : "memory");
+}
 
 // Output to io ports
 
-void outportb(uint16_t port, uint8_t data);
-void outportw(uint16_t port, uint16_t data);
-void outportl(uint16_t port, uint32_t data);
+ASM_INLINE void outportb(uint16_t port, uint8_t data) {
+	asm volatile ("outb %0, %1" : : "a"(data), "Nd"(port));
+}
+
+ASM_INLINE void outportw(uint16_t port, uint16_t data) {
+	asm volatile ("outw %0, %1" : : "a"(data), "Nd"(port));
+}
+
+ASM_INLINE void outportl(uint16_t port, uint32_t data) {
+	asm volatile ("outl %0, %1" : : "a"(data), "Nd"(port));
+}
 
 // Input through io ports
 
-uint8_t inportb(uint16_t port);
-uint16_t inportw(uint16_t port);
-uint32_t inportl(uint16_t port);
+ASM_INLINE uint8_t inportb(uint16_t port) {
+	uint8_t data;
+	asm volatile ("inb %1, %0" : "=a"(data) : "Nd"(port));
+	return data;
+}
+
+ASM_INLINE uint16_t inportw(uint16_t port) {
+	uint16_t data;
+	asm volatile ("inw %1, %0" : "=a"(data) : "Nd"(port));
+	return data;
+}
+
+ASM_INLINE uint32_t inportl(uint16_t port) {
+	uint32_t data;
+	asm volatile ("inl %1, %0" : "=a"(data) : "Nd"(port));
+	return data;
+}
+
+// Transfer count items between an io port and a buffer
+
+ASM_INLINE void outportsb(uint16_t port, const void* buffer, uint64_t count) {
+	asm volatile ("rep outsb" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+ASM_INLINE void outportsw(uint16_t port, const void* buffer, uint64_t count) {
+	asm volatile ("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+ASM_INLINE void outportsl(uint16_t port, const void* buffer, uint64_t count) {
+	asm volatile ("rep outsl" : "+S"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+ASM_INLINE void inportsb(uint16_t port, void* buffer, uint64_t count) {
+	asm volatile ("rep insb" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+ASM_INLINE void inportsw(uint16_t port, void* buffer, uint64_t count) {
+	asm volatile ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+ASM_INLINE void inportsl(uint16_t port, void* buffer, uint64_t count) {
+	asm volatile ("rep insl" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+// Wait about a microsecond by writing to an unused port, for slow devices like the PIC
+ASM_INLINE void io_wait(void) {
+	outportb(0x80, 0);
+}
 
-#endif
\ No newline at end of file
+#endif // ASM_H
@@ -0,0 +1,14 @@
+/*
+ * evan-os/include/benchmark.h
+ * 
+ * Declares the kernel benchmarks, which are only compiled in with `make BENCH=1`
+ * 
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+// Run every benchmark and print the results. Must be called by all cores
+void benchmark_run(void);
+
+#endif // BENCHMARK_H
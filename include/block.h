@@ -0,0 +1,158 @@
+/*
+ * evan-os/include/block.h
+ *
+ * Declares block devices and the block layer between them and their
+ * users. A disk driver registers a block_device_t with one or more
+ * hardware queues, each able to hold depth requests at once. A request
+ * describes its data as a scatter-gather list of physical segments, so
+ * drivers can point the device straight at the pages being read into,
+ * such as page cache frames, without copying.
+ *
+ * Every core has a software queue on each device, mapped to one of its
+ * hardware queues, where requests wait when the hardware queue is full.
+ * A core can also plug its submissions for a while: requests collect on
+ * the core until the plug is finished, and are then sorted, and adjacent
+ * ones merged into larger requests, before being handed to the device in
+ * one batch.
+ *
+ * Drivers report finished requests from their interrupt handlers, and
+ * the requests are completed afterwards in a softirq.
+ *
+ */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BLOCK_SECTOR_SIZE 512
+
+// The most physical segments in a request, enough for 256 KiB in separate pages
+#define BLOCK_SEGMENTS_MAX 64
+
+// Requests a plug holds before it is flushed anyway
+#define BLOCK_PLUG_MAX 32
+
+// Request statuses
+#define BLOCK_SUCCESS       0
+#define BLOCK_ERROR_IO      1 // The device reported an error
+#define BLOCK_ERROR_BUSY    2 // Returned by submit when the queue is full
+#define BLOCK_ERROR_RANGE   3 // Past the end of the device
+#define BLOCK_ERROR_SEGMENT 4 // Too many segments, or a segment the device can not address
+#define BLOCK_PENDING       0xff
+
+typedef struct block_device_t block_device_t;
+typedef struct block_request_t block_request_t;
+
+typedef void (*block_complete_t)(block_request_t* request);
+
+typedef struct block_segment_t {
+	uint64_t phys;
+	uint32_t length; // In bytes, a multiple of BLOCK_SECTOR_SIZE in total
+} block_segment_t;
+
+struct block_request_t {
+	block_device_t*  device;
+	uint64_t         sector;
+	uint32_t         sectors;
+	bool             write;
+
+	uint32_t         segment_count;
+	block_segment_t  segments[BLOCK_SEGMENTS_MAX];
+
+	block_complete_t complete; // Called once with status set, from a softirq or the submitting thread
+	void*            private_data;
+	volatile uint8_t status;
+
+	// Used by the block layer and the driver while the request is in flight
+	uint8_t          result;   // Status held until the completion softirq
+	uint32_t         queue;    // Hardware queue it was started on
+	block_request_t* merged;   // Requests merged into this one, chained through next
+	block_request_t* next;
+};
+
+// Requests one core is waiting to start on a hardware queue, oldest first
+typedef struct block_software_queue_t {
+	spinlock_t       lock;
+	block_request_t* waiting;
+	block_request_t* waiting_tail;
+} block_software_queue_t;
+
+struct block_device_t {
+	char     name[16];
+	uint64_t sectors;
+	uint32_t queues;       // Hardware queues
+	uint32_t depth;        // Requests each queue can hold
+	uint32_t sectors_max;  // Largest request merging can make, 0 for no limit
+	uint32_t segments_max; // Most segments the device takes in a request, 0 for BLOCK_SEGMENTS_MAX
+
+	// Start a request on a hardware queue. Returns BLOCK_ERROR_BUSY if the queue is full.
+	// last is false when more requests follow straight away, so telling the device can wait.
+	// The request must not be completed before it returns
+	uint8_t (*submit)(block_device_t* device, uint32_t queue, block_request_t* request, bool last);
+
+	// Tell the device about requests submitted with last false, when no more followed. Can be 0
+	void (*commit)(block_device_t* device, uint32_t queue);
+
+	// Find whatever has finished on a queue, for waiting without interrupts. Can be 0
+	void (*poll)(block_device_t* device, uint32_t queue);
+
+	// Turn the device's completion interrupts off, so completions are only found by poll. Can be 0
+	void (*set_polling)(block_device_t* device, bool polling);
+
+	void* driver_data;
+
+	// One for each core, core n using hardware queue n modulo queues
+	block_software_queue_t* software;
+	volatile uint32_t       waiting; // Requests in all of the software queues
+
+	// Counted by the block layer, shown in /proc/block
+	volatile uint64_t requests;   // Submitted by users
+	volatile uint64_t merges;     // Merged into an earlier request
+	volatile uint64_t dispatched; // Started on the device
+
+	struct buffer_cache_t* cache; // Made by the buffer cache when the device is first used through it
+
+	block_device_t* next;
+};
+
+// Every registered device
+extern block_device_t* block_devices;
+
+// Set up request completion and /proc/block. Called once by the bootstrap core
+void block_init(void);
+
+// Make a device available. Called by drivers once the device can take requests
+void block_register(block_device_t* device);
+
+// The device with a name, or 0
+block_device_t* block_find(const char* name);
+
+// Add a kernel buffer to a request's segments, splitting it where it is not physically contiguous.
+// Returns BLOCK_ERROR_SEGMENT if it does not fit
+uint8_t block_add_buffer(block_request_t* request, void* buffer, uint64_t length);
+
+// Start a request, or queue it until the device has room. Its complete function is called when done
+void block_submit(block_request_t* request);
+
+// Hold this core's submissions until the matching finish, then merge and start them together.
+// Plugs nest, and only the outermost finish starts the requests
+void block_start_plug(void);
+void block_finish_plug(void);
+
+// Wait for a request submitted without a complete function, flushing this core's plug first.
+// Returns its status
+uint8_t block_wait(block_request_t* request);
+
+// Called by drivers when a request finishes, from any context. The request is completed
+// in a softirq, straight away if not called from an interrupt, so no driver locks may be held
+void block_complete(block_request_t* request, uint8_t status);
+
+// Read or write sectors into a kernel buffer and wait for it. Returns a BLOCK_ status
+uint8_t block_read(block_device_t* device, uint64_t sector, uint32_t sectors, void* buffer);
+uint8_t block_write(block_device_t* device, uint64_t sector, uint32_t sectors, void* buffer);
+
+#endif // BLOCK_H
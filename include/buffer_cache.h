@@ -0,0 +1,84 @@
+/*
+ * evan-os/include/buffer_cache.h
+ *
+ * Declares the buffer cache, a page cache in front of each block device
+ * that filesystems read and write the device through. Writes only change
+ * the cached pages and mark them dirty before returning. Each device has
+ * a flusher, run from the idle loop of one core, which writes its dirty
+ * pages back in batches sorted by sector, neighbouring pages sharing a
+ * request. It runs once pages have been dirty for buffer_cache_dirty_age,
+ * or once more than buffer_cache_dirty_ratio of memory is dirty, and at
+ * twice that writers write back themselves. buffer_cache_sync writes a
+ * device's pages back straight away, for callers that need them on disk.
+ *
+ */
+
+#ifndef BUFFER_CACHE_H
+#define BUFFER_CACHE_H
+
+#include <block.h>
+#include <idle.h>
+#include <page_cache.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Dirty pages taken to write back at a time
+#define BUFFER_CACHE_BATCH 256
+
+// The tunables' starting values
+#define BUFFER_CACHE_DIRTY_AGE   5000 // Milliseconds
+#define BUFFER_CACHE_DIRTY_RATIO 10   // Percent of memory
+
+// A cache keeps at most this fraction of memory, dropping clean pages past it
+#define BUFFER_CACHE_MEMORY_SHARE 4
+
+typedef struct buffer_cache_t {
+	block_device_t*        device;
+	page_cache_t           pages;      // Indexed by byte offset on the device over PAGE_SIZE
+	uint32_t               pages_max;  // Most pages the device takes in one request
+
+	uint32_t               cpu;        // Whose idle loop the flusher runs in
+	idle_work_t            flusher;
+	volatile bool          queued;     // The flusher is waiting to run
+	volatile uint64_t      due;        // When the oldest dirty page is old enough to write back, or 0
+	spinlock_t             flush_lock; // Held while writing back, so syncs wait for writes already started
+	page_cache_entry_t*    batch;
+
+	// Shown in /proc/buffer_cache
+	volatile uint64_t      written;    // Pages written back
+	volatile uint64_t      requests;   // Requests they took
+	volatile uint64_t      flushes;    // Times the flusher ran
+
+	struct buffer_cache_t* next;
+} buffer_cache_t;
+
+// How long a page can stay dirty before its flusher writes it back, in milliseconds
+extern uint32_t buffer_cache_dirty_age;
+
+// The percentage of memory that can be dirty before flushers write back every dirty page
+extern uint32_t buffer_cache_dirty_ratio;
+
+// Dirty pages in every cache
+extern volatile uint64_t buffer_cache_dirty;
+
+// Set up the flushers' timer and /proc/buffer_cache. Called once by the bootstrap core
+void buffer_cache_init(void);
+
+// Copy bytes from a device at a byte offset. Returns a BLOCK_ status
+uint8_t buffer_cache_read(block_device_t* device, uint64_t offset, uint64_t length, void* buffer);
+
+// Copy bytes to a device at a byte offset, returning once the cached pages are changed.
+// Returns a BLOCK_ status, reporting read errors for partly written pages but never write errors
+uint8_t buffer_cache_write(block_device_t* device, uint64_t offset, uint64_t length, const void* buffer);
+
+// Write back every page of a device dirtied so far, and wait for them. Returns a BLOCK_ status
+uint8_t buffer_cache_sync(block_device_t* device);
+
+// Wake the running core's flushers whose pages have come of age, and set its timer for the rest
+// unless profiling has it. Called with interrupts disabled, from the timer interrupt, and by
+// the profiler on each of its ticks and once it lets the timer go
+void buffer_cache_tick(void);
+
+#endif // BUFFER_CACHE_H
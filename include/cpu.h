@@ -0,0 +1,87 @@
+/*
+ * evan-os/include/cpu.h
+ *
+ * Declares the processor feature table, filled in from CPUID once during boot.
+ * Checking a feature afterwards is a single bit test instead of a cpuid
+ * instruction (which traps to the hypervisor in virtual machines)
+ *
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Feature numbers for cpu_has
+#define CPU_FEATURE_FPU           0
+#define CPU_FEATURE_TSC           1
+#define CPU_FEATURE_MSR           2
+#define CPU_FEATURE_PAE           3
+#define CPU_FEATURE_APIC          4
+#define CPU_FEATURE_PGE           5  // Global pages
+#define CPU_FEATURE_PAT           6
+#define CPU_FEATURE_CLFLUSH       7
+#define CPU_FEATURE_FXSR          8  // fxsave and fxrstor
+#define CPU_FEATURE_SSE           9
+#define CPU_FEATURE_SSE2          10
+#define CPU_FEATURE_HTT           11
+#define CPU_FEATURE_SSE3          12
+#define CPU_FEATURE_MONITOR       13 // monitor and mwait
+#define CPU_FEATURE_SSSE3         14
+#define CPU_FEATURE_PCID          15
+#define CPU_FEATURE_SSE4_1        16
+#define CPU_FEATURE_SSE4_2        17
+#define CPU_FEATURE_X2APIC        18
+#define CPU_FEATURE_POPCNT        19
+#define CPU_FEATURE_TSC_DEADLINE  20
+#define CPU_FEATURE_XSAVE         21
+#define CPU_FEATURE_OSXSAVE       22
+#define CPU_FEATURE_AVX           23
+#define CPU_FEATURE_RDRAND        24
+#define CPU_FEATURE_HYPERVISOR    25
+#define CPU_FEATURE_FSGSBASE      26
+#define CPU_FEATURE_AVX2          27
+#define CPU_FEATURE_SMEP          28
+#define CPU_FEATURE_ERMS          29 // Enhanced rep movsb and stosb
+#define CPU_FEATURE_INVPCID       30
+#define CPU_FEATURE_AVX512F       31
+#define CPU_FEATURE_SMAP          32
+#define CPU_FEATURE_CLFLUSHOPT    33
+#define CPU_FEATURE_CLWB          34
+#define CPU_FEATURE_FSRM          35 // Fast short rep movsb
+#define CPU_FEATURE_XSAVEOPT      36
+#define CPU_FEATURE_XSAVEC        37
+#define CPU_FEATURE_XSAVES        38
+#define CPU_FEATURE_ARAT          39 // The local APIC timer keeps running in deep sleep states
+#define CPU_FEATURE_SYSCALL       40
+#define CPU_FEATURE_NX            41
+#define CPU_FEATURE_PAGE_1GB      42
+#define CPU_FEATURE_RDTSCP        43
+#define CPU_FEATURE_INVARIANT_TSC 44 // The TSC runs at a constant rate in every power state
+#define CPU_FEATURE_COUNT         45
+
+typedef struct cpu_info_t {
+	char     vendor[13];    // For example "GenuineIntel" or "AuthenticAMD"
+	uint32_t family;
+	uint32_t model;
+	uint32_t stepping;
+	uint32_t max_leaf;      // Highest basic cpuid leaf
+	uint32_t max_ext_leaf;  // Highest extended cpuid leaf
+	uint32_t clflush_size;  // Cache line size in bytes
+	uint32_t phys_bits;     // Physical address width
+	uint32_t virt_bits;     // Virtual address width
+	uint64_t features[(CPU_FEATURE_COUNT + 63) / 64];
+} cpu_info_t;
+
+extern cpu_info_t cpu_info;
+
+// Fill in the feature table. Every core calls it, the bootstrap core reads
+// cpuid and the other cores wait until the table is ready
+void cpu_features_init(void);
+
+static inline bool cpu_has(uint32_t feature) {
+	return (cpu_info.features[feature / 64] >> (feature % 64)) & 1;
+}
+
+#endif // CPU_H
@@ -0,0 +1,50 @@
+/*
+ * evan-os/include/devfs.h
+ *
+ * Declares the device filesystem, mounted at /dev. Drivers register a
+ * devfs_node_t for each device file, found by name through a hash table
+ * when opened. A node carries its own operations table holding its
+ * driver's callbacks, so reads and writes go from the VFS straight to
+ * the driver, with no page cache in between.
+ *
+ */
+
+#ifndef DEVFS_H
+#define DEVFS_H
+
+#include <vfs.h>
+
+#include <stdint.h>
+
+#define DEVFS_BUCKETS 64
+
+// Move size bytes at offset between the device and buffer. Returns an FS_ERROR code.
+// The node is found through inode->private_data
+typedef uint64_t (*devfs_transfer_t)(inode_t* inode, uint32_t offset, uint32_t size, uint8_t* buffer);
+
+typedef struct devfs_node_t {
+	// Filled in by the driver
+	char             name[46];
+	uint8_t          type;  // FS_CHARDEVICE or FS_BLOCKDEVICE
+	uint64_t         size;  // Bytes the device holds, or 0 for a stream read at any offset
+	devfs_transfer_t read;  // Either can be 0 if the device can not do it
+	devfs_transfer_t write;
+	void*            private_data; // Owned by the driver
+
+	// Filled in by devfs_register
+	inode_t              inode;      // Handed out by every open, since nodes are never freed
+	superblock_t         superblock; // Holds the driver's callbacks as its operations
+	struct devfs_node_t* next;
+} devfs_node_t;
+
+// Mount /dev. Called once by the bootstrap core
+void devfs_init(void);
+
+// Add a device file to /dev. The node must stay valid for as long as the kernel runs.
+// Returns an FS_ERROR code, FS_ERROR_FAILURE if the name is taken
+uint64_t devfs_register(devfs_node_t* node);
+
+// Add several device files to /dev at once, either all of them or, on an error, none
+uint64_t devfs_register_nodes(devfs_node_t** nodes, uint32_t count);
+
+#endif // DEVFS_H
@@ -0,0 +1,109 @@
+/*
+ * evan-os/include/elf.h
+ *
+ * ELF64 structures and constants, only as much as loading x86-64
+ * relocatable objects needs.
+ *
+ */
+
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+
+#define ELF_MAGIC 0x464c457f // "\x7fELF"
+
+#define ELF_CLASS_64      2
+#define ELF_DATA_LSB      1
+#define ELF_TYPE_REL      1
+#define ELF_MACHINE_X86_64 62
+
+// Section types
+#define ELF_SECTION_PROGBITS 1
+#define ELF_SECTION_SYMTAB   2
+#define ELF_SECTION_STRTAB   3
+#define ELF_SECTION_RELA     4
+#define ELF_SECTION_NOBITS   8
+
+// Section flags
+#define ELF_SECTION_WRITE 0x1
+#define ELF_SECTION_ALLOC 0x2
+#define ELF_SECTION_EXEC  0x4
+
+// Special section indexes
+#define ELF_SECTION_UNDEF  0
+#define ELF_SECTION_ABS    0xfff1
+#define ELF_SECTION_COMMON 0xfff2
+
+// Symbol bindings, from the top 4 bits of info
+#define ELF_SYMBOL_BIND(info) ((info) >> 4)
+#define ELF_BIND_LOCAL  0
+#define ELF_BIND_GLOBAL 1
+#define ELF_BIND_WEAK   2
+
+// x86-64 relocation types
+#define ELF_RELOC_TYPE(info)   ((uint32_t)(info))
+#define ELF_RELOC_SYMBOL(info) ((uint32_t)((info) >> 32))
+#define R_X86_64_NONE          0
+#define R_X86_64_64            1
+#define R_X86_64_PC32          2
+#define R_X86_64_PLT32         4
+#define R_X86_64_GOTPCREL      9
+#define R_X86_64_32            10
+#define R_X86_64_32S           11
+#define R_X86_64_PC64          24
+#define R_X86_64_GOTPCRELX     41
+#define R_X86_64_REX_GOTPCRELX 42
+
+typedef struct elf_header_t {
+	uint32_t magic;
+	uint8_t  class;
+	uint8_t  data;
+	uint8_t  ident_version;
+	uint8_t  abi;
+	uint8_t  abi_version;
+	uint8_t  padding[7];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint64_t entry;
+	uint64_t program_headers;   // File offset
+	uint64_t section_headers;   // File offset
+	uint32_t flags;
+	uint16_t header_size;
+	uint16_t program_header_size;
+	uint16_t program_header_count;
+	uint16_t section_header_size;
+	uint16_t section_header_count;
+	uint16_t section_names;     // Index of the section holding section names
+} __attribute__((packed)) elf_header_t;
+
+typedef struct elf_section_t {
+	uint32_t name;      // Offset into the section name table
+	uint32_t type;
+	uint64_t flags;
+	uint64_t address;
+	uint64_t offset;    // In the file
+	uint64_t size;
+	uint32_t link;
+	uint32_t info;
+	uint64_t alignment;
+	uint64_t entry_size;
+} __attribute__((packed)) elf_section_t;
+
+typedef struct elf_symbol_t {
+	uint32_t name;      // Offset into the symbol string table
+	uint8_t  info;
+	uint8_t  other;
+	uint16_t section;
+	uint64_t value;
+	uint64_t size;
+} __attribute__((packed)) elf_symbol_t;
+
+typedef struct elf_rela_t {
+	uint64_t offset;    // Into the section being relocated
+	uint64_t info;      // Symbol and type
+	int64_t  addend;
+} __attribute__((packed)) elf_rela_t;
+
+#endif // ELF_H
@@ -0,0 +1,30 @@
+/*
+ * evan-os/include/ext2.h
+ *
+ * Declares the ext2 filesystem. Group descriptors are kept in memory for
+ * as long as a volume is mounted, and the metadata blocks, such as inode
+ * tables, bitmaps, indirect blocks and directories, in a cache of their
+ * own. Both they and file data reach the disk through the buffer cache,
+ * which writes them back in the background.
+ *
+ */
+
+#ifndef EXT2_H
+#define EXT2_H
+
+#include <block.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Find an ext2 volume on a device: the whole device or an MBR partition.
+// Sets start to its first sector and returns true if there is one
+bool ext2_find(block_device_t* device, uint64_t* start);
+
+// Mount the ext2 volume starting at sector start of a device at path. Returns an FS_ERROR code
+uint64_t ext2_mount(block_device_t* device, uint64_t start, const char* path);
+
+// Mount the first ext2 volume found on any block device as the root. Called once by the bootstrap core
+void ext2_mount_root(void);
+
+#endif // EXT2_H
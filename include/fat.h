@@ -0,0 +1,30 @@
+/*
+ * evan-os/include/fat.h
+ *
+ * Declares the read only FAT filesystem, for FAT12, FAT16 and FAT32
+ * volumes on a block device. The FAT itself is kept in memory, read in
+ * pieces as it is first used, and each node caches its cluster chain as
+ * a list of contiguous runs, so reads at any offset find their clusters
+ * without following the chain and become one block request per run.
+ *
+ */
+
+#ifndef FAT_H
+#define FAT_H
+
+#include <block.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Find a FAT volume on a device: the whole device, an MBR partition, or an El Torito
+// boot image on a CD. Sets start to its first sector and returns true if there is one
+bool fat_find(block_device_t* device, uint64_t* start);
+
+// Mount the FAT volume starting at sector start of a device at path. Returns an FS_ERROR code
+uint64_t fat_mount(block_device_t* device, uint64_t start, const char* path);
+
+// Mount the first FAT volume found on any block device at /boot. Called once by the bootstrap core
+void fat_mount_boot(void);
+
+#endif // FAT_H
@@ -0,0 +1,69 @@
+/*
+ * evan-os/include/fpu.h
+ *
+ * Declares FPU, SSE and AVX state management.
+ *
+ * Each task owns an fpu_context_t, and its registers are only saved and
+ * restored when needed. Switching tasks sets CR0.TS, so the first FPU or
+ * SIMD instruction the new task runs traps (#NM) and loads its state.
+ * Tasks that never touch the FPU never pay for it, and a task that comes
+ * back to a core whose registers still hold its state skips the restore.
+ *
+ * The kernel itself is compiled with -mno-sse, so its code never touches
+ * these registers implicitly. Routines that want vector instructions
+ * must wrap them in kernel_fpu_begin and kernel_fpu_end.
+ *
+ */
+
+#ifndef FPU_H
+#define FPU_H
+
+#include <interrupt.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Save areas must be aligned to this many bytes
+#define FPU_AREA_ALIGN 64
+
+// How the registers are saved, from slowest to fastest
+#define FPU_SAVE_FXSAVE   0 // Only x87 and SSE
+#define FPU_SAVE_XSAVE    1
+#define FPU_SAVE_XSAVEOPT 2 // Skips components that were not modified since they were restored
+#define FPU_SAVE_XSAVES   3 // Also uses the compacted format, which makes the area smaller
+
+typedef struct fpu_context_t {
+	void*    area;     // Register save area, fpu_state_size bytes long
+	uint32_t last_cpu; // The core whose registers last held this state
+} fpu_context_t;
+
+// The size of a save area for the enabled state components
+extern uint32_t fpu_state_size;
+
+// The state components enabled in XCR0
+extern uint64_t fpu_xfeatures;
+
+extern uint32_t fpu_save_method;
+
+// Enable the FPU, SSE and (when supported) AVX on this core. Called after cpu_features_init
+void fpu_init(void);
+
+// Prepare a context holding the initial register state.
+// area must be fpu_state_size bytes, aligned to FPU_AREA_ALIGN
+void fpu_context_init(fpu_context_t* context, void* area);
+
+// Called when this core switches from prev to next. Either can be null for kernel only tasks
+void fpu_switch(fpu_context_t* prev, fpu_context_t* next);
+
+// Stop using a context, for example when its task exits
+void fpu_context_release(fpu_context_t* context);
+
+// Device not available (#NM) exception handler, loads the running task's state
+void fpu_trap(struct interrupt_frame* frame);
+
+// Allow the kernel to use FPU and SIMD instructions until kernel_fpu_end.
+// Interrupts are disabled in between, so the section should be short
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif // FPU_H
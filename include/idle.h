@@ -0,0 +1,49 @@
+/*
+ * evan-os/include/idle.h
+ *
+ * Declares the idle loop each core runs when it has nothing else to do.
+ * An idle core sleeps with mwait when the processor supports it, and hlt
+ * otherwise. Other cores hand it work through its run queue, and only
+ * send a wakeup IPI when it is not already monitoring the queue.
+ *
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Work for a core to run from its idle loop. Must stay valid until func is called
+typedef struct idle_work_t idle_work_t;
+
+struct idle_work_t {
+	void (*func)(void* arg);
+	void* arg;
+	idle_work_t* next;
+};
+
+// Whether idle cores sleep with mwait. Supported cores always do, the benchmarks clear it for comparison
+extern bool idle_mwait_enabled;
+
+// Wakeup IPIs sent, and those left out because the target was monitoring its run queue
+extern volatile uint64_t idle_ipis_sent;
+extern volatile uint64_t idle_ipis_skipped;
+
+// Set up the wakeup interrupt. Called by every core after apic_init
+void idle_init(void);
+
+// Queue work to run on a core, waking it if it sleeps
+void idle_queue_work(uint32_t cpu, idle_work_t* work);
+
+// The cycles a core has spent asleep, and how many times it went to sleep
+uint64_t idle_cycles(uint32_t cpu);
+uint64_t idle_sleeps(uint32_t cpu);
+
+// Print how much of its time each core has spent idle
+void idle_print_stats(void);
+
+// Run queued work, clear frames ahead of time, and sleep in between. Never returns
+__attribute__((noreturn)) void idle_run(void);
+
+#endif // IDLE_H
@@ -19,6 +19,26 @@
 #define INTERRUPT_TRAP_GATE 		0xf // 64 Bit trap gate (return to next instruction)
 // OR a gate type and type value together to make the type_attributes parameter for interrupt setting
 
+// Device IRQs 0 to INTERRUPT_IRQ_COUNT - 1 arrive at vectors from INTERRUPT_IRQ_BASE,
+// the same ones whether they come through the PIC or an IOAPIC
+#define INTERRUPT_IRQ_BASE  32
+#define INTERRUPT_IRQ_COUNT 24
+
+// Vectors handed out to MSI and MSI-X messages by interrupt_alloc_vector. Each core has its own
+// set, so the same vector can belong to a different device on every core. 0x80 is left out
+#define INTERRUPT_VECTOR_DYNAMIC       56
+#define INTERRUPT_VECTOR_DYNAMIC_END   0xf0 // Exclusive
+#define INTERRUPT_VECTOR_DYNAMIC_COUNT (INTERRUPT_VECTOR_DYNAMIC_END - INTERRUPT_VECTOR_DYNAMIC)
+
+// Vectors from here up are used by the kernel itself, and can not be registered by drivers
+#define INTERRUPT_VECTOR_KERNEL         0xf0
+#define INTERRUPT_VECTOR_TLB_SHOOTDOWN  0xf0
+#define INTERRUPT_VECTOR_WAKEUP         0xf1
+#define INTERRUPT_VECTOR_TIMER          0xf2 // Local APIC timer
+#define INTERRUPT_VECTOR_PATCH          0xf3 // Holds cores while static keys change code
+#define INTERRUPT_VECTOR_WRITEBACK      0xf4 // One shot local APIC timer for the buffer cache flushers
+#define INTERRUPT_VECTOR_SPURIOUS       0xff
+
 // The structure of information saved when exceptions or interrupts are tiggered
 // Holds information used to restore the state of the cpu from before the interrupt
 // This also allows the use of gcc's interrupt attribute
@@ -32,6 +52,9 @@ struct interrupt_frame {
 
 typedef void (*interrupt_handler_t) (void);
 
+// Handlers for allocated vectors are passed an argument, such as the queue the message is for
+typedef void (*interrupt_vector_handler_t) (void* arg);
+
 
 void interrupt_init(void);
 
@@ -47,9 +70,26 @@ void interrupt_unmask(uint8_t interrupt);
 
 void interrupt_load_table(void);
 
-// Set whether the OS will use the newer APIC or the old PIC for interrupts
+// Set whether the OS will use the newer APIC or the old PIC for interrupts.
+// The PIC is used instead if no IOAPIC is found
 void interrupt_set_mode(bool use_apic); 
 
+// Let an IRQ be sent to any core in cpus, a mask of cpu ids. It goes to one of them at a time,
+// chosen by the balancer if it is running. Returns false without IOAPICs, or if none of the
+// cores can take interrupts. A mask with a single core pins the IRQ to it
+bool interrupt_set_affinity(uint8_t irq, uint64_t cpus);
+uint64_t interrupt_get_affinity(uint8_t irq);
+
+// The core an IRQ is currently sent to, and moving it to another in its affinity mask
+uint32_t interrupt_get_target(uint8_t irq);
+bool interrupt_set_target(uint8_t irq, uint32_t cpu);
+
+// Claim a free vector on a core and send it to handler. Returns false if the core has none left
+bool interrupt_alloc_vector(uint32_t cpu, interrupt_vector_handler_t handler, void* arg, uint8_t* vector);
+
+// Release an allocated vector once no core can still be running its handler
+void interrupt_free_vector(uint32_t cpu, uint8_t vector);
+
 // Send an eoi to the PIC chips
 void interrupt_end_pic(uint8_t index);
 
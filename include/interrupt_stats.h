@@ -0,0 +1,56 @@
+/*
+ * evan-os/include/interrupt_stats.h
+ *
+ * Declares per-CPU interrupt statistics. Every interrupt handler counts
+ * itself and the cycles it ran for against its vector, in a histogram
+ * with power of 2 buckets. With tracking enabled, every section run with
+ * interrupts disabled through irq_save is timed the same way, and the
+ * longest one on each core is kept along with where it started.
+ *
+ * Interrupt handlers themselves run with interrupts disabled, but are
+ * counted as handler time instead. So are cli sections outside irq_save.
+ *
+ * The counts are shown in /proc/interrupts, and the histograms in
+ * /proc/interrupt_latency.
+ *
+ */
+
+#ifndef INTERRUPT_STATS_H
+#define INTERRUPT_STATS_H
+
+#include <stdint.h>
+
+// Bucket 0 counts everything under 2^(INTERRUPT_HISTOGRAM_SHIFT + 1) cycles, each bucket after
+// it covers twice the cycles of the last, and the last holds everything longer
+#define INTERRUPT_HISTOGRAM_BUCKETS 16
+#define INTERRUPT_HISTOGRAM_SHIFT   8
+
+typedef struct interrupt_stats_t {
+	uint64_t count[256];
+	uint64_t cycles[256];
+	uint32_t histogram[256][INTERRUPT_HISTOGRAM_BUCKETS];
+
+	uint64_t irq_off_start; // When the current section started, or 0
+	uint64_t irq_off_site;
+	uint64_t irq_off_count;
+	uint64_t irq_off_max;
+	uint64_t irq_off_max_site;
+	uint64_t irq_off_histogram[INTERRUPT_HISTOGRAM_BUCKETS];
+} interrupt_stats_t;
+
+// Allocate the running core's statistics. Called by every core after interrupt_init,
+// and the bootstrap core adds the /proc files
+void interrupt_stats_init(void);
+
+// Count an interrupt that started at start, a time stamp counter value.
+// Called at the end of every interrupt handler
+void interrupt_account(uint8_t vector, uint64_t start);
+
+// Start timing sections run with interrupts disabled. Called by every core after sti.
+// The bootstrap core waits for the others, then enables tracking on all of them
+void irq_off_tracking_start(void);
+
+// A core's statistics, or 0 before it called interrupt_stats_init
+interrupt_stats_t* interrupt_stats_cpu(uint32_t cpu);
+
+#endif // INTERRUPT_STATS_H
@@ -0,0 +1,42 @@
+/*
+ * evan-os/include/ioapic.h
+ *
+ * Declares the IOAPIC driver. IOAPICs take the place of the PIC chips,
+ * and send each device interrupt line (a global system interrupt, GSI)
+ * to any core's local APIC. They and the legacy IRQs they were wired
+ * differently from are described by the ACPI MADT.
+ *
+ * Destinations use physical mode, so only cores with an APIC id below
+ * 256 can be sent interrupts without interrupt remapping.
+ *
+ */
+
+#ifndef IOAPIC_H
+#define IOAPIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The most IOAPICs used
+#define IOAPIC_MAX 8
+
+// Find the IOAPICs and mask every line. Called once by the bootstrap core after acpi_init.
+// Returns false if there are none
+bool ioapic_init(void);
+
+// The GSI a legacy IRQ is connected to. Anything past the ISA IRQs is its own GSI
+uint32_t ioapic_irq_to_gsi(uint32_t irq);
+
+// The IRQ connected to a GSI, or -1 if an override moved its ISA IRQ elsewhere
+int32_t ioapic_gsi_to_irq(uint32_t gsi);
+
+// Send irq to vector on the core with apic_id, masked until ioapic_set_masked.
+// Returns false if no IOAPIC has the line
+bool ioapic_route(uint32_t irq, uint8_t vector, uint32_t apic_id);
+
+void ioapic_set_masked(uint32_t irq, bool masked);
+
+// Send irq to another core. Only the destination changes, so it can be done while the line is in use
+void ioapic_set_destination(uint32_t irq, uint32_t apic_id);
+
+#endif // IOAPIC_H
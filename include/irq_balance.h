@@ -0,0 +1,39 @@
+/*
+ * evan-os/include/irq_balance.h
+ *
+ * Declares the IRQ balancer. Every IRQ_BALANCE_INTERVAL_MS it looks at
+ * how many cycles each IRQ's handler used since the last pass, and moves
+ * the busy ones so the handler time is spread over the cores in their
+ * affinity masks. Quiet IRQs, and IRQs pinned to one core, are left
+ * where they are, so a driver can keep its interrupts next to the code
+ * consuming their data by setting the affinity itself.
+ *
+ * Passes are started by interrupts arriving, and run from the idle loop
+ * of the core that noticed the interval had passed.
+ *
+ */
+
+#ifndef IRQ_BALANCE_H
+#define IRQ_BALANCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IRQ_BALANCE_INTERVAL_MS 100
+
+// IRQs with fewer interrupts in an interval are not moved
+#define IRQ_BALANCE_MIN_INTERRUPTS 100
+
+// Off by default, since a single busy device is better served by one warm core
+extern bool irq_balance_enabled;
+
+// IRQs moved so far
+extern volatile uint64_t irq_balance_moves;
+
+// Called by interrupt_handler after every device interrupt, to start a pass when one is due
+void irq_balance_tick(void);
+
+// Balance the IRQs now. Returns how many were moved
+uint32_t irq_balance(void);
+
+#endif // IRQ_BALANCE_H
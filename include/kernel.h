@@ -21,6 +21,7 @@ void invalid_opcode_fault(struct interrupt_frame *frame);
 // Value printing
 void print_val(uint64_t value, uint8_t bits);
 void print_hex(uint64_t value);
+void print_dec(uint64_t value);
 
 // Number functions
 uint64_t octal_string_to_int(char* octal_string, uint64_t length);
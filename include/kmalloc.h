@@ -0,0 +1,22 @@
+/*
+ * evan-os/include/kmalloc.h
+ *
+ * Declares the kernel heap. Small allocations are carved out of pages
+ * dedicated to one size class, larger ones get whole pages of their own.
+ *
+ */
+
+#ifndef KMALLOC_H
+#define KMALLOC_H
+
+#include <stddef.h>
+
+// Returns 0 when out of memory. Allocations are aligned to their size class, up to 64 bytes
+void* kmalloc(size_t size);
+
+// Like kmalloc, but the memory is cleared
+void* kzalloc(size_t size);
+
+void kfree(void* pointer);
+
+#endif // KMALLOC_H
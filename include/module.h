@@ -1,10 +1,23 @@
 
-
+/*
+ * evan-os/include/module.h
+ *
+ * Declares driver modules. A module is a relocatable ELF object in the
+ * initrd, linked into the kernel half at runtime against the symbols the
+ * kernel and earlier modules export with EXPORT_SYMBOL. Its driver_info_t
+ * is kept in the .driverinfo section, which is read before loading to
+ * decide whether the module is needed at all.
+ *
+ * Modules are linked within 2 GiB of the kernel image, so they can be
+ * built with -mcmodel=kernel and call the kernel directly.
+ *
+ */
 
 #ifndef MODULE_H
 #define MODULE_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 // Device types and subtypes
 #define DEV_PICTURE				0x1
@@ -31,6 +44,8 @@
 #define DEV_CONNECTION_PCI			0x2 // PCI devices
 #define DEV_CONNECTION_USB			0x3 // USB devices
 
+#define PCI_ANY_ID 0xffff
+
 
 typedef struct driver_info_t {
 	char* name; // The divice's human readable name
@@ -40,8 +55,10 @@ typedef struct driver_info_t {
 	void * init; // Pointer to the device initialization function
 	union {
 		struct {
-			uint16_t vendor;
+			uint16_t vendor; // PCI_ANY_ID in both to match on class, or in device for any of the vendor's
 			uint16_t device;
+			void * probe; // Called for each device matched, see include/pci.h
+			uint32_t class_code; // Class, subclass and programming interface, one byte each
 
 		} pci; 
 		struct {
@@ -54,10 +71,80 @@ typedef struct driver_info_t {
 	} connection_data;
 } driver_info_t;
 
+// Error codes returned by module_load
+#define MODULE_SUCCESS          0
+#define MODULE_ERROR_FORMAT     1 // Not a relocatable x86-64 ELF file
+#define MODULE_ERROR_MEMORY     2
+#define MODULE_ERROR_SYMBOL     3 // Uses a symbol nothing exports
+#define MODULE_ERROR_RELOCATION 4 // Unsupported relocation, or the result does not fit
+#define MODULE_ERROR_NO_INFO    5 // No driver_info_t in .driverinfo
+#define MODULE_ERROR_INIT       6 // The driver's init returned an error
+
+// Buckets in the exported symbol hash table
+#define MODULE_SYMBOL_BUCKETS 512
+
+// Module states
+#define MODULE_UNLOADED     0
+#define MODULE_INITIALIZING 1 // Linked, and its driver's init is running
+#define MODULE_READY        2
+#define MODULE_FAILED       3 // Linking or init failed, with the error kept in error
+
+typedef struct kernel_symbol_t {
+	const char* name;
+	uint64_t    address;
+} kernel_symbol_t;
+
+// Make a function or variable usable by modules. Used at file scope after its definition
+#define EXPORT_SYMBOL(symbol) \
+	static const kernel_symbol_t export_##symbol __attribute__((section(".ksymtab"), used)) = { #symbol, (uint64_t)&symbol }
+
+typedef struct module_t module_t;
+
+struct module_t {
+	char           name[100]; // Path in the initrd
+	const uint8_t* file;
+	uint64_t       file_size;
+
+	// Copied from .driverinfo when the module is found, before it is loaded
+	uint16_t       connection_type;
+	uint16_t       pci_vendor;
+	uint16_t       pci_device;
+	uint32_t       pci_class;
+
+	driver_info_t* info;      // Once loaded
+	uint64_t       base;      // Where it was linked
+	uint64_t       size;
+	volatile uint8_t state;
+	uint8_t        error;     // Returned to every later module_load once it failed
+	uint8_t        (*receive)(uint64_t value); // The module's module_receive function, if it has one
+
+	module_t*      next;
+};
+
+// Every module found in the initrd
+extern module_t* module_list;
+
+// Add the kernel's exported symbols to the hash table and find the modules in the initrd.
+// Called once by the bootstrap core after kmalloc can be used
+void module_init(void);
+
+// Link a module and call its driver's init, only the first time. Later calls wait for that init
+// to finish and get its result. Returns a MODULE_ERROR code
+uint8_t module_load(module_t* module);
+
+// Load every module not waiting for a device on a bus to be found. Returns how many were loaded
+uint32_t module_load_boot(void);
+
+// The module with a driver or file name, or 0
+module_t* module_find(const char* name);
+
+// The address of an exported symbol, or 0
+uint64_t module_symbol_lookup(const char* name);
+
+// Call an exported function taking nothing and returning a uint8_t. Returns MODULE_ERROR_SYMBOL if there is none
 uint8_t module_call_function(char* function_name);
 
+// Pass a value to a loaded module's module_receive function. Returns MODULE_ERROR_SYMBOL if it has none
 uint8_t module_send_value(char* module, uint64_t value);
 
-uint8_t module_load(driver_info_t* driver);
-
 #endif // MODULE_H
@@ -0,0 +1,56 @@
+/*
+ * evan-os/include/msi.h
+ *
+ * Declares message signalled interrupts. Instead of asserting a shared
+ * interrupt line, an MSI device writes a message straight to one core's
+ * local APIC, naming a vector allocated on that core. MSI gives a device
+ * a single message. MSI-X gives it a table of them, so a device with a
+ * queue per core can interrupt each core about its own queue.
+ *
+ * Messages use physical destination mode, so only cores with an APIC id
+ * below 256 can be targeted.
+ *
+ */
+
+#ifndef MSI_H
+#define MSI_H
+
+#include <interrupt.h>
+#include <pci.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Message address of the local APICs, with the destination APIC id in bits 12 to 19
+#define MSI_ADDRESS_BASE 0xfee00000
+
+// An MSI-X table, and where each of its entries is sent
+typedef struct msix_t {
+	pci_device_t*      device;
+	uint16_t           capability;
+	volatile uint32_t* table;
+	uint32_t           entries;
+	uint32_t*          cpus;    // For each entry
+	uint8_t*           vectors; // 0 for entries not routed
+} msix_t;
+
+// Send a device's MSI message to a vector allocated on cpu, and turn off its INTx line.
+// Returns false if the device has no MSI capability or the core no free vector
+bool msi_enable(pci_device_t* device, uint32_t cpu, interrupt_vector_handler_t handler, void* arg);
+void msi_disable(pci_device_t* device);
+
+// Turn on a device's MSI-X table with every entry masked, and its INTx line off.
+// Returns 0 if the device has no MSI-X capability
+msix_t* msix_enable(pci_device_t* device);
+
+// Send an entry to a vector allocated on cpu and unmask it. An entry already routed
+// is moved, and its old vector freed. Returns false if the core has no free vector
+bool msix_route(msix_t* msix, uint32_t entry, uint32_t cpu, interrupt_vector_handler_t handler, void* arg);
+
+void msix_set_masked(msix_t* msix, uint32_t entry, bool masked);
+
+// Give queue q entry q, sent to core q modulo the number of cores, with args[q] passed to handler.
+// Returns how many queues were routed, stopping at the first that could not be
+uint32_t msix_route_queues(msix_t* msix, uint32_t queues, interrupt_vector_handler_t handler, void** args);
+
+#endif // MSI_H
@@ -0,0 +1,58 @@
+/*
+ * evan-os/include/numa.h
+ *
+ * Declares the NUMA topology, read from the ACPI SRAT and SLIT.
+ * Proximity domains are numbered as nodes 0 and up in the order the SRAT
+ * lists them. Without an SRAT, everything is on node 0.
+ *
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <percpu.h>
+
+#include <stdint.h>
+
+#define NUMA_MAX_NODES  8
+#define NUMA_MAX_RANGES 32
+
+// SLIT distances. A node is always 10 from itself
+#define NUMA_LOCAL_DISTANCE  10
+#define NUMA_REMOTE_DISTANCE 20 // Assumed between nodes when there is no SLIT
+
+// A physical memory range belonging to one node, in frames
+typedef struct numa_range_t {
+	uint64_t start;
+	uint64_t end;
+	uint32_t node;
+} numa_range_t;
+
+extern uint32_t numa_node_count;
+
+extern numa_range_t numa_ranges[NUMA_MAX_RANGES];
+extern uint32_t numa_range_count;
+
+// Every node sorted by distance from a node, starting with itself
+extern uint32_t numa_fallback[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+// The node of the running core
+DECLARE_PER_CPU(uint32_t, numa_node);
+
+// Read the SRAT and SLIT. Called by the bootstrap core after acpi_init and before pmm_init
+void numa_init(void);
+
+// Look up the running core's node. Called by every core
+void numa_cpu_init(void);
+
+static inline uint32_t numa_node(void) {
+	return this_cpu_read(numa_node);
+}
+
+// The node a physical address belongs to. Memory outside every SRAT range is on node 0
+uint32_t numa_node_of_frame(uint64_t frame);
+
+// The relative cost of node a reaching memory on node b
+uint32_t numa_distance(uint32_t a, uint32_t b);
+
+#endif // NUMA_H
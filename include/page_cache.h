@@ -0,0 +1,78 @@
+/*
+ * evan-os/include/page_cache.h
+ *
+ * Declares the page cache. Each file (or anything else backed by storage)
+ * owns a page_cache_t holding the pages of it that were read so far, and
+ * file mappings map those same frames instead of copying them. Pages
+ * changed in memory are marked dirty, along with when they were first
+ * changed, until whoever owns the cache takes them to write back.
+ *
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PAGE_CACHE_BUCKETS 64
+
+typedef struct page_cache_t page_cache_t;
+
+// Fill buffer with page index of the backing data. Returns 0 on success
+typedef uint64_t (*page_cache_read_t)(page_cache_t* cache, uint64_t index, void* buffer);
+
+typedef struct page_cache_entry_t {
+	uint64_t                   index;   // Offset into the backing data, in pages
+	uint64_t                   frame;
+	uint64_t                   dirtied; // Time stamp of its first change since it was written back, 0 while clean
+	struct page_cache_entry_t* next;
+} page_cache_entry_t;
+
+struct page_cache_t {
+	page_cache_read_t   read_page;
+	void*               owner;  // The file or device the data comes from
+	uint64_t            pages;  // Pages currently cached
+	uint64_t            dirty;  // Of those, the ones changed since they were written back
+	page_cache_entry_t* buckets[PAGE_CACHE_BUCKETS];
+	spinlock_t          lock;
+};
+
+void page_cache_init(page_cache_t* cache, page_cache_read_t read_page, void* owner);
+
+// The frame holding page index, read in first if it is not cached.
+// The caller gets a reference, dropped with pmm_page_put. Returns 0 if it could not be read
+uint64_t page_cache_get(page_cache_t* cache, uint64_t index);
+
+// Like page_cache_get, but a page that is not cached is zeroed instead of read in, for a caller
+// about to overwrite all of it
+uint64_t page_cache_get_new(page_cache_t* cache, uint64_t index);
+
+// The frame holding page index with a reference for the caller, or 0 if it is not cached
+uint64_t page_cache_peek(page_cache_t* cache, uint64_t index);
+
+// Add a frame the caller has filled as page index, for callers reading many pages at once.
+// Returns the cached frame with the caller's reference: frame itself, or the one another core
+// added first, in which case frame is dropped. Returns 0 if there is no memory for it
+uint64_t page_cache_add(page_cache_t* cache, uint64_t index, uint64_t frame);
+
+// Mark a cached page as changed. Returns true if it was clean
+bool page_cache_set_dirty(page_cache_t* cache, uint64_t index);
+
+// Take up to count dirty pages first changed at or before time stamp before, copying their entries
+// into pages and marking them clean, so changes made while they are written dirty them again.
+// Each frame comes with a reference for the caller. Returns the number taken
+uint64_t page_cache_take_dirty(page_cache_t* cache, uint64_t before, page_cache_entry_t* pages, uint64_t count);
+
+// The time stamp of the oldest dirty page, or 0 if every page is clean
+uint64_t page_cache_oldest_dirty(page_cache_t* cache);
+
+// Drop clean pages nobody else holds until at most target are cached
+void page_cache_shrink(page_cache_t* cache, uint64_t target);
+
+// Drop the cache's references to all of its pages. Pages still mapped stay until they are unmapped
+void page_cache_release(page_cache_t* cache);
+
+#endif // PAGE_CACHE_H
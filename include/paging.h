@@ -1,15 +1,136 @@
 /*
- * evan-os/include/paging.h 
- * 
+ * evan-os/include/paging.h
+ *
  * Delcares functions for manipulating memory paging structures
- * 
+ *
+ * Every address space shares the kernel half (the top level entries from
+ * 256 up), which holds the kernel image and a direct map of all physical
+ * memory at PHYS_MAP_BASE. The lower half belongs to the address space.
+ *
+ * Mappings the kernel adds to its half are global. Removing or changing a
+ * mapping shoots it down on other cores, see tlb.h.
+ *
+ * When the processor supports PCIDs, each core keeps a few recently used
+ * address spaces tagged in its TLB, so switching back to one of them does
+ * not have to flush anything.
+ *
  */
 
 #ifndef PAGING_H
 #define PAGING_H
 
+#include <spinlock.h>
 
+#include <stdint.h>
+#include <stdbool.h>
 
+#define PAGE_SIZE  4096
+#define PAGE_SHIFT 12
 
+// All physical memory is mapped here, in every address space
+#define PHYS_MAP_BASE 0xffff800000000000
 
-#endif // PAGINH_H
\ No newline at end of file
+// Addresses from here up are shared by every address space
+#define KERNEL_HALF_BASE 0xffff800000000000
+
+// Uncached mappings of device registers, from paging_map_mmio
+#define MMIO_BASE 0xffffc00000000000
+
+// Loaded modules, in the same 2 GiB as the kernel image and below bootboot's own mappings
+#define MODULE_BASE 0xffffffffc0000000
+#define MODULE_END  0xfffffffff8000000
+
+// Page table entry bits
+#define PAGE_PRESENT  (1ull << 0)
+#define PAGE_WRITE    (1ull << 1)
+#define PAGE_USER     (1ull << 2)
+#define PAGE_PWT      (1ull << 3) // Write through
+#define PAGE_PCD      (1ull << 4) // Cache disable
+#define PAGE_ACCESSED (1ull << 5)
+#define PAGE_DIRTY    (1ull << 6)
+#define PAGE_HUGE     (1ull << 7) // 2 MiB or 1 GiB page, in the upper levels
+#define PAGE_GLOBAL   (1ull << 8) // Kept in the TLB when CR3 changes
+#define PAGE_NX       (1ull << 63)
+
+#define PAGE_ADDRESS_MASK 0x000ffffffffff000
+
+// Error codes returned by paging_map
+#define PAGING_ERROR_NO_MEMORY 1 // No frame for a page table
+#define PAGING_ERROR_HUGE_PAGE 2 // The address is inside a 2 MiB or 1 GiB page
+#define PAGING_ERROR_CHANGED   3 // The entry was not what the caller expected
+
+typedef struct address_space_t {
+	uint64_t          pml4;    // Physical address of the top level table
+	uint64_t          id;      // Never reused, so PCID caches can not mix up address spaces
+	volatile uint64_t tlb_gen; // Increased whenever a mapping is removed or changed
+	volatile uint64_t cpus;    // Cores currently running in this address space
+	spinlock_t        lock;    // Serializes page table changes
+	struct vma_t*     vmas;    // Mapped regions, sorted by address. See vmm.h
+	rwlock_t          vma_lock;
+} address_space_t;
+
+struct tlb_batch_t;
+
+// The address space the kernel booted in
+extern address_space_t kernel_address_space;
+
+// Whether switches use PCIDs. Supported cores always do, the benchmarks clear it for comparison
+extern bool paging_pcid_enabled;
+
+// Where physical memory is mapped. Identity mapped until paging_init builds the direct map
+extern uint64_t phys_map_base;
+
+static inline void* phys_to_virt(uint64_t address) {
+	return (void*)(address + phys_map_base);
+}
+
+// Only valid for pointers into the direct map
+static inline uint64_t virt_to_phys(void* address) {
+	return (uint64_t)address - phys_map_base;
+}
+
+// Build the direct map, and enable global pages and PCIDs. Called by every core after pmm_init
+void paging_init(void);
+
+// Set up an empty address space sharing the kernel half. Returns false when out of memory
+bool paging_create(address_space_t* space);
+
+// Free the lower half page tables, but not the frames they map. No core may be running in it
+void paging_destroy(address_space_t* space);
+
+// Map one page, replacing any existing mapping. Returns 0 or a PAGING_ERROR code
+uint64_t paging_map(address_space_t* space, uint64_t virt, uint64_t phys, uint64_t flags);
+
+// Remove one page, returning the frame it mapped or 0 if it was not mapped
+uint64_t paging_unmap(address_space_t* space, uint64_t virt);
+
+// Remove one page and add it to a batch. The frame must not be reused until the batch is flushed
+uint64_t paging_unmap_batch(address_space_t* space, uint64_t virt, struct tlb_batch_t* batch);
+
+// The physical address virt maps to, or 0 if it is not mapped
+uint64_t paging_translate(address_space_t* space, uint64_t virt);
+
+// The page table entry for virt, or 0 if there is none
+uint64_t paging_entry(address_space_t* space, uint64_t virt);
+
+// Replace the entry for virt with new_entry, but only if it still holds old_entry.
+// Stale TLB entries are added to batch, or shot down right away if batch is 0.
+// Returns 0 or a PAGING_ERROR code
+uint64_t paging_replace(address_space_t* space, uint64_t virt, uint64_t old_entry, uint64_t new_entry, struct tlb_batch_t* batch);
+
+// Drop stale TLB entries for virt on every core after its mapping changed
+void paging_invalidate(address_space_t* space, uint64_t virt);
+
+// Drop this core's entries for a batch. gen is the address space's tlb_gen after the change
+void paging_flush_local(struct tlb_batch_t* batch, uint64_t gen);
+
+// Map device registers uncached into the kernel half, returning their address or 0
+void* paging_map_mmio(uint64_t phys, uint64_t size);
+
+// Run this core in another address space
+void paging_switch(address_space_t* space);
+
+// The address space this core is running in
+address_space_t* paging_current(void);
+
+#endif // PAGING_H
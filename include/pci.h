@@ -0,0 +1,136 @@
+/*
+ * evan-os/include/pci.h
+ *
+ * Declares PCI enumeration. Configuration space is read through the
+ * memory mapped ECAM windows listed in the ACPI MCFG table, or through
+ * the legacy 0xcf8/0xcfc ports on machines without one, which can only
+ * reach segment 0 and the first 256 bytes of each function.
+ *
+ * Found devices are matched to driver modules by vendor and device id,
+ * and each driver's probe is run once per device it drives. Probes for
+ * different devices run on different cores at the same time.
+ *
+ */
+
+#ifndef PCI_H
+#define PCI_H
+
+#include <idle.h>
+#include <module.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The most MCFG entries used
+#define PCI_ECAM_MAX 8
+
+// Buckets in the vendor and device id hash table, a power of 2
+#define PCI_DRIVER_HASH_BITS 6
+#define PCI_DRIVER_BUCKETS   (1 << PCI_DRIVER_HASH_BITS)
+
+// Configuration space registers
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_REVISION       0x08
+#define PCI_PROG_IF        0x09
+#define PCI_SUBCLASS       0x0a
+#define PCI_CLASS          0x0b
+#define PCI_HEADER_TYPE    0x0e
+#define PCI_BAR0           0x10
+#define PCI_SECONDARY_BUS  0x19 // Bridges only
+#define PCI_CAPABILITIES   0x34
+#define PCI_INTERRUPT_LINE 0x3c
+#define PCI_INTERRUPT_PIN  0x3d
+
+// Command register bits
+#define PCI_COMMAND_IO         (1 << 0)
+#define PCI_COMMAND_MEMORY     (1 << 1)
+#define PCI_COMMAND_MASTER     (1 << 2)
+#define PCI_COMMAND_INTX_OFF   (1 << 10)
+
+#define PCI_STATUS_CAPABILITIES (1 << 4)
+
+// Where a device is in its driver's probe
+#define PCI_PROBE_NONE    0 // No driver
+#define PCI_PROBE_QUEUED  1
+#define PCI_PROBE_RUNNING 2
+#define PCI_PROBE_DONE    3
+#define PCI_PROBE_FAILED  4
+
+typedef struct pci_device_t pci_device_t;
+
+struct pci_device_t {
+	uint16_t  segment;
+	uint8_t   bus;
+	uint8_t   slot;
+	uint8_t   function;
+
+	uint16_t  vendor;
+	uint16_t  device;
+	uint8_t   class_code;
+	uint8_t   subclass;
+	uint8_t   prog_if;
+	uint8_t   revision;
+	uint8_t   header_type;   // Without the multi-function bit
+	uint8_t   interrupt_line;
+	uint8_t   interrupt_pin; // 0 if the device has no INTx pin
+
+	module_t* driver;
+	void*     driver_data;   // For the driver's own use
+	void*     msi_route;     // Where its MSI message goes, see src/msi.c
+
+	idle_work_t   probe_work;
+	volatile uint8_t probe_state;
+
+	pci_device_t* next;
+};
+
+// A driver's probe function, from connection_data.pci.probe. Returns 0 if it took the device
+typedef uint8_t (*pci_probe_t)(pci_device_t* device);
+
+// Every function found, in the order they were found
+extern pci_device_t* pci_devices;
+extern uint32_t pci_device_count;
+
+// Whether configuration space goes through ECAM rather than the legacy ports
+extern bool pci_ecam_enabled;
+
+// Find the ECAM windows and every function on every bus. Called once by the bootstrap core after acpi_init
+void pci_init(void);
+
+// Load the driver module for each device found and run its probe, spreading the probes
+// over the cores. Returns once every probe has finished. Called by the bootstrap core after module_init
+void pci_probe_drivers(void);
+
+// The first device with a vendor and device id, starting after from (or at the start if from is 0)
+pci_device_t* pci_find_device(uint16_t vendor, uint16_t device, pci_device_t* from);
+
+// Configuration space accesses. Offsets must be aligned to the access size
+uint8_t  pci_read8(pci_device_t* device, uint16_t offset);
+uint16_t pci_read16(pci_device_t* device, uint16_t offset);
+uint32_t pci_read32(pci_device_t* device, uint16_t offset);
+void pci_write8(pci_device_t* device, uint16_t offset, uint8_t value);
+void pci_write16(pci_device_t* device, uint16_t offset, uint16_t value);
+void pci_write32(pci_device_t* device, uint16_t offset, uint32_t value);
+
+// Capability ids
+#define PCI_CAPABILITY_MSI    0x05
+#define PCI_CAPABILITY_VENDOR 0x09
+#define PCI_CAPABILITY_MSIX   0x11
+
+// The configuration space offset of a capability, or 0 if the device does not have it
+uint16_t pci_find_capability(pci_device_t* device, uint8_t id);
+
+// The next capability with an id after the one at offset from, for devices with several
+uint16_t pci_find_next_capability(pci_device_t* device, uint16_t from, uint8_t id);
+
+// Turn on memory and I/O decoding and bus mastering
+void pci_enable(pci_device_t* device);
+
+// The address of a memory BAR or the port of an I/O BAR, or 0 if it is unused.
+// size is set to the BAR's size if it is not 0. 64 bit BARs take two indexes
+uint64_t pci_bar(pci_device_t* device, uint8_t index, uint64_t* size);
+
+#endif // PCI_H
@@ -0,0 +1,77 @@
+/*
+ * evan-os/include/percpu.h
+ *
+ * Declares per-CPU variables. Every core gets its own copy of the
+ * .percpu section, and the GS base of each core holds the distance from
+ * the original section to that core's copy. A variable can then be
+ * accessed with a single GS-relative instruction using its link address.
+ *
+ */
+
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+
+// The most cores the kernel will bring up. Must match CPU_MAX in linker.ld
+#define CPU_MAX 64
+
+// Define or declare a per-CPU variable. Must be used at file scope,
+// since the accessors reference the variable by its symbol name
+#define DEFINE_PER_CPU(type, name) \
+	__attribute__((section(".percpu"))) __typeof__(type) percpu_##name
+#define DECLARE_PER_CPU(type, name) \
+	extern __typeof__(type) percpu_##name
+
+// Distance from the original .percpu section to the running core's copy
+DECLARE_PER_CPU(uint64_t, offset);
+// Index of the running core. The bootstrap core is always 0
+DECLARE_PER_CPU(uint32_t, cpu_id);
+// Local APIC id of the running core
+DECLARE_PER_CPU(uint32_t, apic_id);
+
+// The per-CPU offsets of every core, indexed by cpu id
+extern uint64_t percpu_offsets[CPU_MAX];
+
+// The number of cores that have set up their per-CPU area
+extern volatile uint32_t cpu_count;
+
+// Single instruction accesses to scalar per-CPU variables.
+// They can not be torn by an interrupt on the same core
+#define this_cpu_read(name) ({ \
+	__typeof__(percpu_##name) percpu_value__; \
+	asm volatile ("mov %%gs:percpu_" #name ", %0" : "=r"(percpu_value__)); \
+	percpu_value__; \
+})
+
+#define this_cpu_write(name, value) do { \
+	__typeof__(percpu_##name) percpu_value__ = (value); \
+	asm volatile ("mov %0, %%gs:percpu_" #name : : "r"(percpu_value__) : "memory"); \
+} while (0)
+
+#define this_cpu_add(name, value) do { \
+	__typeof__(percpu_##name) percpu_value__ = (value); \
+	asm volatile ("add %0, %%gs:percpu_" #name : : "r"(percpu_value__) : "memory", "cc"); \
+} while (0)
+
+#define this_cpu_inc(name) this_cpu_add(name, 1)
+
+// Pointers to per-CPU variables of any type
+#define per_cpu_ptr(name, cpu) \
+	((__typeof__(percpu_##name)*)((uintptr_t)&percpu_##name + percpu_offsets[(cpu)]))
+#define this_cpu_ptr(name) \
+	((__typeof__(percpu_##name)*)((uintptr_t)&percpu_##name + this_cpu_read(offset)))
+
+// The running core's copy of a per-CPU variable, usable as an lvalue
+#define this_cpu(name) (*this_cpu_ptr(name))
+#define per_cpu(name, cpu) (*per_cpu_ptr(name, cpu))
+
+// Create the running core's per-CPU area and point its GS base at it.
+// Must be called by every core after gdt_init, which clears the GS base
+void percpu_init(void);
+
+static inline uint32_t cpu_id(void) {
+	return this_cpu_read(cpu_id);
+}
+
+#endif // PERCPU_H
@@ -0,0 +1,65 @@
+/*
+ * evan-os/include/pmm.h
+ *
+ * Declares the physical page frame allocator.
+ * Free frames are tracked in a bitmap built from the bootboot memory map,
+ * with one bit per 4 KiB frame, next to a reference count for every frame.
+ * Frames are handed out as physical addresses, use phys_to_virt to access them.
+ *
+ * Allocations come from the running core's NUMA node when it has free
+ * memory, and from the nearest other nodes when it does not.
+ *
+ */
+
+#ifndef PMM_H
+#define PMM_H
+
+#include <numa.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Number of frames in the bitmap, and how many of them are free.
+// Frames held in the per-CPU caches and zero pools are not counted as free
+extern uint64_t pmm_total_frames;
+extern volatile uint64_t pmm_free_frames;
+
+// Build the bitmap from the memory map. Called once by the bootstrap core after numa_init
+void pmm_init(void);
+
+// Allocate one frame, or count physically contiguous frames. Returns 0 when out of memory.
+// The contents are not cleared
+uint64_t pmm_alloc_page(void);
+uint64_t pmm_alloc_pages(uint64_t count);
+
+// The same, but preferring memory on a given node instead of the running core's
+uint64_t pmm_alloc_page_node(uint32_t node);
+uint64_t pmm_alloc_pages_node(uint32_t node, uint64_t count);
+
+void pmm_free_page(uint64_t frame);
+void pmm_free_pages(uint64_t frame, uint64_t count);
+
+// Pre-zeroed frames, kept so demand-zero faults do not have to clear a page while they wait
+#define PMM_ZERO_POOL_SIZE 256
+
+// Frames waiting in each node's pool
+extern volatile uint32_t pmm_zero_count[NUMA_MAX_NODES];
+
+// Allocations served from the pool, and those that had to clear a frame themselves
+extern volatile uint64_t pmm_zero_hits;
+extern volatile uint64_t pmm_zero_misses;
+
+// Allocate one frame filled with zeroes, from the local node's pool when it has one. Returns 0 when out of memory
+uint64_t pmm_alloc_zeroed(void);
+
+// Clear a few frames into the local node's pool with non-temporal stores. Called from the idle loop.
+// Returns true if it cleared any, and there may be more to do
+bool pmm_zero_refill(void);
+
+// Reference counts for frames shared between mappings, such as copy-on-write pages.
+// Allocating a frame sets its count to 1, and dropping the last reference frees it
+void pmm_page_get(uint64_t frame);
+void pmm_page_put(uint64_t frame);
+uint32_t pmm_page_count(uint64_t frame);
+
+#endif // PMM_H
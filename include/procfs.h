@@ -0,0 +1,38 @@
+/*
+ * evan-os/include/procfs.h
+ *
+ * Declares the process filesystem, mounted at /proc. Its files hold no
+ * data of their own: opening one runs its show function, which prints
+ * the file's current contents into a buffer that reads are served from.
+ *
+ */
+
+#ifndef PROCFS_H
+#define PROCFS_H
+
+#include <stdint.h>
+
+#define PROCFS_FILES 16
+
+// The largest a file's contents can be. Anything printed past it is cut off
+#define PROCFS_BUFFER_SIZE (64 * 1024)
+
+typedef struct procfs_buffer_t {
+	char*    data;
+	uint64_t length;
+} procfs_buffer_t;
+
+typedef void (*procfs_show_t)(procfs_buffer_t* buffer);
+
+// Mount /proc. Called once by the bootstrap core
+void procfs_init(void);
+
+// Add a file to /proc. Returns an FS_ERROR code
+uint64_t procfs_register(const char* name, procfs_show_t show);
+
+// Append text to a file's contents. Numbers are right aligned to width characters
+void procfs_print(procfs_buffer_t* buffer, const char* string);
+void procfs_print_dec(procfs_buffer_t* buffer, uint64_t value, uint32_t width);
+void procfs_print_hex(procfs_buffer_t* buffer, uint64_t value);
+
+#endif // PROCFS_H
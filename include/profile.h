@@ -0,0 +1,37 @@
+/*
+ * evan-os/include/profile.h
+ *
+ * Declares the sampling profiler. Each core's local APIC timer interrupts
+ * it at a fixed rate, and the instruction it interrupted is recorded in a
+ * per-CPU buffer. The samples are printed over the serial port as folded
+ * stacks, one line per core and function, for flame graph tools.
+ *
+ * The timer is a normal interrupt, so code running with interrupts
+ * disabled is never sampled. Its time shows up in whatever runs next.
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Samples kept per core. Later samples are counted as dropped
+#define PROFILE_SAMPLES 16384
+
+// Start sampling the running core hz times a second. Called by every core to be profiled, after idle_init.
+// Returns false if there is no memory for the core's samples
+bool profile_start(uint32_t hz);
+
+// Stop sampling on every core, and wait until they have
+void profile_stop(void);
+
+// Whether the running core's local APIC timer is taken by sampling. Called with interrupts disabled
+bool profile_owns_timer(void);
+
+// Print the samples over the serial port between "PROFILE BEGIN" and "PROFILE END" lines,
+// as "cpu<n>;<function> <samples>". Called after profile_stop
+void profile_dump(void);
+
+#endif // PROFILE_H
@@ -0,0 +1,75 @@
+/*
+ * evan-os/include/rcu.h
+ *
+ * Declares the read-copy-update (RCU) synchronization mechanism.
+ * Readers of an RCU protected pointer never take locks or use atomic
+ * instructions, while writers publish a new version of the data and
+ * wait for every core to pass through a quiescent state before
+ * freeing the old version.
+ *
+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Callback queued by call_rcu, embedded in the structure being freed
+typedef struct rcu_head_t rcu_head_t;
+typedef void (*rcu_callback_t)(rcu_head_t* head);
+
+struct rcu_head_t {
+	rcu_head_t* next;
+	rcu_callback_t func;
+};
+
+// Prevent the compiler from moving memory accesses across this point
+#define rcu_barrier() asm volatile ("" ::: "memory")
+
+// Read-side critical sections. The kernel does not preempt code, so a core
+// can only pass a quiescent state outside of them and nothing has to be recorded.
+// Interrupt handlers, exception handlers, and syscalls are implicitly read-side sections.
+#define rcu_read_lock()   rcu_barrier()
+#define rcu_read_unlock() rcu_barrier()
+
+// Load an RCU protected pointer exactly once. x86 does not reorder
+// dependent loads, so a plain load is enough.
+#define rcu_dereference(p) (*(__typeof__(p) volatile *)&(p))
+
+// Publish a new version of an RCU protected pointer.
+// x86 does not reorder stores with other stores, so only the compiler needs a barrier
+#define rcu_assign_pointer(p, v) do { \
+	rcu_barrier(); \
+	*(__typeof__(p) volatile *)&(p) = (v); \
+} while (0)
+
+// Start tracking the calling core. Must be called by every core after percpu_init, before
+// it uses RCU and before any core waits for a grace period it should take part in
+void rcu_cpu_online(void);
+
+// Report that the calling core holds no references to RCU protected data
+// Called from the idle loop, and later on context switches and returns to user mode
+void rcu_quiescent_state(void);
+
+// Leave grace periods out of waiting for the calling core while it sleeps in the idle loop.
+// Returns false without entering idle if the core has callbacks waiting, which would never run
+bool rcu_idle_enter(void);
+
+// Take part in grace periods again after waking. Must be called before any read-side section
+void rcu_idle_exit(void);
+
+// Called on entry to and exit from every interrupt handler that can run kernel code. An
+// interrupt taken while the core sleeps makes it take part in grace periods until it returns
+void rcu_irq_enter(void);
+void rcu_irq_exit(void);
+
+// Wait until every core that was online has passed through a quiescent state.
+// Reports a quiescent state for the calling core, so it must not be called
+// while the caller still uses a pointer loaded with rcu_dereference
+void synchronize_rcu(void);
+
+// Run func(head) on the calling core once a grace period has passed, without waiting
+void call_rcu(rcu_head_t* head, rcu_callback_t func);
+
+#endif // RCU_H
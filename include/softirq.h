@@ -0,0 +1,39 @@
+/*
+ * evan-os/include/softirq.h
+ *
+ * Declares softirqs, work raised by an interrupt handler to run once the
+ * handler is done and has sent its EOI. Device handlers only take what
+ * finished off the hardware and raise a softirq, and the slower part,
+ * such as completing block requests, runs after every nested handler on
+ * the core has returned. Softirqs raised outside interrupts run at once.
+ *
+ * Softirqs run on the core that raised them, one at a time, with
+ * interrupts in whatever state the core was in.
+ *
+ */
+
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SOFTIRQ_BLOCK 0 // Block request completions
+#define SOFTIRQ_COUNT 1
+
+typedef void (*softirq_handler_t)(void);
+
+void softirq_register(uint32_t number, softirq_handler_t handler);
+
+// Mark a softirq pending on the running core, running it now unless in an interrupt or softirq
+void softirq_raise(uint32_t number);
+
+// Called on entry to and exit from device interrupt handlers. Exiting the
+// outermost one runs the pending softirqs
+void irq_enter(void);
+void irq_exit(void);
+
+// Whether the core is in an interrupt handler or running softirqs
+bool in_interrupt(void);
+
+#endif // SOFTIRQ_H
@@ -0,0 +1,302 @@
+/*
+ * evan-os/include/spinlock.h
+ *
+ * Spinning locks for protecting data shared between cores.
+ *
+ * Ticket spinlocks are small and fair, and best for short sections with
+ * little contention. MCS locks make each waiting core spin on its own
+ * cache line, so they keep scaling when many cores fight over one lock.
+ * Reader-writer locks let any number of readers in at once, and queue
+ * contending cores on a ticket lock so writers can not be starved.
+ *
+ * The _irqsave variants also disable interrupts on the running core, and
+ * must be used for any lock that is also taken by an interrupt handler.
+ *
+ */
+
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <asm.h>
+#include <static_key.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RFLAGS_IF 0x200 // Interrupt enable flag
+
+// The address of the code using it. Evaluated in the caller, since the helpers below may or
+// may not be inlined, which leaves __builtin_return_address pointing one frame off either way
+#define _THIS_IP_ ({ uint64_t ip; asm volatile ("lea 0(%%rip), %0" : "=r"(ip)); ip; })
+
+// Enabled while the time interrupts stay disabled is measured, see include/interrupt_stats.h
+extern static_key_t irq_off_key;
+void irq_off_begin(uint64_t site);
+void irq_off_end(void);
+
+// irq_save, recording site as where interrupts were disabled
+static inline uint64_t irq_save_site(uint64_t site) {
+	uint64_t flags;
+	asm volatile ("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+
+	if (static_branch(irq_off_key) && (flags & RFLAGS_IF)) {
+		irq_off_begin(site);
+	}
+
+	return flags;
+}
+
+// Disable interrupts on this core, and return the flags needed to restore them
+#define irq_save() irq_save_site(_THIS_IP_)
+
+// Enable interrupts again if they were enabled before the matching irq_save
+static inline void irq_restore(uint64_t flags) {
+	if (flags & RFLAGS_IF) {
+		if (static_branch(irq_off_key)) {
+			irq_off_end();
+		}
+		asm volatile ("sti" ::: "memory");
+	}
+}
+
+// Ticket spinlocks
+
+typedef struct spinlock_t {
+	volatile uint16_t owner; // The ticket currently holding the lock
+	volatile uint16_t next;  // The next ticket to hand out
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock_init(spinlock_t* lock) {
+	lock->owner = 0;
+	lock->next = 0;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+	uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_ACQUIRE);
+
+	while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+		pause();
+	}
+}
+
+static inline bool spin_trylock(spinlock_t* lock) {
+	uint16_t owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+	uint16_t expected = owner;
+
+	// Only take a ticket if it would be served right away
+	return __atomic_compare_exchange_n(&lock->next, &expected, (uint16_t)(owner + 1), false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+	// Only the holder writes owner, so this does not need a locked instruction
+	__atomic_store_n(&lock->owner, (uint16_t)(lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+static inline bool spin_is_locked(spinlock_t* lock) {
+	return lock->owner != lock->next;
+}
+
+static inline uint64_t spin_lock_irqsave_site(spinlock_t* lock, uint64_t site) {
+	uint64_t flags = irq_save_site(site);
+	spin_lock(lock);
+
+	return flags;
+}
+
+#define spin_lock_irqsave(lock) spin_lock_irqsave_site((lock), _THIS_IP_)
+
+static inline void spin_unlock_irqrestore(spinlock_t* lock, uint64_t flags) {
+	spin_unlock(lock);
+	irq_restore(flags);
+}
+
+// MCS queue spinlocks.
+// Every waiter brings its own queue node (usually on its stack), which
+// must stay valid until the matching unlock
+
+typedef struct mcs_node_t mcs_node_t;
+
+struct mcs_node_t {
+	mcs_node_t* volatile next;
+	volatile bool locked; // Set by the previous holder when it hands over the lock
+} __attribute__((aligned(64)));
+
+typedef struct mcs_lock_t {
+	mcs_node_t* volatile tail; // The last core in the queue, or null when unlocked
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT { 0 }
+
+static inline void mcs_lock(mcs_lock_t* lock, mcs_node_t* node) {
+	node->next = 0;
+	node->locked = false;
+
+	mcs_node_t* previous = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+
+	// Queue behind the previous holder, and spin on this node until it hands over the lock
+	if (previous != 0) {
+		__atomic_store_n(&previous->next, node, __ATOMIC_RELEASE);
+
+		while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+			pause();
+		}
+	}
+}
+
+static inline bool mcs_trylock(mcs_lock_t* lock, mcs_node_t* node) {
+	mcs_node_t* expected = 0;
+	node->next = 0;
+	node->locked = false;
+
+	return __atomic_compare_exchange_n(&lock->tail, &expected, node, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void mcs_unlock(mcs_lock_t* lock, mcs_node_t* node) {
+	mcs_node_t* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+	if (next == 0) {
+		// Nobody is queued, so try to release the lock completely
+		mcs_node_t* expected = node;
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return;
+		}
+
+		// Another core is between swapping the tail and linking itself in
+		while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == 0) {
+			pause();
+		}
+	}
+
+	__atomic_store_n(&next->locked, true, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t mcs_lock_irqsave_site(mcs_lock_t* lock, mcs_node_t* node, uint64_t site) {
+	uint64_t flags = irq_save_site(site);
+	mcs_lock(lock, node);
+
+	return flags;
+}
+
+#define mcs_lock_irqsave(lock, node) mcs_lock_irqsave_site((lock), (node), _THIS_IP_)
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t* lock, mcs_node_t* node, uint64_t flags) {
+	mcs_unlock(lock, node);
+	irq_restore(flags);
+}
+
+// Queued reader-writer locks.
+// The low byte of value is set while a writer holds the lock, the next bit while
+// a writer is waiting for the readers to leave, and the rest counts readers
+
+#define RWLOCK_WRITER_LOCKED  0x0ff
+#define RWLOCK_WRITER_WAITING 0x100
+#define RWLOCK_WRITER_MASK    0x1ff
+#define RWLOCK_READER         0x200
+
+typedef struct rwlock_t {
+	volatile uint32_t value;
+	spinlock_t wait; // Queue for contending readers and writers
+} rwlock_t;
+
+#define RWLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline void rwlock_init(rwlock_t* lock) {
+	lock->value = 0;
+	spin_lock_init(&lock->wait);
+}
+
+static inline void read_lock(rwlock_t* lock) {
+
+	// Fast path, no writer holds or wants the lock
+	uint32_t value = __atomic_add_fetch(&lock->value, RWLOCK_READER, __ATOMIC_ACQUIRE);
+	if ((value & RWLOCK_WRITER_MASK) == 0) {
+		return;
+	}
+
+	// Back out and wait in line behind the writer
+	__atomic_sub_fetch(&lock->value, RWLOCK_READER, __ATOMIC_RELAXED);
+
+	spin_lock(&lock->wait);
+	__atomic_add_fetch(&lock->value, RWLOCK_READER, __ATOMIC_ACQUIRE);
+
+	while ((__atomic_load_n(&lock->value, __ATOMIC_ACQUIRE) & RWLOCK_WRITER_LOCKED) != 0) {
+		pause();
+	}
+
+	spin_unlock(&lock->wait);
+}
+
+// Take the lock for reading only if no writer holds or wants it
+static inline bool read_trylock(rwlock_t* lock) {
+
+	uint32_t value = __atomic_add_fetch(&lock->value, RWLOCK_READER, __ATOMIC_ACQUIRE);
+	if ((value & RWLOCK_WRITER_MASK) == 0) {
+		return true;
+	}
+
+	__atomic_sub_fetch(&lock->value, RWLOCK_READER, __ATOMIC_RELAXED);
+	return false;
+}
+
+static inline void read_unlock(rwlock_t* lock) {
+	__atomic_sub_fetch(&lock->value, RWLOCK_READER, __ATOMIC_RELEASE);
+}
+
+static inline void write_lock(rwlock_t* lock) {
+
+	spin_lock(&lock->wait);
+
+	// Fast path, the lock is completely free
+	uint32_t expected = 0;
+	if (!__atomic_compare_exchange_n(&lock->value, &expected, RWLOCK_WRITER_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+
+		// Stop new readers from getting in, then wait for the current ones to leave
+		__atomic_fetch_or(&lock->value, RWLOCK_WRITER_WAITING, __ATOMIC_RELAXED);
+
+		while (1) {
+			expected = RWLOCK_WRITER_WAITING;
+			if (__atomic_compare_exchange_n(&lock->value, &expected, RWLOCK_WRITER_LOCKED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+				break;
+			}
+			pause();
+		}
+	}
+
+	spin_unlock(&lock->wait);
+}
+
+static inline void write_unlock(rwlock_t* lock) {
+	__atomic_sub_fetch(&lock->value, RWLOCK_WRITER_LOCKED, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t read_lock_irqsave_site(rwlock_t* lock, uint64_t site) {
+	uint64_t flags = irq_save_site(site);
+	read_lock(lock);
+
+	return flags;
+}
+
+#define read_lock_irqsave(lock) read_lock_irqsave_site((lock), _THIS_IP_)
+
+static inline void read_unlock_irqrestore(rwlock_t* lock, uint64_t flags) {
+	read_unlock(lock);
+	irq_restore(flags);
+}
+
+static inline uint64_t write_lock_irqsave_site(rwlock_t* lock, uint64_t site) {
+	uint64_t flags = irq_save_site(site);
+	write_lock(lock);
+
+	return flags;
+}
+
+#define write_lock_irqsave(lock) write_lock_irqsave_site((lock), _THIS_IP_)
+
+static inline void write_unlock_irqrestore(rwlock_t* lock, uint64_t flags) {
+	write_unlock(lock);
+	irq_restore(flags);
+}
+
+#endif // SPINLOCK_H
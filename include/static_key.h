@@ -0,0 +1,53 @@
+/*
+ * evan-os/include/static_key.h
+ *
+ * Declares static keys, branches that cost a single nop while their key
+ * is disabled. Each use of static_branch() leaves a 5 byte nop in the
+ * code and records its address in the .static_keys section. Enabling the
+ * key rewrites every one of its nops into a jmp to the branch's body.
+ *
+ */
+
+#ifndef STATIC_KEY_H
+#define STATIC_KEY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct static_key_t {
+	volatile bool enabled;
+} static_key_t;
+
+// A branch site, generated by static_branch()
+typedef struct static_key_entry_t {
+	uint64_t      site;   // The 5 byte nop
+	uint64_t      target; // Where it jumps to when the key is enabled
+	static_key_t* key;
+} static_key_entry_t;
+
+// True while key is enabled. key must be a static_key_t named directly, not a pointer,
+// since its symbol is placed in the entry by the assembler
+#define static_branch(key) ({ \
+	__label__ static_branch_yes, static_branch_done; \
+	bool static_branch_taken = false; \
+	asm goto ("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n" \
+		".pushsection .static_keys, \"aw\"\n" \
+		".balign 8\n" \
+		".quad 1b, %l[static_branch_yes], " #key "\n" \
+		".popsection" : : : : static_branch_yes); \
+	goto static_branch_done; \
+static_branch_yes: \
+	static_branch_taken = true; \
+static_branch_done: \
+	static_branch_taken; \
+})
+
+// Install the interrupt used to stop other cores while code is patched. Called by every core after apic_init
+void static_key_init(void);
+
+// Patch every branch on key. Other cores are held in an interrupt handler while their code changes,
+// so this must not be called while holding a spinlock or with interrupts disabled
+void static_key_enable(static_key_t* key);
+void static_key_disable(static_key_t* key);
+
+#endif // STATIC_KEY_H
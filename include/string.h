@@ -0,0 +1,45 @@
+/*
+ * evan-os/include/string.h
+ *
+ * Declares the kernel's memory copying and filling routines.
+ * gcc also emits calls to memcpy, memmove and memset for struct copies
+ * and initializers, so these are used even where they are not called by name
+ *
+ */
+
+#ifndef STRING_H
+#define STRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Copies at least this large bypass the cache with non-temporal stores,
+// since they would evict more useful data than they could reuse
+#define STRING_NT_THRESHOLD (512 * 1024)
+
+// Pick the fastest variants for this processor. Called after cpu_features_init
+void string_init(void);
+
+void* memcpy(void* dest, const void* src, size_t n);
+void* memmove(void* dest, const void* src, size_t n);
+void* memset(void* dest, int value, size_t n);
+int   memcmp(const void* a, const void* b, size_t n);
+
+size_t strlen(const char* s);
+int    strcmp(const char* a, const char* b);
+int    strncmp(const char* a, const char* b, size_t n);
+
+// Zero or copy a page with non-temporal stores, for pages that will not be read again soon
+void clear_page(void* page);
+void copy_page(void* dest, const void* src);
+
+// The individual variants, selected between by string_init
+void* memcpy_erms(void* dest, const void* src, size_t n);     // rep movsb
+void* memcpy_unrolled(void* dest, const void* src, size_t n); // 64 bytes per loop
+void* memcpy_nt(void* dest, const void* src, size_t n);       // Non-temporal stores
+
+void* memset_erms(void* dest, int value, size_t n);     // rep stosb
+void* memset_unrolled(void* dest, int value, size_t n); // 64 bytes per loop
+void* memset_nt(void* dest, int value, size_t n);       // Non-temporal stores
+
+#endif // STRING_H
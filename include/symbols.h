@@ -0,0 +1,31 @@
+/*
+ * evan-os/include/symbols.h
+ *
+ * Declares the kernel symbol table, for turning code addresses back into
+ * function names. The table is generated from the linked kernel by
+ * tools/symbols.sh and linked in on a second pass, see the Makefile.
+ *
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+typedef struct symbol_t {
+	uint64_t address;
+	uint32_t name; // Offset into symbol_names
+} symbol_t;
+
+// Every function in the kernel, sorted by address
+extern const uint64_t symbol_count;
+extern const symbol_t symbol_table[];
+extern const char symbol_names[];
+
+// The index of the function containing address, or -1 if it is outside the kernel's code
+int64_t symbol_find(uint64_t address);
+
+// The name of the function containing address, or 0. offset is set to the distance from its start
+const char* symbol_lookup(uint64_t address, uint64_t* offset);
+
+#endif // SYMBOLS_H
@@ -0,0 +1,67 @@
+/*
+ * evan-os/include/tlb.h
+ *
+ * Declares TLB shootdowns. After a mapping is removed or changed, every
+ * core that may still have the old translation cached has to drop it.
+ * Only cores currently running in the address space are interrupted,
+ * the others catch up through tlb_gen when they switch back to it.
+ * Changes to the kernel half reach every core, since it is shared.
+ *
+ * Unmaps can be gathered in a tlb_batch_t and flushed together, which
+ * costs one round of IPIs instead of one per page.
+ *
+ */
+
+#ifndef TLB_H
+#define TLB_H
+
+#include <paging.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Above this many pages, flushing everything is cheaper than invlpg on each one
+#define TLB_FLUSH_THRESHOLD 33
+
+// Runs of pages a batch can hold before it gives up and flushes everything
+#define TLB_BATCH_RANGES 8
+
+typedef struct tlb_range_t {
+	uint64_t start;
+	uint64_t pages;
+} tlb_range_t;
+
+typedef struct tlb_batch_t {
+	address_space_t* space;
+	tlb_range_t      ranges[TLB_BATCH_RANGES];
+	uint32_t         count;  // Ranges in use
+	uint64_t         pages;  // Pages across all ranges
+	bool             full;   // Flush everything instead of the ranges
+	bool             global; // Holds kernel half addresses, so every core is affected
+} tlb_batch_t;
+
+// Cores taking part in shootdowns, the ones that have enabled interrupts and so answer the IPIs
+extern volatile uint64_t tlb_online;
+
+// Install the shootdown interrupt handler. Called by every core after apic_init
+void tlb_init(void);
+
+// Start taking part in shootdowns, flushing everything that changed before this core was
+// targeted. Called by every core straight after it enables interrupts
+void tlb_cpu_online(void);
+
+void tlb_batch_init(tlb_batch_t* batch, address_space_t* space);
+
+// Add a page whose mapping was changed. Does not flush anything yet
+void tlb_batch_add(tlb_batch_t* batch, uint64_t virt);
+
+// Flush the batch on this core and every affected core, and wait until they all have.
+// The batch is empty again afterwards. Must not be called while holding a spinlock, since a
+// core spinning on it with interrupts disabled would never answer
+void tlb_batch_flush(tlb_batch_t* batch);
+
+// Handle shootdowns sent to this core. Cores waiting with interrupts disabled call this,
+// so two cores shooting at each other can not deadlock
+void tlb_shootdown_poll(void);
+
+#endif // TLB_H
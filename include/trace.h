@@ -0,0 +1,87 @@
+/*
+ * evan-os/include/trace.h
+ *
+ * Declares static tracepoints. Each one records a time stamp counter
+ * value, an event and two arguments into the running core's trace ring,
+ * which overwrites its oldest records when full. Tracepoints sit behind
+ * a static key, so while tracing is off each costs one nop.
+ *
+ * The rings are dumped over the serial port in a binary format, decoded
+ * into a timeline on the host by tools/trace_decode.py:
+ *
+ *   trace_header_t
+ *   For each core: trace_cpu_header_t, then its records oldest first
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <static_key.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Records kept per core, must be a power of 2
+#define TRACE_RECORDS 8192
+
+#define TRACE_MAGIC   0x52545645 // "EVTR"
+#define TRACE_VERSION 1
+
+// Events. Entries and exits are paired up by the decoder
+#define TRACE_INTERRUPT_ENTRY  1 // Vector
+#define TRACE_INTERRUPT_EXIT   2 // Vector
+#define TRACE_SYSCALL_ENTRY    3 // Id, first argument
+#define TRACE_SYSCALL_EXIT     4 // Id, return value
+#define TRACE_PAGE_FAULT_ENTRY 5 // Address, error code
+#define TRACE_PAGE_FAULT_EXIT  6 // Address, whether it was handled
+#define TRACE_CONTEXT_SWITCH   7 // Previous and next address space ids
+#define TRACE_VFS_READ_ENTRY   8 // Offset, size
+#define TRACE_VFS_READ_EXIT    9 // Offset, status
+#define TRACE_VFS_MOUNT        10 // Status
+
+typedef struct trace_record_t {
+	uint64_t tsc;
+	uint32_t event;
+	uint32_t cpu;
+	uint64_t arg0;
+	uint64_t arg1;
+} trace_record_t;
+
+typedef struct trace_header_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t cpu_count;
+	uint32_t record_size;
+	uint64_t tsc_frequency; // Ticks per second
+} trace_header_t;
+
+typedef struct trace_cpu_header_t {
+	uint32_t cpu;
+	uint32_t count; // Records following
+} trace_cpu_header_t;
+
+// Enabled while tracing
+extern static_key_t trace_key;
+
+// Record an event on the running core
+void trace_record(uint32_t event, uint64_t arg0, uint64_t arg1);
+
+#define trace(event, arg0, arg1) do { \
+	if (static_branch(trace_key)) { \
+		trace_record((event), (uint64_t)(arg0), (uint64_t)(arg1)); \
+	} \
+} while (0)
+
+// Allocate the running core's ring. Called by every core to be traced, after static_key_init and sti.
+// The bootstrap core waits for the others, then enables the tracepoints.
+// Returns false if there is no memory for the ring, and the core is not traced
+bool trace_start(void);
+
+// Disable the tracepoints on every core
+void trace_stop(void);
+
+// Write every ring over the serial port. Called after trace_stop
+void trace_dump(void);
+
+#endif // TRACE_H
@@ -10,6 +10,9 @@
 
 #include <stdint.h>
 
+// Filesystems that can be mounted at once
+#define VFS_MOUNTS 16
+
 // Error types
 #define FS_ERROR_SUCCESS			 0x0 // No error
 #define FS_ERROR_FAILURE			 0x1 // Generic error
@@ -63,15 +66,23 @@ typedef struct operations_t {
 	uint64_t (*write_fs_disk)    (superblock_t*);
 	uint64_t (*write_inode_disk) (inode_t *inode);
 
-	// Creating new fs entries
-	uint64_t (*make_inode)  (inode_t *inode);
-	uint64_t (*make_dentry) (dentry_t *dentry);
+	// Creating new fs entries. make_inode makes a node of a type, with nothing linking to it yet,
+	// placed near directory where that matters, and kept until release like lookup's nodes.
+	// make_dentry links dentry->inode_ptr into directory under dentry->name
+	inode_t* (*make_inode)  (inode_t* directory, uint8_t type);
+	uint64_t (*make_dentry) (inode_t* directory, dentry_t* dentry);
 
-	// Deleting fs entries
+	// Deleting fs entries. A node is freed once nothing links to it and it has been released
 	uint64_t (*remove_inode)  (inode_t *inode);
-	uint64_t (*remove_dentry) (dentry_t *dentry);
+	uint64_t (*remove_dentry) (inode_t* directory, dentry_t* dentry);
+
+	// The id of the node called name in directory, or 0
+	uint64_t (*find_name) (inode_t* directory, const char* name);
 
-	uint64_t (*find_name) (char* path);
+	// Find a node by its path relative to the mount point, or return 0.
+	// The node is kept until release is called on it
+	inode_t* (*lookup)  (superblock_t* superblock, const char* path);
+	void     (*release) (inode_t* inode);
 
 } operations_t;
 
@@ -81,6 +92,8 @@ struct superblock_t {
 	char fs_type[8]; // 8 letter filesystem type name
 
 	operations_t ops;
+
+	void* private_data; // Owned by the filesystem
 };
 
 // File nodes
@@ -92,6 +105,8 @@ struct inode_t {
 	uint32_t	link_count; // The number of dentries pointing to this node
 	uint64_t*	extra_data; // Points to inode for symbolic links or the superblock 
 							// of mount points. Otherwise, should always be 0
+	superblock_t* superblock;   // The filesystem the node belongs to
+	void*		private_data; // Owned by the filesystem
 };
 
 // File tree entries
@@ -102,4 +117,31 @@ struct dentry_t {
 	char 		 name[46];  // The name of the entry, as used in file paths
 };
 
+// Read up to size bytes of a file from offset. Nodes with a size stop at it
+uint64_t read_fs(dentry_t* file, uint64_t offset, uint64_t size, uint8_t* buffer);
+
+// Write size bytes to a file at offset, growing it if they go past its end
+uint64_t write_fs(dentry_t* file, uint64_t offset, uint64_t size, uint8_t* buffer);
+
+// Wait until everything written to a file so far is on its disk. Writes only reach a cache otherwise
+uint64_t sync_fs(dentry_t* file);
+
+uint64_t mount_root(char* file);
+
+// Attach a filesystem at path, an absolute path such as "/proc"
+uint64_t vfs_mount(const char* path, superblock_t* superblock);
+
+// Write every mounted filesystem's changes back to its disk and wait for them
+uint64_t vfs_sync(void);
+
+// Find the file at an absolute path and fill in file. It must be closed with vfs_close
+uint64_t vfs_open(const char* path, dentry_t* file);
+void vfs_close(dentry_t* file);
+
+// Make a file or directory at an absolute path and open it into file, like vfs_open
+uint64_t vfs_create(const char* path, uint8_t type, dentry_t* file);
+
+// Unlink the file or empty directory at an absolute path
+uint64_t vfs_remove(const char* path);
+
 #endif // VFS_H
\ No newline at end of file
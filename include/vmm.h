@@ -0,0 +1,68 @@
+/*
+ * evan-os/include/vmm.h
+ *
+ * Declares virtual memory regions (VMAs) and the page fault path.
+ *
+ * Mapping a region only records it. Pages are filled in by the page fault
+ * handler the first time they are touched: anonymous memory reads as the
+ * shared zero page until it is written, and file mappings map pages from
+ * their page cache. Private pages shared between address spaces are read
+ * only, and copied when one of them writes (copy-on-write).
+ *
+ */
+
+#ifndef VMM_H
+#define VMM_H
+
+#include <paging.h>
+#include <page_cache.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Region flags
+#define VMA_READ   (1 << 0)
+#define VMA_WRITE  (1 << 1)
+#define VMA_EXEC   (1 << 2)
+#define VMA_USER   (1 << 3) // Accessible from ring 3
+#define VMA_SHARED (1 << 4) // Writes go to the page cache, instead of private copies
+
+// Page fault error code bits
+#define FAULT_PRESENT (1 << 0) // Protection violation, rather than a missing page
+#define FAULT_WRITE   (1 << 1)
+#define FAULT_USER    (1 << 2)
+
+// Error codes returned by vmm_map and vmm_clone
+#define VMM_ERROR_NO_MEMORY 1
+#define VMM_ERROR_OVERLAP   2 // Part of the range is already mapped
+#define VMM_ERROR_INVALID   3 // The range is empty, unaligned or crosses into the kernel half
+
+typedef struct vma_t {
+	uint64_t      start; // Page aligned
+	uint64_t      end;   // Exclusive
+	uint64_t      flags;
+	page_cache_t* cache;  // Backing pages, or 0 for anonymous memory
+	uint64_t      offset; // Byte offset into the backing data of start
+	struct vma_t* next;
+} vma_t;
+
+// Allocate the shared zero page. Called by the bootstrap core after paging_init
+void vmm_init(void);
+
+// Add a region. Pages are only allocated when they are touched. Returns 0 or a VMM_ERROR code
+uint64_t vmm_map(address_space_t* space, uint64_t start, uint64_t size, uint64_t flags, page_cache_t* cache, uint64_t offset);
+
+// Remove every region, or part of one, in a range and free its private pages
+void vmm_unmap(address_space_t* space, uint64_t start, uint64_t size);
+
+// Give child (a new, empty address space) the same regions as parent.
+// Private pages become copy-on-write in both. Returns 0 or a VMM_ERROR code
+uint64_t vmm_clone(address_space_t* child, address_space_t* parent);
+
+// Remove every region and free the page tables
+void vmm_destroy(address_space_t* space);
+
+// Try to resolve a page fault. Returns false if the access was not allowed
+bool vmm_handle_fault(uint64_t address, uint64_t error_code);
+
+#endif // VMM_H
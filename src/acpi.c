@@ -0,0 +1,115 @@
+/*
+ * evan-os/src/acpi.c
+ *
+ * ACPI table discovery. Tables are referred to by physical address, and
+ * reached through phys_to_virt, which covers them both before and after
+ * the direct map is built.
+ *
+ */
+
+#include <acpi.h>
+
+#include <bootboot.h>
+#include <paging.h>
+#include <string.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct acpi_table_entry_t {
+	uint32_t signature;
+	uint64_t address; // Physical
+} acpi_table_entry_t;
+
+acpi_table_entry_t acpi_tables[ACPI_TABLE_MAX];
+uint32_t acpi_table_count;
+
+extern BOOTBOOT bootboot;
+
+// Every byte of a table adds up to 0
+static bool acpi_checksum(void* table, uint64_t length) {
+
+	uint8_t sum = 0;
+	for (uint64_t i = 0; i < length; i++) {
+		sum += ((uint8_t*)table)[i];
+	}
+
+	return sum == 0;
+}
+
+static inline uint32_t acpi_signature_of(acpi_header_t* header) {
+	return ACPI_SIGNATURE(header->signature[0], header->signature[1], header->signature[2], header->signature[3]);
+}
+
+// Add every table listed by the root table. entry_size is 8 for the XSDT and 4 for the RSDT
+static void acpi_index(acpi_header_t* root, uint32_t entry_size) {
+
+	uint8_t* entries = (uint8_t*)root + sizeof(acpi_header_t);
+	uint32_t count = (root->length - sizeof(acpi_header_t)) / entry_size;
+
+	for (uint32_t i = 0; i < count && acpi_table_count < ACPI_TABLE_MAX; i++) {
+		uint64_t address = entry_size == 8 ? *(uint64_t*)(entries + i * 8) : *(uint32_t*)(entries + i * 4);
+		acpi_header_t* table = phys_to_virt(address);
+
+		// Skip tables the firmware left broken
+		if (address == 0 || !acpi_checksum(table, table->length)) {
+			continue;
+		}
+
+		acpi_tables[acpi_table_count].signature = acpi_signature_of(table);
+		acpi_tables[acpi_table_count].address = address;
+		acpi_table_count++;
+	}
+}
+
+bool acpi_init(void) {
+
+	uint64_t address = bootboot.arch.x86_64.acpi_ptr;
+	if (address == 0) {
+		return false;
+	}
+
+	acpi_header_t* root = phys_to_virt(address);
+	uint32_t entry_size = 8;
+
+	// Depending on the loader, the pointer is to the RSDP or straight to the root table
+	acpi_rsdp_t* rsdp = phys_to_virt(address);
+	if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0) {
+		if (!acpi_checksum(rsdp, 20)) {
+			return false;
+		}
+
+		if (rsdp->revision >= 2 && rsdp->xsdt_address != 0) {
+			root = phys_to_virt(rsdp->xsdt_address);
+		}
+		else {
+			root = phys_to_virt(rsdp->rsdt_address);
+		}
+	}
+
+	if (memcmp(root->signature, "RSDT", 4) == 0) {
+		entry_size = 4;
+	}
+	else if (memcmp(root->signature, "XSDT", 4) != 0) {
+		return false;
+	}
+
+	if (!acpi_checksum(root, root->length)) {
+		return false;
+	}
+
+	acpi_index(root, entry_size);
+
+	return true;
+}
+
+acpi_header_t* acpi_find_table(uint32_t signature, uint32_t index) {
+
+	for (uint32_t i = 0; i < acpi_table_count; i++) {
+		if (acpi_tables[i].signature == signature && index-- == 0) {
+			return phys_to_virt(acpi_tables[i].address);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * evan-os/src/apic.c
+ *
+ * Local APIC driver
+ *
+ */
+
+#include <apic.h>
+
+#include <asm.h>
+#include <cpu.h>
+#include <interrupt.h>
+#include <module.h>
+#include <paging.h>
+#include <percpu.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MSR_APIC_BASE     0x1B
+#define MSR_X2APIC_BASE   0x800 // Register n of the memory mapped layout is MSR 0x800 + n / 16
+
+#define APIC_BASE_ENABLE  (1 << 11)
+#define APIC_BASE_X2APIC  (1 << 10)
+#define APIC_BASE_ADDRESS 0xfffff000
+
+#define APIC_SPURIOUS_ENABLE (1 << 8)
+
+#define APIC_ICR_PENDING  (1 << 12) // The last IPI has not been accepted yet
+#define APIC_ICR_ASSERT   (1 << 14)
+
+#define PIC_DATA_PRIMARY   0x21
+#define PIC_DATA_SECONDARY 0xA1
+
+// The timer counts down once every 16 bus clocks
+#define APIC_TIMER_DIVIDE_16 0x3
+
+// PIT channel 2, which can be gated and polled without interrupts
+#define PIT_FREQUENCY     1193182
+#define PIT_CHANNEL_2     0x42
+#define PIT_COMMAND       0x43
+#define PIT_GATE          0x61
+#define PIT_GATE_ENABLE   (1 << 0)
+#define PIT_GATE_SPEAKER  (1 << 1)
+#define PIT_GATE_OUTPUT   (1 << 5) // Goes high when channel 2 reaches 0
+#define PIT_CALIBRATE_HZ  100      // Measure for 10 ms
+
+bool apic_x2apic;
+volatile uint64_t apic_online;
+
+// The registers, when they are memory mapped. Every core's APIC is at the same address
+volatile uint32_t* apic_registers;
+
+volatile bool apic_ready;
+
+uint64_t apic_timer_frequency;
+uint64_t tsc_frequency;
+EXPORT_SYMBOL(tsc_frequency);
+
+// Nothing to acknowledge, the APIC just had nothing to deliver
+__attribute__((interrupt))
+static void apic_spurious(__attribute__((unused)) struct interrupt_frame* frame) {
+}
+
+uint32_t apic_read(uint32_t reg) {
+
+	if (apic_x2apic) {
+		return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+	}
+
+	return apic_registers[reg / 4];
+}
+
+void apic_write(uint32_t reg, uint32_t value) {
+
+	if (apic_x2apic) {
+		wrmsr(MSR_X2APIC_BASE + (reg >> 4), value, 0);
+		return;
+	}
+
+	apic_registers[reg / 4] = value;
+}
+
+void apic_eoi(void) {
+	apic_write(APIC_REG_EOI, 0);
+}
+EXPORT_SYMBOL(apic_eoi);
+
+void apic_send_ipi(uint32_t cpu, uint8_t vector) {
+
+	uint32_t destination = per_cpu(apic_id, cpu);
+
+	if (apic_x2apic) {
+		// One write sends it, and there is no pending bit to wait on
+		wrmsr(MSR_X2APIC_BASE + (APIC_REG_ICR_LOW >> 4), APIC_ICR_ASSERT | vector, destination);
+		return;
+	}
+
+	uint64_t flags = irq_save();
+
+	// An interrupt handler sending its own IPI in between the two writes would clobber the destination
+	while (apic_registers[APIC_REG_ICR_LOW / 4] & APIC_ICR_PENDING) {
+		pause();
+	}
+	apic_registers[APIC_REG_ICR_HIGH / 4] = destination << 24;
+	apic_registers[APIC_REG_ICR_LOW / 4] = APIC_ICR_ASSERT | vector;
+
+	irq_restore(flags);
+}
+EXPORT_SYMBOL(apic_send_ipi);
+
+// Enable the running core's local APIC
+static void apic_enable(void) {
+
+	uint64_t base = rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE;
+	if (apic_x2apic) {
+		base |= APIC_BASE_X2APIC;
+	}
+	wrmsr(MSR_APIC_BASE, (uint32_t)base, (uint32_t)(base >> 32));
+
+	// The full id, since cpuid only reports the low 8 bits
+	uint32_t id = apic_read(APIC_REG_ID);
+	this_cpu_write(apic_id, apic_x2apic ? id : id >> 24);
+
+	// Accept every priority, and keep the timer quiet until something programs it
+	apic_write(APIC_REG_TPR, 0);
+	apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+	apic_write(APIC_REG_SPURIOUS, APIC_SPURIOUS_ENABLE | INTERRUPT_VECTOR_SPURIOUS);
+}
+
+// Count timer ticks over a known number of PIT ticks
+static void apic_timer_calibrate(void) {
+
+	uint16_t count = PIT_FREQUENCY / PIT_CALIBRATE_HZ;
+
+	// Gate channel 2 off with the speaker disconnected, and load it in one shot mode
+	uint8_t gate = inportb(PIT_GATE) & ~(PIT_GATE_ENABLE | PIT_GATE_SPEAKER);
+	outportb(PIT_GATE, gate);
+	outportb(PIT_COMMAND, 0xb0); // Channel 2, low then high byte, mode 0
+	outportb(PIT_CHANNEL_2, count & 0xff);
+	outportb(PIT_CHANNEL_2, count >> 8);
+
+	apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIVIDE_16);
+
+	// Start both counting together
+	outportb(PIT_GATE, gate | PIT_GATE_ENABLE);
+	apic_write(APIC_REG_TIMER_INIT, 0xffffffff);
+	uint64_t tsc_start = rdtsc();
+
+	while (!(inportb(PIT_GATE) & PIT_GATE_OUTPUT)) {
+		pause();
+	}
+
+	uint32_t elapsed = 0xffffffff - apic_read(APIC_REG_TIMER_COUNT);
+	uint64_t tsc_elapsed = rdtsc() - tsc_start;
+	apic_write(APIC_REG_TIMER_INIT, 0);
+	outportb(PIT_GATE, gate);
+
+	apic_timer_frequency = (uint64_t)elapsed * PIT_CALIBRATE_HZ;
+	tsc_frequency = tsc_elapsed * PIT_CALIBRATE_HZ;
+}
+
+void apic_timer_periodic(uint8_t vector, uint32_t hz) {
+
+	apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIVIDE_16);
+	apic_write(APIC_REG_LVT_TIMER, APIC_LVT_PERIODIC | vector);
+
+	uint64_t count = apic_timer_frequency / hz;
+	apic_write(APIC_REG_TIMER_INIT, count != 0 ? count : 1);
+}
+
+void apic_timer_oneshot(uint8_t vector, uint64_t us) {
+
+	apic_write(APIC_REG_TIMER_DIV, APIC_TIMER_DIVIDE_16);
+	apic_write(APIC_REG_LVT_TIMER, vector);
+
+	uint64_t count = apic_timer_frequency * us / 1000000;
+	apic_write(APIC_REG_TIMER_INIT, count == 0 ? 1 : count > 0xffffffff ? 0xffffffff : count);
+}
+
+void apic_timer_stop(void) {
+	apic_write(APIC_REG_LVT_TIMER, APIC_LVT_MASKED);
+	apic_write(APIC_REG_TIMER_INIT, 0);
+}
+
+void apic_init(void) {
+
+	bool bsp = cpu_id() == 0;
+
+	if (bsp) {
+		apic_x2apic = cpu_has(CPU_FEATURE_X2APIC);
+
+		if (!apic_x2apic) {
+			uint64_t base = rdmsr(MSR_APIC_BASE) & APIC_BASE_ADDRESS;
+			apic_registers = paging_map_mmio(base, PAGE_SIZE);
+		}
+
+		// Interrupts only come through the APICs now, so silence the old PIC chips
+		outportb(PIC_DATA_PRIMARY, 0xff);
+		outportb(PIC_DATA_SECONDARY, 0xff);
+
+		interrupt_set_gate(INTERRUPT_VECTOR_SPURIOUS, (uint64_t)&apic_spurious, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+
+		// Every core's timer runs from the same bus clock, so one measurement covers them all
+		apic_enable();
+		apic_timer_calibrate();
+
+		__atomic_store_n(&apic_ready, true, __ATOMIC_RELEASE);
+	}
+	else {
+		while (!apic_ready) {
+			pause();
+		}
+	}
+
+	apic_enable();
+
+	__atomic_or_fetch(&apic_online, 1ull << cpu_id(), __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,1163 @@
+/*
+ * evan-os/src/benchmark.c
+ *
+ * Kernel microbenchmarks, run on every core after booting when the
+ * kernel is built with `make BENCH=1`. Results are printed to the tty
+ * and serial port by the bootstrap core.
+ *
+ */
+
+#ifdef BENCHMARK
+
+#include <benchmark.h>
+
+#include <apic.h>
+#include <bootboot.h>
+#include <kernel.h>
+#include <asm.h>
+#include <tty.h>
+#include <rcu.h>
+#include <percpu.h>
+#include <spinlock.h>
+#include <string.h>
+#include <cpu.h>
+#include <pmm.h>
+#include <paging.h>
+#include <tlb.h>
+#include <vmm.h>
+#include <numa.h>
+#include <idle.h>
+#include <static_key.h>
+#include <vfs.h>
+#include <block.h>
+#include <kmalloc.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern BOOTBOOT bootboot;
+
+// The number of cores running the benchmarks
+static uint32_t benchmark_cores(void) {
+	return bootboot.numcores < CPU_MAX ? bootboot.numcores : CPU_MAX;
+}
+
+volatile uint32_t benchmark_barrier_count;
+volatile uint32_t benchmark_barrier_generation;
+
+// Wait for every core to arrive
+static void benchmark_barrier(void) {
+
+	uint32_t generation = benchmark_barrier_generation;
+
+	// The last core to arrive resets the count and releases the others
+	if (__atomic_add_fetch(&benchmark_barrier_count, 1, __ATOMIC_SEQ_CST) == benchmark_cores()) {
+		benchmark_barrier_count = 0;
+		__atomic_store_n(&benchmark_barrier_generation, generation + 1, __ATOMIC_SEQ_CST);
+		return;
+	}
+
+	while (benchmark_barrier_generation == generation) {
+		// Dont hold up grace periods started by other cores
+		rcu_quiescent_state();
+		pause();
+	}
+}
+
+// Print a labeled decimal value on its own line
+static void benchmark_print(char* label, uint64_t value) {
+	tty_print_string(label);
+	print_dec(value);
+	tty_print_string("\n");
+}
+
+// RCU: the bootstrap core replaces a protected pointer while the other cores read it
+
+#define RCU_BENCH_UPDATES     1000
+#define RCU_BENCH_QS_INTERVAL 64   // Reads between quiescent states, standing in for a scheduler tick
+
+typedef struct rcu_bench_data_t {
+	uint64_t value;
+	uint64_t check; // Always ~value, unless the writer reused a version while it was being read
+} rcu_bench_data_t;
+
+rcu_bench_data_t rcu_bench_versions[2];
+rcu_bench_data_t* rcu_bench_ptr;
+
+volatile bool rcu_bench_done;
+
+volatile uint64_t rcu_bench_reads;
+volatile uint64_t rcu_bench_read_cycles;
+volatile uint64_t rcu_bench_errors;
+
+static void benchmark_rcu(void) {
+
+	bool writer = cpu_id() == 0;
+
+	if (writer) {
+		rcu_bench_versions[0].value = 0;
+		rcu_bench_versions[0].check = ~0ull;
+		rcu_bench_ptr = &rcu_bench_versions[0];
+	}
+
+	benchmark_barrier();
+
+	if (writer) {
+		uint64_t start = rdtsc();
+
+		for (uint64_t i = 1; i <= RCU_BENCH_UPDATES; i++) {
+			// The version replaced by the previous update is free to reuse once its grace period ended
+			rcu_bench_data_t* version = &rcu_bench_versions[i & 1];
+			version->value = i;
+			version->check = ~i;
+
+			rcu_assign_pointer(rcu_bench_ptr, version);
+			synchronize_rcu();
+		}
+
+		uint64_t cycles = rdtsc() - start;
+		rcu_bench_done = true;
+
+		tty_print_string("RCU benchmark\n");
+		benchmark_print("  Readers: ", benchmark_cores() - 1);
+		benchmark_print("  Updates: ", RCU_BENCH_UPDATES);
+		benchmark_print("  Cycles per update and grace period: ", cycles / RCU_BENCH_UPDATES);
+	}
+	else {
+		uint64_t reads = 0, errors = 0;
+		uint64_t start = rdtsc();
+
+		while (!rcu_bench_done) {
+			for (uint32_t i = 0; i < RCU_BENCH_QS_INTERVAL; i++) {
+				rcu_read_lock();
+				rcu_bench_data_t* version = rcu_dereference(rcu_bench_ptr);
+				if (version->check != ~version->value) {
+					errors++;
+				}
+				rcu_read_unlock();
+			}
+			reads += RCU_BENCH_QS_INTERVAL;
+
+			rcu_quiescent_state();
+		}
+
+		uint64_t cycles = rdtsc() - start;
+
+		__atomic_add_fetch(&rcu_bench_reads, reads, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&rcu_bench_read_cycles, cycles, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&rcu_bench_errors, errors, __ATOMIC_SEQ_CST);
+	}
+
+	benchmark_barrier();
+
+	if (writer && rcu_bench_reads != 0) {
+		benchmark_print("  Reads: ", rcu_bench_reads);
+		benchmark_print("  Cycles per read (including quiescent states): ", rcu_bench_read_cycles / rcu_bench_reads);
+		benchmark_print("  Torn reads: ", rcu_bench_errors);
+	}
+}
+
+// Locks: 1 to N cores take the same lock, to show how throughput scales under contention
+
+#define LOCK_BENCH_ACQUIRES 20000 // Per core
+
+#define LOCK_BENCH_TICKET       0
+#define LOCK_BENCH_MCS          1
+#define LOCK_BENCH_RWLOCK_WRITE 2
+#define LOCK_BENCH_RWLOCK_READ  3
+#define LOCK_BENCH_TYPES        4
+
+char* lock_bench_names[LOCK_BENCH_TYPES] = { "ticket", "mcs", "rwlock write", "rwlock read" };
+
+spinlock_t lock_bench_ticket = SPINLOCK_INIT;
+mcs_lock_t lock_bench_mcs = MCS_LOCK_INIT;
+rwlock_t lock_bench_rwlock = RWLOCK_INIT;
+
+// Shared data touched inside the critical section
+volatile uint64_t lock_bench_counter;
+
+static void lock_bench_acquire(uint32_t type) {
+
+	mcs_node_t node;
+
+	for (uint32_t i = 0; i < LOCK_BENCH_ACQUIRES; i++) {
+		switch (type) {
+			case LOCK_BENCH_TICKET:
+				spin_lock(&lock_bench_ticket);
+				lock_bench_counter++;
+				spin_unlock(&lock_bench_ticket);
+				break;
+			case LOCK_BENCH_MCS:
+				mcs_lock(&lock_bench_mcs, &node);
+				lock_bench_counter++;
+				mcs_unlock(&lock_bench_mcs, &node);
+				break;
+			case LOCK_BENCH_RWLOCK_WRITE:
+				write_lock(&lock_bench_rwlock);
+				lock_bench_counter++;
+				write_unlock(&lock_bench_rwlock);
+				break;
+			case LOCK_BENCH_RWLOCK_READ:
+				read_lock(&lock_bench_rwlock);
+				(void)lock_bench_counter;
+				read_unlock(&lock_bench_rwlock);
+				break;
+		}
+	}
+}
+
+static void benchmark_locks(void) {
+
+	bool bsp = cpu_id() == 0;
+
+	if (bsp) {
+		tty_print_string("Lock benchmark (acquisitions per million cycles)\n");
+	}
+
+	for (uint32_t cores = 1; cores <= benchmark_cores(); cores++) {
+
+		if (bsp) {
+			tty_print_string("  Cores: ");
+			print_dec(cores);
+		}
+
+		for (uint32_t type = 0; type < LOCK_BENCH_TYPES; type++) {
+
+			benchmark_barrier();
+			uint64_t start = rdtsc();
+
+			if (cpu_id() < cores) {
+				lock_bench_acquire(type);
+			}
+
+			benchmark_barrier();
+			uint64_t cycles = rdtsc() - start;
+
+			if (bsp) {
+				tty_print_string("  ");
+				tty_print_string(lock_bench_names[type]);
+				tty_print_string(": ");
+				print_dec((uint64_t)cores * LOCK_BENCH_ACQUIRES * 1000000 / cycles);
+			}
+		}
+
+		if (bsp) {
+			tty_print_string("\n");
+		}
+	}
+}
+
+// Allocate physically contiguous memory for benchmark buffers, through the direct map
+static void* benchmark_memory(uint64_t size) {
+
+	uint64_t frames = pmm_alloc_pages((size + PAGE_SIZE - 1) / PAGE_SIZE);
+	if (frames == 0) {
+		return 0;
+	}
+
+	return phys_to_virt(frames);
+}
+
+static void benchmark_free(void* memory, uint64_t size) {
+	pmm_free_pages(virt_to_phys(memory), (size + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+// String routines: every memcpy and memset variant over a sweep of sizes
+
+#define STRING_BENCH_MAX_SIZE (4 * 1024 * 1024)
+#define STRING_BENCH_BYTES    (32 * 1024 * 1024) // Bytes moved per size and variant
+
+#define STRING_BENCH_ERMS     0
+#define STRING_BENCH_UNROLLED 1
+#define STRING_BENCH_NT       2
+#define STRING_BENCH_DISPATCH 3 // memcpy and memset themselves
+#define STRING_BENCH_VARIANTS 4
+
+char* string_bench_names[STRING_BENCH_VARIANTS] = { "erms", "unrolled", "nt", "dispatched" };
+
+// Returns the throughput in bytes per thousand cycles
+static uint64_t string_bench_one(bool copy, uint32_t variant, uint8_t* dest, uint8_t* src, uint64_t size) {
+
+	uint64_t iterations = STRING_BENCH_BYTES / size;
+	if (iterations < 8) {
+		iterations = 8;
+	}
+
+	uint64_t start = rdtsc();
+
+	for (uint64_t i = 0; i < iterations; i++) {
+		switch (variant) {
+			case STRING_BENCH_ERMS:
+				copy ? memcpy_erms(dest, src, size) : memset_erms(dest, (int)i, size);
+				break;
+			case STRING_BENCH_UNROLLED:
+				copy ? memcpy_unrolled(dest, src, size) : memset_unrolled(dest, (int)i, size);
+				break;
+			case STRING_BENCH_NT:
+				copy ? memcpy_nt(dest, src, size) : memset_nt(dest, (int)i, size);
+				break;
+			case STRING_BENCH_DISPATCH:
+				copy ? memcpy(dest, src, size) : memset(dest, (int)i, size);
+				break;
+		}
+	}
+
+	return iterations * size * 1000 / (rdtsc() - start);
+}
+
+static void benchmark_string(void) {
+
+	uint8_t* buffers = benchmark_memory(2 * STRING_BENCH_MAX_SIZE);
+	if (buffers == 0) {
+		tty_print_string("String benchmark skipped, no free memory\n");
+		return;
+	}
+
+	uint8_t* dest = buffers;
+	uint8_t* src = buffers + STRING_BENCH_MAX_SIZE;
+
+	tty_print_string("String benchmark (bytes per thousand cycles)\n");
+	if (!cpu_has(CPU_FEATURE_ERMS)) {
+		tty_print_string("  No enhanced rep movsb, the erms results use the slow microcode\n");
+	}
+
+	for (int copy = 1; copy >= 0; copy--) {
+		tty_print_string(copy ? "  memcpy\n" : "  memset\n");
+
+		for (uint64_t size = 64; size <= STRING_BENCH_MAX_SIZE; size *= 4) {
+			tty_print_string("    Size: ");
+			print_dec(size);
+
+			for (uint32_t variant = 0; variant < STRING_BENCH_VARIANTS; variant++) {
+				tty_print_string("  ");
+				tty_print_string(string_bench_names[variant]);
+				tty_print_string(": ");
+				print_dec(string_bench_one(copy, variant, dest, src, size));
+			}
+			tty_print_string("\n");
+		}
+	}
+
+	benchmark_free(buffers, 2 * STRING_BENCH_MAX_SIZE);
+}
+
+// PCIDs: switch round robin between address spaces, touching a few pages in each after
+// the switch. Without PCIDs every switch flushes the TLB, so the touches miss again
+
+#define PCID_BENCH_SPACES   4
+#define PCID_BENCH_PAGES    32     // Pages touched after each switch
+#define PCID_BENCH_SWITCHES 20000
+#define PCID_BENCH_BASE     0x40000000 // Where the pages are mapped in each address space
+
+address_space_t pcid_bench_spaces[PCID_BENCH_SPACES];
+
+static void pcid_bench_one(bool pcid) {
+
+	paging_pcid_enabled = pcid;
+
+	uint64_t switch_cycles = 0, touch_cycles = 0;
+
+	for (uint32_t i = 0; i < PCID_BENCH_SWITCHES; i++) {
+		uint64_t start = rdtsc();
+		paging_switch(&pcid_bench_spaces[i % PCID_BENCH_SPACES]);
+		uint64_t switched = rdtsc();
+
+		for (uint64_t page = 0; page < PCID_BENCH_PAGES; page++) {
+			(void)*(volatile uint64_t*)(PCID_BENCH_BASE + page * PAGE_SIZE);
+		}
+
+		touch_cycles += rdtsc() - switched;
+		switch_cycles += switched - start;
+	}
+
+	paging_switch(&kernel_address_space);
+
+	tty_print_string(pcid ? "  With PCIDs\n" : "  Without PCIDs\n");
+	benchmark_print("    Cycles per switch: ", switch_cycles / PCID_BENCH_SWITCHES);
+	benchmark_print("    Cycles per page touched after a switch: ", touch_cycles / (PCID_BENCH_SWITCHES * PCID_BENCH_PAGES));
+}
+
+static void benchmark_pcid(void) {
+
+	bool supported = paging_pcid_enabled;
+	uint32_t created = 0;
+
+	for (; created < PCID_BENCH_SPACES; created++) {
+		address_space_t* space = &pcid_bench_spaces[created];
+		if (!paging_create(space)) {
+			break;
+		}
+
+		// Each address space maps its own frames at the same addresses
+		for (uint64_t page = 0; page < PCID_BENCH_PAGES; page++) {
+			uint64_t frame = pmm_alloc_page();
+			if (frame != 0) {
+				paging_map(space, PCID_BENCH_BASE + page * PAGE_SIZE, frame, PAGE_WRITE);
+			}
+		}
+	}
+
+	if (created == PCID_BENCH_SPACES) {
+		tty_print_string("PCID benchmark\n");
+		benchmark_print("  Address spaces: ", PCID_BENCH_SPACES);
+		benchmark_print("  Pages touched per switch: ", PCID_BENCH_PAGES);
+
+		if (supported) {
+			pcid_bench_one(true);
+		}
+		else {
+			tty_print_string("  No PCID support\n");
+		}
+		pcid_bench_one(false);
+
+		paging_pcid_enabled = supported;
+	}
+	else {
+		tty_print_string("PCID benchmark skipped, no free memory\n");
+	}
+
+	for (uint32_t i = 0; i < created; i++) {
+		address_space_t* space = &pcid_bench_spaces[i];
+
+		for (uint64_t page = 0; page < PCID_BENCH_PAGES; page++) {
+			uint64_t frame = paging_unmap(space, PCID_BENCH_BASE + page * PAGE_SIZE);
+			if (frame != 0) {
+				pmm_free_page(frame);
+			}
+		}
+		paging_destroy(space);
+	}
+}
+
+// TLB shootdowns: every core runs in one address space while the bootstrap core unmaps
+// runs of pages, one shootdown per page or one batched shootdown per run
+
+#define TLB_BENCH_ROUNDS 200
+#define TLB_BENCH_BASE   0x40000000
+#define TLB_BENCH_SIZES  4
+
+uint64_t tlb_bench_sizes[TLB_BENCH_SIZES] = { 1, 8, 32, 64 };
+
+address_space_t tlb_bench_space;
+volatile bool tlb_bench_ready;
+
+static uint64_t tlb_bench_one(uint64_t frame, uint64_t pages, bool batched) {
+
+	uint64_t cycles = 0;
+	tlb_batch_t batch;
+
+	for (uint32_t round = 0; round < TLB_BENCH_ROUNDS; round++) {
+		for (uint64_t page = 0; page < pages; page++) {
+			paging_map(&tlb_bench_space, TLB_BENCH_BASE + page * PAGE_SIZE, frame, PAGE_WRITE);
+			(void)*(volatile uint64_t*)(TLB_BENCH_BASE + page * PAGE_SIZE);
+		}
+
+		uint64_t start = rdtsc();
+
+		if (batched) {
+			tlb_batch_init(&batch, &tlb_bench_space);
+			for (uint64_t page = 0; page < pages; page++) {
+				paging_unmap_batch(&tlb_bench_space, TLB_BENCH_BASE + page * PAGE_SIZE, &batch);
+			}
+			tlb_batch_flush(&batch);
+		}
+		else {
+			for (uint64_t page = 0; page < pages; page++) {
+				paging_unmap(&tlb_bench_space, TLB_BENCH_BASE + page * PAGE_SIZE);
+			}
+		}
+
+		cycles += rdtsc() - start;
+	}
+
+	return cycles / (TLB_BENCH_ROUNDS * pages);
+}
+
+static void benchmark_tlb(void) {
+
+	bool bsp = cpu_id() == 0;
+
+	if (bsp) {
+		tlb_bench_ready = paging_create(&tlb_bench_space);
+	}
+	benchmark_barrier();
+
+	if (!tlb_bench_ready) {
+		if (bsp) {
+			tty_print_string("TLB shootdown benchmark skipped, no free memory\n");
+		}
+		return;
+	}
+
+	// Every core joins, so each unmap has to reach all of them
+	paging_switch(&tlb_bench_space);
+	benchmark_barrier();
+
+	if (bsp) {
+		uint64_t frame = pmm_alloc_page();
+
+		tty_print_string("TLB shootdown benchmark (cycles per page unmapped)\n");
+		benchmark_print("  Cores in the address space: ", benchmark_cores());
+
+		for (uint32_t i = 0; i < TLB_BENCH_SIZES; i++) {
+			tty_print_string("  Pages: ");
+			print_dec(tlb_bench_sizes[i]);
+			tty_print_string("  one at a time: ");
+			print_dec(tlb_bench_one(frame, tlb_bench_sizes[i], false));
+			tty_print_string("  batched: ");
+			print_dec(tlb_bench_one(frame, tlb_bench_sizes[i], true));
+			tty_print_string("\n");
+		}
+
+		pmm_free_page(frame);
+	}
+
+	// The other cores answer shootdowns while they wait here
+	benchmark_barrier();
+	paging_switch(&kernel_address_space);
+	benchmark_barrier();
+
+	if (bsp) {
+		paging_destroy(&tlb_bench_space);
+	}
+}
+
+// Demand paging: map a large anonymous region and touch part of it, then clone the
+// address space and write to the same pages again to copy them
+
+#define VMM_BENCH_BASE   0x40000000
+#define VMM_BENCH_SIZE   (64 * 1024 * 1024)
+#define VMM_BENCH_STRIDE (16 * PAGE_SIZE) // Touch one page in 16
+
+address_space_t vmm_bench_parent;
+address_space_t vmm_bench_child;
+
+// Returns the cycles per page touched
+static uint64_t vmm_bench_touch(bool write) {
+
+	uint64_t start = rdtsc();
+
+	for (uint64_t offset = 0; offset < VMM_BENCH_SIZE; offset += VMM_BENCH_STRIDE) {
+		volatile uint64_t* address = (volatile uint64_t*)(VMM_BENCH_BASE + offset);
+		if (write) {
+			*address = offset;
+		}
+		else {
+			(void)*address;
+		}
+	}
+
+	return (rdtsc() - start) / (VMM_BENCH_SIZE / VMM_BENCH_STRIDE);
+}
+
+static void benchmark_vmm(void) {
+
+	if (!paging_create(&vmm_bench_parent)) {
+		tty_print_string("Demand paging benchmark skipped, no free memory\n");
+		return;
+	}
+	if (!paging_create(&vmm_bench_child)) {
+		paging_destroy(&vmm_bench_parent);
+		tty_print_string("Demand paging benchmark skipped, no free memory\n");
+		return;
+	}
+
+	// Fill the zero pool, as idle cores would have by now
+	while (pmm_zero_count[numa_node()] < PMM_ZERO_POOL_SIZE) {
+		pmm_zero_refill();
+	}
+	uint64_t hits = pmm_zero_hits, misses = pmm_zero_misses;
+
+	vmm_map(&vmm_bench_parent, VMM_BENCH_BASE, VMM_BENCH_SIZE, VMA_READ | VMA_WRITE, 0, 0);
+	paging_switch(&vmm_bench_parent);
+
+	tty_print_string("Demand paging benchmark\n");
+	benchmark_print("  Region size: ", VMM_BENCH_SIZE);
+	benchmark_print("  Pages touched: ", VMM_BENCH_SIZE / VMM_BENCH_STRIDE);
+
+	uint64_t free_before = pmm_free_frames;
+	benchmark_print("  Cycles per read fault (zero page): ", vmm_bench_touch(false));
+	benchmark_print("  Frames used after reading: ", free_before - pmm_free_frames);
+	benchmark_print("  Cycles per first write (copy of the zero page): ", vmm_bench_touch(true));
+	benchmark_print("  Cycles per write to a mapped page: ", vmm_bench_touch(true));
+	benchmark_print("  Frames used after writing: ", free_before - pmm_free_frames);
+	benchmark_print("  Zero pool hits: ", pmm_zero_hits - hits);
+	benchmark_print("  Zero pool misses: ", pmm_zero_misses - misses);
+
+	free_before = pmm_free_frames;
+	uint64_t start = rdtsc();
+	vmm_clone(&vmm_bench_child, &vmm_bench_parent);
+	benchmark_print("  Cycles to clone the address space: ", rdtsc() - start);
+
+	paging_switch(&vmm_bench_child);
+	benchmark_print("  Cycles per copy-on-write fault: ", vmm_bench_touch(true));
+	benchmark_print("  Frames copied: ", free_before - pmm_free_frames);
+
+	paging_switch(&kernel_address_space);
+	vmm_destroy(&vmm_bench_child);
+	vmm_destroy(&vmm_bench_parent);
+}
+
+// NUMA: the bootstrap core reads memory allocated on each node in turn
+
+#define NUMA_BENCH_FRAMES 4096 // 16 MiB, bigger than the last level cache
+#define NUMA_BENCH_HOPS   (1024 * 1024)
+
+uint64_t numa_bench_frames[NUMA_BENCH_FRAMES];
+
+// Link one cache line of every frame into a cycle in a shuffled order, so
+// the prefetchers can not guess the next load. Returns the cycles per load
+static uint64_t numa_bench_latency(void) {
+
+	uint64_t seed = 0x2545f4914f6cdd1d;
+	for (uint32_t i = NUMA_BENCH_FRAMES - 1; i > 0; i--) {
+		seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+		uint32_t j = (seed >> 33) % (i + 1);
+		uint64_t frame = numa_bench_frames[i];
+		numa_bench_frames[i] = numa_bench_frames[j];
+		numa_bench_frames[j] = frame;
+	}
+
+	// Vary the line within each frame too, spreading the loads over every cache set
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		uint32_t next = (i + 1) % NUMA_BENCH_FRAMES;
+		uint64_t* from = (uint64_t*)((uint8_t*)phys_to_virt(numa_bench_frames[i]) + (i * 64 * 7) % PAGE_SIZE);
+		uint64_t* to = (uint64_t*)((uint8_t*)phys_to_virt(numa_bench_frames[next]) + (next * 64 * 7) % PAGE_SIZE);
+		*from = (uint64_t)to;
+	}
+
+	uint64_t* line = phys_to_virt(numa_bench_frames[0]);
+	uint64_t start = rdtsc();
+
+	for (uint32_t i = 0; i < NUMA_BENCH_HOPS; i++) {
+		line = (uint64_t*)*(volatile uint64_t*)line;
+	}
+
+	return (rdtsc() - start) / NUMA_BENCH_HOPS;
+}
+
+// Returns the cycles per KiB read
+static uint64_t numa_bench_bandwidth(void) {
+
+	uint64_t sum = 0;
+	uint64_t start = rdtsc();
+
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		volatile uint64_t* words = phys_to_virt(numa_bench_frames[i]);
+		for (uint32_t word = 0; word < PAGE_SIZE / 8; word++) {
+			sum += words[word];
+		}
+	}
+
+	uint64_t cycles = rdtsc() - start;
+	(void)sum;
+
+	return cycles * 1024 / ((uint64_t)NUMA_BENCH_FRAMES * PAGE_SIZE);
+}
+
+static void benchmark_numa(void) {
+
+	uint32_t local = numa_node();
+
+	tty_print_string("NUMA benchmark\n");
+	benchmark_print("  Nodes: ", numa_node_count);
+	benchmark_print("  Bootstrap core's node: ", local);
+
+	// The per-CPU cache against the bitmap, on the local node
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		numa_bench_frames[i] = pmm_alloc_page();
+	}
+	uint64_t cached = rdtsc() - start;
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		pmm_free_page(numa_bench_frames[i]);
+	}
+
+	start = rdtsc();
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		numa_bench_frames[i] = pmm_alloc_page_node(local);
+	}
+	uint64_t uncached = rdtsc() - start;
+	for (uint32_t i = 0; i < NUMA_BENCH_FRAMES; i++) {
+		pmm_free_page(numa_bench_frames[i]);
+	}
+
+	benchmark_print("  Cycles per allocation through the per-CPU cache: ", cached / NUMA_BENCH_FRAMES);
+	benchmark_print("  Cycles per allocation from the bitmap: ", uncached / NUMA_BENCH_FRAMES);
+
+	for (uint32_t node = 0; node < numa_node_count; node++) {
+
+		uint32_t allocated = 0, on_node = 0;
+		for (; allocated < NUMA_BENCH_FRAMES; allocated++) {
+			uint64_t frame = pmm_alloc_page_node(node);
+			if (frame == 0) {
+				break;
+			}
+			numa_bench_frames[allocated] = frame;
+			on_node += numa_node_of_frame(frame) == node;
+		}
+
+		tty_print_string(node == local ? "  Local node " : "  Remote node ");
+		print_dec(node);
+		tty_print_string("\n");
+
+		if (allocated == NUMA_BENCH_FRAMES) {
+			benchmark_print("    Distance: ", numa_distance(local, node));
+			benchmark_print("    Frames allocated on the node: ", on_node);
+			benchmark_print("    Cycles per dependent load: ", numa_bench_latency());
+			benchmark_print("    Cycles per KiB read: ", numa_bench_bandwidth());
+		}
+		else {
+			tty_print_string("    Skipped, no free memory\n");
+		}
+
+		for (uint32_t i = 0; i < allocated; i++) {
+			pmm_free_page(numa_bench_frames[i]);
+		}
+	}
+}
+
+// Idle: the bootstrap core queues work on a sleeping core and waits for it to run
+
+#define IDLE_BENCH_ROUNDS 1000
+#define IDLE_BENCH_DELAY  200000 // Cycles for the core to go back to sleep between rounds
+
+idle_work_t idle_bench_work;
+volatile bool idle_bench_done;
+
+static void idle_bench_func(__attribute__((unused)) void* arg) {
+	idle_bench_done = true;
+}
+
+static void idle_bench_one(uint32_t cpu, bool mwait) {
+
+	idle_mwait_enabled = mwait;
+
+	uint64_t sent = idle_ipis_sent, skipped = idle_ipis_skipped;
+	uint64_t cycles = 0;
+
+	for (uint32_t i = 0; i < IDLE_BENCH_ROUNDS; i++) {
+		uint64_t start = rdtsc();
+		while (rdtsc() - start < IDLE_BENCH_DELAY) {
+			pause();
+		}
+
+		idle_bench_done = false;
+		idle_bench_work.func = idle_bench_func;
+
+		start = rdtsc();
+		idle_queue_work(cpu, &idle_bench_work);
+		while (!idle_bench_done) {
+			pause();
+		}
+		cycles += rdtsc() - start;
+	}
+
+	tty_print_string(mwait ? "  With mwait\n" : "  With hlt\n");
+	benchmark_print("    Cycles until queued work runs: ", cycles / IDLE_BENCH_ROUNDS);
+	benchmark_print("    Wakeup IPIs sent: ", idle_ipis_sent - sent);
+	benchmark_print("    Wakeup IPIs skipped: ", idle_ipis_skipped - skipped);
+}
+
+// Runs after the other cores have gone idle
+static void benchmark_idle(void) {
+
+	if (benchmark_cores() < 2) {
+		tty_print_string("Idle benchmark skipped, only one core\n");
+		return;
+	}
+
+	// Core 1 may still be clearing frames for the zero pool
+	while (idle_sleeps(1) == 0) {
+		pause();
+	}
+
+	bool supported = idle_mwait_enabled;
+
+	tty_print_string("Idle benchmark\n");
+	if (supported) {
+		idle_bench_one(1, true);
+	}
+	else {
+		tty_print_string("  No mwait support\n");
+	}
+	idle_bench_one(1, false);
+
+	idle_mwait_enabled = supported;
+
+	idle_print_stats();
+}
+
+// Interrupt statistics: the cost of irq_save and irq_restore with and without timing the
+// section, then the statistics gathered during the benchmarks, read back through /proc
+
+#define IRQ_BENCH_SECTIONS 100000
+
+static uint64_t irq_bench_one(bool tracking) {
+
+	if (tracking) {
+		static_key_enable(&irq_off_key);
+	}
+	else {
+		static_key_disable(&irq_off_key);
+	}
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < IRQ_BENCH_SECTIONS; i++) {
+		uint64_t flags = irq_save();
+		irq_restore(flags);
+	}
+
+	return (rdtsc() - start) / IRQ_BENCH_SECTIONS;
+}
+
+static void benchmark_print_file(const char* path) {
+
+	dentry_t file;
+	if (vfs_open(path, &file) != FS_ERROR_SUCCESS) {
+		tty_print_string("  Could not open ");
+		tty_print_string((char*)path);
+		tty_print_string("\n");
+		return;
+	}
+
+	char chunk[128];
+	for (uint64_t offset = 0; offset < file.inode_ptr->size; offset += sizeof(chunk) - 1) {
+		uint64_t size = file.inode_ptr->size - offset;
+		if (size > sizeof(chunk) - 1) {
+			size = sizeof(chunk) - 1;
+		}
+
+		read_fs(&file, offset, size, (uint8_t*)chunk);
+		chunk[size] = '\0';
+		tty_print_string(chunk);
+	}
+
+	vfs_close(&file);
+}
+
+// Runs after the other cores have gone idle, since they must answer the patching IPIs
+static void benchmark_irq_stats(void) {
+
+	bool tracking = irq_off_key.enabled;
+
+	tty_print_string("Interrupt statistics benchmark\n");
+	benchmark_print("  irq_save and irq_restore, cycles: ", irq_bench_one(false));
+	benchmark_print("  Timing interrupts disabled, cycles: ", irq_bench_one(true));
+
+	if (!tracking) {
+		static_key_disable(&irq_off_key);
+	}
+
+	benchmark_print_file("/proc/interrupts");
+	benchmark_print_file("/proc/interrupt_latency");
+}
+
+// Block devices: 4 KiB reads from every disk, one at a time in order, 32 at a time in
+// order under a plug, then 32 at a time at random offsets. Each is run with completion interrupts, then by polling.
+// Disks with several queues are also given random reads from every core at once
+
+#define BLOCK_BENCH_SECTORS    (4096 / BLOCK_SECTOR_SIZE)
+#define BLOCK_BENCH_SEQUENTIAL 4096
+#define BLOCK_BENCH_RANDOM     16384
+#define BLOCK_BENCH_DEPTH      32
+
+block_request_t* block_bench_requests[BLOCK_BENCH_DEPTH];
+volatile uint32_t block_bench_started;
+volatile uint32_t block_bench_done;
+uint64_t block_bench_blocks;
+
+// A random 4 KiB block for the nth read, so completions on any core agree without sharing a generator
+static uint64_t block_bench_sector(uint64_t n) {
+
+	uint64_t x = n * 0x9e3779b97f4a7c15 + 1;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+
+	return x % block_bench_blocks * BLOCK_BENCH_SECTORS;
+}
+
+// Each completion starts the next read in its slot, keeping the device full
+static void block_bench_complete(block_request_t* request) {
+
+	__atomic_add_fetch(&block_bench_done, 1, __ATOMIC_RELEASE);
+
+	uint32_t n = __atomic_fetch_add(&block_bench_started, 1, __ATOMIC_RELAXED);
+	if (n < BLOCK_BENCH_RANDOM) {
+		request->sector = block_bench_sector(n);
+		block_submit(request);
+	}
+}
+
+static void block_bench_print(char* label, uint64_t reads, uint64_t cycles) {
+
+	uint64_t us = cycles * 1000000 / tsc_frequency;
+	if (us == 0) {
+		us = 1;
+	}
+
+	tty_print_string(label);
+	print_dec(reads * 1000000 / us);
+	tty_print_string(" IOPS, ");
+	print_dec(reads * 4096 / us);
+	tty_print_string(" MB/s\n");
+}
+
+// Start the first reads whose number matches the core
+static void block_bench_start(void* arg) {
+
+	uint32_t cpu = (uint64_t)arg;
+
+	for (uint32_t i = cpu; i < BLOCK_BENCH_DEPTH; i += benchmark_cores()) {
+		block_request_t* request = block_bench_requests[i];
+		request->sector = block_bench_sector(i);
+		block_submit(request);
+	}
+}
+
+idle_work_t block_bench_work[CPU_MAX];
+
+// Returns the cycles taken by the random reads, started by the bootstrap core or by every core
+static uint64_t block_bench_random(block_device_t* device, bool polling, bool every_core) {
+
+	block_bench_started = BLOCK_BENCH_DEPTH;
+	block_bench_done = 0;
+
+	uint64_t start = rdtsc();
+
+	for (uint32_t cpu = 1; every_core && cpu < benchmark_cores(); cpu++) {
+		block_bench_work[cpu].func = block_bench_start;
+		block_bench_work[cpu].arg = (void*)(uint64_t)cpu;
+		idle_queue_work(cpu, &block_bench_work[cpu]);
+	}
+
+	if (every_core) {
+		block_bench_start((void*)0);
+	}
+	else {
+		for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+			block_request_t* request = block_bench_requests[i];
+			request->sector = block_bench_sector(i);
+			block_submit(request);
+		}
+	}
+
+	while (__atomic_load_n(&block_bench_done, __ATOMIC_ACQUIRE) < BLOCK_BENCH_RANDOM) {
+		for (uint32_t queue = 0; polling && queue < device->queues; queue++) {
+			device->poll(device, queue);
+		}
+		pause();
+	}
+
+	return rdtsc() - start;
+}
+
+// Sequential reads submitted 32 at a time under a plug, which merges them into larger requests
+static uint64_t block_bench_plugged(void) {
+
+	uint64_t start = rdtsc();
+
+	for (uint32_t round = 0; round < BLOCK_BENCH_SEQUENTIAL / BLOCK_BENCH_DEPTH; round++) {
+		block_start_plug();
+		for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+			block_request_t* request = block_bench_requests[i];
+			request->sector = (round * BLOCK_BENCH_DEPTH + i) % block_bench_blocks * BLOCK_BENCH_SECTORS;
+			request->complete = 0;
+			block_submit(request);
+		}
+		block_finish_plug();
+
+		for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+			block_wait(block_bench_requests[i]);
+		}
+	}
+
+	uint64_t cycles = rdtsc() - start;
+
+	for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+		block_bench_requests[i]->complete = block_bench_complete;
+	}
+
+	return cycles;
+}
+
+static void block_bench_one(block_device_t* device, uint8_t* buffer, bool polling) {
+
+	if (polling) {
+		if (device->set_polling == 0 || device->poll == 0) {
+			return;
+		}
+		device->set_polling(device, true);
+	}
+
+	tty_print_string(polling ? "    Polling\n" : "    Interrupts\n");
+
+	uint64_t start = rdtsc();
+	for (uint32_t i = 0; i < BLOCK_BENCH_SEQUENTIAL; i++) {
+		uint64_t sector = i % block_bench_blocks * BLOCK_BENCH_SECTORS;
+		if (block_read(device, sector, BLOCK_BENCH_SECTORS, buffer) != BLOCK_SUCCESS) {
+			tty_print_string("      Read failed\n");
+			break;
+		}
+	}
+	block_bench_print("      Sequential, depth 1: ", BLOCK_BENCH_SEQUENTIAL, rdtsc() - start);
+
+	uint64_t merges = device->merges;
+	block_bench_print("      Sequential, 32 plugged: ", BLOCK_BENCH_SEQUENTIAL, block_bench_plugged());
+	benchmark_print("        Requests merged: ", device->merges - merges);
+
+	block_bench_print("      Random, depth 32: ", BLOCK_BENCH_RANDOM, block_bench_random(device, polling, false));
+
+	// Each core submits to its own queue, and its completions keep that queue busy
+	if (!polling && device->queues > 1) {
+		block_bench_print("      Random, depth 32, every core: ", BLOCK_BENCH_RANDOM, block_bench_random(device, false, true));
+	}
+
+	if (polling) {
+		device->set_polling(device, false);
+	}
+}
+
+// Runs after the other cores have gone idle, since devices may interrupt any of them
+static void benchmark_block(void) {
+
+	if (block_devices == 0) {
+		tty_print_string("Block benchmark skipped, no block devices\n");
+		return;
+	}
+
+	uint8_t* buffers = benchmark_memory(BLOCK_BENCH_DEPTH * 4096);
+	if (buffers == 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+		block_bench_requests[i] = kzalloc(sizeof(block_request_t));
+		if (block_bench_requests[i] == 0) {
+			return;
+		}
+		block_add_buffer(block_bench_requests[i], buffers + i * 4096, 4096);
+		block_bench_requests[i]->sectors = BLOCK_BENCH_SECTORS;
+		block_bench_requests[i]->complete = block_bench_complete;
+	}
+
+	tty_print_string("Block benchmark\n");
+
+	for (block_device_t* device = block_devices; device != 0; device = device->next) {
+		block_bench_blocks = device->sectors / BLOCK_BENCH_SECTORS;
+		if (block_bench_blocks == 0) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+			block_bench_requests[i]->device = device;
+		}
+
+		tty_print_string("  ");
+		tty_print_string(device->name);
+		tty_print_string(", queues: ");
+		print_dec(device->queues);
+		tty_print_string("\n");
+		block_bench_one(device, buffers, false);
+		block_bench_one(device, buffers, true);
+	}
+
+	for (uint32_t i = 0; i < BLOCK_BENCH_DEPTH; i++) {
+		kfree(block_bench_requests[i]);
+	}
+	benchmark_free(buffers, BLOCK_BENCH_DEPTH * 4096);
+}
+
+// FAT reads through the VFS, of the kernel's own initrd on the boot image
+
+#define FAT_BENCH_FILE   "/boot/BOOTBOOT/INITRD"
+#define FAT_BENCH_CHUNK  (64 * 1024)
+#define FAT_BENCH_PASSES 8
+#define FAT_BENCH_RANDOM 4096
+
+static void fat_bench_print(char* label, uint64_t reads, uint64_t bytes, uint64_t cycles) {
+
+	uint64_t us = cycles * 1000000 / tsc_frequency;
+	if (us == 0) {
+		us = 1;
+	}
+
+	tty_print_string(label);
+	print_dec(reads * 1000000 / us);
+	tty_print_string(" reads/s, ");
+	print_dec(bytes / us);
+	tty_print_string(" MB/s\n");
+}
+
+// Every read goes to the disk, so this measures how few requests each read turns into
+static void benchmark_fat(void) {
+
+	dentry_t file;
+	if (vfs_open(FAT_BENCH_FILE, &file) != FS_ERROR_SUCCESS) {
+		tty_print_string("FAT benchmark skipped, no " FAT_BENCH_FILE "\n");
+		return;
+	}
+
+	uint64_t size = file.inode_ptr->size;
+	uint8_t* buffer = benchmark_memory(FAT_BENCH_CHUNK);
+	if (buffer == 0 || size < 4096) {
+		vfs_close(&file);
+		return;
+	}
+
+	tty_print_string("FAT benchmark, " FAT_BENCH_FILE "\n");
+
+	uint64_t reads = 0;
+	uint64_t start = rdtsc();
+	for (uint32_t pass = 0; pass < FAT_BENCH_PASSES; pass++) {
+		for (uint64_t offset = 0; offset < size; offset += FAT_BENCH_CHUNK) {
+			read_fs(&file, offset, FAT_BENCH_CHUNK, buffer);
+			reads++;
+		}
+	}
+	fat_bench_print("  Sequential 64 KiB: ", reads, size * FAT_BENCH_PASSES, rdtsc() - start);
+
+	// Offsets anywhere in the file, found from the cached cluster runs instead of the chain
+	uint64_t x = 0x9e3779b97f4a7c15;
+	start = rdtsc();
+	for (uint32_t i = 0; i < FAT_BENCH_RANDOM; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		read_fs(&file, x % (size - 4096), 4096, buffer);
+	}
+	fat_bench_print("  Random 4 KiB: ", FAT_BENCH_RANDOM, FAT_BENCH_RANDOM * 4096, rdtsc() - start);
+
+	benchmark_free(buffer, FAT_BENCH_CHUNK);
+	vfs_close(&file);
+}
+
+void benchmark_run(void) {
+
+	benchmark_rcu();
+	benchmark_barrier();
+	benchmark_locks();
+	benchmark_barrier();
+	benchmark_tlb();
+	benchmark_barrier();
+
+	// Single core benchmarks, the other cores wait
+	if (cpu_id() == 0) {
+		benchmark_string();
+		benchmark_pcid();
+		benchmark_vmm();
+		benchmark_numa();
+	}
+	benchmark_barrier();
+
+	// The other cores return to the idle loop
+	if (cpu_id() == 0) {
+		benchmark_idle();
+		benchmark_block();
+		benchmark_fat();
+		benchmark_irq_stats();
+	}
+}
+
+#endif // BENCHMARK
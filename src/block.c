@@ -0,0 +1,544 @@
+/*
+ * evan-os/src/block.c
+ *
+ * The block layer. Each core submits to the hardware queue its software
+ * queue maps to, so devices with a queue per core are never shared
+ * between cores. When a hardware queue is full, requests wait on the
+ * submitting core's software queue and are started as earlier ones on
+ * that hardware queue complete.
+ *
+ * A plugged core's requests are sorted by device and sector when the plug
+ * is finished. Runs of adjacent requests going the same way are merged
+ * into one request holding all of their segments, which completes each of
+ * them when it completes.
+ *
+ */
+
+#include <block.h>
+
+#include <asm.h>
+#include <kernel.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <paging.h>
+#include <percpu.h>
+#include <procfs.h>
+#include <softirq.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tty.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Requests held by a plugged core, in the order they were submitted
+typedef struct block_plug_t {
+	uint32_t         depth;
+	uint32_t         count;
+	block_request_t* head;
+	block_request_t* tail;
+} block_plug_t;
+
+block_device_t* block_devices;
+spinlock_t block_devices_lock;
+
+DEFINE_PER_CPU(block_plug_t, block_plug);
+
+// Requests finished by drivers on this core, waiting for the softirq
+DEFINE_PER_CPU(block_request_t*, block_completions);
+
+void block_register(block_device_t* device) {
+
+	device->software = kzalloc(CPU_MAX * sizeof(block_software_queue_t));
+	if (device->software == 0) {
+		tty_print_string("Block device ");
+		tty_print_string(device->name);
+		tty_print_string(" not registered, out of memory\n");
+		return;
+	}
+
+	for (uint32_t cpu = 0; cpu < CPU_MAX; cpu++) {
+		spin_lock_init(&device->software[cpu].lock);
+	}
+
+	spin_lock(&block_devices_lock);
+	device->next = block_devices;
+	block_devices = device;
+	spin_unlock(&block_devices_lock);
+
+	tty_print_string("Block device ");
+	tty_print_string(device->name);
+	tty_print_string(": ");
+	print_dec(device->sectors * BLOCK_SECTOR_SIZE / (1024 * 1024));
+	tty_print_string(" MiB\n");
+}
+EXPORT_SYMBOL(block_register);
+
+block_device_t* block_find(const char* name) {
+
+	spin_lock(&block_devices_lock);
+
+	block_device_t* device = block_devices;
+	while (device != 0 && strcmp(device->name, name) != 0) {
+		device = device->next;
+	}
+
+	spin_unlock(&block_devices_lock);
+	return device;
+}
+EXPORT_SYMBOL(block_find);
+
+uint8_t block_add_buffer(block_request_t* request, void* buffer, uint64_t length) {
+
+	uint64_t virt = (uint64_t)buffer;
+
+	while (length != 0) {
+		uint64_t chunk = PAGE_SIZE - (virt & (PAGE_SIZE - 1));
+		if (chunk > length) {
+			chunk = length;
+		}
+
+		uint64_t phys = paging_translate(&kernel_address_space, virt);
+		if (phys == 0) {
+			return BLOCK_ERROR_SEGMENT;
+		}
+
+		// Physically contiguous pages, such as the direct map, become a single segment
+		block_segment_t* last = request->segment_count != 0 ? &request->segments[request->segment_count - 1] : 0;
+		if (last != 0 && last->phys + last->length == phys) {
+			last->length += chunk;
+		}
+		else {
+			if (request->segment_count == BLOCK_SEGMENTS_MAX) {
+				return BLOCK_ERROR_SEGMENT;
+			}
+			request->segments[request->segment_count].phys = phys;
+			request->segments[request->segment_count].length = chunk;
+			request->segment_count++;
+		}
+
+		virt += chunk;
+		length -= chunk;
+	}
+
+	return BLOCK_SUCCESS;
+}
+EXPORT_SYMBOL(block_add_buffer);
+
+// Set a request's status and call its complete function
+static void block_end(block_request_t* request, uint8_t status) {
+
+	block_complete_t complete = request->complete;
+
+	// A waiter without a complete function may free the request as soon as the status is set
+	__atomic_store_n(&request->status, status, __ATOMIC_RELEASE);
+	if (complete != 0) {
+		complete(request);
+	}
+}
+
+static void block_commit(block_device_t* device, uint32_t queue) {
+	if (device->commit != 0) {
+		device->commit(device, queue);
+	}
+}
+
+// Start a software queue's requests until its hardware queue is full again
+static void block_run_software(block_device_t* device, uint32_t cpu) {
+
+	block_software_queue_t* software = &device->software[cpu];
+	uint32_t queue = cpu % device->queues;
+	bool uncommitted = false;
+
+	uint64_t flags = spin_lock_irqsave(&software->lock);
+
+	while (software->waiting != 0) {
+		block_request_t* request = software->waiting;
+		bool last = request->next == 0;
+
+		request->queue = queue;
+		uint8_t status = device->submit(device, queue, request, last);
+		if (status == BLOCK_ERROR_BUSY) {
+			break;
+		}
+
+		software->waiting = request->next;
+		if (software->waiting == 0) {
+			software->waiting_tail = 0;
+		}
+		__atomic_sub_fetch(&device->waiting, 1, __ATOMIC_RELAXED);
+
+		// Rejected outright, completed after the lock is dropped
+		if (status != BLOCK_SUCCESS) {
+			spin_unlock_irqrestore(&software->lock, flags);
+			block_end(request, status);
+			flags = spin_lock_irqsave(&software->lock);
+			continue;
+		}
+
+		__atomic_add_fetch(&device->dispatched, 1, __ATOMIC_RELAXED);
+		uncommitted = !last;
+	}
+
+	spin_unlock_irqrestore(&software->lock, flags);
+
+	if (uncommitted) {
+		block_commit(device, queue);
+	}
+}
+
+// Start the software queues waiting for room on a hardware queue
+static void block_restart(block_device_t* device, uint32_t queue) {
+
+	if (__atomic_load_n(&device->waiting, __ATOMIC_RELAXED) == 0) {
+		return;
+	}
+
+	for (uint32_t cpu = queue; cpu < cpu_count; cpu += device->queues) {
+		if (__atomic_load_n(&device->software[cpu].waiting, __ATOMIC_RELAXED) != 0) {
+			block_run_software(device, cpu);
+		}
+	}
+}
+
+// Hand a request to the device through this core's software queue
+static void block_dispatch(block_request_t* request, bool last) {
+
+	block_device_t* device = request->device;
+	uint32_t cpu = cpu_id();
+	block_software_queue_t* software = &device->software[cpu];
+
+	request->queue = cpu % device->queues;
+	request->next = 0;
+
+	// Straight to the device unless others from this core are already waiting for room
+	if (__atomic_load_n(&software->waiting, __ATOMIC_RELAXED) == 0) {
+		uint8_t status = device->submit(device, request->queue, request, last);
+		if (status == BLOCK_SUCCESS) {
+			__atomic_add_fetch(&device->dispatched, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		if (status != BLOCK_ERROR_BUSY) {
+			block_end(request, status);
+			return;
+		}
+
+		// Earlier requests of the batch were started without telling the device
+		block_commit(device, request->queue);
+	}
+
+	uint64_t flags = spin_lock_irqsave(&software->lock);
+	if (software->waiting_tail != 0) {
+		software->waiting_tail->next = request;
+	}
+	else {
+		software->waiting = request;
+	}
+	software->waiting_tail = request;
+	__atomic_add_fetch(&device->waiting, 1, __ATOMIC_RELAXED);
+	spin_unlock_irqrestore(&software->lock, flags);
+
+	// Everything in flight may have completed before the request was added
+	block_run_software(device, cpu);
+}
+
+// Complete every request merged into one
+static void block_merged_complete(block_request_t* merged) {
+
+	uint8_t status = merged->status;
+	block_request_t* request = merged->merged;
+
+	while (request != 0) {
+		block_request_t* next = request->next;
+		block_end(request, status);
+		request = next;
+	}
+
+	kfree(merged);
+}
+
+// Whether request can be added to the end of a merge ending with last
+static bool block_can_merge(block_request_t* last, block_request_t* request, uint32_t sectors, uint32_t segments) {
+
+	block_device_t* device = last->device;
+	uint32_t segments_max = device->segments_max != 0 ? device->segments_max : BLOCK_SEGMENTS_MAX;
+
+	return request->device == device && request->write == last->write &&
+		request->sector == last->sector + last->sectors &&
+		segments + request->segment_count <= segments_max &&
+		(device->sectors_max == 0 || sectors + request->sectors <= device->sectors_max);
+}
+
+// One request for a chain of adjacent requests, or 0 if there is no memory for it
+static block_request_t* block_merge(block_request_t* first) {
+
+	block_request_t* merged = kzalloc(sizeof(block_request_t));
+	if (merged == 0) {
+		return 0;
+	}
+
+	merged->device = first->device;
+	merged->sector = first->sector;
+	merged->write = first->write;
+	merged->complete = &block_merged_complete;
+	merged->merged = first;
+
+	for (block_request_t* request = first; request != 0; request = request->next) {
+		merged->sectors += request->sectors;
+
+		for (uint32_t i = 0; i < request->segment_count; i++) {
+			block_segment_t* segment = &request->segments[i];
+			block_segment_t* last = merged->segment_count != 0 ? &merged->segments[merged->segment_count - 1] : 0;
+
+			// Neighbouring pages of one buffer join up again
+			if (last != 0 && last->phys + last->length == segment->phys) {
+				last->length += segment->length;
+			}
+			else {
+				merged->segments[merged->segment_count++] = *segment;
+			}
+		}
+
+		if (request != first) {
+			__atomic_add_fetch(&first->device->merges, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	merged->status = BLOCK_PENDING;
+	return merged;
+}
+
+// Sorted by device, then direction, then sector
+static bool block_sorts_before(block_request_t* a, block_request_t* b) {
+	if (a->device != b->device) {
+		return a->device < b->device;
+	}
+	if (a->write != b->write) {
+		return !a->write;
+	}
+	return a->sector < b->sector;
+}
+
+// Start a plug's requests, merged where they are adjacent
+static void block_flush_plug(block_plug_t* plug) {
+
+	block_request_t* list = plug->head;
+	plug->head = 0;
+	plug->tail = 0;
+	plug->count = 0;
+
+	// Insertion sort, there are at most BLOCK_PLUG_MAX
+	block_request_t* sorted = 0;
+	while (list != 0) {
+		block_request_t* request = list;
+		list = list->next;
+
+		block_request_t** link = &sorted;
+		while (*link != 0 && !block_sorts_before(request, *link)) {
+			link = &(*link)->next;
+		}
+		request->next = *link;
+		*link = request;
+	}
+
+	while (sorted != 0) {
+		block_request_t* first = sorted;
+		block_request_t* last = first;
+		uint32_t sectors = first->sectors;
+		uint32_t segments = first->segment_count;
+
+		while (last->next != 0 && block_can_merge(last, last->next, sectors, segments)) {
+			last = last->next;
+			sectors += last->sectors;
+			segments += last->segment_count;
+		}
+
+		sorted = last->next;
+		last->next = 0;
+
+		// The device is told once the last request for it is started
+		bool batch_end = sorted == 0 || sorted->device != first->device;
+
+		block_request_t* merged = first != last ? block_merge(first) : 0;
+		if (merged != 0) {
+			block_dispatch(merged, batch_end);
+			continue;
+		}
+
+		while (first != 0) {
+			block_request_t* next = first->next;
+			block_dispatch(first, batch_end && next == 0);
+			first = next;
+		}
+	}
+}
+
+void block_submit(block_request_t* request) {
+
+	block_device_t* device = request->device;
+	request->status = BLOCK_PENDING;
+	request->merged = 0;
+	request->next = 0;
+
+	__atomic_add_fetch(&device->requests, 1, __ATOMIC_RELAXED);
+
+	if (request->sector + request->sectors > device->sectors) {
+		block_end(request, BLOCK_ERROR_RANGE);
+		return;
+	}
+
+	// Requests from interrupts and softirqs are never plugged, since the plug's
+	// owner could be interrupted part way through changing it
+	block_plug_t* plug = this_cpu_ptr(block_plug);
+	if (plug->depth != 0 && !in_interrupt()) {
+		if (plug->tail != 0) {
+			plug->tail->next = request;
+		}
+		else {
+			plug->head = request;
+		}
+		plug->tail = request;
+
+		if (++plug->count == BLOCK_PLUG_MAX) {
+			block_flush_plug(plug);
+		}
+		return;
+	}
+
+	block_dispatch(request, true);
+}
+EXPORT_SYMBOL(block_submit);
+
+void block_start_plug(void) {
+	this_cpu_ptr(block_plug)->depth++;
+}
+EXPORT_SYMBOL(block_start_plug);
+
+void block_finish_plug(void) {
+
+	block_plug_t* plug = this_cpu_ptr(block_plug);
+
+	if (--plug->depth == 0 && plug->head != 0) {
+		block_flush_plug(plug);
+	}
+}
+EXPORT_SYMBOL(block_finish_plug);
+
+uint8_t block_wait(block_request_t* request) {
+
+	// The request may still be held by the plug
+	block_plug_t* plug = this_cpu_ptr(block_plug);
+	if (plug->head != 0) {
+		block_flush_plug(plug);
+	}
+
+	block_device_t* device = request->device;
+
+	while (__atomic_load_n(&request->status, __ATOMIC_ACQUIRE) == BLOCK_PENDING) {
+		// Started by whichever core found room, so on any queue
+		for (uint32_t queue = 0; device->poll != 0 && queue < device->queues; queue++) {
+			device->poll(device, queue);
+		}
+		pause();
+	}
+
+	return request->status;
+}
+EXPORT_SYMBOL(block_wait);
+
+void block_complete(block_request_t* request, uint8_t status) {
+
+	request->result = status;
+
+	uint64_t flags = irq_save();
+	request->next = this_cpu_read(block_completions);
+	this_cpu_write(block_completions, request);
+	irq_restore(flags);
+
+	softirq_raise(SOFTIRQ_BLOCK);
+}
+EXPORT_SYMBOL(block_complete);
+
+static void block_softirq(void) {
+
+	uint64_t flags = irq_save();
+	block_request_t* list = this_cpu_read(block_completions);
+	this_cpu_write(block_completions, 0);
+	irq_restore(flags);
+
+	// Pushed newest first, so turned around to complete them in order
+	block_request_t* ordered = 0;
+	while (list != 0) {
+		block_request_t* next = list->next;
+		list->next = ordered;
+		ordered = list;
+		list = next;
+	}
+
+	while (ordered != 0) {
+		block_request_t* next = ordered->next;
+		block_device_t* device = ordered->device;
+		uint32_t queue = ordered->queue;
+
+		block_end(ordered, ordered->result);
+		block_restart(device, queue);
+
+		ordered = next;
+	}
+}
+
+static uint8_t block_transfer(block_device_t* device, uint64_t sector, uint32_t sectors, void* buffer, bool write) {
+
+	// Too big for the small stacks of the application processors
+	block_request_t* request = kzalloc(sizeof(block_request_t));
+	if (request == 0) {
+		return BLOCK_ERROR_SEGMENT;
+	}
+
+	request->device = device;
+	request->sector = sector;
+	request->sectors = sectors;
+	request->write = write;
+
+	uint8_t status = block_add_buffer(request, buffer, (uint64_t)sectors * BLOCK_SECTOR_SIZE);
+	if (status == BLOCK_SUCCESS) {
+		block_submit(request);
+		status = block_wait(request);
+	}
+
+	kfree(request);
+	return status;
+}
+
+uint8_t block_read(block_device_t* device, uint64_t sector, uint32_t sectors, void* buffer) {
+	return block_transfer(device, sector, sectors, buffer, false);
+}
+EXPORT_SYMBOL(block_read);
+
+uint8_t block_write(block_device_t* device, uint64_t sector, uint32_t sectors, void* buffer) {
+	return block_transfer(device, sector, sectors, buffer, true);
+}
+EXPORT_SYMBOL(block_write);
+
+static void block_show_devices(procfs_buffer_t* buffer) {
+
+	procfs_print(buffer, "Device      Queues  Depth    Requests      Merges  Dispatched\n");
+
+	for (block_device_t* device = block_devices; device != 0; device = device->next) {
+		procfs_print(buffer, device->name);
+		for (uint32_t i = strlen(device->name); i < 10; i++) {
+			procfs_print(buffer, " ");
+		}
+		procfs_print_dec(buffer, device->queues, 8);
+		procfs_print_dec(buffer, device->depth, 7);
+		procfs_print_dec(buffer, device->requests, 12);
+		procfs_print_dec(buffer, device->merges, 12);
+		procfs_print_dec(buffer, device->dispatched, 12);
+		procfs_print(buffer, "\n");
+	}
+}
+
+void block_init(void) {
+	softirq_register(SOFTIRQ_BLOCK, &block_softirq);
+	procfs_register("block", &block_show_devices);
+}
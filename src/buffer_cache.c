@@ -0,0 +1,555 @@
+/*
+ * evan-os/src/buffer_cache.c
+ *
+ * The buffer cache. Pages missing from the cache are read in runs, one
+ * request for as many neighbouring pages as the device takes. There are
+ * no threads to flush from, so each device's flusher is idle work queued
+ * on one core, woken by writers and by that core's local APIC timer in
+ * one shot mode, set for when the oldest dirty page of any flusher on the
+ * core comes of age. While profiling has the timer, its ticks check the
+ * flushers instead, and the one shot is set again when it stops.
+ *
+ */
+
+#include <buffer_cache.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <block.h>
+#include <idle.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <page_cache.h>
+#include <paging.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <procfs.h>
+#include <profile.h>
+#include <rcu.h>
+#include <spinlock.h>
+#include <string.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BUFFER_CACHE_PAGE_SECTORS (PAGE_SIZE / BLOCK_SECTOR_SIZE)
+
+// A writeback request, with the part of the batch it holds
+typedef struct buffer_cache_request_t {
+	block_request_t                request;
+	uint32_t                       first;
+	uint32_t                       count;
+	struct buffer_cache_request_t* next;
+} buffer_cache_request_t;
+
+uint32_t buffer_cache_dirty_age = BUFFER_CACHE_DIRTY_AGE;
+uint32_t buffer_cache_dirty_ratio = BUFFER_CACHE_DIRTY_RATIO;
+
+volatile uint64_t buffer_cache_dirty;
+
+// Every cache, newest first. Caches are never freed, so the timer walks the list without the lock
+buffer_cache_t* buffer_caches;
+uint32_t buffer_cache_count;
+spinlock_t buffer_caches_lock;
+
+// Sectors of a page that are on the device, fewer than a page's worth only for its last page
+static uint32_t buffer_cache_page_sectors(block_device_t* device, uint64_t index) {
+	uint64_t first = index * BUFFER_CACHE_PAGE_SECTORS;
+	return device->sectors - first < BUFFER_CACHE_PAGE_SECTORS ? device->sectors - first : BUFFER_CACHE_PAGE_SECTORS;
+}
+
+static uint64_t buffer_cache_age_ticks(void) {
+	return (uint64_t)buffer_cache_dirty_age * tsc_frequency / 1000;
+}
+
+// Whether more than times the dirty ratio of memory is dirty
+static bool buffer_cache_over(uint32_t times) {
+	return __atomic_load_n(&buffer_cache_dirty, __ATOMIC_RELAXED) * 100 > pmm_total_frames * buffer_cache_dirty_ratio * times;
+}
+
+static void buffer_cache_redirty(buffer_cache_t* cache, uint64_t index) {
+	if (page_cache_set_dirty(&cache->pages, index)) {
+		__atomic_add_fetch(&buffer_cache_dirty, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static uint64_t buffer_cache_read_page(page_cache_t* pages, uint64_t index, void* buffer) {
+
+	buffer_cache_t* cache = pages->owner;
+	uint32_t sectors = buffer_cache_page_sectors(cache->device, index);
+
+	memset((uint8_t*)buffer + sectors * BLOCK_SECTOR_SIZE, 0, PAGE_SIZE - sectors * BLOCK_SECTOR_SIZE);
+	return block_read(cache->device, index * BUFFER_CACHE_PAGE_SECTORS, sectors, buffer) != BLOCK_SUCCESS;
+}
+
+static void buffer_cache_flusher(void* arg);
+
+// The device's cache, made the first time it is needed. Returns 0 if there is no memory for it
+static buffer_cache_t* buffer_cache_of(block_device_t* device) {
+
+	buffer_cache_t* cache = __atomic_load_n(&device->cache, __ATOMIC_ACQUIRE);
+	if (cache != 0) {
+		return cache;
+	}
+
+	cache = kzalloc(sizeof(buffer_cache_t));
+	page_cache_entry_t* batch = kmalloc(BUFFER_CACHE_BATCH * sizeof(page_cache_entry_t));
+	if (cache == 0 || batch == 0) {
+		kfree(cache);
+		kfree(batch);
+		return 0;
+	}
+
+	cache->device = device;
+	cache->batch = batch;
+	cache->flusher.func = &buffer_cache_flusher;
+	cache->flusher.arg = cache;
+	spin_lock_init(&cache->flush_lock);
+	page_cache_init(&cache->pages, &buffer_cache_read_page, cache);
+
+	cache->pages_max = device->segments_max != 0 && device->segments_max < BLOCK_SEGMENTS_MAX ? device->segments_max : BLOCK_SEGMENTS_MAX;
+	if (device->sectors_max != 0 && device->sectors_max / BUFFER_CACHE_PAGE_SECTORS < cache->pages_max) {
+		cache->pages_max = device->sectors_max >= BUFFER_CACHE_PAGE_SECTORS ? device->sectors_max / BUFFER_CACHE_PAGE_SECTORS : 1;
+	}
+
+	spin_lock(&buffer_caches_lock);
+
+	// Another core may have made it in the meantime
+	if (device->cache != 0) {
+		spin_unlock(&buffer_caches_lock);
+		kfree(batch);
+		kfree(cache);
+		return device->cache;
+	}
+
+	// Spread the flushers of different devices over the cores
+	cache->cpu = buffer_cache_count++ % cpu_count;
+
+	cache->next = buffer_caches;
+	__atomic_store_n(&buffer_caches, cache, __ATOMIC_RELEASE);
+	__atomic_store_n(&device->cache, cache, __ATOMIC_RELEASE);
+
+	spin_unlock(&buffer_caches_lock);
+	return cache;
+}
+
+// Drop clean pages once a cache holds more than its share of memory
+static void buffer_cache_trim(buffer_cache_t* cache) {
+
+	uint64_t limit = pmm_total_frames / BUFFER_CACHE_MEMORY_SHARE;
+	if (cache->pages.pages > limit) {
+		page_cache_shrink(&cache->pages, limit - limit / 4);
+	}
+}
+
+// Read page index along with the uncached pages after it up to last, in one request, and add them
+// to the cache. Returns the frame of page index with a reference, or 0 if it could not be read
+static uint64_t buffer_cache_fill(buffer_cache_t* cache, uint64_t index, uint64_t last) {
+
+	block_request_t* request = kzalloc(sizeof(block_request_t));
+	if (request == 0) {
+		return 0;
+	}
+
+	request->device = cache->device;
+	request->sector = index * BUFFER_CACHE_PAGE_SECTORS;
+
+	for (uint64_t page = index; page <= last && request->segment_count < cache->pages_max; page++) {
+		if (page != index) {
+			uint64_t cached = page_cache_peek(&cache->pages, page);
+			if (cached != 0) {
+				pmm_page_put(cached);
+				break;
+			}
+		}
+
+		uint64_t frame = pmm_alloc_page();
+		if (frame == 0) {
+			break;
+		}
+
+		uint32_t sectors = buffer_cache_page_sectors(cache->device, page);
+		memset((uint8_t*)phys_to_virt(frame) + sectors * BLOCK_SECTOR_SIZE, 0, PAGE_SIZE - sectors * BLOCK_SECTOR_SIZE);
+
+		request->segments[request->segment_count].phys = frame;
+		request->segments[request->segment_count].length = sectors * BLOCK_SECTOR_SIZE;
+		request->segment_count++;
+		request->sectors += sectors;
+	}
+
+	uint64_t result = 0;
+
+	if (request->segment_count != 0) {
+		block_submit(request);
+		bool read = block_wait(request) == BLOCK_SUCCESS;
+
+		for (uint32_t i = 0; i < request->segment_count; i++) {
+			uint64_t frame = request->segments[i].phys;
+
+			if (!read) {
+				pmm_page_put(frame);
+				continue;
+			}
+
+			frame = page_cache_add(&cache->pages, index + i, frame);
+			if (i == 0) {
+				result = frame;
+			}
+			else if (frame != 0) {
+				pmm_page_put(frame);
+			}
+		}
+	}
+
+	kfree(request);
+	return result;
+}
+
+// Write back the sorted batch, a request for each run of neighbouring pages, all started under one
+// plug. Pages that fail are dirtied again. Returns a BLOCK_ status
+static uint8_t buffer_cache_write_batch(buffer_cache_t* cache, uint32_t count) {
+
+	page_cache_entry_t* batch = cache->batch;
+	buffer_cache_request_t* pending = 0;
+	uint8_t status = BLOCK_SUCCESS;
+
+	block_start_plug();
+
+	for (uint32_t i = 0; i < count; ) {
+		buffer_cache_request_t* request = kzalloc(sizeof(buffer_cache_request_t));
+		if (request == 0) {
+			for (; i < count; i++) {
+				buffer_cache_redirty(cache, batch[i].index);
+			}
+			status = BLOCK_ERROR_IO;
+			break;
+		}
+
+		request->request.device = cache->device;
+		request->request.sector = batch[i].index * BUFFER_CACHE_PAGE_SECTORS;
+		request->request.write = true;
+		request->first = i;
+
+		do {
+			uint32_t sectors = buffer_cache_page_sectors(cache->device, batch[i].index);
+
+			request->request.segments[request->request.segment_count].phys = batch[i].frame;
+			request->request.segments[request->request.segment_count].length = sectors * BLOCK_SECTOR_SIZE;
+			request->request.segment_count++;
+			request->request.sectors += sectors;
+			i++;
+		} while (i < count && request->request.segment_count < cache->pages_max && batch[i].index == batch[i - 1].index + 1);
+
+		request->count = i - request->first;
+		request->next = pending;
+		pending = request;
+
+		block_submit(&request->request);
+	}
+
+	block_finish_plug();
+
+	while (pending != 0) {
+		buffer_cache_request_t* request = pending;
+		pending = request->next;
+
+		if (block_wait(&request->request) == BLOCK_SUCCESS) {
+			__atomic_add_fetch(&cache->written, request->count, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&cache->requests, 1, __ATOMIC_RELAXED);
+		}
+		else {
+			for (uint32_t i = request->first; i < request->first + request->count; i++) {
+				buffer_cache_redirty(cache, batch[i].index);
+			}
+			status = BLOCK_ERROR_IO;
+		}
+
+		kfree(request);
+	}
+
+	return status;
+}
+
+// Write back the pages first dirtied at or before time stamp before, a batch at a time. Pages
+// dirtied again while that happens, or that fail, get a later time stamp and are left for next time
+static uint8_t buffer_cache_flush(buffer_cache_t* cache, uint64_t before) {
+
+	uint8_t status = BLOCK_SUCCESS;
+	uint64_t count;
+
+	spin_lock(&cache->flush_lock);
+
+	while ((count = page_cache_take_dirty(&cache->pages, before, cache->batch, BUFFER_CACHE_BATCH)) != 0) {
+		__atomic_sub_fetch(&buffer_cache_dirty, count, __ATOMIC_RELAXED);
+
+		page_cache_entry_t* batch = cache->batch;
+		for (uint32_t i = 1; i < count; i++) {
+			page_cache_entry_t entry = batch[i];
+			uint32_t j = i;
+			while (j > 0 && batch[j - 1].index > entry.index) {
+				batch[j] = batch[j - 1];
+				j--;
+			}
+			batch[j] = entry;
+		}
+
+		if (buffer_cache_write_batch(cache, count) != BLOCK_SUCCESS) {
+			status = BLOCK_ERROR_IO;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			pmm_page_put(batch[i].frame);
+		}
+	}
+
+	spin_unlock(&cache->flush_lock);
+	return status;
+}
+
+static void buffer_cache_wake(buffer_cache_t* cache) {
+	if (!__atomic_exchange_n(&cache->queued, true, __ATOMIC_SEQ_CST)) {
+		idle_queue_work(cache->cpu, &cache->flusher);
+	}
+}
+
+// Set this core's timer for the next of its flushers waiting for pages to come of age
+static void buffer_cache_arm(void) {
+
+	uint32_t cpu = cpu_id();
+	uint64_t next = 0;
+
+	uint64_t flags = irq_save();
+
+	for (buffer_cache_t* cache = __atomic_load_n(&buffer_caches, __ATOMIC_ACQUIRE); cache != 0; cache = cache->next) {
+		uint64_t due = cache->due;
+		if (cache->cpu == cpu && due != 0 && !cache->queued && (next == 0 || due < next)) {
+			next = due;
+		}
+	}
+
+	// Setting it would stop the profiler's periodic timer, whose ticks check the flushers meanwhile
+	if (next != 0 && !profile_owns_timer()) {
+		uint64_t now = rdtsc();
+		uint64_t wait = next > now ? next - now : 0;
+		apic_timer_oneshot(INTERRUPT_VECTOR_WRITEBACK, wait * 1000000 / tsc_frequency + 1);
+	}
+
+	irq_restore(flags);
+}
+
+void buffer_cache_tick(void) {
+
+	uint64_t now = rdtsc();
+	uint32_t cpu = cpu_id();
+
+	for (buffer_cache_t* cache = __atomic_load_n(&buffer_caches, __ATOMIC_ACQUIRE); cache != 0; cache = cache->next) {
+		uint64_t due = cache->due;
+		if (cache->cpu == cpu && due != 0 && due <= now) {
+			buffer_cache_wake(cache);
+		}
+	}
+
+	// For flushers on this core that are not due yet
+	buffer_cache_arm();
+}
+
+__attribute__((interrupt))
+static void buffer_cache_timer(__attribute__((unused)) struct interrupt_frame* frame) {
+
+	uint64_t start = rdtsc();
+	rcu_irq_enter();
+
+	buffer_cache_tick();
+
+	apic_eoi();
+	interrupt_account(INTERRUPT_VECTOR_WRITEBACK, start);
+	rcu_irq_exit();
+}
+
+static void buffer_cache_flusher(void* arg) {
+
+	buffer_cache_t* cache = arg;
+
+	__atomic_store_n(&cache->queued, false, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(&cache->flushes, 1, __ATOMIC_RELAXED);
+
+	// Past the dirty ratio every page goes, otherwise only those old enough
+	uint64_t now = rdtsc();
+	uint64_t age = buffer_cache_age_ticks();
+	buffer_cache_flush(cache, buffer_cache_over(1) ? now : now > age ? now - age : 0);
+
+	uint64_t oldest = page_cache_oldest_dirty(&cache->pages);
+	__atomic_store_n(&cache->due, oldest != 0 ? oldest + age : 0, __ATOMIC_SEQ_CST);
+
+	// A writer that dirtied a page after the oldest was found, but still saw the old due, did not wake
+	// the flusher. Either it sees due cleared, or this sees its page
+	if (oldest == 0) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&cache->pages.dirty, __ATOMIC_RELAXED) != 0) {
+			buffer_cache_wake(cache);
+		}
+	}
+
+	buffer_cache_arm();
+}
+
+// After a writer dirtied pages: wake the flusher to set its timer if it has none, or to write back
+// now past the dirty ratio. Past twice the ratio the writer can not wait for it
+static void buffer_cache_dirtied(buffer_cache_t* cache) {
+
+	if (buffer_cache_over(2)) {
+		buffer_cache_flush(cache, rdtsc());
+		return;
+	}
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&cache->due, __ATOMIC_RELAXED) == 0 || buffer_cache_over(1)) {
+		buffer_cache_wake(cache);
+	}
+}
+
+uint8_t buffer_cache_read(block_device_t* device, uint64_t offset, uint64_t length, void* buffer) {
+
+	if (length == 0) {
+		return BLOCK_SUCCESS;
+	}
+
+	if (offset + length < offset || offset + length > device->sectors * BLOCK_SECTOR_SIZE) {
+		return BLOCK_ERROR_RANGE;
+	}
+
+	buffer_cache_t* cache = buffer_cache_of(device);
+	if (cache == 0) {
+		return BLOCK_ERROR_IO;
+	}
+
+	uint8_t* data = buffer;
+	uint64_t last = (offset + length - 1) / PAGE_SIZE;
+	uint8_t status = BLOCK_SUCCESS;
+
+	while (length != 0) {
+		uint64_t index = offset / PAGE_SIZE;
+		uint64_t within = offset % PAGE_SIZE;
+		uint64_t chunk = PAGE_SIZE - within < length ? PAGE_SIZE - within : length;
+
+		uint64_t frame = page_cache_peek(&cache->pages, index);
+		if (frame == 0) {
+			frame = buffer_cache_fill(cache, index, last);
+		}
+
+		if (frame == 0) {
+			status = BLOCK_ERROR_IO;
+			break;
+		}
+
+		memcpy(data, (uint8_t*)phys_to_virt(frame) + within, chunk);
+		pmm_page_put(frame);
+
+		offset += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+
+	buffer_cache_trim(cache);
+	return status;
+}
+EXPORT_SYMBOL(buffer_cache_read);
+
+uint8_t buffer_cache_write(block_device_t* device, uint64_t offset, uint64_t length, const void* buffer) {
+
+	if (length == 0) {
+		return BLOCK_SUCCESS;
+	}
+
+	if (offset + length < offset || offset + length > device->sectors * BLOCK_SECTOR_SIZE) {
+		return BLOCK_ERROR_RANGE;
+	}
+
+	buffer_cache_t* cache = buffer_cache_of(device);
+	if (cache == 0) {
+		return BLOCK_ERROR_IO;
+	}
+
+	const uint8_t* data = buffer;
+	uint8_t status = BLOCK_SUCCESS;
+	bool dirtied = false;
+
+	while (length != 0) {
+		uint64_t index = offset / PAGE_SIZE;
+		uint64_t within = offset % PAGE_SIZE;
+		uint64_t chunk = PAGE_SIZE - within < length ? PAGE_SIZE - within : length;
+
+		// Pages written whole are not read first
+		uint64_t frame = chunk == PAGE_SIZE ? page_cache_get_new(&cache->pages, index) : page_cache_get(&cache->pages, index);
+		if (frame == 0) {
+			status = BLOCK_ERROR_IO;
+			break;
+		}
+
+		// Dirtied after the copy, so a flusher that takes the page part way through sees it dirty again
+		memcpy((uint8_t*)phys_to_virt(frame) + within, data, chunk);
+		if (page_cache_set_dirty(&cache->pages, index)) {
+			__atomic_add_fetch(&buffer_cache_dirty, 1, __ATOMIC_RELAXED);
+			dirtied = true;
+		}
+		pmm_page_put(frame);
+
+		offset += chunk;
+		data += chunk;
+		length -= chunk;
+	}
+
+	if (dirtied) {
+		buffer_cache_dirtied(cache);
+	}
+
+	buffer_cache_trim(cache);
+	return status;
+}
+EXPORT_SYMBOL(buffer_cache_write);
+
+uint8_t buffer_cache_sync(block_device_t* device) {
+
+	buffer_cache_t* cache = __atomic_load_n(&device->cache, __ATOMIC_ACQUIRE);
+	if (cache == 0) {
+		return BLOCK_SUCCESS;
+	}
+
+	return buffer_cache_flush(cache, rdtsc());
+}
+EXPORT_SYMBOL(buffer_cache_sync);
+
+static void buffer_cache_show(procfs_buffer_t* buffer) {
+
+	procfs_print(buffer, "Dirty age ");
+	procfs_print_dec(buffer, buffer_cache_dirty_age, 0);
+	procfs_print(buffer, " ms, ratio ");
+	procfs_print_dec(buffer, buffer_cache_dirty_ratio, 0);
+	procfs_print(buffer, "%, ");
+	procfs_print_dec(buffer, buffer_cache_dirty, 0);
+	procfs_print(buffer, " pages dirty\n");
+
+	procfs_print(buffer, "Device    Core    Cached     Dirty   Written  Requests   Flushes\n");
+
+	for (buffer_cache_t* cache = __atomic_load_n(&buffer_caches, __ATOMIC_ACQUIRE); cache != 0; cache = cache->next) {
+		procfs_print(buffer, cache->device->name);
+		for (uint32_t i = strlen(cache->device->name); i < 10; i++) {
+			procfs_print(buffer, " ");
+		}
+		procfs_print_dec(buffer, cache->cpu, 4);
+		procfs_print_dec(buffer, cache->pages.pages, 10);
+		procfs_print_dec(buffer, cache->pages.dirty, 10);
+		procfs_print_dec(buffer, cache->written, 10);
+		procfs_print_dec(buffer, cache->requests, 10);
+		procfs_print_dec(buffer, cache->flushes, 10);
+		procfs_print(buffer, "\n");
+	}
+}
+
+void buffer_cache_init(void) {
+	spin_lock_init(&buffer_caches_lock);
+	interrupt_set_gate(INTERRUPT_VECTOR_WRITEBACK, (uint64_t)&buffer_cache_timer, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	procfs_register("buffer_cache", &buffer_cache_show);
+}
@@ -0,0 +1,144 @@
+/*
+ * evan-os/src/cpu.c
+ *
+ * Reads the processor's features from CPUID into a table during boot
+ *
+ */
+
+#include <cpu.h>
+
+#include <asm.h>
+#include <percpu.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CPUID_EAX 0
+#define CPUID_EBX 1
+#define CPUID_ECX 2
+#define CPUID_EDX 3
+
+// Where each feature's bit is found in cpuid's output
+typedef struct cpu_feature_bit_t {
+	uint8_t  feature;
+	uint32_t leaf;
+	uint8_t  subleaf;
+	uint8_t  reg;
+	uint8_t  bit;
+} cpu_feature_bit_t;
+
+const cpu_feature_bit_t cpu_feature_bits[] = {
+	{ CPU_FEATURE_FPU,           0x1,        0, CPUID_EDX, 0 },
+	{ CPU_FEATURE_TSC,           0x1,        0, CPUID_EDX, 4 },
+	{ CPU_FEATURE_MSR,           0x1,        0, CPUID_EDX, 5 },
+	{ CPU_FEATURE_PAE,           0x1,        0, CPUID_EDX, 6 },
+	{ CPU_FEATURE_APIC,          0x1,        0, CPUID_EDX, 9 },
+	{ CPU_FEATURE_PGE,           0x1,        0, CPUID_EDX, 13 },
+	{ CPU_FEATURE_PAT,           0x1,        0, CPUID_EDX, 16 },
+	{ CPU_FEATURE_CLFLUSH,       0x1,        0, CPUID_EDX, 19 },
+	{ CPU_FEATURE_FXSR,          0x1,        0, CPUID_EDX, 24 },
+	{ CPU_FEATURE_SSE,           0x1,        0, CPUID_EDX, 25 },
+	{ CPU_FEATURE_SSE2,          0x1,        0, CPUID_EDX, 26 },
+	{ CPU_FEATURE_HTT,           0x1,        0, CPUID_EDX, 28 },
+	{ CPU_FEATURE_SSE3,          0x1,        0, CPUID_ECX, 0 },
+	{ CPU_FEATURE_MONITOR,       0x1,        0, CPUID_ECX, 3 },
+	{ CPU_FEATURE_SSSE3,         0x1,        0, CPUID_ECX, 9 },
+	{ CPU_FEATURE_PCID,          0x1,        0, CPUID_ECX, 17 },
+	{ CPU_FEATURE_SSE4_1,        0x1,        0, CPUID_ECX, 19 },
+	{ CPU_FEATURE_SSE4_2,        0x1,        0, CPUID_ECX, 20 },
+	{ CPU_FEATURE_X2APIC,        0x1,        0, CPUID_ECX, 21 },
+	{ CPU_FEATURE_POPCNT,        0x1,        0, CPUID_ECX, 23 },
+	{ CPU_FEATURE_TSC_DEADLINE,  0x1,        0, CPUID_ECX, 24 },
+	{ CPU_FEATURE_XSAVE,         0x1,        0, CPUID_ECX, 26 },
+	{ CPU_FEATURE_OSXSAVE,       0x1,        0, CPUID_ECX, 27 },
+	{ CPU_FEATURE_AVX,           0x1,        0, CPUID_ECX, 28 },
+	{ CPU_FEATURE_RDRAND,        0x1,        0, CPUID_ECX, 30 },
+	{ CPU_FEATURE_HYPERVISOR,    0x1,        0, CPUID_ECX, 31 },
+	{ CPU_FEATURE_ARAT,          0x6,        0, CPUID_EAX, 2 },
+	{ CPU_FEATURE_FSGSBASE,      0x7,        0, CPUID_EBX, 0 },
+	{ CPU_FEATURE_AVX2,          0x7,        0, CPUID_EBX, 5 },
+	{ CPU_FEATURE_SMEP,          0x7,        0, CPUID_EBX, 7 },
+	{ CPU_FEATURE_ERMS,          0x7,        0, CPUID_EBX, 9 },
+	{ CPU_FEATURE_INVPCID,       0x7,        0, CPUID_EBX, 10 },
+	{ CPU_FEATURE_AVX512F,       0x7,        0, CPUID_EBX, 16 },
+	{ CPU_FEATURE_SMAP,          0x7,        0, CPUID_EBX, 20 },
+	{ CPU_FEATURE_CLFLUSHOPT,    0x7,        0, CPUID_EBX, 23 },
+	{ CPU_FEATURE_CLWB,          0x7,        0, CPUID_EBX, 24 },
+	{ CPU_FEATURE_FSRM,          0x7,        0, CPUID_EDX, 4 },
+	{ CPU_FEATURE_XSAVEOPT,      0xd,        1, CPUID_EAX, 0 },
+	{ CPU_FEATURE_XSAVEC,        0xd,        1, CPUID_EAX, 1 },
+	{ CPU_FEATURE_XSAVES,        0xd,        1, CPUID_EAX, 3 },
+	{ CPU_FEATURE_SYSCALL,       0x80000001, 0, CPUID_EDX, 11 },
+	{ CPU_FEATURE_NX,            0x80000001, 0, CPUID_EDX, 20 },
+	{ CPU_FEATURE_PAGE_1GB,      0x80000001, 0, CPUID_EDX, 26 },
+	{ CPU_FEATURE_RDTSCP,        0x80000001, 0, CPUID_EDX, 27 },
+	{ CPU_FEATURE_INVARIANT_TSC, 0x80000007, 0, CPUID_EDX, 8 },
+};
+
+cpu_info_t cpu_info;
+
+volatile bool cpu_info_ready;
+
+void cpu_features_init(void) {
+
+	// Every core has the same features, so only one needs to read them
+	if (cpu_id() != 0) {
+		while (!cpu_info_ready) {
+			pause();
+		}
+		return;
+	}
+
+	uint32_t regs[4];
+
+	// The vendor string is spread across ebx, edx and ecx
+	cpuid(0, 0, &regs[CPUID_EAX], &regs[CPUID_EBX], &regs[CPUID_ECX], &regs[CPUID_EDX]);
+	cpu_info.max_leaf = regs[CPUID_EAX];
+	uint32_t vendor[3] = { regs[CPUID_EBX], regs[CPUID_EDX], regs[CPUID_ECX] };
+	for (uint32_t i = 0; i < 12; i++) {
+		cpu_info.vendor[i] = (char)(vendor[i / 4] >> ((i % 4) * 8));
+	}
+	cpu_info.vendor[12] = '\0';
+
+	cpuid(0x80000000, 0, &regs[CPUID_EAX], &regs[CPUID_EBX], &regs[CPUID_ECX], &regs[CPUID_EDX]);
+	cpu_info.max_ext_leaf = regs[CPUID_EAX];
+
+	// Decode the family and model, including the extended fields
+	cpuid(1, 0, &regs[CPUID_EAX], &regs[CPUID_EBX], &regs[CPUID_ECX], &regs[CPUID_EDX]);
+	cpu_info.stepping = regs[CPUID_EAX] & 0xf;
+	cpu_info.model = (regs[CPUID_EAX] >> 4) & 0xf;
+	cpu_info.family = (regs[CPUID_EAX] >> 8) & 0xf;
+	if (cpu_info.family == 0xf) {
+		cpu_info.family += (regs[CPUID_EAX] >> 20) & 0xff;
+	}
+	if (cpu_info.family >= 0x6) {
+		cpu_info.model |= ((regs[CPUID_EAX] >> 16) & 0xf) << 4;
+	}
+	cpu_info.clflush_size = ((regs[CPUID_EBX] >> 8) & 0xff) * 8;
+
+	// Address widths, with the architectural minimums as defaults
+	cpu_info.phys_bits = 36;
+	cpu_info.virt_bits = 48;
+	if (cpu_info.max_ext_leaf >= 0x80000008) {
+		cpuid(0x80000008, 0, &regs[CPUID_EAX], &regs[CPUID_EBX], &regs[CPUID_ECX], &regs[CPUID_EDX]);
+		cpu_info.phys_bits = regs[CPUID_EAX] & 0xff;
+		cpu_info.virt_bits = (regs[CPUID_EAX] >> 8) & 0xff;
+	}
+
+	for (uint32_t i = 0; i < sizeof(cpu_feature_bits) / sizeof(cpu_feature_bit_t); i++) {
+		const cpu_feature_bit_t* bit = &cpu_feature_bits[i];
+
+		// Leaves above the maximum return garbage instead of zeros
+		uint32_t max = bit->leaf >= 0x80000000 ? cpu_info.max_ext_leaf : cpu_info.max_leaf;
+		if (bit->leaf > max) {
+			continue;
+		}
+
+		cpuid(bit->leaf, bit->subleaf, &regs[CPUID_EAX], &regs[CPUID_EBX], &regs[CPUID_ECX], &regs[CPUID_EDX]);
+		if ((regs[bit->reg] >> bit->bit) & 1) {
+			cpu_info.features[bit->feature / 64] |= 1ull << (bit->feature % 64);
+		}
+	}
+
+	__atomic_store_n(&cpu_info_ready, true, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,154 @@
+/*
+ * evan-os/src/devfs.c
+ *
+ * The device filesystem. Nodes are never freed, so opening one is a walk
+ * of its hash chain without taking any lock, and hands out the inode kept
+ * in the node itself. Only registering takes the lock.
+ *
+ */
+
+#include <devfs.h>
+
+#include <module.h>
+#include <spinlock.h>
+#include <string.h>
+#include <vfs.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+devfs_node_t* devfs_buckets[DEVFS_BUCKETS];
+spinlock_t devfs_lock;
+uint32_t devfs_nodes;
+
+superblock_t devfs_superblock;
+
+// FNV-1a
+static uint32_t devfs_hash(const char* name) {
+
+	uint32_t hash = 2166136261u;
+	while (*name != '\0') {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+
+	return hash;
+}
+
+static devfs_node_t* devfs_find(const char* name) {
+
+	devfs_node_t* node = __atomic_load_n(&devfs_buckets[devfs_hash(name) % DEVFS_BUCKETS], __ATOMIC_ACQUIRE);
+	while (node != 0 && strcmp(node->name, name) != 0) {
+		node = node->next;
+	}
+
+	return node;
+}
+
+static inode_t* devfs_lookup(__attribute__((unused)) superblock_t* superblock, const char* path) {
+
+	devfs_node_t* node = devfs_find(path);
+	return node != 0 ? &node->inode : 0;
+}
+
+void devfs_init(void) {
+
+	spin_lock_init(&devfs_lock);
+
+	memcpy(devfs_superblock.fs_type, "devfs", 6);
+	devfs_superblock.ops.lookup = &devfs_lookup;
+
+	vfs_mount("/dev", &devfs_superblock);
+}
+
+// Whether a node can go in /dev, before anything about it is known to be safe to change
+static uint64_t devfs_check(devfs_node_t* node) {
+
+	// /dev is flat, so names are a single part of a path
+	uint64_t length = 0;
+	while (length < sizeof(node->name) && node->name[length] != '\0') {
+		if (node->name[length++] == '/') {
+			return FS_ERROR_INVALID_PATH;
+		}
+	}
+
+	if (length == 0 || length == sizeof(node->name)) {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	if (node->type != FS_CHARDEVICE && node->type != FS_BLOCKDEVICE) {
+		return FS_ERROR_NODE_TYPE;
+	}
+
+	return FS_ERROR_SUCCESS;
+}
+
+// Whether the node, or another with its name, is already in /dev. Called with devfs_lock held
+static bool devfs_taken(devfs_node_t* node) {
+
+	for (devfs_node_t* other = devfs_buckets[devfs_hash(node->name) % DEVFS_BUCKETS]; other != 0; other = other->next) {
+		if (other == node || strcmp(other->name, node->name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint64_t devfs_register_nodes(devfs_node_t** nodes, uint32_t count) {
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t error = devfs_check(nodes[i]);
+		if (error != FS_ERROR_SUCCESS) {
+			return error;
+		}
+	}
+
+	spin_lock(&devfs_lock);
+
+	// A node already in /dev is in use, so nothing is changed until every node is known to be new
+	for (uint32_t i = 0; i < count; i++) {
+		bool taken = devfs_taken(nodes[i]);
+		for (uint32_t j = 0; j < i && !taken; j++) {
+			taken = nodes[j] == nodes[i] || strcmp(nodes[j]->name, nodes[i]->name) == 0;
+		}
+
+		if (taken) {
+			spin_unlock(&devfs_lock);
+			return FS_ERROR_FAILURE;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		devfs_node_t* node = nodes[i];
+
+		// The driver's callbacks become the node's own operations, so the VFS calls them directly
+		memset(&node->superblock, 0, sizeof(superblock_t));
+		memcpy(node->superblock.fs_type, "devfs", 6);
+		node->superblock.ops.read_inode = node->read;
+		node->superblock.ops.write_inode = node->write;
+		node->superblock.private_data = node;
+
+		memset(&node->inode, 0, sizeof(inode_t));
+		node->inode.id = ++devfs_nodes;
+		node->inode.type = node->type;
+		node->inode.size = node->size != 0 ? node->size : UINT64_MAX;
+		node->inode.link_count = 1;
+		node->inode.superblock = &node->superblock;
+		node->inode.private_data = node;
+
+		devfs_node_t** bucket = &devfs_buckets[devfs_hash(node->name) % DEVFS_BUCKETS];
+		node->next = *bucket;
+
+		// Published last, for lookups walking the chain without the lock
+		__atomic_store_n(bucket, node, __ATOMIC_RELEASE);
+	}
+
+	spin_unlock(&devfs_lock);
+	return FS_ERROR_SUCCESS;
+}
+EXPORT_SYMBOL(devfs_register_nodes);
+
+uint64_t devfs_register(devfs_node_t* node) {
+	return devfs_register_nodes(&node, 1);
+}
+EXPORT_SYMBOL(devfs_register);
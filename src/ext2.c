@@ -0,0 +1,1512 @@
+/*
+ * evan-os/src/ext2.c
+ *
+ * The ext2 filesystem. Every operation on a volume holds its lock, and
+ * works on its metadata through a cache of blocks. Changed blocks, along
+ * with the group descriptors and superblock kept in memory, are handed to
+ * the buffer cache when the operation finishes, so they age and are
+ * written back along with the data they describe. File data is read and
+ * written through the buffer cache a run of contiguous blocks at a time,
+ * and new blocks are placed straight after the ones before them in the
+ * file. write_fs_disk and write_inode_disk wait for all of it to reach
+ * the disk.
+ *
+ */
+
+#include <ext2.h>
+
+#include <block.h>
+#include <buffer_cache.h>
+#include <kmalloc.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tty.h>
+#include <vfs.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EXT2_SUPERBLOCK_OFFSET 1024
+#define EXT2_SUPERBLOCK_SIZE   1024
+#define EXT2_MAGIC             0xef53
+#define EXT2_ROOT              2
+
+// Revision 0 volumes have fixed size inodes
+#define EXT2_OLD_INODE_SIZE  128
+
+// Features this driver understands. Volumes with other incompatible features are not mounted,
+// and volumes with other read only compatible features are mounted read only
+#define EXT2_INCOMPAT_FILETYPE      0x0002
+#define EXT2_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT2_RO_COMPAT_LARGE_FILE   0x0002
+
+#define EXT2_INCOMPAT_SUPPORTED  EXT2_INCOMPAT_FILETYPE
+#define EXT2_RO_COMPAT_SUPPORTED (EXT2_RO_COMPAT_SPARSE_SUPER | EXT2_RO_COMPAT_LARGE_FILE)
+
+// Block pointers in an inode
+#define EXT2_DIRECT_BLOCKS 12
+#define EXT2_INDIRECT      12
+#define EXT2_DOUBLE        13
+#define EXT2_TRIPLE        14
+#define EXT2_BLOCK_POINTERS 15
+
+// Inode modes and flags
+#define EXT2_S_IFMT   0xf000
+#define EXT2_S_IFIFO  0x1000
+#define EXT2_S_IFCHR  0x2000
+#define EXT2_S_IFDIR  0x4000
+#define EXT2_S_IFBLK  0x6000
+#define EXT2_S_IFREG  0x8000
+#define EXT2_S_IFLNK  0xa000
+#define EXT2_FILE_MODE      (EXT2_S_IFREG | 0644)
+#define EXT2_DIRECTORY_MODE (EXT2_S_IFDIR | 0755)
+
+#define EXT2_INDEX_FL 0x1000 // A hashed directory
+
+// Directory entry types, with the filetype feature
+#define EXT2_FT_REG_FILE 1
+#define EXT2_FT_DIR      2
+
+#define EXT2_NAME_MAX 255
+
+// Bytes an entry with a name of length takes
+#define EXT2_DIRENT_LENGTH(length) ((8 + (length) + 3) & ~3u)
+
+// Metadata blocks cached for each volume
+#define EXT2_BUFFERS        256
+#define EXT2_BUFFER_BUCKETS 64
+
+#define EXT2_NODE_BUCKETS 64
+
+// MBR partition table
+#define MBR_SIGNATURE       510
+#define MBR_PARTITIONS      446
+#define MBR_PARTITION_SIZE  16
+#define MBR_PARTITION_TYPE  4
+#define MBR_PARTITION_START 8
+#define MBR_TYPE_LINUX      0x83
+
+typedef struct ext2_superblock_t {
+	uint32_t inodes_count;
+	uint32_t blocks_count;
+	uint32_t reserved_blocks_count;
+	uint32_t free_blocks_count;
+	uint32_t free_inodes_count;
+	uint32_t first_data_block;
+	uint32_t log_block_size;
+	uint32_t log_fragment_size;
+	uint32_t blocks_per_group;
+	uint32_t fragments_per_group;
+	uint32_t inodes_per_group;
+	uint32_t mount_time;
+	uint32_t write_time;
+	uint16_t mount_count;
+	uint16_t max_mount_count;
+	uint16_t magic;
+	uint16_t state;
+	uint16_t errors;
+	uint16_t minor_revision;
+	uint32_t last_check;
+	uint32_t check_interval;
+	uint32_t creator_os;
+	uint32_t revision;
+	uint16_t default_uid;
+	uint16_t default_gid;
+	uint32_t first_inode;
+	uint16_t inode_size;
+	uint16_t block_group;
+	uint32_t feature_compat;
+	uint32_t feature_incompat;
+	uint32_t feature_ro_compat;
+	uint8_t  rest[EXT2_SUPERBLOCK_SIZE - 104];
+} ext2_superblock_t;
+
+typedef struct ext2_group_t {
+	uint32_t block_bitmap;
+	uint32_t inode_bitmap;
+	uint32_t inode_table;
+	uint16_t free_blocks;
+	uint16_t free_inodes;
+	uint16_t directories;
+	uint16_t pad;
+	uint32_t reserved[3];
+} ext2_group_t;
+
+// The part of an inode every revision has
+typedef struct ext2_inode_t {
+	uint16_t mode;
+	uint16_t uid;
+	uint32_t size;
+	uint32_t access_time;
+	uint32_t change_time;
+	uint32_t modify_time;
+	uint32_t delete_time;
+	uint16_t gid;
+	uint16_t links;
+	uint32_t sectors; // In 512 byte units, whatever the block size
+	uint32_t flags;
+	uint32_t os1;
+	uint32_t block[EXT2_BLOCK_POINTERS];
+	uint32_t generation;
+	uint32_t file_acl;
+	uint32_t size_high; // Regular files with the large file feature
+	uint32_t fragment;
+	uint8_t  os2[12];
+} ext2_inode_t;
+
+typedef struct ext2_dirent_t {
+	uint32_t inode;
+	uint16_t length;
+	uint8_t  name_length;
+	uint8_t  type;
+	char     name[];
+} ext2_dirent_t;
+
+typedef struct ext2_buffer_t {
+	uint32_t              block; // 0 while unused
+	uint32_t              users;
+	uint64_t              used;  // When it was last used, to reuse the oldest
+	bool                  dirty;
+	uint8_t*              data;
+	struct ext2_buffer_t* next;
+} ext2_buffer_t;
+
+typedef struct ext2_node_t {
+	inode_t             inode; // Its id is the inode number
+	uint32_t            users;
+	uint32_t            goal;  // Where the file's next new block should go, or 0 to work it out
+	ext2_inode_t        raw;
+	struct ext2_node_t* next;
+} ext2_node_t;
+
+typedef struct ext2_volume_t {
+	superblock_t       superblock;
+	block_device_t*    device;
+	uint64_t           start;
+	bool               read_only;
+
+	ext2_superblock_t* super;
+	bool               super_dirty;
+	ext2_group_t*      groups;
+	bool*              groups_dirty; // For each block of the descriptor table
+	uint32_t           group_count;
+	uint32_t           group_blocks;
+
+	uint32_t           block_size;
+	uint32_t           block_sectors;
+	uint32_t           inode_size;
+
+	ext2_buffer_t      buffers[EXT2_BUFFERS];
+	ext2_buffer_t*     buckets[EXT2_BUFFER_BUCKETS];
+	uint8_t*           buffer_data;
+	uint32_t           dirty_count;
+	uint64_t           tick;
+
+	ext2_node_t*       nodes[EXT2_NODE_BUCKETS];
+	spinlock_t         lock;
+} ext2_volume_t;
+
+static uint64_t ext2_sector(ext2_volume_t* volume, uint32_t block) {
+	return volume->start + (uint64_t)block * volume->block_sectors;
+}
+
+// There is no clock, so changes are dated to when the host last wrote the volume
+static uint32_t ext2_now(ext2_volume_t* volume) {
+	return volume->super->write_time;
+}
+
+static uint16_t ext2_read16(const uint8_t* p) {
+	return p[0] | p[1] << 8;
+}
+
+// Byte offset of a block on the device
+static uint64_t ext2_offset(ext2_volume_t* volume, uint32_t block) {
+	return ext2_sector(volume, block) * BLOCK_SECTOR_SIZE;
+}
+
+// Hand the superblock, changed group descriptors and every dirty cached block to the buffer cache
+static uint64_t ext2_flush(ext2_volume_t* volume) {
+
+	block_device_t* device = volume->device;
+	uint64_t status = FS_ERROR_SUCCESS;
+
+	if (volume->super_dirty) {
+		uint64_t offset = volume->start * BLOCK_SECTOR_SIZE + EXT2_SUPERBLOCK_OFFSET;
+		if (buffer_cache_write(device, offset, EXT2_SUPERBLOCK_SIZE, volume->super) != BLOCK_SUCCESS) {
+			return FS_ERROR_FAILURE;
+		}
+		volume->super_dirty = false;
+	}
+
+	// The descriptor table follows the superblock's block
+	for (uint32_t i = 0; i < volume->group_blocks; i++) {
+		if (volume->groups_dirty[i]) {
+			uint8_t* data = (uint8_t*)volume->groups + (uint64_t)i * volume->block_size;
+			uint32_t block = volume->super->first_data_block + 1 + i;
+
+			if (buffer_cache_write(device, ext2_offset(volume, block), volume->block_size, data) != BLOCK_SUCCESS) {
+				return FS_ERROR_FAILURE;
+			}
+			volume->groups_dirty[i] = false;
+		}
+	}
+
+	for (uint32_t i = 0; i < EXT2_BUFFERS && volume->dirty_count != 0; i++) {
+		ext2_buffer_t* buffer = &volume->buffers[i];
+
+		if (buffer->dirty) {
+			if (buffer_cache_write(device, ext2_offset(volume, buffer->block), volume->block_size, buffer->data) != BLOCK_SUCCESS) {
+				status = FS_ERROR_FAILURE;
+				continue;
+			}
+			buffer->dirty = false;
+			volume->dirty_count--;
+		}
+	}
+
+	return status;
+}
+
+// At the end of every operation that changed metadata
+static void ext2_writeback(ext2_volume_t* volume) {
+	ext2_flush(volume);
+}
+
+static void ext2_buffer_unhash(ext2_volume_t* volume, ext2_buffer_t* buffer) {
+
+	for (ext2_buffer_t** link = &volume->buckets[buffer->block % EXT2_BUFFER_BUCKETS]; *link != 0; link = &(*link)->next) {
+		if (*link == buffer) {
+			*link = buffer->next;
+			break;
+		}
+	}
+
+	buffer->block = 0;
+}
+
+// The cached copy of a block, read from the disk, or zeroed for the caller to fill in if fill is
+// false. Held until ext2_buffer_put. Returns 0 if it can not be read, or every buffer is held
+static ext2_buffer_t* ext2_buffer_get(ext2_volume_t* volume, uint32_t block, bool fill) {
+
+	ext2_buffer_t** bucket = &volume->buckets[block % EXT2_BUFFER_BUCKETS];
+	ext2_buffer_t* buffer;
+
+	for (buffer = *bucket; buffer != 0 && buffer->block != block; buffer = buffer->next);
+
+	if (buffer == 0) {
+		// Reuse the least recently used buffer nobody holds
+		for (uint32_t i = 0; i < EXT2_BUFFERS; i++) {
+			ext2_buffer_t* candidate = &volume->buffers[i];
+			if (candidate->users == 0 && (buffer == 0 || candidate->used < buffer->used)) {
+				buffer = candidate;
+			}
+		}
+
+		if (buffer == 0 || (buffer->dirty && ext2_flush(volume) != FS_ERROR_SUCCESS)) {
+			return 0;
+		}
+
+		if (buffer->block != 0) {
+			ext2_buffer_unhash(volume, buffer);
+		}
+
+		if (fill && buffer_cache_read(volume->device, ext2_offset(volume, block), volume->block_size, buffer->data) != BLOCK_SUCCESS) {
+			return 0;
+		}
+
+		buffer->block = block;
+		buffer->next = *bucket;
+		*bucket = buffer;
+	}
+
+	if (!fill) {
+		memset(buffer->data, 0, volume->block_size);
+	}
+
+	buffer->users++;
+	buffer->used = ++volume->tick;
+
+	return buffer;
+}
+
+static void ext2_buffer_put(ext2_buffer_t* buffer) {
+	if (buffer != 0) {
+		buffer->users--;
+	}
+}
+
+static void ext2_buffer_dirty(ext2_volume_t* volume, ext2_buffer_t* buffer) {
+	if (!buffer->dirty) {
+		buffer->dirty = true;
+		volume->dirty_count++;
+	}
+}
+
+// Drop a freed block from the cache, so a stale copy is never written over its next owner
+static void ext2_buffer_forget(ext2_volume_t* volume, uint32_t block) {
+
+	ext2_buffer_t* buffer;
+	for (buffer = volume->buckets[block % EXT2_BUFFER_BUCKETS]; buffer != 0 && buffer->block != block; buffer = buffer->next);
+
+	if (buffer == 0) {
+		return;
+	}
+
+	if (buffer->dirty) {
+		buffer->dirty = false;
+		volume->dirty_count--;
+	}
+	ext2_buffer_unhash(volume, buffer);
+}
+
+static void ext2_group_dirty(ext2_volume_t* volume, uint32_t group) {
+	volume->groups_dirty[(uint64_t)group * sizeof(ext2_group_t) / volume->block_size] = true;
+	volume->super_dirty = true;
+}
+
+// Set the first clear bit of a bitmap from start, wrapping round. Returns it, or -1 if every bit is set
+static int64_t ext2_bitmap_take(ext2_volume_t* volume, uint32_t block, uint32_t bits, uint32_t start) {
+
+	ext2_buffer_t* buffer = ext2_buffer_get(volume, block, true);
+	if (buffer == 0) {
+		return -1;
+	}
+
+	int64_t found = -1;
+
+	for (uint32_t n = 0; n < bits; n++) {
+		uint32_t bit = (start + n) % bits;
+
+		// Whole bytes of used blocks are skipped at once
+		if (bit % 8 == 0 && bit + 8 <= bits && n + 8 <= bits && buffer->data[bit / 8] == 0xff) {
+			n += 7;
+			continue;
+		}
+
+		if (!(buffer->data[bit / 8] & (1 << (bit % 8)))) {
+			buffer->data[bit / 8] |= 1 << (bit % 8);
+			ext2_buffer_dirty(volume, buffer);
+			found = bit;
+			break;
+		}
+	}
+
+	ext2_buffer_put(buffer);
+	return found;
+}
+
+static void ext2_bitmap_clear(ext2_volume_t* volume, uint32_t block, uint32_t bit) {
+
+	ext2_buffer_t* buffer = ext2_buffer_get(volume, block, true);
+	if (buffer == 0) {
+		return;
+	}
+
+	buffer->data[bit / 8] &= ~(1 << (bit % 8));
+	ext2_buffer_dirty(volume, buffer);
+	ext2_buffer_put(buffer);
+}
+
+// Allocate the first free block from goal on, trying the rest of goal's group before the others
+static uint32_t ext2_alloc_block(ext2_volume_t* volume, uint32_t goal) {
+
+	ext2_superblock_t* super = volume->super;
+
+	if (goal < super->first_data_block || goal >= super->blocks_count) {
+		goal = super->first_data_block;
+	}
+
+	uint32_t first_group = (goal - super->first_data_block) / super->blocks_per_group;
+
+	for (uint32_t i = 0; i < volume->group_count; i++) {
+		uint32_t group = (first_group + i) % volume->group_count;
+		if (volume->groups[group].free_blocks == 0) {
+			continue;
+		}
+
+		// The last group can be short
+		uint32_t base = super->first_data_block + group * super->blocks_per_group;
+		uint32_t bits = super->blocks_count - base < super->blocks_per_group ? super->blocks_count - base : super->blocks_per_group;
+
+		int64_t bit = ext2_bitmap_take(volume, volume->groups[group].block_bitmap, bits, i == 0 ? goal - base : 0);
+		if (bit < 0) {
+			continue;
+		}
+
+		volume->groups[group].free_blocks--;
+		super->free_blocks_count--;
+		ext2_group_dirty(volume, group);
+
+		return base + bit;
+	}
+
+	return 0;
+}
+
+static void ext2_free_block(ext2_volume_t* volume, uint32_t block) {
+
+	ext2_superblock_t* super = volume->super;
+	uint32_t group = (block - super->first_data_block) / super->blocks_per_group;
+
+	ext2_buffer_forget(volume, block);
+	ext2_bitmap_clear(volume, volume->groups[group].block_bitmap, (block - super->first_data_block) % super->blocks_per_group);
+
+	volume->groups[group].free_blocks++;
+	super->free_blocks_count++;
+	ext2_group_dirty(volume, group);
+}
+
+// Allocate an inode. Files go in their directory's group, and directories in the group with the
+// most free blocks among those with at least an average share of free inodes, spreading them out
+static uint32_t ext2_alloc_inode(ext2_volume_t* volume, uint32_t parent, bool directory) {
+
+	ext2_superblock_t* super = volume->super;
+	uint32_t first_group = (parent - 1) / super->inodes_per_group;
+
+	if (directory) {
+		uint32_t average = super->free_inodes_count / volume->group_count;
+		int64_t best = -1;
+
+		for (uint32_t group = 0; group < volume->group_count; group++) {
+			ext2_group_t* candidate = &volume->groups[group];
+			if (candidate->free_inodes == 0 || candidate->free_inodes < average) {
+				continue;
+			}
+			if (best < 0 || candidate->free_blocks > volume->groups[best].free_blocks) {
+				best = group;
+			}
+		}
+
+		if (best >= 0) {
+			first_group = best;
+		}
+	}
+
+	for (uint32_t i = 0; i < volume->group_count; i++) {
+		uint32_t group = (first_group + i) % volume->group_count;
+		if (volume->groups[group].free_inodes == 0) {
+			continue;
+		}
+
+		int64_t bit = ext2_bitmap_take(volume, volume->groups[group].inode_bitmap, super->inodes_per_group, 0);
+		if (bit < 0) {
+			continue;
+		}
+
+		volume->groups[group].free_inodes--;
+		if (directory) {
+			volume->groups[group].directories++;
+		}
+		super->free_inodes_count--;
+		ext2_group_dirty(volume, group);
+
+		return group * super->inodes_per_group + bit + 1;
+	}
+
+	return 0;
+}
+
+static void ext2_free_inode(ext2_volume_t* volume, uint32_t ino, bool directory) {
+
+	ext2_superblock_t* super = volume->super;
+	uint32_t group = (ino - 1) / super->inodes_per_group;
+
+	ext2_bitmap_clear(volume, volume->groups[group].inode_bitmap, (ino - 1) % super->inodes_per_group);
+
+	volume->groups[group].free_inodes++;
+	if (directory) {
+		volume->groups[group].directories--;
+	}
+	super->free_inodes_count++;
+	ext2_group_dirty(volume, group);
+}
+
+// The inode table block an inode is in, and its offset in the block
+static uint32_t ext2_inode_block(ext2_volume_t* volume, uint32_t ino, uint32_t* offset) {
+
+	uint32_t index = (ino - 1) % volume->super->inodes_per_group;
+	uint64_t byte = (uint64_t)index * volume->inode_size;
+
+	*offset = byte % volume->block_size;
+	return volume->groups[(ino - 1) / volume->super->inodes_per_group].inode_table + byte / volume->block_size;
+}
+
+// Copy a node's inode into its inode table block, to go out with the next writeback
+static bool ext2_node_store(ext2_volume_t* volume, ext2_node_t* node) {
+
+	uint32_t offset;
+	ext2_buffer_t* buffer = ext2_buffer_get(volume, ext2_inode_block(volume, node->inode.id, &offset), true);
+	if (buffer == 0) {
+		return false;
+	}
+
+	memcpy(buffer->data + offset, &node->raw, sizeof(ext2_inode_t));
+	ext2_buffer_dirty(volume, buffer);
+	ext2_buffer_put(buffer);
+
+	node->inode.link_count = node->raw.links;
+	return true;
+}
+
+static uint8_t ext2_type(uint16_t mode) {
+
+	switch (mode & EXT2_S_IFMT) {
+		case EXT2_S_IFDIR: return FS_DIRECTORY;
+		case EXT2_S_IFCHR: return FS_CHARDEVICE;
+		case EXT2_S_IFBLK: return FS_BLOCKDEVICE;
+		case EXT2_S_IFIFO: return FS_PIPE;
+		case EXT2_S_IFLNK: return FS_SYMLINK;
+		default:           return FS_FILE;
+	}
+}
+
+static uint64_t ext2_size(ext2_inode_t* raw) {
+
+	uint64_t size = raw->size;
+	if ((raw->mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+		size |= (uint64_t)raw->size_high << 32;
+	}
+
+	return size;
+}
+
+// Set a node's size, taking the large file feature once a file passes 2 GiB
+static void ext2_set_size(ext2_volume_t* volume, ext2_node_t* node, uint64_t size) {
+
+	node->raw.size = size;
+	if ((node->raw.mode & EXT2_S_IFMT) == EXT2_S_IFREG) {
+		node->raw.size_high = size >> 32;
+	}
+
+	if (size >= 0x80000000 && !(volume->super->feature_ro_compat & EXT2_RO_COMPAT_LARGE_FILE)) {
+		volume->super->feature_ro_compat |= EXT2_RO_COMPAT_LARGE_FILE;
+		volume->super_dirty = true;
+	}
+
+	node->inode.size = size;
+}
+
+// The node for an inode, read in the first time and held until ext2_node_put
+static ext2_node_t* ext2_node_get(ext2_volume_t* volume, uint32_t ino) {
+
+	if (ino == 0 || ino > volume->super->inodes_count) {
+		return 0;
+	}
+
+	ext2_node_t** bucket = &volume->nodes[ino % EXT2_NODE_BUCKETS];
+	ext2_node_t* node;
+
+	for (node = *bucket; node != 0 && node->inode.id != ino; node = node->next);
+	if (node != 0) {
+		node->users++;
+		return node;
+	}
+
+	node = kzalloc(sizeof(ext2_node_t));
+	if (node == 0) {
+		return 0;
+	}
+
+	uint32_t offset;
+	ext2_buffer_t* buffer = ext2_buffer_get(volume, ext2_inode_block(volume, ino, &offset), true);
+	if (buffer == 0) {
+		kfree(node);
+		return 0;
+	}
+
+	memcpy(&node->raw, buffer->data + offset, sizeof(ext2_inode_t));
+	ext2_buffer_put(buffer);
+
+	node->inode.id = ino;
+	node->inode.type = ext2_type(node->raw.mode);
+	node->inode.size = ext2_size(&node->raw);
+	node->inode.link_count = node->raw.links;
+	node->inode.superblock = &volume->superblock;
+	node->inode.private_data = node;
+	node->users = 1;
+
+	node->next = *bucket;
+	*bucket = node;
+
+	return node;
+}
+
+// Free a block and the tree of blocks below it, depth levels of indirect blocks deep
+static void ext2_free_tree(ext2_volume_t* volume, uint32_t block, uint32_t depth) {
+
+	if (block == 0) {
+		return;
+	}
+
+	if (depth > 0) {
+		ext2_buffer_t* buffer = ext2_buffer_get(volume, block, true);
+		if (buffer != 0) {
+			uint32_t* pointers = (uint32_t*)buffer->data;
+			for (uint32_t i = 0; i < volume->block_size / 4; i++) {
+				ext2_free_tree(volume, pointers[i], depth - 1);
+			}
+			ext2_buffer_put(buffer);
+		}
+	}
+
+	ext2_free_block(volume, block);
+}
+
+// Give back the blocks and inode of a node nothing links to any more
+static void ext2_node_delete(ext2_volume_t* volume, ext2_node_t* node) {
+
+	// Short symbolic links keep their target in the block pointers instead
+	if (node->raw.sectors != 0) {
+		for (uint32_t i = 0; i < EXT2_DIRECT_BLOCKS; i++) {
+			ext2_free_tree(volume, node->raw.block[i], 0);
+		}
+		ext2_free_tree(volume, node->raw.block[EXT2_INDIRECT], 1);
+		ext2_free_tree(volume, node->raw.block[EXT2_DOUBLE], 2);
+		ext2_free_tree(volume, node->raw.block[EXT2_TRIPLE], 3);
+	}
+
+	bool directory = node->inode.type == FS_DIRECTORY;
+
+	memset(node->raw.block, 0, sizeof(node->raw.block));
+	node->raw.sectors = 0;
+	node->raw.delete_time = ext2_now(volume);
+	ext2_set_size(volume, node, 0);
+	ext2_node_store(volume, node);
+
+	ext2_free_inode(volume, node->inode.id, directory);
+}
+
+static void ext2_node_put(ext2_volume_t* volume, ext2_node_t* node) {
+
+	if (node == 0 || --node->users != 0) {
+		return;
+	}
+
+	// Unlinked while it was open, it goes once the last user is done with it
+	if (node->raw.links == 0) {
+		ext2_node_delete(volume, node);
+	}
+
+	for (ext2_node_t** link = &volume->nodes[node->inode.id % EXT2_NODE_BUCKETS]; *link != 0; link = &(*link)->next) {
+		if (*link == node) {
+			*link = node->next;
+			break;
+		}
+	}
+
+	kfree(node);
+}
+
+// The disk block holding block logical of a node, or 0 for a hole. With create, holes are filled
+// with new blocks, indirect blocks included, and fresh is set when the data block is new
+static uint32_t ext2_bmap(ext2_volume_t* volume, ext2_node_t* node, uint32_t logical, bool create, bool* fresh) {
+
+	uint32_t per = volume->block_size / 4;
+	uint32_t path[4];
+	uint32_t depth;
+
+	// Reduced to the index within the direct or indirect tree it falls in
+	uint32_t index = logical;
+
+	if (index < EXT2_DIRECT_BLOCKS) {
+		path[0] = index;
+		depth = 1;
+	}
+	else if ((index -= EXT2_DIRECT_BLOCKS) < per) {
+		path[0] = EXT2_INDIRECT;
+		path[1] = index;
+		depth = 2;
+	}
+	else if ((index -= per) < per * per) {
+		path[0] = EXT2_DOUBLE;
+		path[1] = index / per;
+		path[2] = index % per;
+		depth = 3;
+	}
+	else {
+		index -= per * per;
+		if (index / per / per >= per) {
+			return 0;
+		}
+		path[0] = EXT2_TRIPLE;
+		path[1] = index / per / per;
+		path[2] = index / per % per;
+		path[3] = index % per;
+		depth = 4;
+	}
+
+	// New blocks follow the one before them, or start at the beginning of the inode's group
+	if (create && node->goal == 0) {
+		uint32_t before = logical != 0 ? ext2_bmap(volume, node, logical - 1, false, 0) : 0;
+		uint32_t group = (node->inode.id - 1) / volume->super->inodes_per_group;
+		node->goal = before != 0 ? before + 1 : volume->super->first_data_block + group * volume->super->blocks_per_group;
+	}
+
+	uint32_t* slot = &node->raw.block[path[0]];
+	ext2_buffer_t* held = 0; // The indirect block slot is in
+	uint32_t block = 0;
+	bool changed = false;
+
+	for (uint32_t level = 0; level < depth; level++) {
+		block = *slot;
+		bool allocated = false;
+
+		if (block == 0 && create) {
+			block = ext2_alloc_block(volume, node->goal);
+			if (block != 0) {
+				node->goal = block + 1;
+				node->raw.sectors += volume->block_sectors;
+				*slot = block;
+				changed = true;
+				allocated = true;
+
+				if (held != 0) {
+					ext2_buffer_dirty(volume, held);
+				}
+				if (fresh != 0 && level + 1 == depth) {
+					*fresh = true;
+				}
+			}
+		}
+
+		if (block == 0 || level + 1 == depth) {
+			break;
+		}
+
+		// A new indirect block starts out empty
+		ext2_buffer_put(held);
+		held = ext2_buffer_get(volume, block, !allocated);
+		if (held == 0) {
+			block = 0;
+			break;
+		}
+		if (allocated) {
+			ext2_buffer_dirty(volume, held);
+		}
+
+		slot = (uint32_t*)held->data + path[level + 1];
+	}
+
+	ext2_buffer_put(held);
+
+	if (changed) {
+		ext2_node_store(volume, node);
+	}
+
+	return block;
+}
+
+// Move part of a file between the buffer cache and buffer, a call for each run of blocks that is
+// contiguous on disk. New blocks only partly written are zeroed around the data first
+static uint64_t ext2_transfer(ext2_volume_t* volume, ext2_node_t* node, uint64_t offset, uint64_t size, uint8_t* buffer, bool write) {
+
+	uint32_t block_size = volume->block_size;
+	uint64_t end = offset + size;
+	uint64_t position = offset;
+	uint8_t* bounce = 0;
+	uint8_t status = BLOCK_SUCCESS;
+
+	// The run not handed over yet
+	uint64_t run_offset = 0;
+	uint64_t run_length = 0;
+	uint8_t* run_buffer = 0;
+
+	while (position < end && status == BLOCK_SUCCESS) {
+		uint32_t within = position % block_size;
+		uint64_t length = block_size - within < end - position ? block_size - within : end - position;
+		uint8_t* data = buffer + (position - offset);
+
+		bool fresh = false;
+		uint32_t block = ext2_bmap(volume, node, position / block_size, write, &fresh);
+		if (write && block == 0) {
+			status = BLOCK_ERROR_IO;
+			break;
+		}
+
+		uint64_t device_offset = ext2_offset(volume, block) + within;
+
+		// Hand over the run when this does not carry it on
+		if (run_length != 0 && (block == 0 || (fresh && length != block_size) || device_offset != run_offset + run_length)) {
+			status = write ? buffer_cache_write(volume->device, run_offset, run_length, run_buffer)
+				: buffer_cache_read(volume->device, run_offset, run_length, run_buffer);
+			run_length = 0;
+		}
+
+		if (block == 0) {
+			// Holes read as zeroes
+			memset(data, 0, length);
+		}
+		else if (fresh && length != block_size) {
+			if (bounce == 0) {
+				bounce = kmalloc(block_size);
+			}
+
+			if (bounce == 0) {
+				status = BLOCK_ERROR_IO;
+				break;
+			}
+
+			memset(bounce, 0, block_size);
+			memcpy(bounce + within, data, length);
+			status = buffer_cache_write(volume->device, ext2_offset(volume, block), block_size, bounce);
+		}
+		else {
+			if (run_length == 0) {
+				run_offset = device_offset;
+				run_buffer = data;
+			}
+			run_length += length;
+		}
+
+		position += length;
+	}
+
+	if (status == BLOCK_SUCCESS && run_length != 0) {
+		status = write ? buffer_cache_write(volume->device, run_offset, run_length, run_buffer)
+			: buffer_cache_read(volume->device, run_offset, run_length, run_buffer);
+	}
+
+	kfree(bounce);
+	return status == BLOCK_SUCCESS ? FS_ERROR_SUCCESS : FS_ERROR_FAILURE;
+}
+
+static bool ext2_dirent_valid(ext2_volume_t* volume, ext2_dirent_t* dirent, uint32_t offset) {
+	return dirent->length >= 8 && dirent->length % 4 == 0 && offset + dirent->length <= volume->block_size
+		&& EXT2_DIRENT_LENGTH(dirent->name_length) <= dirent->length;
+}
+
+// Find a name in a directory and return its inode, or 0. If found is not 0, the block holding the
+// entry is left held in it, with the entry's offset and that of the entry before it in the block
+static uint32_t ext2_find_entry(ext2_volume_t* volume, ext2_node_t* directory, const char* name, uint64_t length,
+	ext2_buffer_t** found, uint32_t* offset, uint32_t* previous) {
+
+	uint32_t blocks = directory->inode.size / volume->block_size;
+
+	for (uint32_t logical = 0; logical < blocks; logical++) {
+		uint32_t block = ext2_bmap(volume, directory, logical, false, 0);
+		if (block == 0) {
+			continue;
+		}
+
+		ext2_buffer_t* buffer = ext2_buffer_get(volume, block, true);
+		if (buffer == 0) {
+			return 0;
+		}
+
+		uint32_t before = 0;
+		for (uint32_t at = 0; at < volume->block_size; ) {
+			ext2_dirent_t* dirent = (ext2_dirent_t*)(buffer->data + at);
+			if (!ext2_dirent_valid(volume, dirent, at)) {
+				break;
+			}
+
+			if (dirent->inode != 0 && dirent->name_length == length && memcmp(dirent->name, name, length) == 0) {
+				uint32_t ino = dirent->inode;
+
+				if (found != 0) {
+					*found = buffer;
+					*offset = at;
+					*previous = before;
+				}
+				else {
+					ext2_buffer_put(buffer);
+				}
+				return ino;
+			}
+
+			before = at;
+			at += dirent->length;
+		}
+
+		ext2_buffer_put(buffer);
+	}
+
+	return 0;
+}
+
+// Link an inode into a directory, in the first gap big enough, or in a new block on the end
+static uint64_t ext2_add_entry(ext2_volume_t* volume, ext2_node_t* directory, const char* name, uint32_t ino, uint8_t type) {
+
+	uint32_t length = strlen(name);
+	if (length == 0 || length > EXT2_NAME_MAX) {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	uint32_t needed = EXT2_DIRENT_LENGTH(length);
+	uint32_t blocks = directory->inode.size / volume->block_size;
+
+	for (uint32_t logical = 0; logical <= blocks; logical++) {
+		bool extend = logical == blocks;
+
+		uint32_t block = ext2_bmap(volume, directory, logical, extend, 0);
+		if (block == 0) {
+			if (extend) {
+				return FS_ERROR_FAILURE;
+			}
+			continue;
+		}
+
+		ext2_buffer_t* buffer = ext2_buffer_get(volume, block, !extend);
+		if (buffer == 0) {
+			return FS_ERROR_FAILURE;
+		}
+
+		// A new block holds one empty entry covering all of it
+		if (extend) {
+			ext2_dirent_t* dirent = (ext2_dirent_t*)buffer->data;
+			dirent->length = volume->block_size;
+			ext2_buffer_dirty(volume, buffer);
+
+			ext2_set_size(volume, directory, directory->inode.size + volume->block_size);
+			ext2_node_store(volume, directory);
+		}
+
+		for (uint32_t at = 0; at < volume->block_size; ) {
+			ext2_dirent_t* dirent = (ext2_dirent_t*)(buffer->data + at);
+			if (!ext2_dirent_valid(volume, dirent, at)) {
+				break;
+			}
+
+			uint32_t used = dirent->inode != 0 ? EXT2_DIRENT_LENGTH(dirent->name_length) : 0;
+
+			if (dirent->length - used >= needed) {
+				// Split the space left over at the end of a used entry off into a new one
+				if (used != 0) {
+					ext2_dirent_t* split = (ext2_dirent_t*)(buffer->data + at + used);
+					split->length = dirent->length - used;
+					dirent->length = used;
+					dirent = split;
+				}
+
+				dirent->inode = ino;
+				dirent->name_length = length;
+				dirent->type = volume->super->feature_incompat & EXT2_INCOMPAT_FILETYPE ? type : 0;
+				memcpy(dirent->name, name, length);
+
+				ext2_buffer_dirty(volume, buffer);
+				ext2_buffer_put(buffer);
+
+				// The hash index of an indexed directory would now be out of date, so it stops being used
+				if (directory->raw.flags & EXT2_INDEX_FL) {
+					directory->raw.flags &= ~EXT2_INDEX_FL;
+					ext2_node_store(volume, directory);
+				}
+
+				return FS_ERROR_SUCCESS;
+			}
+
+			at += dirent->length;
+		}
+
+		ext2_buffer_put(buffer);
+	}
+
+	return FS_ERROR_FAILURE;
+}
+
+// Whether a directory holds nothing but "." and ".."
+static bool ext2_empty(ext2_volume_t* volume, ext2_node_t* directory) {
+
+	uint32_t blocks = directory->inode.size / volume->block_size;
+
+	for (uint32_t logical = 0; logical < blocks; logical++) {
+		uint32_t block = ext2_bmap(volume, directory, logical, false, 0);
+		if (block == 0) {
+			continue;
+		}
+
+		ext2_buffer_t* buffer = ext2_buffer_get(volume, block, true);
+		if (buffer == 0) {
+			return false;
+		}
+
+		for (uint32_t at = 0; at < volume->block_size; ) {
+			ext2_dirent_t* dirent = (ext2_dirent_t*)(buffer->data + at);
+			if (!ext2_dirent_valid(volume, dirent, at)) {
+				break;
+			}
+
+			bool dots = (dirent->name_length == 1 && dirent->name[0] == '.')
+				|| (dirent->name_length == 2 && dirent->name[0] == '.' && dirent->name[1] == '.');
+
+			if (dirent->inode != 0 && !dots) {
+				ext2_buffer_put(buffer);
+				return false;
+			}
+
+			at += dirent->length;
+		}
+
+		ext2_buffer_put(buffer);
+	}
+
+	return true;
+}
+
+static inode_t* ext2_lookup(superblock_t* superblock, const char* path) {
+
+	ext2_volume_t* volume = superblock->private_data;
+
+	spin_lock(&volume->lock);
+
+	ext2_node_t* node = ext2_node_get(volume, EXT2_ROOT);
+
+	while (node != 0 && *path != '\0') {
+		uint64_t length = 0;
+		while (path[length] != '\0' && path[length] != '/') {
+			length++;
+		}
+
+		uint32_t ino = node->inode.type == FS_DIRECTORY ? ext2_find_entry(volume, node, path, length, 0, 0, 0) : 0;
+		ext2_node_t* next = ino != 0 ? ext2_node_get(volume, ino) : 0;
+
+		ext2_node_put(volume, node);
+		node = next;
+
+		path += length;
+		while (*path == '/') {
+			path++;
+		}
+	}
+
+	spin_unlock(&volume->lock);
+
+	return node != 0 ? &node->inode : 0;
+}
+
+static void ext2_release(inode_t* inode) {
+
+	ext2_volume_t* volume = inode->superblock->private_data;
+
+	spin_lock(&volume->lock);
+	ext2_node_put(volume, inode->private_data);
+	ext2_writeback(volume);
+	spin_unlock(&volume->lock);
+}
+
+static uint64_t ext2_read(inode_t* inode, uint32_t offset, uint32_t size, uint8_t* buffer) {
+
+	ext2_volume_t* volume = inode->superblock->private_data;
+	ext2_node_t* node = inode->private_data;
+	uint64_t status = FS_ERROR_SUCCESS;
+
+	spin_lock(&volume->lock);
+
+	if (offset >= inode->size) {
+		spin_unlock(&volume->lock);
+		return FS_ERROR_END_OF_FILE;
+	}
+
+	if (size > inode->size - offset) {
+		size = inode->size - offset;
+	}
+
+	if (inode->type != FS_DIRECTORY) {
+		status = ext2_transfer(volume, node, offset, size, buffer, false);
+	}
+	else {
+		// Directories are read through the cache, which may hold changes not written back yet
+		for (uint64_t position = offset; position < offset + size && status == FS_ERROR_SUCCESS; ) {
+			uint32_t within = position % volume->block_size;
+			uint64_t length = volume->block_size - within < offset + size - position ? volume->block_size - within : offset + size - position;
+
+			uint32_t block = ext2_bmap(volume, node, position / volume->block_size, false, 0);
+			ext2_buffer_t* cached = block != 0 ? ext2_buffer_get(volume, block, true) : 0;
+
+			if (cached != 0) {
+				memcpy(buffer + (position - offset), cached->data + within, length);
+				ext2_buffer_put(cached);
+			}
+			else if (block == 0) {
+				memset(buffer + (position - offset), 0, length);
+			}
+			else {
+				status = FS_ERROR_FAILURE;
+			}
+
+			position += length;
+		}
+	}
+
+	spin_unlock(&volume->lock);
+	return status;
+}
+
+static uint64_t ext2_write(inode_t* inode, uint32_t offset, uint32_t size, uint8_t* buffer) {
+
+	ext2_volume_t* volume = inode->superblock->private_data;
+	ext2_node_t* node = inode->private_data;
+
+	if (volume->read_only) {
+		return FS_ERROR_INVALID_PERMISSIONS;
+	}
+
+	if (inode->type != FS_FILE) {
+		return FS_ERROR_NODE_TYPE;
+	}
+
+	spin_lock(&volume->lock);
+
+	uint64_t status = ext2_transfer(volume, node, offset, size, buffer, true);
+
+	// Whatever was written before a failure is kept
+	uint64_t end = (uint64_t)offset + size;
+	if (status == FS_ERROR_SUCCESS && end > inode->size) {
+		ext2_set_size(volume, node, end);
+	}
+
+	node->raw.modify_time = ext2_now(volume);
+	ext2_node_store(volume, node);
+	ext2_writeback(volume);
+
+	spin_unlock(&volume->lock);
+	return status;
+}
+
+static uint64_t ext2_sync(superblock_t* superblock) {
+
+	ext2_volume_t* volume = superblock->private_data;
+
+	spin_lock(&volume->lock);
+
+	uint64_t status = ext2_flush(volume);
+	if (buffer_cache_sync(volume->device) != BLOCK_SUCCESS) {
+		status = FS_ERROR_FAILURE;
+	}
+
+	spin_unlock(&volume->lock);
+	return status;
+}
+
+static uint64_t ext2_sync_inode(inode_t* inode) {
+	return ext2_sync(inode->superblock);
+}
+
+static inode_t* ext2_make_inode(inode_t* directory, uint8_t type) {
+
+	ext2_volume_t* volume = directory->superblock->private_data;
+
+	if (volume->read_only || (type != FS_FILE && type != FS_DIRECTORY)) {
+		return 0;
+	}
+
+	spin_lock(&volume->lock);
+
+	uint32_t ino = ext2_alloc_inode(volume, directory->id, type == FS_DIRECTORY);
+	if (ino == 0) {
+		spin_unlock(&volume->lock);
+		return 0;
+	}
+
+	// Clear all of the inode's space in the table, including anything past the part read here
+	uint32_t offset;
+	ext2_buffer_t* buffer = ext2_buffer_get(volume, ext2_inode_block(volume, ino, &offset), true);
+	if (buffer != 0) {
+		memset(buffer->data + offset, 0, volume->inode_size);
+		ext2_buffer_dirty(volume, buffer);
+		ext2_buffer_put(buffer);
+	}
+
+	ext2_node_t* node = buffer != 0 ? ext2_node_get(volume, ino) : 0;
+	if (node == 0) {
+		ext2_free_inode(volume, ino, type == FS_DIRECTORY);
+		spin_unlock(&volume->lock);
+		return 0;
+	}
+
+	uint32_t now = ext2_now(volume);
+	node->raw.mode = type == FS_DIRECTORY ? EXT2_DIRECTORY_MODE : EXT2_FILE_MODE;
+	node->raw.access_time = now;
+	node->raw.change_time = now;
+	node->raw.modify_time = now;
+	node->inode.type = type;
+	ext2_node_store(volume, node);
+
+	// Nothing links to it until make_dentry, so releasing it before then frees it again
+	if (type == FS_DIRECTORY) {
+		uint32_t block = ext2_bmap(volume, node, 0, true, 0);
+		ext2_buffer_t* entries = block != 0 ? ext2_buffer_get(volume, block, false) : 0;
+
+		if (entries == 0) {
+			ext2_node_put(volume, node);
+			spin_unlock(&volume->lock);
+			return 0;
+		}
+
+		ext2_dirent_t* dot = (ext2_dirent_t*)entries->data;
+		dot->inode = ino;
+		dot->length = EXT2_DIRENT_LENGTH(1);
+		dot->name_length = 1;
+		dot->name[0] = '.';
+
+		ext2_dirent_t* dot_dot = (ext2_dirent_t*)(entries->data + dot->length);
+		dot_dot->inode = directory->id;
+		dot_dot->length = volume->block_size - dot->length;
+		dot_dot->name_length = 2;
+		dot_dot->name[0] = '.';
+		dot_dot->name[1] = '.';
+
+		if (volume->super->feature_incompat & EXT2_INCOMPAT_FILETYPE) {
+			dot->type = EXT2_FT_DIR;
+			dot_dot->type = EXT2_FT_DIR;
+		}
+
+		ext2_buffer_dirty(volume, entries);
+		ext2_buffer_put(entries);
+
+		ext2_set_size(volume, node, volume->block_size);
+		ext2_node_store(volume, node);
+	}
+
+	spin_unlock(&volume->lock);
+	return &node->inode;
+}
+
+static uint64_t ext2_make_dentry(inode_t* directory, dentry_t* dentry) {
+
+	ext2_volume_t* volume = directory->superblock->private_data;
+	ext2_node_t* parent = directory->private_data;
+	ext2_node_t* node = dentry->inode_ptr->private_data;
+
+	if (volume->read_only) {
+		return FS_ERROR_INVALID_PERMISSIONS;
+	}
+
+	if (directory->type != FS_DIRECTORY) {
+		return FS_ERROR_NODE_TYPE;
+	}
+
+	spin_lock(&volume->lock);
+
+	bool is_directory = node->inode.type == FS_DIRECTORY;
+	uint64_t status = ext2_add_entry(volume, parent, dentry->name, node->inode.id, is_directory ? EXT2_FT_DIR : EXT2_FT_REG_FILE);
+
+	if (status == FS_ERROR_SUCCESS) {
+		// A directory is linked from its parent and its own ".", and the parent gains its ".."
+		if (is_directory) {
+			node->raw.links = 2;
+			parent->raw.links++;
+			parent->raw.modify_time = ext2_now(volume);
+			ext2_node_store(volume, parent);
+		}
+		else {
+			node->raw.links++;
+		}
+		ext2_node_store(volume, node);
+	}
+
+	ext2_writeback(volume);
+
+	spin_unlock(&volume->lock);
+	return status;
+}
+
+static uint64_t ext2_remove_dentry(inode_t* directory, dentry_t* dentry) {
+
+	ext2_volume_t* volume = directory->superblock->private_data;
+	ext2_node_t* parent = directory->private_data;
+
+	if (volume->read_only) {
+		return FS_ERROR_INVALID_PERMISSIONS;
+	}
+
+	if (strcmp(dentry->name, ".") == 0 || strcmp(dentry->name, "..") == 0) {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	spin_lock(&volume->lock);
+
+	ext2_buffer_t* buffer;
+	uint32_t offset;
+	uint32_t previous;
+
+	uint32_t ino = ext2_find_entry(volume, parent, dentry->name, strlen(dentry->name), &buffer, &offset, &previous);
+	if (ino == 0) {
+		spin_unlock(&volume->lock);
+		return FS_ERROR_DOES_NOT_EXIST;
+	}
+
+	ext2_node_t* node = ext2_node_get(volume, ino);
+	bool is_directory = node != 0 && node->inode.type == FS_DIRECTORY;
+
+	if (node == 0 || (is_directory && !ext2_empty(volume, node))) {
+		ext2_buffer_put(buffer);
+		ext2_node_put(volume, node);
+		spin_unlock(&volume->lock);
+		return FS_ERROR_FAILURE;
+	}
+
+	// The entry before it in the block takes its space, unless it is the first
+	ext2_dirent_t* dirent = (ext2_dirent_t*)(buffer->data + offset);
+	if (offset != 0) {
+		((ext2_dirent_t*)(buffer->data + previous))->length += dirent->length;
+	}
+	else {
+		dirent->inode = 0;
+	}
+	ext2_buffer_dirty(volume, buffer);
+	ext2_buffer_put(buffer);
+
+	if (is_directory) {
+		node->raw.links = 0;
+		parent->raw.links--;
+	}
+	else {
+		node->raw.links--;
+	}
+
+	parent->raw.modify_time = ext2_now(volume);
+	ext2_node_store(volume, parent);
+	ext2_node_store(volume, node);
+
+	// Freed here, unless it is still open somewhere
+	ext2_node_put(volume, node);
+	ext2_writeback(volume);
+
+	spin_unlock(&volume->lock);
+	return FS_ERROR_SUCCESS;
+}
+
+static uint64_t ext2_find_name(inode_t* directory, const char* name) {
+
+	ext2_volume_t* volume = directory->superblock->private_data;
+
+	if (directory->type != FS_DIRECTORY) {
+		return 0;
+	}
+
+	spin_lock(&volume->lock);
+	uint32_t ino = ext2_find_entry(volume, directory->private_data, name, strlen(name), 0, 0, 0);
+	spin_unlock(&volume->lock);
+
+	return ino;
+}
+
+static void ext2_volume_free(ext2_volume_t* volume) {
+
+	kfree(volume->super);
+	kfree(volume->groups);
+	kfree(volume->groups_dirty);
+	kfree(volume->buffer_data);
+	kfree(volume);
+}
+
+// Read a superblock at a sector, returning whether it is ext2's
+static bool ext2_read_super(block_device_t* device, uint64_t start, ext2_superblock_t* super) {
+	return block_read(device, start + EXT2_SUPERBLOCK_OFFSET / BLOCK_SECTOR_SIZE, EXT2_SUPERBLOCK_SIZE / BLOCK_SECTOR_SIZE, super) == BLOCK_SUCCESS
+		&& super->magic == EXT2_MAGIC;
+}
+
+bool ext2_find(block_device_t* device, uint64_t* start) {
+
+	ext2_superblock_t* super = kmalloc(sizeof(ext2_superblock_t));
+	uint8_t* sector = kmalloc(BLOCK_SECTOR_SIZE);
+	bool found = false;
+
+	if (super != 0 && sector != 0) {
+		if (ext2_read_super(device, 0, super)) {
+			*start = 0;
+			found = true;
+		}
+		else if (block_read(device, 0, 1, sector) == BLOCK_SUCCESS && ext2_read16(sector + MBR_SIGNATURE) == 0xaa55) {
+			for (uint32_t i = 0; i < 4 && !found; i++) {
+				uint8_t* partition = sector + MBR_PARTITIONS + i * MBR_PARTITION_SIZE;
+				uint32_t first = ext2_read16(partition + MBR_PARTITION_START) | (uint32_t)ext2_read16(partition + MBR_PARTITION_START + 2) << 16;
+
+				if (partition[MBR_PARTITION_TYPE] == MBR_TYPE_LINUX && first != 0 && ext2_read_super(device, first, super)) {
+					*start = first;
+					found = true;
+				}
+			}
+		}
+	}
+
+	kfree(super);
+	kfree(sector);
+	return found;
+}
+
+uint64_t ext2_mount(block_device_t* device, uint64_t start, const char* path) {
+
+	ext2_volume_t* volume = kzalloc(sizeof(ext2_volume_t));
+	if (volume == 0) {
+		return FS_ERROR_FAILURE;
+	}
+
+	volume->device = device;
+	volume->start = start;
+	volume->super = kmalloc(sizeof(ext2_superblock_t));
+
+	ext2_superblock_t* super = volume->super;
+	if (super == 0 || !ext2_read_super(device, start, super)) {
+		ext2_volume_free(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	// Blocks are cached in pages, and the descriptor table is laid out for up to 4 KiB blocks
+	if (super->log_block_size > 2 || (super->feature_incompat & ~EXT2_INCOMPAT_SUPPORTED)
+		|| super->blocks_per_group == 0 || super->inodes_per_group == 0 || super->first_data_block >= super->blocks_count) {
+		ext2_volume_free(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	volume->read_only = (super->feature_ro_compat & ~EXT2_RO_COMPAT_SUPPORTED) != 0;
+	volume->block_size = 1024 << super->log_block_size;
+	volume->block_sectors = volume->block_size / BLOCK_SECTOR_SIZE;
+	volume->inode_size = super->revision == 0 ? EXT2_OLD_INODE_SIZE : super->inode_size;
+	volume->group_count = (super->blocks_count - super->first_data_block + super->blocks_per_group - 1) / super->blocks_per_group;
+	volume->group_blocks = (volume->group_count * sizeof(ext2_group_t) + volume->block_size - 1) / volume->block_size;
+
+	volume->groups = kmalloc((uint64_t)volume->group_blocks * volume->block_size);
+	volume->groups_dirty = kzalloc(volume->group_blocks);
+	volume->buffer_data = kmalloc((uint64_t)EXT2_BUFFERS * volume->block_size);
+
+	if (volume->inode_size < sizeof(ext2_inode_t) || volume->groups == 0 || volume->groups_dirty == 0
+		|| volume->buffer_data == 0
+		|| buffer_cache_read(device, ext2_offset(volume, super->first_data_block + 1), (uint64_t)volume->group_blocks * volume->block_size, volume->groups) != BLOCK_SUCCESS) {
+		ext2_volume_free(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	for (uint32_t i = 0; i < EXT2_BUFFERS; i++) {
+		volume->buffers[i].data = volume->buffer_data + (uint64_t)i * volume->block_size;
+	}
+
+	memcpy(volume->superblock.fs_type, "ext2", 5);
+	volume->superblock.ops.read_inode = &ext2_read;
+	volume->superblock.ops.write_inode = &ext2_write;
+	volume->superblock.ops.write_fs_disk = &ext2_sync;
+	volume->superblock.ops.write_inode_disk = &ext2_sync_inode;
+	volume->superblock.ops.make_inode = &ext2_make_inode;
+	volume->superblock.ops.make_dentry = &ext2_make_dentry;
+	volume->superblock.ops.remove_dentry = &ext2_remove_dentry;
+	volume->superblock.ops.find_name = &ext2_find_name;
+	volume->superblock.ops.lookup = &ext2_lookup;
+	volume->superblock.ops.release = &ext2_release;
+	volume->superblock.private_data = volume;
+
+	ext2_node_t* root = ext2_node_get(volume, EXT2_ROOT);
+	bool valid = root != 0 && root->inode.type == FS_DIRECTORY;
+	ext2_node_put(volume, root);
+
+	if (!valid) {
+		ext2_volume_free(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	return vfs_mount(path, &volume->superblock);
+}
+
+void ext2_mount_root(void) {
+
+	for (block_device_t* device = block_devices; device != 0; device = device->next) {
+		uint64_t start;
+
+		if (ext2_find(device, &start) && ext2_mount(device, start, "/") == FS_ERROR_SUCCESS) {
+			tty_print_string("Mounted ");
+			tty_print_string(device->name);
+			tty_print_string(" as the root\n");
+			return;
+		}
+	}
+}
@@ -0,0 +1,799 @@
+/*
+ * evan-os/src/fat.c
+ *
+ * The FAT filesystem, read only. The FAT is read into memory a chunk at
+ * a time as clusters in it are first followed. A node follows its chain
+ * once, when it is first looked up, and keeps where it jumps as runs of
+ * contiguous clusters. Nodes stay cached while the volume is mounted, so
+ * a file opened again, or read at any offset, never walks its chain.
+ *
+ */
+
+#include <fat.h>
+
+#include <block.h>
+#include <kmalloc.h>
+#include <paging.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tty.h>
+#include <vfs.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Boot sector fields, by byte offset
+#define FAT_BPB_BYTES_PER_SECTOR    11
+#define FAT_BPB_SECTORS_PER_CLUSTER 13
+#define FAT_BPB_RESERVED            14
+#define FAT_BPB_FATS                16
+#define FAT_BPB_ROOT_ENTRIES        17
+#define FAT_BPB_SECTORS_16          19
+#define FAT_BPB_FAT_SIZE_16         22
+#define FAT_BPB_SECTORS_32          32
+#define FAT_BPB_FAT_SIZE_32         36
+#define FAT_BPB_ROOT_CLUSTER        44 // FAT32 only
+#define FAT_BOOT_SIGNATURE          510
+
+// Volumes with fewer clusters than these have 12 or 16 bit FAT entries
+#define FAT12_CLUSTERS_MAX 4084
+#define FAT16_CLUSTERS_MAX 65524
+
+// Directory entries
+#define FAT_DIRENT_SIZE        32
+#define FAT_ENTRY_ATTRIBUTES   11
+#define FAT_ENTRY_CHECKSUM     13 // Long name entries only
+#define FAT_ENTRY_CLUSTER_HIGH 20
+#define FAT_ENTRY_CLUSTER_LOW  26
+#define FAT_ENTRY_FILE_SIZE    28
+
+#define FAT_ENTRY_END     0x00
+#define FAT_ENTRY_DELETED 0xe5
+#define FAT_ENTRY_E5      0x05 // A name really starting with 0xe5
+
+#define FAT_ATTRIBUTE_VOLUME    0x08
+#define FAT_ATTRIBUTE_DIRECTORY 0x10
+#define FAT_ATTRIBUTE_LONG_NAME 0x0f
+
+#define FAT_LONG_NAME_LAST  0x40 // In the order byte of the first long name entry
+#define FAT_LONG_NAME_ORDER 0x1f
+#define FAT_LONG_NAME_CHARS 13
+#define FAT_NAME_MAX        256
+
+// The FAT is read in pieces of this size as they are first needed
+#define FAT_CHUNK_SIZE (64 * 1024)
+
+#define FAT_NODE_BUCKETS 64
+
+// MBR partition table
+#define MBR_PARTITIONS      446
+#define MBR_PARTITION_SIZE  16
+#define MBR_PARTITION_TYPE  4
+#define MBR_PARTITION_START 8
+
+// El Torito boot images on a CD
+#define ISO_SECTORS          (2048 / BLOCK_SECTOR_SIZE)
+#define ISO_BOOT_RECORD      17   // The volume descriptor after the primary one
+#define ISO_BOOT_CATALOG     0x47 // Its sector, in the boot record
+#define ELTORITO_BOOTABLE    0x88
+#define ELTORITO_LOAD_SECTOR 8
+
+// Clusters length of a file, from file_cluster on, lie one after another on disk from cluster
+typedef struct fat_run_t {
+	uint32_t file_cluster;
+	uint32_t cluster;
+	uint32_t length;
+} fat_run_t;
+
+typedef struct fat_node_t {
+	inode_t            inode;
+	uint64_t           key;       // The parent's id and the entry's index in it
+	fat_run_t*         runs;
+	uint32_t           run_count;
+	uint8_t*           entries;   // A directory's whole contents
+	struct fat_node_t* next;
+} fat_node_t;
+
+typedef struct fat_volume_t {
+	superblock_t    superblock;
+	block_device_t* device;
+
+	// Where things are, in device sectors
+	uint64_t        fat_start;
+	uint64_t        root_start;      // The FAT12 and FAT16 root directory
+	uint64_t        data_start;
+	uint32_t        cluster_sectors;
+
+	uint32_t        bits;            // Of each FAT entry
+	uint32_t        clusters;        // Data clusters, numbered from 2
+	uint32_t        root_cluster;    // FAT32 only
+	uint32_t        root_bytes;
+	uint64_t        fat_bytes;
+
+	uint8_t**       chunks;          // The FAT, a chunk at a time once read
+	fat_node_t*     root;
+	fat_node_t*     nodes[FAT_NODE_BUCKETS];
+	spinlock_t      lock;
+	uint32_t        next_id;
+} fat_volume_t;
+
+static const uint8_t fat_long_name_offsets[FAT_LONG_NAME_CHARS] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+static uint16_t fat_read16(const uint8_t* p) {
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t fat_read32(const uint8_t* p) {
+	return fat_read16(p) | (uint32_t)fat_read16(p + 2) << 16;
+}
+
+// Whether a sector holds a FAT boot sector
+static bool fat_valid(const uint8_t* sector) {
+
+	uint16_t bytes = fat_read16(sector + FAT_BPB_BYTES_PER_SECTOR);
+	uint8_t cluster = sector[FAT_BPB_SECTORS_PER_CLUSTER];
+
+	return (sector[0] == 0xeb || sector[0] == 0xe9)
+		&& fat_read16(sector + FAT_BOOT_SIGNATURE) == 0xaa55
+		&& bytes >= BLOCK_SECTOR_SIZE && bytes <= 4096 && (bytes & (bytes - 1)) == 0
+		&& cluster != 0 && (cluster & (cluster - 1)) == 0
+		&& fat_read16(sector + FAT_BPB_RESERVED) != 0
+		&& sector[FAT_BPB_FATS] != 0;
+}
+
+// The chunk of the FAT at index, read in the first time it is used. Returns 0 if it can not be read
+static uint8_t* fat_chunk(fat_volume_t* volume, uint64_t index) {
+
+	uint8_t* chunk = __atomic_load_n(&volume->chunks[index], __ATOMIC_ACQUIRE);
+	if (chunk != 0) {
+		return chunk;
+	}
+
+	uint64_t offset = index * FAT_CHUNK_SIZE;
+	uint64_t length = volume->fat_bytes - offset < FAT_CHUNK_SIZE ? volume->fat_bytes - offset : FAT_CHUNK_SIZE;
+
+	chunk = kmalloc(FAT_CHUNK_SIZE);
+	if (chunk == 0) {
+		return 0;
+	}
+
+	if (block_read(volume->device, volume->fat_start + offset / BLOCK_SECTOR_SIZE, length / BLOCK_SECTOR_SIZE, chunk) != BLOCK_SUCCESS) {
+		kfree(chunk);
+		return 0;
+	}
+
+	// Cores reading the same chunk at once keep the first copy
+	uint8_t* expected = 0;
+	if (!__atomic_compare_exchange_n(&volume->chunks[index], &expected, chunk, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		kfree(chunk);
+		chunk = expected;
+	}
+
+	return chunk;
+}
+
+// The cluster after this one in its chain, or 0 at the end of the chain or if the FAT can not be read
+static uint32_t fat_next(fat_volume_t* volume, uint32_t cluster) {
+
+	uint64_t offset = volume->bits == 12 ? cluster + cluster / 2 : (uint64_t)cluster * volume->bits / 8;
+	uint32_t bytes = volume->bits == 12 ? 2 : volume->bits / 8;
+	uint32_t value = 0;
+
+	// A FAT12 entry can straddle two chunks, so it is put together a byte at a time
+	for (uint32_t i = 0; i < bytes; i++) {
+		uint64_t at = offset + i;
+		if (at >= volume->fat_bytes) {
+			return 0;
+		}
+
+		uint8_t* chunk = fat_chunk(volume, at / FAT_CHUNK_SIZE);
+		if (chunk == 0) {
+			return 0;
+		}
+		value |= (uint32_t)chunk[at % FAT_CHUNK_SIZE] << (i * 8);
+	}
+
+	if (volume->bits == 12) {
+		value = cluster & 1 ? value >> 4 : value & 0xfff;
+	}
+	else if (volume->bits == 32) {
+		value &= 0x0fffffff;
+	}
+
+	// Free, reserved, bad and end of chain values are all past the last cluster
+	if (value < 2 || value >= volume->clusters + 2) {
+		return 0;
+	}
+
+	return value;
+}
+
+// Follow a node's chain from its first cluster, noting each run of contiguous clusters
+static bool fat_build_runs(fat_volume_t* volume, fat_node_t* node, uint32_t cluster) {
+
+	uint32_t capacity = 0;
+
+	// A chain longer than the volume has a loop in it
+	for (uint32_t file_cluster = 0; cluster != 0 && file_cluster < volume->clusters; file_cluster++) {
+		fat_run_t* run = node->run_count != 0 ? &node->runs[node->run_count - 1] : 0;
+
+		if (run != 0 && run->cluster + run->length == cluster) {
+			run->length++;
+		}
+		else {
+			if (node->run_count == capacity) {
+				capacity = capacity != 0 ? capacity * 2 : 4;
+
+				fat_run_t* runs = kmalloc(capacity * sizeof(fat_run_t));
+				if (runs == 0) {
+					return false;
+				}
+				if (node->runs != 0) {
+					memcpy(runs, node->runs, node->run_count * sizeof(fat_run_t));
+				}
+				kfree(node->runs);
+				node->runs = runs;
+			}
+
+			run = &node->runs[node->run_count++];
+			run->file_cluster = file_cluster;
+			run->cluster = cluster;
+			run->length = 1;
+		}
+
+		cluster = fat_next(volume, cluster);
+	}
+
+	return true;
+}
+
+// The run holding one of a node's clusters, or 0 past the end of its chain
+static fat_run_t* fat_find_run(fat_node_t* node, uint32_t file_cluster) {
+
+	uint32_t low = 0;
+	uint32_t high = node->run_count;
+
+	while (low < high) {
+		uint32_t middle = (low + high) / 2;
+		fat_run_t* run = &node->runs[middle];
+
+		if (file_cluster < run->file_cluster) {
+			high = middle;
+		}
+		else if (file_cluster >= run->file_cluster + run->length) {
+			low = middle + 1;
+		}
+		else {
+			return run;
+		}
+	}
+
+	return 0;
+}
+
+// Read part of a node's clusters. Whole sectors go straight into buffer, a request for each run
+// of contiguous clusters, all submitted under one plug. Only partial sectors at the ends are copied
+static uint64_t fat_read_clusters(fat_volume_t* volume, fat_node_t* node, uint64_t offset, uint64_t size, uint8_t* buffer) {
+
+	block_device_t* device = volume->device;
+	uint64_t cluster_bytes = (uint64_t)volume->cluster_sectors * BLOCK_SECTOR_SIZE;
+
+	// Keep a segment spare for a buffer that does not start on a page
+	uint32_t segments = device->segments_max != 0 && device->segments_max < BLOCK_SEGMENTS_MAX ? device->segments_max : BLOCK_SEGMENTS_MAX;
+	uint64_t request_max = segments > 1 ? (uint64_t)(segments - 1) * PAGE_SIZE : BLOCK_SECTOR_SIZE;
+	if (device->sectors_max != 0 && request_max > (uint64_t)device->sectors_max * BLOCK_SECTOR_SIZE) {
+		request_max = (uint64_t)device->sectors_max * BLOCK_SECTOR_SIZE;
+	}
+
+	uint64_t end = offset + size;
+	uint64_t position = offset;
+	uint64_t status = FS_ERROR_SUCCESS;
+	block_request_t* pending = 0;
+	uint8_t* bounce = 0;
+
+	block_start_plug();
+
+	while (position < end) {
+		fat_run_t* run = fat_find_run(node, position / cluster_bytes);
+		if (run == 0) {
+			status = FS_ERROR_FAILURE;
+			break;
+		}
+
+		uint64_t run_start = (uint64_t)run->file_cluster * cluster_bytes;
+		uint64_t run_end = run_start + (uint64_t)run->length * cluster_bytes;
+		if (run_end > end) {
+			run_end = end;
+		}
+
+		uint64_t sector = volume->data_start + (uint64_t)(run->cluster - 2) * volume->cluster_sectors + (position - run_start) / BLOCK_SECTOR_SIZE;
+		uint64_t within = position % BLOCK_SECTOR_SIZE;
+
+		if (within != 0 || run_end - position < BLOCK_SECTOR_SIZE) {
+			uint64_t length = BLOCK_SECTOR_SIZE - within < run_end - position ? BLOCK_SECTOR_SIZE - within : run_end - position;
+
+			if (bounce == 0) {
+				bounce = kmalloc(BLOCK_SECTOR_SIZE);
+			}
+			if (bounce == 0 || block_read(device, sector, 1, bounce) != BLOCK_SUCCESS) {
+				status = FS_ERROR_FAILURE;
+				break;
+			}
+
+			memcpy(buffer + (position - offset), bounce + within, length);
+			position += length;
+			continue;
+		}
+
+		uint64_t length = (run_end - position) & ~(uint64_t)(BLOCK_SECTOR_SIZE - 1);
+		if (length > request_max) {
+			length = request_max;
+		}
+
+		block_request_t* request = kzalloc(sizeof(block_request_t));
+		if (request == 0) {
+			status = FS_ERROR_FAILURE;
+			break;
+		}
+
+		request->device = device;
+		request->sector = sector;
+		request->sectors = length / BLOCK_SECTOR_SIZE;
+
+		if (block_add_buffer(request, buffer + (position - offset), length) != BLOCK_SUCCESS) {
+			kfree(request);
+			status = FS_ERROR_FAILURE;
+			break;
+		}
+
+		// Chained through private_data to be waited for once they are all started
+		request->private_data = pending;
+		pending = request;
+
+		block_submit(request);
+		position += length;
+	}
+
+	block_finish_plug();
+
+	while (pending != 0) {
+		block_request_t* request = pending;
+		pending = request->private_data;
+
+		if (block_wait(request) != BLOCK_SUCCESS) {
+			status = FS_ERROR_FAILURE;
+		}
+		kfree(request);
+	}
+
+	kfree(bounce);
+	return status;
+}
+
+static void fat_node_free(fat_node_t* node) {
+	kfree(node->runs);
+	kfree(node->entries);
+	kfree(node);
+}
+
+// Make a node starting at a cluster, reading all of a directory's entries in.
+// A directory at cluster 0 is the FAT12 or FAT16 root, which has an area of its own
+static fat_node_t* fat_node_create(fat_volume_t* volume, uint64_t key, uint32_t cluster, uint8_t type, uint32_t size) {
+
+	fat_node_t* node = kzalloc(sizeof(fat_node_t));
+	if (node == 0) {
+		return 0;
+	}
+
+	node->key = key;
+	node->inode.id = __atomic_add_fetch(&volume->next_id, 1, __ATOMIC_RELAXED);
+	node->inode.type = type;
+	node->inode.size = size;
+	node->inode.link_count = 1;
+	node->inode.superblock = &volume->superblock;
+	node->inode.private_data = node;
+
+	bool valid = cluster == 0 || (cluster >= 2 && cluster < volume->clusters + 2);
+	if (!valid || (cluster != 0 && !fat_build_runs(volume, node, cluster))) {
+		fat_node_free(node);
+		return 0;
+	}
+
+	if (type != FS_DIRECTORY) {
+		return node;
+	}
+
+	// Directories have no size in their entries, so they take that of their chain
+	uint64_t length = volume->root_bytes;
+	if (cluster != 0) {
+		fat_run_t* last = &node->runs[node->run_count - 1];
+		length = (uint64_t)(last->file_cluster + last->length) * volume->cluster_sectors * BLOCK_SECTOR_SIZE;
+	}
+
+	node->inode.size = length;
+	node->entries = kmalloc(length != 0 ? length : 1);
+
+	bool read = node->entries != 0;
+	if (read && length != 0) {
+		read = cluster != 0
+			? fat_read_clusters(volume, node, 0, length, node->entries) == FS_ERROR_SUCCESS
+			: block_read(volume->device, volume->root_start, length / BLOCK_SECTOR_SIZE, node->entries) == BLOCK_SUCCESS;
+	}
+
+	if (!read) {
+		fat_node_free(node);
+		return 0;
+	}
+
+	return node;
+}
+
+// The cached node for a key, made the first time it is looked up
+static fat_node_t* fat_node_get(fat_volume_t* volume, uint64_t key, uint32_t cluster, uint8_t type, uint32_t size) {
+
+	uint32_t bucket = (key ^ key >> 32) % FAT_NODE_BUCKETS;
+	fat_node_t* node;
+
+	spin_lock(&volume->lock);
+	for (node = volume->nodes[bucket]; node != 0 && node->key != key; node = node->next);
+	spin_unlock(&volume->lock);
+
+	if (node != 0) {
+		return node;
+	}
+
+	// Made without the lock held, since it reads from the disk
+	fat_node_t* created = fat_node_create(volume, key, cluster, type, size);
+	if (created == 0) {
+		return 0;
+	}
+
+	spin_lock(&volume->lock);
+
+	// Another core may have made the same node meanwhile
+	for (node = volume->nodes[bucket]; node != 0 && node->key != key; node = node->next);
+	if (node == 0) {
+		created->next = volume->nodes[bucket];
+		volume->nodes[bucket] = created;
+		node = created;
+		created = 0;
+	}
+
+	spin_unlock(&volume->lock);
+
+	if (created != 0) {
+		fat_node_free(created);
+	}
+
+	return node;
+}
+
+static char fat_lower(char c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Whether a name matches the first length characters of a path, ignoring case like FAT does
+static bool fat_name_equal(const char* name, const char* path, uint64_t length) {
+
+	for (uint64_t i = 0; i < length; i++) {
+		if (name[i] == '\0' || fat_lower(name[i]) != fat_lower(path[i])) {
+			return false;
+		}
+	}
+
+	return name[length] == '\0';
+}
+
+// A short entry's name, as "NAME.EXT"
+static void fat_short_name(const uint8_t* entry, char* name) {
+
+	uint32_t length = 0;
+
+	for (uint32_t i = 0; i < 8 && entry[i] != ' '; i++) {
+		name[length++] = entry[i];
+	}
+
+	if (entry[8] != ' ') {
+		name[length++] = '.';
+		for (uint32_t i = 8; i < 11 && entry[i] != ' '; i++) {
+			name[length++] = entry[i];
+		}
+	}
+
+	name[length] = '\0';
+
+	if (entry[0] == FAT_ENTRY_E5) {
+		name[0] = (char)FAT_ENTRY_DELETED;
+	}
+}
+
+// The checksum of a short name, held by the long name entries belonging to it
+static uint8_t fat_checksum(const uint8_t* entry) {
+
+	uint8_t sum = 0;
+
+	for (uint32_t i = 0; i < 11; i++) {
+		sum = ((sum & 1) << 7) + (sum >> 1) + entry[i];
+	}
+
+	return sum;
+}
+
+// Find the short entry with a name in a directory, by its long name or its short one.
+// Sets index to the entry's position and returns it, or returns 0
+static uint8_t* fat_find_entry(fat_node_t* directory, const char* path, uint64_t length, char* long_name, uint32_t* index) {
+
+	uint32_t count = directory->inode.size / FAT_DIRENT_SIZE;
+	bool have_long = false;
+	uint8_t checksum = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t* entry = directory->entries + i * FAT_DIRENT_SIZE;
+
+		if (entry[0] == FAT_ENTRY_END) {
+			break;
+		}
+
+		if (entry[0] == FAT_ENTRY_DELETED) {
+			have_long = false;
+			continue;
+		}
+
+		// Long names come in 13 character pieces, last piece first, before their short entry
+		if (entry[FAT_ENTRY_ATTRIBUTES] == FAT_ATTRIBUTE_LONG_NAME) {
+			uint32_t order = entry[0] & FAT_LONG_NAME_ORDER;
+
+			if (entry[0] & FAT_LONG_NAME_LAST) {
+				memset(long_name, 0, FAT_NAME_MAX);
+				checksum = entry[FAT_ENTRY_CHECKSUM];
+				have_long = true;
+			}
+
+			if (!have_long || order == 0 || order * FAT_LONG_NAME_CHARS >= FAT_NAME_MAX || entry[FAT_ENTRY_CHECKSUM] != checksum) {
+				have_long = false;
+				continue;
+			}
+
+			// Characters are UCS-2, anything outside ASCII can only match as '?'
+			for (uint32_t c = 0; c < FAT_LONG_NAME_CHARS; c++) {
+				uint16_t character = fat_read16(entry + fat_long_name_offsets[c]);
+				long_name[(order - 1) * FAT_LONG_NAME_CHARS + c] = character == 0xffff ? '\0' : character < 0x80 ? character : '?';
+			}
+			continue;
+		}
+
+		bool matched = false;
+		if (!(entry[FAT_ENTRY_ATTRIBUTES] & FAT_ATTRIBUTE_VOLUME)) {
+			char short_name[13];
+			fat_short_name(entry, short_name);
+
+			matched = (have_long && fat_checksum(entry) == checksum && fat_name_equal(long_name, path, length))
+				|| fat_name_equal(short_name, path, length);
+		}
+
+		if (matched) {
+			*index = i;
+			return entry;
+		}
+
+		have_long = false;
+	}
+
+	return 0;
+}
+
+// The node for a directory entry
+static fat_node_t* fat_open_entry(fat_volume_t* volume, fat_node_t* parent, uint8_t* entry, uint32_t index) {
+
+	uint32_t cluster = fat_read16(entry + FAT_ENTRY_CLUSTER_LOW);
+	if (volume->bits == 32) {
+		cluster |= (uint32_t)fat_read16(entry + FAT_ENTRY_CLUSTER_HIGH) << 16;
+	}
+
+	bool directory = entry[FAT_ENTRY_ATTRIBUTES] & FAT_ATTRIBUTE_DIRECTORY;
+
+	// ".." in the root's children holds cluster 0
+	if (directory && (cluster == 0 || cluster == volume->root_cluster)) {
+		return volume->root;
+	}
+
+	uint64_t key = (uint64_t)parent->inode.id << 32 | index;
+	return fat_node_get(volume, key, cluster, directory ? FS_DIRECTORY : FS_FILE, fat_read32(entry + FAT_ENTRY_FILE_SIZE));
+}
+
+static inode_t* fat_lookup(superblock_t* superblock, const char* path) {
+
+	fat_volume_t* volume = superblock->private_data;
+	fat_node_t* node = volume->root;
+
+	// Too big for the small stacks of the application processors
+	char* long_name = kmalloc(FAT_NAME_MAX);
+	if (long_name == 0) {
+		return 0;
+	}
+
+	while (node != 0 && *path != '\0') {
+		uint64_t length = 0;
+		while (path[length] != '\0' && path[length] != '/') {
+			length++;
+		}
+
+		uint32_t index;
+		uint8_t* entry = node->inode.type == FS_DIRECTORY ? fat_find_entry(node, path, length, long_name, &index) : 0;
+		node = entry != 0 ? fat_open_entry(volume, node, entry, index) : 0;
+
+		path += length;
+		while (*path == '/') {
+			path++;
+		}
+	}
+
+	kfree(long_name);
+	return node != 0 ? &node->inode : 0;
+}
+
+static uint64_t fat_read(inode_t* inode, uint32_t offset, uint32_t size, uint8_t* buffer) {
+
+	fat_node_t* node = inode->private_data;
+
+	if (offset >= inode->size) {
+		return FS_ERROR_END_OF_FILE;
+	}
+
+	if (size > inode->size - offset) {
+		size = inode->size - offset;
+	}
+
+	// Directories were read in whole when their node was made
+	if (node->entries != 0) {
+		memcpy(buffer, node->entries + offset, size);
+		return FS_ERROR_SUCCESS;
+	}
+
+	return fat_read_clusters(inode->superblock->private_data, node, offset, size, buffer);
+}
+
+bool fat_find(block_device_t* device, uint64_t* start) {
+
+	// A CD sector, and a sector to check for a boot sector
+	uint8_t* buffer = kmalloc(ISO_SECTORS * BLOCK_SECTOR_SIZE + BLOCK_SECTOR_SIZE);
+	if (buffer == 0) {
+		return false;
+	}
+
+	uint8_t* sector = buffer + ISO_SECTORS * BLOCK_SECTOR_SIZE;
+	bool found = false;
+
+	// A volume taking the whole device, or a partition of it
+	if (block_read(device, 0, 1, buffer) == BLOCK_SUCCESS) {
+		if (fat_valid(buffer)) {
+			*start = 0;
+			found = true;
+		}
+		else if (fat_read16(buffer + FAT_BOOT_SIGNATURE) == 0xaa55) {
+			for (uint32_t i = 0; i < 4 && !found; i++) {
+				uint8_t* partition = buffer + MBR_PARTITIONS + i * MBR_PARTITION_SIZE;
+				uint8_t type = partition[MBR_PARTITION_TYPE];
+				uint32_t first = fat_read32(partition + MBR_PARTITION_START);
+
+				bool fat = type == 0x01 || type == 0x04 || type == 0x06 || type == 0x0b || type == 0x0c || type == 0x0e;
+				if (fat && first != 0 && block_read(device, first, 1, sector) == BLOCK_SUCCESS && fat_valid(sector)) {
+					*start = first;
+					found = true;
+				}
+			}
+		}
+	}
+
+	// The image a CD boots, such as the one the Makefile wraps in cdimage.iso
+	if (!found && block_read(device, ISO_BOOT_RECORD * ISO_SECTORS, ISO_SECTORS, buffer) == BLOCK_SUCCESS
+		&& memcmp(buffer, "\0CD001\1EL TORITO SPECIFICATION", 30) == 0) {
+
+		uint64_t catalog = (uint64_t)fat_read32(buffer + ISO_BOOT_CATALOG) * ISO_SECTORS;
+
+		if (block_read(device, catalog, ISO_SECTORS, buffer) == BLOCK_SUCCESS) {
+			// Every bootable entry after the validation entry, in any section
+			for (uint32_t offset = 32; offset < ISO_SECTORS * BLOCK_SECTOR_SIZE && !found; offset += 32) {
+				if (buffer[offset] != ELTORITO_BOOTABLE) {
+					continue;
+				}
+
+				uint64_t image = (uint64_t)fat_read32(buffer + offset + ELTORITO_LOAD_SECTOR) * ISO_SECTORS;
+				if (image != 0 && block_read(device, image, 1, sector) == BLOCK_SUCCESS && fat_valid(sector)) {
+					*start = image;
+					found = true;
+				}
+			}
+		}
+	}
+
+	kfree(buffer);
+	return found;
+}
+
+uint64_t fat_mount(block_device_t* device, uint64_t start, const char* path) {
+
+	uint8_t* sector = kmalloc(BLOCK_SECTOR_SIZE);
+	fat_volume_t* volume = kzalloc(sizeof(fat_volume_t));
+
+	if (sector == 0 || volume == 0 || block_read(device, start, 1, sector) != BLOCK_SUCCESS || !fat_valid(sector)) {
+		kfree(sector);
+		kfree(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	// The boot sector counts in its own sectors, which may be larger than the device's
+	uint32_t bytes = fat_read16(sector + FAT_BPB_BYTES_PER_SECTOR);
+	uint32_t scale = bytes / BLOCK_SECTOR_SIZE;
+	uint32_t reserved = fat_read16(sector + FAT_BPB_RESERVED);
+	uint32_t root_entries = fat_read16(sector + FAT_BPB_ROOT_ENTRIES);
+
+	uint32_t sectors = fat_read16(sector + FAT_BPB_SECTORS_16);
+	if (sectors == 0) {
+		sectors = fat_read32(sector + FAT_BPB_SECTORS_32);
+	}
+
+	uint32_t fat_size = fat_read16(sector + FAT_BPB_FAT_SIZE_16);
+	if (fat_size == 0) {
+		fat_size = fat_read32(sector + FAT_BPB_FAT_SIZE_32);
+	}
+
+	uint32_t root_sectors = (root_entries * FAT_DIRENT_SIZE + bytes - 1) / bytes;
+	uint32_t data = reserved + sector[FAT_BPB_FATS] * fat_size + root_sectors;
+
+	if (fat_size == 0 || sectors <= data) {
+		kfree(sector);
+		kfree(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	volume->device = device;
+	volume->clusters = (sectors - data) / sector[FAT_BPB_SECTORS_PER_CLUSTER];
+	volume->bits = volume->clusters <= FAT12_CLUSTERS_MAX ? 12 : volume->clusters <= FAT16_CLUSTERS_MAX ? 16 : 32;
+	volume->cluster_sectors = sector[FAT_BPB_SECTORS_PER_CLUSTER] * scale;
+	volume->fat_start = start + reserved * scale;
+	volume->fat_bytes = (uint64_t)fat_size * bytes;
+	volume->root_start = start + (uint64_t)(reserved + sector[FAT_BPB_FATS] * fat_size) * scale;
+	volume->root_bytes = root_sectors * bytes;
+	volume->data_start = start + (uint64_t)data * scale;
+	volume->root_cluster = volume->bits == 32 ? fat_read32(sector + FAT_BPB_ROOT_CLUSTER) : 0;
+
+	kfree(sector);
+
+	volume->chunks = kzalloc((volume->fat_bytes + FAT_CHUNK_SIZE - 1) / FAT_CHUNK_SIZE * sizeof(uint8_t*));
+	if (volume->chunks == 0) {
+		kfree(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	memcpy(volume->superblock.fs_type, volume->bits == 12 ? "fat12" : volume->bits == 16 ? "fat16" : "fat32", 6);
+	volume->superblock.ops.read_inode = &fat_read;
+	volume->superblock.ops.lookup = &fat_lookup;
+	volume->superblock.private_data = volume;
+
+	volume->root = fat_node_create(volume, 0, volume->root_cluster, FS_DIRECTORY, 0);
+	if (volume->root == 0) {
+		for (uint64_t i = 0; i < (volume->fat_bytes + FAT_CHUNK_SIZE - 1) / FAT_CHUNK_SIZE; i++) {
+			kfree(volume->chunks[i]);
+		}
+		kfree(volume->chunks);
+		kfree(volume);
+		return FS_ERROR_FAILURE;
+	}
+
+	return vfs_mount(path, &volume->superblock);
+}
+
+void fat_mount_boot(void) {
+
+	for (block_device_t* device = block_devices; device != 0; device = device->next) {
+		uint64_t start;
+
+		if (fat_find(device, &start) && fat_mount(device, start, "/boot") == FS_ERROR_SUCCESS) {
+			tty_print_string("Mounted ");
+			tty_print_string(device->name);
+			tty_print_string(" at /boot\n");
+			return;
+		}
+	}
+}
@@ -0,0 +1,311 @@
+/*
+ * evan-os/src/fpu.c
+ *
+ * Lazy FPU, SSE and AVX context switching.
+ *
+ * Every core tracks the context whose registers it holds (the owner) and
+ * the context of the task it is running (current). A task's registers are
+ * saved when it is switched out, but only if it used them, and only
+ * restored when it first uses them again. With XSAVEOPT and XSAVES the
+ * save itself skips any component that was not modified since the restore.
+ *
+ */
+
+#include <fpu.h>
+
+#include <asm.h>
+#include <cpu.h>
+#include <percpu.h>
+#include <spinlock.h>
+#include <string.h>
+#include <kernel.h>
+#include <tty.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CR0_MP (1 << 1) // Monitor coprocessor, makes wait/fwait trap when TS is set
+#define CR0_EM (1 << 2) // Emulate the FPU
+#define CR0_TS (1 << 3) // Task switched, FPU and SIMD instructions trap
+#define CR0_NE (1 << 5) // Report x87 errors with exceptions
+
+#define CR4_OSFXSR     (1 << 9)  // fxsave, fxrstor and SSE
+#define CR4_OSXMMEXCPT (1 << 10) // SIMD floating point exceptions
+#define CR4_OSXSAVE    (1 << 18) // xsave and XCR0
+
+#define MSR_IA32_XSS 0xDA0 // Supervisor state components saved by xsaves
+
+// State components in XCR0
+#define XFEATURE_X87    (1 << 0)
+#define XFEATURE_SSE    (1 << 1)
+#define XFEATURE_AVX    (1 << 2)
+#define XFEATURE_AVX512 (7 << 5) // Opmask, upper halves of ZMM0-15, and ZMM16-31
+
+// Offsets into a save area
+#define FPU_AREA_FCW      0
+#define FPU_AREA_MXCSR    24
+#define FPU_AREA_XCOMP_BV 520
+
+#define FPU_FCW_DEFAULT   0x37f  // All exceptions masked, 64 bit precision
+#define FPU_MXCSR_DEFAULT 0x1f80 // All exceptions masked, round to nearest
+
+#define XCOMP_BV_COMPACTED (1ull << 63)
+
+#define CPU_NONE 0xffffffff
+
+uint32_t fpu_state_size;
+uint64_t fpu_xfeatures;
+uint32_t fpu_save_method;
+
+volatile bool fpu_ready;
+
+// The context whose state is held in this core's registers
+DEFINE_PER_CPU(fpu_context_t*, fpu_owner);
+// The context of the task running on this core
+DEFINE_PER_CPU(fpu_context_t*, fpu_current);
+// Interrupt flags saved by kernel_fpu_begin
+DEFINE_PER_CPU(uint64_t, fpu_kernel_flags);
+
+static void fpu_save(void* area) {
+	uint32_t low = (uint32_t)fpu_xfeatures;
+	uint32_t high = (uint32_t)(fpu_xfeatures >> 32);
+
+	switch (fpu_save_method) {
+		case FPU_SAVE_XSAVES:
+			asm volatile ("xsaves64 (%0)" : : "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		case FPU_SAVE_XSAVEOPT:
+			asm volatile ("xsaveopt64 (%0)" : : "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		case FPU_SAVE_XSAVE:
+			asm volatile ("xsave64 (%0)" : : "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		default:
+			asm volatile ("fxsave64 (%0)" : : "r"(area) : "memory");
+			break;
+	}
+}
+
+static void fpu_restore(void* area) {
+	uint32_t low = (uint32_t)fpu_xfeatures;
+	uint32_t high = (uint32_t)(fpu_xfeatures >> 32);
+
+	switch (fpu_save_method) {
+		case FPU_SAVE_XSAVES:
+			asm volatile ("xrstors64 (%0)" : : "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		case FPU_SAVE_XSAVEOPT:
+		case FPU_SAVE_XSAVE:
+			asm volatile ("xrstor64 (%0)" : : "r"(area), "a"(low), "d"(high) : "memory");
+			break;
+		default:
+			asm volatile ("fxrstor64 (%0)" : : "r"(area) : "memory");
+			break;
+	}
+}
+
+static inline void fpu_set_ts(void) {
+	write_cr0(read_cr0() | CR0_TS);
+}
+
+// Pick the state components and save instructions, and size the save area
+static void fpu_setup_features(void) {
+
+	uint32_t eax, ebx, ecx, edx;
+
+	if (!cpu_has(CPU_FEATURE_XSAVE)) {
+		fpu_xfeatures = XFEATURE_X87 | XFEATURE_SSE;
+		fpu_state_size = 512;
+		fpu_save_method = FPU_SAVE_FXSAVE;
+		return;
+	}
+
+	cpuid(0xd, 0, &eax, &ebx, &ecx, &edx);
+	uint64_t supported = ((uint64_t)edx << 32) | eax;
+
+	fpu_xfeatures = XFEATURE_X87 | XFEATURE_SSE;
+	if (cpu_has(CPU_FEATURE_AVX) && (supported & XFEATURE_AVX)) {
+		fpu_xfeatures |= XFEATURE_AVX;
+
+		// AVX-512 needs all three of its components
+		if (cpu_has(CPU_FEATURE_AVX512F) && (supported & XFEATURE_AVX512) == XFEATURE_AVX512) {
+			fpu_xfeatures |= XFEATURE_AVX512;
+		}
+	}
+
+	if (cpu_has(CPU_FEATURE_XSAVES)) {
+		fpu_save_method = FPU_SAVE_XSAVES;
+	}
+	else if (cpu_has(CPU_FEATURE_XSAVEOPT)) {
+		fpu_save_method = FPU_SAVE_XSAVEOPT;
+	}
+	else {
+		fpu_save_method = FPU_SAVE_XSAVE;
+	}
+}
+
+// Read the save area size for the components enabled on this core
+static void fpu_setup_size(void) {
+
+	uint32_t eax, ebx, ecx, edx;
+
+	if (fpu_save_method == FPU_SAVE_XSAVES) {
+		// Compacted format, sized for XCR0 and IA32_XSS together
+		cpuid(0xd, 1, &eax, &ebx, &ecx, &edx);
+	}
+	else if (fpu_save_method != FPU_SAVE_FXSAVE) {
+		// Standard format, sized for the components enabled in XCR0
+		cpuid(0xd, 0, &eax, &ebx, &ecx, &edx);
+	}
+	else {
+		return;
+	}
+
+	// Round up so areas can be packed at the required alignment
+	fpu_state_size = (ebx + FPU_AREA_ALIGN - 1) & ~(FPU_AREA_ALIGN - 1);
+}
+
+void fpu_init(void) {
+
+	bool bsp = cpu_id() == 0;
+
+	if (bsp) {
+		fpu_setup_features();
+	}
+	else {
+		while (!fpu_ready) {
+			pause();
+		}
+	}
+
+	// Use the FPU natively and start with TS set, since no task owns the registers yet
+	uint64_t cr0 = read_cr0();
+	cr0 &= ~CR0_EM;
+	cr0 |= CR0_MP | CR0_NE | CR0_TS;
+	write_cr0(cr0);
+
+	uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+	if (fpu_save_method != FPU_SAVE_FXSAVE) {
+		cr4 |= CR4_OSXSAVE;
+	}
+	write_cr4(cr4);
+
+	if (fpu_save_method != FPU_SAVE_FXSAVE) {
+		xsetbv(0, fpu_xfeatures);
+	}
+	if (fpu_save_method == FPU_SAVE_XSAVES) {
+		// No supervisor state components are used
+		wrmsr(MSR_IA32_XSS, 0, 0);
+	}
+
+	this_cpu_write(fpu_owner, 0);
+	this_cpu_write(fpu_current, 0);
+
+	if (bsp) {
+		fpu_setup_size();
+		__atomic_store_n(&fpu_ready, true, __ATOMIC_RELEASE);
+	}
+}
+
+void fpu_context_init(fpu_context_t* context, void* area) {
+
+	// An all zero header means every component starts in its initial state
+	memset(area, 0, fpu_state_size);
+	*(uint16_t*)((uint8_t*)area + FPU_AREA_FCW) = FPU_FCW_DEFAULT;
+	*(uint32_t*)((uint8_t*)area + FPU_AREA_MXCSR) = FPU_MXCSR_DEFAULT;
+
+	// xrstors only accepts the compacted format
+	if (fpu_save_method == FPU_SAVE_XSAVES) {
+		*(uint64_t*)((uint8_t*)area + FPU_AREA_XCOMP_BV) = XCOMP_BV_COMPACTED | fpu_xfeatures;
+	}
+
+	context->area = area;
+	context->last_cpu = CPU_NONE;
+}
+
+void fpu_switch(fpu_context_t* prev, fpu_context_t* next) {
+
+	fpu_context_t* owner = this_cpu_read(fpu_owner);
+
+	// TS is only clear if prev used the FPU since it was switched in
+	if (prev != 0 && prev == owner && (read_cr0() & CR0_TS) == 0) {
+		fpu_save(prev->area);
+	}
+
+	this_cpu_write(fpu_current, next);
+
+	// The registers still hold next's state if it last ran here and nothing else used them since
+	if (next != 0 && next == owner && next->last_cpu == cpu_id()) {
+		clts();
+	}
+	else {
+		fpu_set_ts();
+	}
+}
+
+void fpu_context_release(fpu_context_t* context) {
+
+	if (this_cpu_read(fpu_owner) == context) {
+		this_cpu_write(fpu_owner, 0);
+	}
+	if (this_cpu_read(fpu_current) == context) {
+		this_cpu_write(fpu_current, 0);
+	}
+
+	// Other cores may still point to it as their owner, but will not match last_cpu again
+	context->last_cpu = CPU_NONE;
+}
+
+__attribute__((interrupt))
+void fpu_trap(struct interrupt_frame* frame) {
+
+	clts();
+
+	fpu_context_t* current = this_cpu_read(fpu_current);
+
+	if (current == 0) {
+		// Kernel code used the FPU outside of kernel_fpu_begin and kernel_fpu_end
+		tty_print_string("FPU USED WITHOUT A CONTEXT. HALTING KERNEL.\nAddress: ");
+		print_hex(frame->ip);
+
+		while (1) {
+			cli();
+			hlt();
+		}
+	}
+
+	// Load the task's state unless the registers still hold it
+	if (this_cpu_read(fpu_owner) != current || current->last_cpu != cpu_id()) {
+		fpu_restore(current->area);
+		this_cpu_write(fpu_owner, current);
+		current->last_cpu = cpu_id();
+	}
+}
+
+void kernel_fpu_begin(void) {
+
+	uint64_t flags = irq_save();
+
+	// Save the running task's registers if they hold changes that were not saved yet
+	fpu_context_t* owner = this_cpu_read(fpu_owner);
+	if (owner != 0 && owner == this_cpu_read(fpu_current) && (read_cr0() & CR0_TS) == 0) {
+		fpu_save(owner->area);
+	}
+
+	// The kernel is about to overwrite the registers
+	this_cpu_write(fpu_owner, 0);
+
+	clts();
+	uint32_t mxcsr = FPU_MXCSR_DEFAULT;
+	asm volatile ("fninit; ldmxcsr %0" : : "m"(mxcsr));
+
+	this_cpu_write(fpu_kernel_flags, flags);
+}
+
+void kernel_fpu_end(void) {
+
+	// The next task to use the FPU traps and loads its own state
+	fpu_set_ts();
+
+	irq_restore(this_cpu_read(fpu_kernel_flags));
+}
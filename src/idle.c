@@ -0,0 +1,206 @@
+/*
+ * evan-os/src/idle.c
+ *
+ * The idle loop. Before sleeping, a core arms monitor on the cache line
+ * holding its run queue and marks itself as polling, so a core queuing
+ * work only has to write the queue to wake it. A core sleeping in hlt
+ * instead needs an IPI, which does nothing but end the hlt.
+ *
+ */
+
+#include <idle.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <cpu.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <kernel.h>
+#include <module.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <rcu.h>
+#include <tty.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Per core state, in its own cache line so monitor is not woken by writes to anything else
+typedef struct idle_cpu_t {
+	idle_work_t* volatile queue;   // Work to run, newest first
+	volatile bool         polling; // Set while the core is monitoring queue
+	uint64_t              cycles;  // Spent asleep
+	uint64_t              sleeps;
+	uint64_t              start;   // When idle_init was called, to compare cycles against
+} __attribute__((aligned(64))) idle_cpu_t;
+
+DEFINE_PER_CPU(idle_cpu_t, idle_cpu);
+
+bool idle_mwait_enabled;
+
+volatile uint64_t idle_ipis_sent;
+volatile uint64_t idle_ipis_skipped;
+
+// Only needs to end a hlt, the idle loop finds the work itself
+__attribute__((interrupt))
+static void idle_wakeup_interrupt(__attribute__((unused)) struct interrupt_frame* frame) {
+	uint64_t start = rdtsc();
+	apic_eoi();
+	interrupt_account(INTERRUPT_VECTOR_WAKEUP, start);
+}
+
+void idle_init(void) {
+
+	if (cpu_id() == 0) {
+		idle_mwait_enabled = cpu_has(CPU_FEATURE_MONITOR);
+	}
+
+	interrupt_set_gate(INTERRUPT_VECTOR_WAKEUP, (uint64_t)&idle_wakeup_interrupt, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+
+	this_cpu_ptr(idle_cpu)->start = rdtsc();
+}
+
+void idle_queue_work(uint32_t cpu, idle_work_t* work) {
+
+	idle_cpu_t* idle = per_cpu_ptr(idle_cpu, cpu);
+
+	idle_work_t* head = idle->queue;
+	do {
+		work->next = head;
+	} while (!__atomic_compare_exchange_n(&idle->queue, &head, work, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	// Running the idle loop means it will get to the work next
+	if (cpu == cpu_id()) {
+		return;
+	}
+
+	// The queue write is ordered before this load, and the sleeping core sets polling before it
+	// checks the queue, so at least one of them sees the other
+	if (__atomic_load_n(&idle->polling, __ATOMIC_SEQ_CST)) {
+		__atomic_add_fetch(&idle_ipis_skipped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	__atomic_add_fetch(&idle_ipis_sent, 1, __ATOMIC_RELAXED);
+	apic_send_ipi(cpu, INTERRUPT_VECTOR_WAKEUP);
+}
+EXPORT_SYMBOL(idle_queue_work);
+
+// Run everything queued so far, oldest first
+static bool idle_run_work(idle_cpu_t* idle) {
+
+	idle_work_t* list = __atomic_exchange_n(&idle->queue, 0, __ATOMIC_ACQUIRE);
+	if (list == 0) {
+		return false;
+	}
+
+	idle_work_t* reversed = 0;
+	while (list != 0) {
+		idle_work_t* next = list->next;
+		list->next = reversed;
+		reversed = list;
+		list = next;
+	}
+
+	while (reversed != 0) {
+		// The work may be freed or queued again by func
+		idle_work_t* next = reversed->next;
+		reversed->func(reversed->arg);
+		reversed = next;
+	}
+
+	return true;
+}
+
+static void idle_sleep(idle_cpu_t* idle) {
+
+	// Interrupts stay off from the last check of the queue until the sleeping instruction,
+	// so a wakeup IPI can not slip in between and be missed
+	cli();
+	uint64_t start = rdtsc();
+
+	if (idle_mwait_enabled) {
+		__atomic_store_n(&idle->polling, true, __ATOMIC_SEQ_CST);
+		monitor(&idle->queue);
+
+		if (idle->queue == 0) {
+			sti_mwait(0);
+		}
+		else {
+			sti();
+		}
+
+		__atomic_store_n(&idle->polling, false, __ATOMIC_RELAXED);
+	}
+	else if (idle->queue == 0) {
+		sti_hlt();
+	}
+	else {
+		sti();
+	}
+
+	idle->cycles += rdtsc() - start;
+	idle->sleeps++;
+}
+
+void idle_run(void) {
+
+	idle_cpu_t* idle = this_cpu_ptr(idle_cpu);
+
+	while (1) {
+		// Work and idle page clearing hold no references, so let grace periods end between them
+		rcu_quiescent_state();
+
+		if (idle_run_work(idle)) {
+			continue;
+		}
+
+		// Clear pages ahead of time for demand-zero faults, checking for work between batches
+		if (pmm_zero_refill()) {
+			continue;
+		}
+
+		// Callbacks are waiting for a grace period, so keep reporting quiescent states instead of sleeping
+		if (!rcu_idle_enter()) {
+			pause();
+			continue;
+		}
+
+		idle_sleep(idle);
+		rcu_idle_exit();
+	}
+}
+
+uint64_t idle_cycles(uint32_t cpu) {
+	return per_cpu_ptr(idle_cpu, cpu)->cycles;
+}
+
+uint64_t idle_sleeps(uint32_t cpu) {
+	return per_cpu_ptr(idle_cpu, cpu)->sleeps;
+}
+
+void idle_print_stats(void) {
+
+	uint64_t now = rdtsc();
+
+	tty_print_string("Idle time\n");
+
+	for (uint32_t cpu = 0; cpu < cpu_count && cpu < CPU_MAX; cpu++) {
+		idle_cpu_t* idle = per_cpu_ptr(idle_cpu, cpu);
+		uint64_t total = now - idle->start;
+
+		tty_print_string("  Core ");
+		print_dec(cpu);
+		tty_print_string(": ");
+		print_dec(total != 0 ? idle->cycles * 100 / total : 0);
+		tty_print_string("% idle, ");
+		print_dec(idle->sleeps);
+		tty_print_string(" sleeps\n");
+	}
+
+	tty_print_string("  Wakeup IPIs sent: ");
+	print_dec(idle_ipis_sent);
+	tty_print_string("\n  Wakeup IPIs skipped: ");
+	print_dec(idle_ipis_skipped);
+	tty_print_string("\n");
+}
@@ -7,7 +7,18 @@
 
 #include <interrupt.h>
 
+#include <apic.h>
 #include <asm.h>
+#include <interrupt_stats.h>
+#include <ioapic.h>
+#include <irq_balance.h>
+#include <module.h>
+#include <percpu.h>
+#include <procfs.h>
+#include <rcu.h>
+#include <softirq.h>
+#include <spinlock.h>
+#include <trace.h>
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -22,7 +33,10 @@ bool using_apic;
 
 // Create an interrupt stub called "stub_x" where x is the input number, 
 // that calls the interrupt manager with an interrupt number
-#define INTERRUPT_STUB(x) __attribute__((interrupt)) void x(__attribute__((unused)) struct interrupt_frame *frame) { interrupt_handler((uint64_t)x); }
+#define INTERRUPT_STUB(x) __attribute__((interrupt)) void stub_##x(__attribute__((unused)) struct interrupt_frame *frame) { interrupt_handler((uint64_t)x); }
+
+// The same for allocated vectors, which are looked up on the core they arrive at
+#define INTERRUPT_VECTOR_STUB(x) __attribute__((interrupt)) static void vector_stub_##x(__attribute__((unused)) struct interrupt_frame *frame) { interrupt_vector_dispatch((uint64_t)x); }
 
 typedef struct idt_entry_t {
    uint16_t offset_low; 	// Bits 0-15
@@ -43,26 +57,264 @@ typedef struct idt_ptr_t {
 // The Interrupt Descriptor Table, made of 256 decsriptors
 volatile idt_entry_t idt[256];
 
-volatile interrupt_handler_t interrupt_handlers[256];
-
-INTERRUPT_STUB(stub_32)
-INTERRUPT_STUB(stub_33)
-INTERRUPT_STUB(stub_34)
-INTERRUPT_STUB(stub_35)
-INTERRUPT_STUB(stub_36)
-INTERRUPT_STUB(stub_37)
-INTERRUPT_STUB(stub_38)
-INTERRUPT_STUB(stub_39)
-INTERRUPT_STUB(stub_40)
-INTERRUPT_STUB(stub_41)
-INTERRUPT_STUB(stub_42)
-INTERRUPT_STUB(stub_43)
-INTERRUPT_STUB(stub_44)
-INTERRUPT_STUB(stub_45)
-INTERRUPT_STUB(stub_46)
-INTERRUPT_STUB(stub_47)
-INTERRUPT_STUB(stub_48)
-INTERRUPT_STUB(stub_49)
+// Handlers claimed by drivers. Entries are protected by RCU, so dispatching never takes a lock
+interrupt_handler_t interrupt_handlers[256];
+
+// The cores each IRQ may be sent to, and the one it is sent to
+uint64_t interrupt_affinity[INTERRUPT_IRQ_COUNT];
+uint32_t interrupt_targets[INTERRUPT_IRQ_COUNT];
+spinlock_t interrupt_route_lock;
+
+// Allocated vectors on each core, and the vectors each core has handed out
+typedef struct interrupt_vector_t {
+	interrupt_vector_handler_t handler;
+	void*                      arg;
+} interrupt_vector_t;
+
+DEFINE_PER_CPU(interrupt_vector_t[INTERRUPT_VECTOR_DYNAMIC_COUNT], interrupt_vectors);
+
+uint64_t interrupt_vectors_used[CPU_MAX][(INTERRUPT_VECTOR_DYNAMIC_COUNT + 63) / 64];
+spinlock_t interrupt_vector_lock;
+
+static void interrupt_vector_dispatch(uint64_t vector);
+
+INTERRUPT_STUB(32)
+INTERRUPT_STUB(33)
+INTERRUPT_STUB(34)
+INTERRUPT_STUB(35)
+INTERRUPT_STUB(36)
+INTERRUPT_STUB(37)
+INTERRUPT_STUB(38)
+INTERRUPT_STUB(39)
+INTERRUPT_STUB(40)
+INTERRUPT_STUB(41)
+INTERRUPT_STUB(42)
+INTERRUPT_STUB(43)
+INTERRUPT_STUB(44)
+INTERRUPT_STUB(45)
+INTERRUPT_STUB(46)
+INTERRUPT_STUB(47)
+INTERRUPT_STUB(48)
+INTERRUPT_STUB(49)
+INTERRUPT_STUB(50)
+INTERRUPT_STUB(51)
+INTERRUPT_STUB(52)
+INTERRUPT_STUB(53)
+INTERRUPT_STUB(54)
+INTERRUPT_STUB(55)
+
+INTERRUPT_VECTOR_STUB(56)
+INTERRUPT_VECTOR_STUB(57)
+INTERRUPT_VECTOR_STUB(58)
+INTERRUPT_VECTOR_STUB(59)
+INTERRUPT_VECTOR_STUB(60)
+INTERRUPT_VECTOR_STUB(61)
+INTERRUPT_VECTOR_STUB(62)
+INTERRUPT_VECTOR_STUB(63)
+INTERRUPT_VECTOR_STUB(64)
+INTERRUPT_VECTOR_STUB(65)
+INTERRUPT_VECTOR_STUB(66)
+INTERRUPT_VECTOR_STUB(67)
+INTERRUPT_VECTOR_STUB(68)
+INTERRUPT_VECTOR_STUB(69)
+INTERRUPT_VECTOR_STUB(70)
+INTERRUPT_VECTOR_STUB(71)
+INTERRUPT_VECTOR_STUB(72)
+INTERRUPT_VECTOR_STUB(73)
+INTERRUPT_VECTOR_STUB(74)
+INTERRUPT_VECTOR_STUB(75)
+INTERRUPT_VECTOR_STUB(76)
+INTERRUPT_VECTOR_STUB(77)
+INTERRUPT_VECTOR_STUB(78)
+INTERRUPT_VECTOR_STUB(79)
+INTERRUPT_VECTOR_STUB(80)
+INTERRUPT_VECTOR_STUB(81)
+INTERRUPT_VECTOR_STUB(82)
+INTERRUPT_VECTOR_STUB(83)
+INTERRUPT_VECTOR_STUB(84)
+INTERRUPT_VECTOR_STUB(85)
+INTERRUPT_VECTOR_STUB(86)
+INTERRUPT_VECTOR_STUB(87)
+INTERRUPT_VECTOR_STUB(88)
+INTERRUPT_VECTOR_STUB(89)
+INTERRUPT_VECTOR_STUB(90)
+INTERRUPT_VECTOR_STUB(91)
+INTERRUPT_VECTOR_STUB(92)
+INTERRUPT_VECTOR_STUB(93)
+INTERRUPT_VECTOR_STUB(94)
+INTERRUPT_VECTOR_STUB(95)
+INTERRUPT_VECTOR_STUB(96)
+INTERRUPT_VECTOR_STUB(97)
+INTERRUPT_VECTOR_STUB(98)
+INTERRUPT_VECTOR_STUB(99)
+INTERRUPT_VECTOR_STUB(100)
+INTERRUPT_VECTOR_STUB(101)
+INTERRUPT_VECTOR_STUB(102)
+INTERRUPT_VECTOR_STUB(103)
+INTERRUPT_VECTOR_STUB(104)
+INTERRUPT_VECTOR_STUB(105)
+INTERRUPT_VECTOR_STUB(106)
+INTERRUPT_VECTOR_STUB(107)
+INTERRUPT_VECTOR_STUB(108)
+INTERRUPT_VECTOR_STUB(109)
+INTERRUPT_VECTOR_STUB(110)
+INTERRUPT_VECTOR_STUB(111)
+INTERRUPT_VECTOR_STUB(112)
+INTERRUPT_VECTOR_STUB(113)
+INTERRUPT_VECTOR_STUB(114)
+INTERRUPT_VECTOR_STUB(115)
+INTERRUPT_VECTOR_STUB(116)
+INTERRUPT_VECTOR_STUB(117)
+INTERRUPT_VECTOR_STUB(118)
+INTERRUPT_VECTOR_STUB(119)
+INTERRUPT_VECTOR_STUB(120)
+INTERRUPT_VECTOR_STUB(121)
+INTERRUPT_VECTOR_STUB(122)
+INTERRUPT_VECTOR_STUB(123)
+INTERRUPT_VECTOR_STUB(124)
+INTERRUPT_VECTOR_STUB(125)
+INTERRUPT_VECTOR_STUB(126)
+INTERRUPT_VECTOR_STUB(127)
+INTERRUPT_VECTOR_STUB(129)
+INTERRUPT_VECTOR_STUB(130)
+INTERRUPT_VECTOR_STUB(131)
+INTERRUPT_VECTOR_STUB(132)
+INTERRUPT_VECTOR_STUB(133)
+INTERRUPT_VECTOR_STUB(134)
+INTERRUPT_VECTOR_STUB(135)
+INTERRUPT_VECTOR_STUB(136)
+INTERRUPT_VECTOR_STUB(137)
+INTERRUPT_VECTOR_STUB(138)
+INTERRUPT_VECTOR_STUB(139)
+INTERRUPT_VECTOR_STUB(140)
+INTERRUPT_VECTOR_STUB(141)
+INTERRUPT_VECTOR_STUB(142)
+INTERRUPT_VECTOR_STUB(143)
+INTERRUPT_VECTOR_STUB(144)
+INTERRUPT_VECTOR_STUB(145)
+INTERRUPT_VECTOR_STUB(146)
+INTERRUPT_VECTOR_STUB(147)
+INTERRUPT_VECTOR_STUB(148)
+INTERRUPT_VECTOR_STUB(149)
+INTERRUPT_VECTOR_STUB(150)
+INTERRUPT_VECTOR_STUB(151)
+INTERRUPT_VECTOR_STUB(152)
+INTERRUPT_VECTOR_STUB(153)
+INTERRUPT_VECTOR_STUB(154)
+INTERRUPT_VECTOR_STUB(155)
+INTERRUPT_VECTOR_STUB(156)
+INTERRUPT_VECTOR_STUB(157)
+INTERRUPT_VECTOR_STUB(158)
+INTERRUPT_VECTOR_STUB(159)
+INTERRUPT_VECTOR_STUB(160)
+INTERRUPT_VECTOR_STUB(161)
+INTERRUPT_VECTOR_STUB(162)
+INTERRUPT_VECTOR_STUB(163)
+INTERRUPT_VECTOR_STUB(164)
+INTERRUPT_VECTOR_STUB(165)
+INTERRUPT_VECTOR_STUB(166)
+INTERRUPT_VECTOR_STUB(167)
+INTERRUPT_VECTOR_STUB(168)
+INTERRUPT_VECTOR_STUB(169)
+INTERRUPT_VECTOR_STUB(170)
+INTERRUPT_VECTOR_STUB(171)
+INTERRUPT_VECTOR_STUB(172)
+INTERRUPT_VECTOR_STUB(173)
+INTERRUPT_VECTOR_STUB(174)
+INTERRUPT_VECTOR_STUB(175)
+INTERRUPT_VECTOR_STUB(176)
+INTERRUPT_VECTOR_STUB(177)
+INTERRUPT_VECTOR_STUB(178)
+INTERRUPT_VECTOR_STUB(179)
+INTERRUPT_VECTOR_STUB(180)
+INTERRUPT_VECTOR_STUB(181)
+INTERRUPT_VECTOR_STUB(182)
+INTERRUPT_VECTOR_STUB(183)
+INTERRUPT_VECTOR_STUB(184)
+INTERRUPT_VECTOR_STUB(185)
+INTERRUPT_VECTOR_STUB(186)
+INTERRUPT_VECTOR_STUB(187)
+INTERRUPT_VECTOR_STUB(188)
+INTERRUPT_VECTOR_STUB(189)
+INTERRUPT_VECTOR_STUB(190)
+INTERRUPT_VECTOR_STUB(191)
+INTERRUPT_VECTOR_STUB(192)
+INTERRUPT_VECTOR_STUB(193)
+INTERRUPT_VECTOR_STUB(194)
+INTERRUPT_VECTOR_STUB(195)
+INTERRUPT_VECTOR_STUB(196)
+INTERRUPT_VECTOR_STUB(197)
+INTERRUPT_VECTOR_STUB(198)
+INTERRUPT_VECTOR_STUB(199)
+INTERRUPT_VECTOR_STUB(200)
+INTERRUPT_VECTOR_STUB(201)
+INTERRUPT_VECTOR_STUB(202)
+INTERRUPT_VECTOR_STUB(203)
+INTERRUPT_VECTOR_STUB(204)
+INTERRUPT_VECTOR_STUB(205)
+INTERRUPT_VECTOR_STUB(206)
+INTERRUPT_VECTOR_STUB(207)
+INTERRUPT_VECTOR_STUB(208)
+INTERRUPT_VECTOR_STUB(209)
+INTERRUPT_VECTOR_STUB(210)
+INTERRUPT_VECTOR_STUB(211)
+INTERRUPT_VECTOR_STUB(212)
+INTERRUPT_VECTOR_STUB(213)
+INTERRUPT_VECTOR_STUB(214)
+INTERRUPT_VECTOR_STUB(215)
+INTERRUPT_VECTOR_STUB(216)
+INTERRUPT_VECTOR_STUB(217)
+INTERRUPT_VECTOR_STUB(218)
+INTERRUPT_VECTOR_STUB(219)
+INTERRUPT_VECTOR_STUB(220)
+INTERRUPT_VECTOR_STUB(221)
+INTERRUPT_VECTOR_STUB(222)
+INTERRUPT_VECTOR_STUB(223)
+INTERRUPT_VECTOR_STUB(224)
+INTERRUPT_VECTOR_STUB(225)
+INTERRUPT_VECTOR_STUB(226)
+INTERRUPT_VECTOR_STUB(227)
+INTERRUPT_VECTOR_STUB(228)
+INTERRUPT_VECTOR_STUB(229)
+INTERRUPT_VECTOR_STUB(230)
+INTERRUPT_VECTOR_STUB(231)
+INTERRUPT_VECTOR_STUB(232)
+INTERRUPT_VECTOR_STUB(233)
+INTERRUPT_VECTOR_STUB(234)
+INTERRUPT_VECTOR_STUB(235)
+INTERRUPT_VECTOR_STUB(236)
+INTERRUPT_VECTOR_STUB(237)
+INTERRUPT_VECTOR_STUB(238)
+INTERRUPT_VECTOR_STUB(239)
+
+// Indexed from INTERRUPT_VECTOR_DYNAMIC. The syscall vector has no stub
+typedef void (*interrupt_stub_t)(struct interrupt_frame* frame);
+
+static const interrupt_stub_t interrupt_vector_stubs[INTERRUPT_VECTOR_DYNAMIC_COUNT] = {
+	&vector_stub_56, &vector_stub_57, &vector_stub_58, &vector_stub_59, &vector_stub_60, &vector_stub_61, &vector_stub_62, &vector_stub_63,
+	&vector_stub_64, &vector_stub_65, &vector_stub_66, &vector_stub_67, &vector_stub_68, &vector_stub_69, &vector_stub_70, &vector_stub_71,
+	&vector_stub_72, &vector_stub_73, &vector_stub_74, &vector_stub_75, &vector_stub_76, &vector_stub_77, &vector_stub_78, &vector_stub_79,
+	&vector_stub_80, &vector_stub_81, &vector_stub_82, &vector_stub_83, &vector_stub_84, &vector_stub_85, &vector_stub_86, &vector_stub_87,
+	&vector_stub_88, &vector_stub_89, &vector_stub_90, &vector_stub_91, &vector_stub_92, &vector_stub_93, &vector_stub_94, &vector_stub_95,
+	&vector_stub_96, &vector_stub_97, &vector_stub_98, &vector_stub_99, &vector_stub_100, &vector_stub_101, &vector_stub_102, &vector_stub_103,
+	&vector_stub_104, &vector_stub_105, &vector_stub_106, &vector_stub_107, &vector_stub_108, &vector_stub_109, &vector_stub_110, &vector_stub_111,
+	&vector_stub_112, &vector_stub_113, &vector_stub_114, &vector_stub_115, &vector_stub_116, &vector_stub_117, &vector_stub_118, &vector_stub_119,
+	&vector_stub_120, &vector_stub_121, &vector_stub_122, &vector_stub_123, &vector_stub_124, &vector_stub_125, &vector_stub_126, &vector_stub_127,
+	0, &vector_stub_129, &vector_stub_130, &vector_stub_131, &vector_stub_132, &vector_stub_133, &vector_stub_134, &vector_stub_135,
+	&vector_stub_136, &vector_stub_137, &vector_stub_138, &vector_stub_139, &vector_stub_140, &vector_stub_141, &vector_stub_142, &vector_stub_143,
+	&vector_stub_144, &vector_stub_145, &vector_stub_146, &vector_stub_147, &vector_stub_148, &vector_stub_149, &vector_stub_150, &vector_stub_151,
+	&vector_stub_152, &vector_stub_153, &vector_stub_154, &vector_stub_155, &vector_stub_156, &vector_stub_157, &vector_stub_158, &vector_stub_159,
+	&vector_stub_160, &vector_stub_161, &vector_stub_162, &vector_stub_163, &vector_stub_164, &vector_stub_165, &vector_stub_166, &vector_stub_167,
+	&vector_stub_168, &vector_stub_169, &vector_stub_170, &vector_stub_171, &vector_stub_172, &vector_stub_173, &vector_stub_174, &vector_stub_175,
+	&vector_stub_176, &vector_stub_177, &vector_stub_178, &vector_stub_179, &vector_stub_180, &vector_stub_181, &vector_stub_182, &vector_stub_183,
+	&vector_stub_184, &vector_stub_185, &vector_stub_186, &vector_stub_187, &vector_stub_188, &vector_stub_189, &vector_stub_190, &vector_stub_191,
+	&vector_stub_192, &vector_stub_193, &vector_stub_194, &vector_stub_195, &vector_stub_196, &vector_stub_197, &vector_stub_198, &vector_stub_199,
+	&vector_stub_200, &vector_stub_201, &vector_stub_202, &vector_stub_203, &vector_stub_204, &vector_stub_205, &vector_stub_206, &vector_stub_207,
+	&vector_stub_208, &vector_stub_209, &vector_stub_210, &vector_stub_211, &vector_stub_212, &vector_stub_213, &vector_stub_214, &vector_stub_215,
+	&vector_stub_216, &vector_stub_217, &vector_stub_218, &vector_stub_219, &vector_stub_220, &vector_stub_221, &vector_stub_222, &vector_stub_223,
+	&vector_stub_224, &vector_stub_225, &vector_stub_226, &vector_stub_227, &vector_stub_228, &vector_stub_229, &vector_stub_230, &vector_stub_231,
+	&vector_stub_232, &vector_stub_233, &vector_stub_234, &vector_stub_235, &vector_stub_236, &vector_stub_237, &vector_stub_238, &vector_stub_239,
+};
 
 void interrupt_init(void) {
 	// Set up stubs for interrupts that can be claimed by drivers
@@ -75,7 +327,26 @@ void interrupt_init(void) {
 	interrupt_set_gate(38, (uint64_t)&stub_38, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
 	interrupt_set_gate(39, (uint64_t)&stub_39, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
 	interrupt_set_gate(40, (uint64_t)&stub_40, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
-	// TODO: Initialize the other 9 interrupt stubs
+	interrupt_set_gate(41, (uint64_t)&stub_41, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(42, (uint64_t)&stub_42, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(43, (uint64_t)&stub_43, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(44, (uint64_t)&stub_44, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(45, (uint64_t)&stub_45, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(46, (uint64_t)&stub_46, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(47, (uint64_t)&stub_47, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(48, (uint64_t)&stub_48, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(49, (uint64_t)&stub_49, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(50, (uint64_t)&stub_50, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(51, (uint64_t)&stub_51, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(52, (uint64_t)&stub_52, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(53, (uint64_t)&stub_53, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(54, (uint64_t)&stub_54, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	interrupt_set_gate(55, (uint64_t)&stub_55, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+
+	// And for the vectors MSI messages are given
+	for (uint32_t i = 0; i < INTERRUPT_VECTOR_DYNAMIC_COUNT; i++) {
+		interrupt_set_gate(INTERRUPT_VECTOR_DYNAMIC + i, (uint64_t)interrupt_vector_stubs[i], INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+	}
 }
 
 void interrupt_set_gate(uint8_t index, uint64_t address, uint8_t type_attributes) {
@@ -97,43 +368,170 @@ void interrupt_set_gate(uint8_t index, uint64_t address, uint8_t type_attributes
 void interrupt_register(uint8_t index, interrupt_handler_t handler) {
 
 	// Dont register interrupts on the exception handler slots
-	// Or overwrite the syscall handler.
+	// Or overwrite the syscall handler, the allocated vectors or the kernel's own vectors.
 	// And make sure the passed handler isnt null
-	if (index < 32 || index == 0x80 || handler == 0) {
+	if (index < 32 || index >= INTERRUPT_VECTOR_DYNAMIC || handler == 0) {
 		return;
 	}
 
 	// Set the requested entry in the interrupt manager 
-	interrupt_handlers[index] = handler;
+	interrupt_handler_t old_handler = __atomic_exchange_n(&interrupt_handlers[index], handler, __ATOMIC_SEQ_CST);
+
+	// Wait for cores still running a replaced handler, so its owner can free it
+	if (old_handler != 0) {
+		synchronize_rcu();
+	}
 }
+EXPORT_SYMBOL(interrupt_register);
 
 // Remove a hardware interrupt
 void interrupt_unregister(uint8_t index) {
 
 	// Dont remove interrupts from the exception handler slots
-	// Or overwrite the syscall handler
-	if (index < 32 || index == 0x80) {
+	// Or overwrite the syscall handler, the allocated vectors or the kernel's own vectors
+	if (index < 32 || index >= INTERRUPT_VECTOR_DYNAMIC) {
 		return;
 	}
 
 	// Void the handler list entry
-	interrupt_handlers[index] = 0;
+	rcu_assign_pointer(interrupt_handlers[index], 0);
+
+	// Once no core can still be running it, the handler's code and data can be freed
+	synchronize_rcu();
 }
+EXPORT_SYMBOL(interrupt_unregister);
 
 void interrupt_handler(uint64_t interrupt_num) {
 
+	uint64_t start = rdtsc();
+	trace(TRACE_INTERRUPT_ENTRY, interrupt_num, 0);
+	irq_enter();
+
+	// Interrupts are RCU read-side sections, so the handler stays valid until it returns
+	rcu_read_lock();
+	interrupt_handler_t handler = rcu_dereference(interrupt_handlers[interrupt_num]);
+
 	// If the handler is null dont do anything
-	if (interrupt_handlers[interrupt_num] == 0) {
+	if (handler == 0) {
+		rcu_read_unlock();
+		if (using_apic) {
+			apic_eoi();
+		}
+		trace(TRACE_INTERRUPT_EXIT, interrupt_num, 0);
+		interrupt_account(interrupt_num, start);
+		irq_exit();
 		return;
 	}
 
 	// Call the interrupt handler
-	interrupt_handlers[interrupt_num]();
+	handler();
+	rcu_read_unlock();
 
 	// If using the pic chips, send an eoi
 	if (!using_apic) {
 		interrupt_end_pic(interrupt_num);
 	}
+	else {
+		apic_eoi();
+		irq_balance_tick();
+	}
+
+	trace(TRACE_INTERRUPT_EXIT, interrupt_num, 0);
+	interrupt_account(interrupt_num, start);
+
+	// Softirqs raised by the handler run after it is counted
+	irq_exit();
+}
+
+// Message signalled interrupts always go to a local APIC, whichever chip IRQs use
+static void interrupt_vector_dispatch(uint64_t vector) {
+
+	uint64_t start = rdtsc();
+	trace(TRACE_INTERRUPT_ENTRY, vector, 0);
+	irq_enter();
+
+	rcu_read_lock();
+	interrupt_vector_t* entry = &(*this_cpu_ptr(interrupt_vectors))[vector - INTERRUPT_VECTOR_DYNAMIC];
+	interrupt_vector_handler_t handler = rcu_dereference(entry->handler);
+
+	if (handler != 0) {
+		handler(entry->arg);
+	}
+	rcu_read_unlock();
+
+	apic_eoi();
+
+	trace(TRACE_INTERRUPT_EXIT, vector, 0);
+	interrupt_account(vector, start);
+	irq_exit();
+}
+
+bool interrupt_alloc_vector(uint32_t cpu, interrupt_vector_handler_t handler, void* arg, uint8_t* vector) {
+
+	if (cpu >= cpu_count || handler == 0) {
+		return false;
+	}
+
+	spin_lock(&interrupt_vector_lock);
+
+	for (uint32_t i = 0; i < INTERRUPT_VECTOR_DYNAMIC_COUNT; i++) {
+		if (INTERRUPT_VECTOR_DYNAMIC + i == 0x80 || (interrupt_vectors_used[cpu][i / 64] & (1ull << (i % 64)))) {
+			continue;
+		}
+
+		interrupt_vectors_used[cpu][i / 64] |= 1ull << (i % 64);
+
+		// The argument is in place before the handler can be seen
+		interrupt_vector_t* entry = &per_cpu(interrupt_vectors, cpu)[i];
+		entry->arg = arg;
+		rcu_assign_pointer(entry->handler, handler);
+
+		spin_unlock(&interrupt_vector_lock);
+
+		*vector = INTERRUPT_VECTOR_DYNAMIC + i;
+		return true;
+	}
+
+	spin_unlock(&interrupt_vector_lock);
+	return false;
+}
+EXPORT_SYMBOL(interrupt_alloc_vector);
+
+void interrupt_free_vector(uint32_t cpu, uint8_t vector) {
+
+	if (cpu >= cpu_count || vector < INTERRUPT_VECTOR_DYNAMIC || vector >= INTERRUPT_VECTOR_DYNAMIC_END) {
+		return;
+	}
+
+	uint32_t i = vector - INTERRUPT_VECTOR_DYNAMIC;
+	rcu_assign_pointer(per_cpu(interrupt_vectors, cpu)[i].handler, 0);
+
+	// The vector is only handed out again once no core can still be running the old handler
+	synchronize_rcu();
+
+	spin_lock(&interrupt_vector_lock);
+	interrupt_vectors_used[cpu][i / 64] &= ~(1ull << (i % 64));
+	spin_unlock(&interrupt_vector_lock);
+}
+EXPORT_SYMBOL(interrupt_free_vector);
+
+// /proc/irq_affinity, for the IRQs with a handler
+static void interrupt_show_affinity(procfs_buffer_t* buffer) {
+
+	procfs_print(buffer, "IRQ  Vector  Core  Affinity\n");
+
+	for (uint32_t irq = 0; irq < INTERRUPT_IRQ_COUNT; irq++) {
+		if (interrupt_handlers[INTERRUPT_IRQ_BASE + irq] == 0) {
+			continue;
+		}
+
+		procfs_print_dec(buffer, irq, 3);
+		procfs_print_dec(buffer, INTERRUPT_IRQ_BASE + irq, 8);
+		procfs_print_dec(buffer, interrupt_targets[irq], 6);
+		procfs_print(buffer, "  ");
+		procfs_print_hex(buffer, interrupt_affinity[irq]);
+		procfs_print(buffer, "\n");
+	}
 }
 
 void interrupt_mask(uint8_t interrupt) {
@@ -158,7 +556,11 @@ void interrupt_mask(uint8_t interrupt) {
 		}
 
 	}
+	else {
+		ioapic_set_masked(interrupt, true);
+	}
 }
+EXPORT_SYMBOL(interrupt_mask);
 
 void interrupt_unmask(uint8_t interrupt) {
 	
@@ -182,7 +584,11 @@ void interrupt_unmask(uint8_t interrupt) {
 		}
 
 	}
+	else {
+		ioapic_set_masked(interrupt, false);
+	}
 }
+EXPORT_SYMBOL(interrupt_unmask);
 
 void interrupt_load_table(void) {
 
@@ -198,6 +604,12 @@ void interrupt_load_table(void) {
 
 /* Set which interrupt chip the OS will use (Should never be called after booting) */
 void interrupt_set_mode(bool use_apic) {
+
+	// Without an IOAPIC to route them, device interrupts can only come from the PIC
+	if (use_apic && !ioapic_init()) {
+		use_apic = false;
+	}
+
 	using_apic = use_apic;
 
 	// If using the old PIC chips
@@ -226,8 +638,88 @@ void interrupt_set_mode(bool use_apic) {
 		interrupt_unmask(offset1+2); 
 	}
 	else {
-		// TODO: Implement APIC interrupt handling
+		// Every IRQ starts out on the bootstrap core, masked until a driver unmasks it
+		for (uint32_t irq = 0; irq < INTERRUPT_IRQ_COUNT; irq++) {
+			interrupt_affinity[irq] = ~0ull;
+			interrupt_targets[irq] = 0;
+		}
+
+		// Routed by GSI, so an IRQ whose line an override gave to another, like IRQ2's to the
+		// timer, can not overwrite its entry
+		for (uint32_t gsi = 0; gsi < INTERRUPT_IRQ_COUNT; gsi++) {
+			int32_t irq = ioapic_gsi_to_irq(gsi);
+			if (irq >= 0 && irq < INTERRUPT_IRQ_COUNT) {
+				ioapic_route(irq, INTERRUPT_IRQ_BASE + irq, per_cpu(apic_id, 0));
+			}
+		}
+
+		procfs_register("irq_affinity", &interrupt_show_affinity);
+	}
+}
+
+// The first core in cpus that can take interrupts, or -1
+static int32_t interrupt_first_cpu(uint64_t cpus) {
+
+	cpus &= __atomic_load_n(&apic_online, __ATOMIC_ACQUIRE);
+	if (cpus == 0) {
+		return -1;
+	}
+
+	return __builtin_ctzll(cpus);
+}
+
+bool interrupt_set_affinity(uint8_t irq, uint64_t cpus) {
+
+	if (!using_apic || irq >= INTERRUPT_IRQ_COUNT) {
+		return false;
+	}
+
+	int32_t first = interrupt_first_cpu(cpus);
+	if (first < 0) {
+		return false;
+	}
+
+	spin_lock(&interrupt_route_lock);
+
+	interrupt_affinity[irq] = cpus;
+
+	// Only move the IRQ if its core is no longer allowed
+	if (!(cpus & (1ull << interrupt_targets[irq]))) {
+		interrupt_targets[irq] = first;
+		ioapic_set_destination(irq, per_cpu(apic_id, first));
+	}
+
+	spin_unlock(&interrupt_route_lock);
+
+	return true;
+}
+EXPORT_SYMBOL(interrupt_set_affinity);
+
+uint64_t interrupt_get_affinity(uint8_t irq) {
+	return irq < INTERRUPT_IRQ_COUNT ? interrupt_affinity[irq] : 0;
+}
+
+uint32_t interrupt_get_target(uint8_t irq) {
+	return irq < INTERRUPT_IRQ_COUNT ? interrupt_targets[irq] : 0;
+}
+
+bool interrupt_set_target(uint8_t irq, uint32_t cpu) {
+
+	if (!using_apic || irq >= INTERRUPT_IRQ_COUNT || cpu >= CPU_MAX) {
+		return false;
 	}
+
+	spin_lock(&interrupt_route_lock);
+
+	bool allowed = (interrupt_affinity[irq] & (1ull << cpu)) && (apic_online & (1ull << cpu));
+	if (allowed && interrupt_targets[irq] != cpu) {
+		interrupt_targets[irq] = cpu;
+		ioapic_set_destination(irq, per_cpu(apic_id, cpu));
+	}
+
+	spin_unlock(&interrupt_route_lock);
+
+	return allowed;
 }
 
 void interrupt_end_pic(uint8_t index) {
@@ -0,0 +1,265 @@
+/*
+ * evan-os/src/interrupt_stats.c
+ *
+ * Interrupt and interrupts-disabled statistics. Each core only updates
+ * its own counters, with interrupts disabled, so none of them need to be
+ * atomic. Readers may see a count and its cycles from slightly different
+ * moments, which is fine for statistics.
+ *
+ */
+
+#include <interrupt_stats.h>
+
+#include <asm.h>
+#include <interrupt.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <percpu.h>
+#include <procfs.h>
+#include <spinlock.h>
+#include <static_key.h>
+#include <string.h>
+#include <symbols.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+DEFINE_PER_CPU(interrupt_stats_t*, interrupt_stats);
+
+static_key_t irq_off_key;
+EXPORT_SYMBOL(irq_off_key);
+
+// Cores that have called irq_off_tracking_start
+volatile uint32_t irq_off_cpus_started;
+
+static uint32_t interrupt_histogram_bucket(uint64_t cycles) {
+
+	uint64_t scaled = cycles >> (INTERRUPT_HISTOGRAM_SHIFT + 1);
+	if (scaled == 0) {
+		return 0;
+	}
+
+	uint32_t bucket = 64 - __builtin_clzll(scaled);
+	return bucket < INTERRUPT_HISTOGRAM_BUCKETS ? bucket : INTERRUPT_HISTOGRAM_BUCKETS - 1;
+}
+
+void interrupt_account(uint8_t vector, uint64_t start) {
+
+	interrupt_stats_t* stats = this_cpu_read(interrupt_stats);
+	if (stats == 0) {
+		return;
+	}
+
+	uint64_t cycles = rdtsc() - start;
+
+	stats->count[vector]++;
+	stats->cycles[vector] += cycles;
+	stats->histogram[vector][interrupt_histogram_bucket(cycles)]++;
+}
+
+// Called by irq_save with interrupts just disabled
+void irq_off_begin(uint64_t site) {
+
+	interrupt_stats_t* stats = this_cpu_read(interrupt_stats);
+	if (stats == 0) {
+		return;
+	}
+
+	stats->irq_off_start = rdtsc();
+	stats->irq_off_site = site;
+}
+EXPORT_SYMBOL(irq_off_begin);
+
+// Called by irq_restore just before interrupts are enabled again
+void irq_off_end(void) {
+
+	interrupt_stats_t* stats = this_cpu_read(interrupt_stats);
+
+	// Tracking may have been enabled part way through the section
+	if (stats == 0 || stats->irq_off_start == 0) {
+		return;
+	}
+
+	uint64_t cycles = rdtsc() - stats->irq_off_start;
+	stats->irq_off_start = 0;
+
+	stats->irq_off_count++;
+	stats->irq_off_histogram[interrupt_histogram_bucket(cycles)]++;
+
+	if (cycles > stats->irq_off_max) {
+		stats->irq_off_max = cycles;
+		stats->irq_off_max_site = stats->irq_off_site;
+	}
+}
+EXPORT_SYMBOL(irq_off_end);
+
+interrupt_stats_t* interrupt_stats_cpu(uint32_t cpu) {
+	return per_cpu(interrupt_stats, cpu);
+}
+
+static const char* interrupt_vector_name(uint32_t vector) {
+
+	switch (vector) {
+		case INTERRUPT_VECTOR_TLB_SHOOTDOWN: return "TLB shootdowns";
+		case INTERRUPT_VECTOR_WAKEUP:        return "Idle wakeups";
+		case INTERRUPT_VECTOR_TIMER:         return "Local timer";
+		case INTERRUPT_VECTOR_PATCH:         return "Code patching";
+		case INTERRUPT_VECTOR_WRITEBACK:     return "Writeback timer";
+		default:                             return "IRQ";
+	}
+}
+
+static uint32_t interrupt_stats_cpus(void) {
+	return cpu_count < CPU_MAX ? cpu_count : CPU_MAX;
+}
+
+static void interrupt_stats_show_counts(procfs_buffer_t* buffer) {
+
+	uint32_t cpus = interrupt_stats_cpus();
+
+	procfs_print(buffer, "    ");
+	for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+		procfs_print(buffer, cpu < 10 ? "          CPU" : "         CPU");
+		procfs_print_dec(buffer, cpu, 0);
+	}
+	procfs_print(buffer, "   Avg cycles\n");
+
+	for (uint32_t vector = 0; vector < 256; vector++) {
+		uint64_t total = 0;
+		uint64_t cycles = 0;
+
+		for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+			interrupt_stats_t* stats = interrupt_stats_cpu(cpu);
+			if (stats != 0) {
+				total += stats->count[vector];
+				cycles += stats->cycles[vector];
+			}
+		}
+
+		if (total == 0) {
+			continue;
+		}
+
+		procfs_print_dec(buffer, vector, 3);
+		procfs_print(buffer, ":");
+
+		for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+			interrupt_stats_t* stats = interrupt_stats_cpu(cpu);
+			procfs_print_dec(buffer, stats != 0 ? stats->count[vector] : 0, 14);
+		}
+
+		procfs_print_dec(buffer, cycles / total, 13);
+		procfs_print(buffer, "  ");
+		procfs_print(buffer, interrupt_vector_name(vector));
+		procfs_print(buffer, "\n");
+	}
+}
+
+static void interrupt_stats_show_buckets(procfs_buffer_t* buffer) {
+
+	static const char* labels[INTERRUPT_HISTOGRAM_BUCKETS] = {
+		"<512", "<1K", "<2K", "<4K", "<8K", "<16K", "<32K", "<64K",
+		"<128K", "<256K", "<512K", "<1M", "<2M", "<4M", "<8M", ">=8M"
+	};
+
+	procfs_print(buffer, "      ");
+	for (uint32_t bucket = 0; bucket < INTERRUPT_HISTOGRAM_BUCKETS; bucket++) {
+		for (uint64_t length = strlen(labels[bucket]); length < 8; length++) {
+			procfs_print(buffer, " ");
+		}
+		procfs_print(buffer, labels[bucket]);
+	}
+	procfs_print(buffer, "\n");
+}
+
+static void interrupt_stats_show_latency(procfs_buffer_t* buffer) {
+
+	uint32_t cpus = interrupt_stats_cpus();
+
+	procfs_print(buffer, "Handler cycles, all cores\n");
+	interrupt_stats_show_buckets(buffer);
+
+	for (uint32_t vector = 0; vector < 256; vector++) {
+		uint64_t counts[INTERRUPT_HISTOGRAM_BUCKETS] = {0};
+		uint64_t total = 0;
+
+		for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+			interrupt_stats_t* stats = interrupt_stats_cpu(cpu);
+			if (stats == 0) {
+				continue;
+			}
+			for (uint32_t bucket = 0; bucket < INTERRUPT_HISTOGRAM_BUCKETS; bucket++) {
+				counts[bucket] += stats->histogram[vector][bucket];
+				total += stats->histogram[vector][bucket];
+			}
+		}
+
+		if (total == 0) {
+			continue;
+		}
+
+		procfs_print_dec(buffer, vector, 3);
+		procfs_print(buffer, ":  ");
+		for (uint32_t bucket = 0; bucket < INTERRUPT_HISTOGRAM_BUCKETS; bucket++) {
+			procfs_print_dec(buffer, counts[bucket], 8);
+		}
+		procfs_print(buffer, "\n");
+	}
+
+	procfs_print(buffer, "\nInterrupts disabled cycles\n");
+	interrupt_stats_show_buckets(buffer);
+
+	for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+		interrupt_stats_t* stats = interrupt_stats_cpu(cpu);
+		if (stats == 0 || stats->irq_off_count == 0) {
+			continue;
+		}
+
+		procfs_print(buffer, "cpu");
+		procfs_print_dec(buffer, cpu, 2);
+		procfs_print(buffer, ":");
+		for (uint32_t bucket = 0; bucket < INTERRUPT_HISTOGRAM_BUCKETS; bucket++) {
+			procfs_print_dec(buffer, stats->irq_off_histogram[bucket], 8);
+		}
+
+		procfs_print(buffer, "\n       longest ");
+		procfs_print_dec(buffer, stats->irq_off_max, 0);
+		procfs_print(buffer, " cycles, from ");
+
+		uint64_t offset;
+		const char* name = symbol_lookup(stats->irq_off_max_site, &offset);
+		if (name != 0) {
+			procfs_print(buffer, name);
+			procfs_print(buffer, "+");
+			procfs_print_hex(buffer, offset);
+		}
+		else {
+			procfs_print_hex(buffer, stats->irq_off_max_site);
+		}
+		procfs_print(buffer, "\n");
+	}
+}
+
+void interrupt_stats_init(void) {
+
+	this_cpu_write(interrupt_stats, kzalloc(sizeof(interrupt_stats_t)));
+
+	if (cpu_id() == 0) {
+		procfs_register("interrupts", &interrupt_stats_show_counts);
+		procfs_register("interrupt_latency", &interrupt_stats_show_latency);
+	}
+}
+
+void irq_off_tracking_start(void) {
+
+	__atomic_add_fetch(&irq_off_cpus_started, 1, __ATOMIC_SEQ_CST);
+
+	// Every core has to be able to answer the patching IPI first
+	if (cpu_id() == 0) {
+		while (__atomic_load_n(&irq_off_cpus_started, __ATOMIC_ACQUIRE) < cpu_count) {
+			pause();
+		}
+
+		static_key_enable(&irq_off_key);
+	}
+}
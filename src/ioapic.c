@@ -0,0 +1,244 @@
+/*
+ * evan-os/src/ioapic.c
+ *
+ * IOAPIC driver. Each IOAPIC has two registers, a select and a window,
+ * so every access to its redirection table is two writes that another
+ * core must not come between.
+ *
+ */
+
+#include <ioapic.h>
+
+#include <acpi.h>
+#include <paging.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IOAPIC_REG_SELECT 0x00 // Offsets in 32 bit words
+#define IOAPIC_REG_WINDOW 0x04
+
+#define IOAPIC_VERSION     0x01
+#define IOAPIC_REDIRECTION 0x10 // Two registers for each line
+
+// Redirection entry low word
+#define IOAPIC_ACTIVE_LOW (1 << 13)
+#define IOAPIC_LEVEL      (1 << 15)
+#define IOAPIC_MASKED     (1 << 16)
+
+// MADT entry types
+#define MADT_IOAPIC   1
+#define MADT_OVERRIDE 2
+
+// Interrupt source override flags
+#define MADT_POLARITY_MASK 0x3
+#define MADT_POLARITY_LOW  0x3
+#define MADT_TRIGGER_MASK  0xc
+#define MADT_TRIGGER_LEVEL 0xc
+
+#define ISA_IRQS 16
+
+typedef struct madt_entry_t {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed)) madt_entry_t;
+
+typedef struct madt_ioapic_t {
+	uint8_t  type;
+	uint8_t  length;
+	uint8_t  id;
+	uint8_t  reserved;
+	uint32_t address;
+	uint32_t gsi_base;
+} __attribute__((packed)) madt_ioapic_t;
+
+typedef struct madt_override_t {
+	uint8_t  type;
+	uint8_t  length;
+	uint8_t  bus;
+	uint8_t  source; // ISA IRQ
+	uint32_t gsi;
+	uint16_t flags;
+} __attribute__((packed)) madt_override_t;
+
+typedef struct ioapic_t {
+	volatile uint32_t* registers;
+	uint32_t           gsi_base;
+	uint32_t           lines;
+	spinlock_t         lock;
+} ioapic_t;
+
+ioapic_t ioapics[IOAPIC_MAX];
+uint32_t ioapic_count;
+
+// Where each ISA IRQ is wired, and how
+uint32_t ioapic_isa_gsi[ISA_IRQS];
+uint32_t ioapic_isa_flags[ISA_IRQS];
+
+static uint32_t ioapic_read(ioapic_t* ioapic, uint32_t reg) {
+	ioapic->registers[IOAPIC_REG_SELECT] = reg;
+	return ioapic->registers[IOAPIC_REG_WINDOW];
+}
+
+static void ioapic_write(ioapic_t* ioapic, uint32_t reg, uint32_t value) {
+	ioapic->registers[IOAPIC_REG_SELECT] = reg;
+	ioapic->registers[IOAPIC_REG_WINDOW] = value;
+}
+
+// The IOAPIC with a GSI's line, or 0
+static ioapic_t* ioapic_of(uint32_t gsi) {
+
+	for (uint32_t i = 0; i < ioapic_count; i++) {
+		if (gsi >= ioapics[i].gsi_base && gsi < ioapics[i].gsi_base + ioapics[i].lines) {
+			return &ioapics[i];
+		}
+	}
+
+	return 0;
+}
+
+bool ioapic_init(void) {
+
+	// Without overrides, ISA IRQs are edge triggered, active high, and wired to the same GSI
+	for (uint32_t irq = 0; irq < ISA_IRQS; irq++) {
+		ioapic_isa_gsi[irq] = irq;
+		ioapic_isa_flags[irq] = 0;
+	}
+
+	acpi_header_t* madt = acpi_find_table(ACPI_SIGNATURE('A', 'P', 'I', 'C'), 0);
+	if (madt == 0) {
+		return false;
+	}
+
+	// The entries follow the local APIC address and flags
+	uint8_t* entry = (uint8_t*)madt + sizeof(acpi_header_t) + 8;
+	uint8_t* end = (uint8_t*)madt + madt->length;
+
+	while (entry + sizeof(madt_entry_t) <= end && ((madt_entry_t*)entry)->length != 0) {
+		madt_entry_t* header = (madt_entry_t*)entry;
+
+		if (header->type == MADT_IOAPIC && ioapic_count < IOAPIC_MAX) {
+			madt_ioapic_t* madt_ioapic = (madt_ioapic_t*)entry;
+			ioapic_t* ioapic = &ioapics[ioapic_count];
+
+			ioapic->registers = paging_map_mmio(madt_ioapic->address, PAGE_SIZE);
+			if (ioapic->registers != 0) {
+				ioapic->gsi_base = madt_ioapic->gsi_base;
+				ioapic->lines = ((ioapic_read(ioapic, IOAPIC_VERSION) >> 16) & 0xff) + 1;
+				spin_lock_init(&ioapic->lock);
+				ioapic_count++;
+			}
+		}
+		else if (header->type == MADT_OVERRIDE) {
+			madt_override_t* override = (madt_override_t*)entry;
+			if (override->bus == 0 && override->source < ISA_IRQS) {
+				ioapic_isa_gsi[override->source] = override->gsi;
+				ioapic_isa_flags[override->source] = override->flags;
+			}
+		}
+
+		entry += header->length;
+	}
+
+	// Nothing may arrive until a driver asks for it
+	for (uint32_t i = 0; i < ioapic_count; i++) {
+		for (uint32_t line = 0; line < ioapics[i].lines; line++) {
+			ioapic_write(&ioapics[i], IOAPIC_REDIRECTION + line * 2, IOAPIC_MASKED);
+			ioapic_write(&ioapics[i], IOAPIC_REDIRECTION + line * 2 + 1, 0);
+		}
+	}
+
+	return ioapic_count != 0;
+}
+
+uint32_t ioapic_irq_to_gsi(uint32_t irq) {
+	return irq < ISA_IRQS ? ioapic_isa_gsi[irq] : irq;
+}
+
+int32_t ioapic_gsi_to_irq(uint32_t gsi) {
+
+	// An overridden ISA IRQ takes the GSI from the IRQ it would otherwise be
+	for (uint32_t irq = 0; irq < ISA_IRQS; irq++) {
+		if (ioapic_isa_gsi[irq] == gsi && irq != gsi) {
+			return irq;
+		}
+	}
+
+	if (gsi < ISA_IRQS && ioapic_isa_gsi[gsi] != gsi) {
+		return -1;
+	}
+
+	return gsi;
+}
+
+bool ioapic_route(uint32_t irq, uint8_t vector, uint32_t apic_id) {
+
+	uint32_t gsi = ioapic_irq_to_gsi(irq);
+	ioapic_t* ioapic = ioapic_of(gsi);
+	if (ioapic == 0) {
+		return false;
+	}
+
+	uint32_t low = vector | IOAPIC_MASKED;
+
+	if (irq < ISA_IRQS) {
+		uint32_t flags = ioapic_isa_flags[irq];
+		if ((flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW) {
+			low |= IOAPIC_ACTIVE_LOW;
+		}
+		if ((flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL) {
+			low |= IOAPIC_LEVEL;
+		}
+	}
+	else {
+		// PCI interrupts are shared, so level triggered and active low
+		low |= IOAPIC_LEVEL | IOAPIC_ACTIVE_LOW;
+	}
+
+	uint32_t line = gsi - ioapic->gsi_base;
+
+	uint64_t flags = spin_lock_irqsave(&ioapic->lock);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION + line * 2 + 1, apic_id << 24);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION + line * 2, low);
+	spin_unlock_irqrestore(&ioapic->lock, flags);
+
+	return true;
+}
+
+void ioapic_set_masked(uint32_t irq, bool masked) {
+
+	uint32_t gsi = ioapic_irq_to_gsi(irq);
+	ioapic_t* ioapic = ioapic_of(gsi);
+	if (ioapic == 0) {
+		return;
+	}
+
+	uint32_t reg = IOAPIC_REDIRECTION + (gsi - ioapic->gsi_base) * 2;
+
+	uint64_t flags = spin_lock_irqsave(&ioapic->lock);
+
+	uint32_t low = ioapic_read(ioapic, reg);
+	if (masked) {
+		low |= IOAPIC_MASKED;
+	}
+	else {
+		low &= ~IOAPIC_MASKED;
+	}
+	ioapic_write(ioapic, reg, low);
+
+	spin_unlock_irqrestore(&ioapic->lock, flags);
+}
+
+void ioapic_set_destination(uint32_t irq, uint32_t apic_id) {
+
+	uint32_t gsi = ioapic_irq_to_gsi(irq);
+	ioapic_t* ioapic = ioapic_of(gsi);
+	if (ioapic == 0) {
+		return;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&ioapic->lock);
+	ioapic_write(ioapic, IOAPIC_REDIRECTION + (gsi - ioapic->gsi_base) * 2 + 1, apic_id << 24);
+	spin_unlock_irqrestore(&ioapic->lock, flags);
+}
@@ -0,0 +1,159 @@
+/*
+ * evan-os/src/irq_balance.c
+ *
+ * IRQ balancing. Each pass takes the handler cycles of every busy IRQ
+ * since the last pass, then places the IRQs from the heaviest down on
+ * the least loaded allowed core. An IRQ only leaves its current core if
+ * the other is lighter by at least half of the IRQ's own load, so a
+ * balanced layout is left alone between passes.
+ *
+ */
+
+#include <irq_balance.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <idle.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <percpu.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool irq_balance_enabled;
+
+volatile uint64_t irq_balance_moves;
+
+// Time stamp counter value after which the next pass runs
+volatile uint64_t irq_balance_next;
+// Set while a pass is queued, so its work is never queued twice
+volatile bool irq_balance_queued;
+
+idle_work_t irq_balance_work;
+
+spinlock_t irq_balance_lock;
+
+// Totals at the last pass, summed over every core
+uint64_t irq_balance_last_count[INTERRUPT_IRQ_COUNT];
+uint64_t irq_balance_last_cycles[INTERRUPT_IRQ_COUNT];
+
+// Used by a pass, under irq_balance_lock. Too big for the stacks of the other cores
+uint64_t irq_balance_cpu_load[CPU_MAX];
+uint64_t irq_balance_irq_load[INTERRUPT_IRQ_COUNT];
+bool irq_balance_busy[INTERRUPT_IRQ_COUNT];
+
+static void irq_balance_run(__attribute__((unused)) void* arg) {
+	irq_balance();
+	__atomic_store_n(&irq_balance_queued, false, __ATOMIC_RELEASE);
+}
+
+void irq_balance_tick(void) {
+
+	if (!irq_balance_enabled) {
+		return;
+	}
+
+	uint64_t now = rdtsc();
+	uint64_t next = irq_balance_next;
+	if (now < next) {
+		return;
+	}
+
+	// Only the core that moves the deadline forward starts the pass
+	if (!__atomic_compare_exchange_n(&irq_balance_next, &next, now + tsc_frequency / 1000 * IRQ_BALANCE_INTERVAL_MS, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	if (__atomic_exchange_n(&irq_balance_queued, true, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	irq_balance_work.func = &irq_balance_run;
+	irq_balance_work.arg = 0;
+	idle_queue_work(cpu_id(), &irq_balance_work);
+}
+
+uint32_t irq_balance(void) {
+
+	uint32_t cpus = cpu_count < CPU_MAX ? cpu_count : CPU_MAX;
+
+	uint64_t* load = irq_balance_cpu_load;
+	uint64_t* irq_load = irq_balance_irq_load;
+	bool* busy = irq_balance_busy;
+	uint32_t moved = 0;
+
+	spin_lock(&irq_balance_lock);
+
+	for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+		load[cpu] = 0;
+	}
+
+	for (uint32_t irq = 0; irq < INTERRUPT_IRQ_COUNT; irq++) {
+		uint32_t vector = INTERRUPT_IRQ_BASE + irq;
+		uint64_t count = 0;
+		uint64_t cycles = 0;
+
+		for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+			interrupt_stats_t* stats = interrupt_stats_cpu(cpu);
+			if (stats != 0) {
+				count += stats->count[vector];
+				cycles += stats->cycles[vector];
+			}
+		}
+
+		uint64_t interval_count = count - irq_balance_last_count[irq];
+		irq_load[irq] = cycles - irq_balance_last_cycles[irq];
+		irq_balance_last_count[irq] = count;
+		irq_balance_last_cycles[irq] = cycles;
+
+		// IRQs that stay put still load their core
+		uint64_t affinity = interrupt_get_affinity(irq);
+		busy[irq] = interval_count >= IRQ_BALANCE_MIN_INTERRUPTS && (affinity & (affinity - 1)) != 0;
+		if (!busy[irq]) {
+			load[interrupt_get_target(irq)] += irq_load[irq];
+		}
+	}
+
+	// Place the busy IRQs, heaviest first
+	while (true) {
+		int32_t heaviest = -1;
+		for (uint32_t irq = 0; irq < INTERRUPT_IRQ_COUNT; irq++) {
+			if (busy[irq] && (heaviest < 0 || irq_load[irq] > irq_load[heaviest])) {
+				heaviest = irq;
+			}
+		}
+
+		if (heaviest < 0) {
+			break;
+		}
+		busy[heaviest] = false;
+
+		uint64_t allowed = interrupt_get_affinity(heaviest) & apic_online;
+		uint32_t current = interrupt_get_target(heaviest);
+		uint32_t best = current;
+
+		for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+			if ((allowed & (1ull << cpu)) && load[cpu] < load[best]) {
+				best = cpu;
+			}
+		}
+
+		// Only worth moving if the new core is lighter by at least half the IRQ's load
+		if (best != current && load[best] + irq_load[heaviest] / 2 < load[current] && interrupt_set_target(heaviest, best)) {
+			moved++;
+		}
+		else {
+			best = current;
+		}
+
+		load[best] += irq_load[heaviest];
+	}
+
+	spin_unlock(&irq_balance_lock);
+
+	__atomic_add_fetch(&irq_balance_moves, moved, __ATOMIC_RELAXED);
+
+	return moved;
+}
@@ -13,9 +13,36 @@
 #include <tty.h>
 #include <serial.h> // Serial port output
 #include <syscall.h>
+#include <rcu.h>
+#include <percpu.h>
+#include <cpu.h>
+#include <string.h>
+#include <fpu.h>
+#include <acpi.h>
+#include <numa.h>
+#include <pmm.h>
+#include <paging.h>
+#include <apic.h>
+#include <tlb.h>
+#include <vmm.h>
+#include <idle.h>
+#include <profile.h>
+#include <static_key.h>
+#include <interrupt_stats.h>
+#include <irq_balance.h>
+#include <procfs.h>
+#include <devfs.h>
+#include <pci.h>
+#include <block.h>
+#include <buffer_cache.h>
+#include <fat.h>
+#include <ext2.h>
+#include <trace.h>
+#include <benchmark.h>
 
 // Std headers
 #include <stdint.h>
+#include <stdbool.h>
 
 // Virtual addresses from linker script
 extern BOOTBOOT bootboot;           // See ../dist/bootboot.h
@@ -23,17 +50,6 @@ extern unsigned char *environment;  // Configuration writen in key=value pairs
 extern volatile uint8_t fb;         // Linear framebuffer mapped here
 extern volatile unsigned char _binary_font_psf_start; // Font file
 
-typedef struct tar_header_t {
-    char filename[100];
-    char mode[8];
-    char uid[8];
-    char gid[8];
-    char size[12]; // In octal
-    char mtime[12];
-    char chksum[8];
-    char typeflag[1];
-} __attribute__((packed)) tar_header_t;
-
 char hex_digits[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
 // Entry point
@@ -58,12 +74,39 @@ void kernel(void) {
     // Make a pointer the the screen's framebuffer
     volatile uint32_t* framebuffer = (uint32_t*)&fb;
 
-    // Get the pointer to the ramdisk
-    volatile void * initrd = (void *)bootboot.initrd_ptr;
-
     // Disable interrupts
     cli();
 
+    // Set up this core's per-CPU variables
+    percpu_init();
+
+    // Read the processor's features
+    cpu_features_init();
+
+    // Choose memcpy and memset variants for the processor
+    string_init();
+
+    // Enable FPU, SSE and AVX state for tasks
+    fpu_init();
+
+    // Find the ACPI tables and the NUMA nodes they describe, track free physical memory,
+    // then map all of it into the kernel half
+    if (cpu_id() == 0) {
+        acpi_init();
+        numa_init();
+        pmm_init();
+    }
+    paging_init();
+    numa_cpu_init();
+    if (cpu_id() == 0) {
+        vmm_init();
+        procfs_init();
+        devfs_init();
+    }
+
+    // Take part in RCU grace periods
+    rcu_cpu_online();
+
     // Initialize the tty to take screen dimensions into account
     tty_init();
 
@@ -105,6 +148,7 @@ void kernel(void) {
 
     // Fill the entries for driver assignable interrupts
     interrupt_init();
+    interrupt_stats_init();
 
     // Add exception handlers
     tty_print_string("Adding exception handlers\n");
@@ -119,17 +163,24 @@ void kernel(void) {
     interrupt_set_gate(0x0, (uint64_t)&div_0_fault, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
     
     interrupt_set_gate(0x6, (uint64_t)&invalid_opcode_fault, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+    // Set up the device not available handler, which loads FPU state lazily
+    interrupt_set_gate(0x7, (uint64_t)&fpu_trap, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+
+    // Enable the local APIC, so cores can interrupt each other to shoot down TLB entries
+    apic_init();
+    tlb_init();
+    idle_init();
+    static_key_init();
+
+    // Route device interrupts through the IOAPICs instead of the PIC chips
+    if (cpu_id() == 0) {
+        interrupt_set_mode(true);
+#ifdef IRQBALANCE
+        irq_balance_enabled = true;
+#endif
+    }
 
-    // Load drivers from disk as needed
-    tty_print_string("Loading drivers\n");
-
-    tar_header_t* file = (tar_header_t*)initrd;
-
-    tty_print_string("Found file [");
-    tty_print_string((char*)&file->filename[0]);
-    tty_print_string("]\nFile Size: ");
-    print_hex(octal_string_to_int(file->size, 11));
-    tty_print_string("\nSetting up syscalls\n");
+    tty_print_string("Setting up syscalls\n");
 
     // Set up system calls
     syscall_init();
@@ -137,9 +188,65 @@ void kernel(void) {
     MMapEnt* mmap_ent = &bootboot.mmap; 
     mmap_ent++;
 
-    // Loop to prevent the kernel from returning to nothing and crashing
-    // The OS should run tasks instead of this
-    while(1);
+    // Let IPIs in, every core has to answer TLB shootdowns from now on
+    sti();
+    tlb_cpu_online();
+
+    // Link the driver modules in the initrd. Bus drivers wait for their devices to be found
+    if (cpu_id() == 0) {
+        block_init();
+        buffer_cache_init();
+
+        tty_print_string("Loading drivers\n");
+        module_init();
+        uint32_t loaded = module_load_boot();
+        print_dec(loaded);
+        tty_print_string(" driver(s) loaded\n");
+
+        // Find the devices on the PCI buses, then load and probe their drivers across the cores
+        pci_init();
+        pci_probe_drivers();
+
+        // The boot image and the root filesystem, from whichever disks they are found on
+        fat_mount_boot();
+        ext2_mount_root();
+    }
+
+#ifdef IRQOFF
+    // Time every section run with interrupts disabled, shown in /proc/interrupt_latency
+    irq_off_tracking_start();
+#endif
+
+#ifdef PROFILE
+    // Sample this core until the bootstrap core prints the profile
+    profile_start(PROFILE);
+#endif
+
+#ifdef TRACE
+    // Record this core's tracepoints until the bootstrap core dumps them
+    trace_start();
+#endif
+
+#ifdef BENCHMARK
+    benchmark_run();
+#endif
+
+#ifdef PROFILE
+    if (cpu_id() == 0) {
+        profile_stop();
+        profile_dump();
+    }
+#endif
+
+#ifdef TRACE
+    if (cpu_id() == 0) {
+        trace_stop();
+        trace_dump();
+    }
+#endif
+
+    // Sleep until there is work for this core. The OS should run tasks from here
+    idle_run();
 }
 
 
@@ -203,7 +310,17 @@ void page_fault(struct interrupt_frame *frame, uint64_t error_code) {
     uint64_t faulting_address;
 
     // Get the virtual address of the fault causing instruction
-    asm volatile ("mov %%cr2, %%rax; mov %%rax, %0;" : "=m" (faulting_address) :: "rax");
+    faulting_address = read_cr2();
+
+    trace(TRACE_PAGE_FAULT_ENTRY, faulting_address, error_code);
+
+    // Most faults just mean a page has not been filled in yet, or is copy-on-write
+    bool handled = vmm_handle_fault(faulting_address, error_code);
+    trace(TRACE_PAGE_FAULT_EXIT, faulting_address, handled);
+
+    if (handled) {
+        return;
+    }
 
     tty_print_string("PAGE FAULT. Details:\n");
 
@@ -243,7 +360,15 @@ void page_fault(struct interrupt_frame *frame, uint64_t error_code) {
     print_hex(faulting_address);
     tty_print_string("\nCode Segment: ");
     print_hex(frame->cs);
-    tty_print_char('\n');
+    tty_print_string("\nAddress: ");
+    print_hex(frame->ip);
+    tty_print_string("\nHALTING KERNEL.\n");
+
+    // Returning would only run the faulting instruction again
+    while (1) {
+        cli();
+        hlt();
+    }
 }
 
 __attribute__ ((interrupt))
@@ -299,6 +424,23 @@ void print_hex(uint64_t value) {
         tty_print_char(hex_digits[shifted_value]);
     }
 }
+EXPORT_SYMBOL(print_hex);
+
+void print_dec(uint64_t value) {
+
+    // 20 digits fit the largest 64 bit value
+    char digits[21];
+    int i = 20;
+    digits[i] = '\0';
+
+    do {
+        digits[--i] = hex_digits[value % 10];
+        value /= 10;
+    } while (value != 0);
+
+    tty_print_string(&digits[i]);
+}
+EXPORT_SYMBOL(print_dec);
 
 // Convert an octal string to a sinlge integer that the computer can use
 uint64_t octal_string_to_int(char* octal_string, uint64_t length) {
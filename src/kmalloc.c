@@ -0,0 +1,164 @@
+/*
+ * evan-os/src/kmalloc.c
+ *
+ * Kernel heap. Every heap page starts with a header saying what it holds,
+ * so kfree only needs the pointer. Pages of small objects are never given
+ * back, their free objects stay on the size class's list for reuse.
+ *
+ */
+
+#include <kmalloc.h>
+
+#include <module.h>
+#include <paging.h>
+#include <pmm.h>
+#include <spinlock.h>
+#include <string.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Room for the page header, keeping the objects after it aligned
+#define KMALLOC_HEADER 64
+
+#define KMALLOC_MIN_SHIFT 5  // 32 bytes
+#define KMALLOC_MAX_SHIFT 11 // 2 KiB
+#define KMALLOC_CLASSES   (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+typedef struct kmalloc_page_t {
+	uint32_t size;  // Object size, or 0 for a large allocation
+	uint32_t pages; // Length of a large allocation
+} kmalloc_page_t;
+
+typedef struct kmalloc_object_t {
+	struct kmalloc_object_t* next;
+} kmalloc_object_t;
+
+typedef struct kmalloc_class_t {
+	kmalloc_object_t* free;
+	spinlock_t        lock;
+} kmalloc_class_t;
+
+kmalloc_class_t kmalloc_classes[KMALLOC_CLASSES];
+
+// Fill a size class's free list from a new page
+static void kmalloc_grow(kmalloc_class_t* class, uint32_t size) {
+
+	uint64_t frame = pmm_alloc_page();
+	if (frame == 0) {
+		return;
+	}
+
+	kmalloc_page_t* page = phys_to_virt(frame);
+	page->size = size;
+	page->pages = 1;
+
+	for (uint64_t offset = KMALLOC_HEADER; offset + size <= PAGE_SIZE; offset += size) {
+		kmalloc_object_t* object = (kmalloc_object_t*)((uint8_t*)page + offset);
+		object->next = class->free;
+		class->free = object;
+	}
+}
+
+// Allocations too big for a size class get whole pages
+static void* kmalloc_large(size_t size, bool zeroed) {
+
+	uint64_t pages = (size + KMALLOC_HEADER + PAGE_SIZE - 1) / PAGE_SIZE;
+	uint64_t frames;
+
+	// Single pages can come already cleared from the zero pool
+	if (zeroed && pages == 1) {
+		frames = pmm_alloc_zeroed();
+		zeroed = false;
+	}
+	else {
+		frames = pmm_alloc_pages(pages);
+	}
+
+	if (frames == 0) {
+		return 0;
+	}
+
+	kmalloc_page_t* page = phys_to_virt(frames);
+	page->size = 0;
+	page->pages = pages;
+
+	if (zeroed) {
+		memset((uint8_t*)page + KMALLOC_HEADER, 0, size);
+	}
+
+	return (uint8_t*)page + KMALLOC_HEADER;
+}
+
+void* kmalloc(size_t size) {
+
+	if (size == 0) {
+		return 0;
+	}
+
+	if (size > (1 << KMALLOC_MAX_SHIFT)) {
+		return kmalloc_large(size, false);
+	}
+
+	// The smallest class that fits
+	uint32_t shift = KMALLOC_MIN_SHIFT;
+	while ((1ull << shift) < size) {
+		shift++;
+	}
+
+	kmalloc_class_t* class = &kmalloc_classes[shift - KMALLOC_MIN_SHIFT];
+	uint64_t flags = spin_lock_irqsave(&class->lock);
+
+	if (class->free == 0) {
+		kmalloc_grow(class, 1 << shift);
+	}
+
+	kmalloc_object_t* object = class->free;
+	if (object != 0) {
+		class->free = object->next;
+	}
+
+	spin_unlock_irqrestore(&class->lock, flags);
+
+	return object;
+}
+EXPORT_SYMBOL(kmalloc);
+
+void* kzalloc(size_t size) {
+
+	if (size > (1 << KMALLOC_MAX_SHIFT)) {
+		return kmalloc_large(size, true);
+	}
+
+	void* pointer = kmalloc(size);
+	if (pointer != 0) {
+		memset(pointer, 0, size);
+	}
+
+	return pointer;
+}
+EXPORT_SYMBOL(kzalloc);
+
+void kfree(void* pointer) {
+
+	if (pointer == 0) {
+		return;
+	}
+
+	kmalloc_page_t* page = (kmalloc_page_t*)((uint64_t)pointer & ~(uint64_t)(PAGE_SIZE - 1));
+
+	if (page->size == 0) {
+		pmm_free_pages(virt_to_phys(page), page->pages);
+		return;
+	}
+
+	kmalloc_class_t* class = &kmalloc_classes[__builtin_ctz(page->size) - KMALLOC_MIN_SHIFT];
+	kmalloc_object_t* object = pointer;
+
+	uint64_t flags = spin_lock_irqsave(&class->lock);
+	object->next = class->free;
+	class->free = object;
+	spin_unlock_irqrestore(&class->lock, flags);
+}
+EXPORT_SYMBOL(kfree);
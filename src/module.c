@@ -1,16 +1,630 @@
 /*
- * evan-os/src/module.h
- * 
- * 
- * 
+ * evan-os/src/module.c
+ *
+ * Driver module loader. Modules are found by walking the initrd, a tar
+ * archive, for files ending in .ko. Loading one lays out its allocated
+ * sections in fresh pages of the module area, resolves its undefined
+ * symbols through the exported symbol hash table, and applies its RELA
+ * relocations. GOT relocations get a slot each, after the sections.
+ *
+ * Modules are never unloaded, so the module area is handed out in order.
+ *
  */
 
 #include <module.h>
 
+#include <bootboot.h>
+#include <elf.h>
+#include <kernel.h>
+#include <kmalloc.h>
+#include <paging.h>
+#include <pmm.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tlb.h>
+#include <tty.h>
+
+#include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#define TAR_BLOCK 512
+
+// Frames held at once while unmapping, freed after each TLB flush
+#define MODULE_UNMAP_FRAMES 32
+
+typedef struct tar_header_t {
+	char filename[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12]; // In octal
+	char mtime[12];
+	char chksum[8];
+	char typeflag[1];
+} __attribute__((packed)) tar_header_t;
+
+typedef struct module_symbol_t module_symbol_t;
+
+struct module_symbol_t {
+	const char*      name;
+	uint64_t         address;
+	module_symbol_t* next;
+};
+
+// The kernel's exports, see linker.ld
+extern const kernel_symbol_t __ksymtab_start[];
+extern const kernel_symbol_t __ksymtab_end[];
+
+extern BOOTBOOT bootboot;
+
+module_t* module_list;
+
+module_symbol_t* module_symbols[MODULE_SYMBOL_BUCKETS];
+
+// Protects the symbol table, the module list and the module area
+spinlock_t module_lock;
+
+uint64_t module_next = MODULE_BASE;
+
+// FNV-1a
+static uint32_t module_hash(const char* name) {
+
+	uint32_t hash = 2166136261u;
+	while (*name != '\0') {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+
+	return hash % MODULE_SYMBOL_BUCKETS;
+}
+
+static module_symbol_t* module_symbol_find(const char* name) {
+
+	for (module_symbol_t* symbol = module_symbols[module_hash(name)]; symbol != 0; symbol = symbol->next) {
+		if (strcmp(symbol->name, name) == 0) {
+			return symbol;
+		}
+	}
+
+	return 0;
+}
+
+// Add exports to the table. Called with module_lock held
+static bool module_export(const kernel_symbol_t* start, const kernel_symbol_t* end) {
+
+	if (end <= start) {
+		return true;
+	}
+
+	module_symbol_t* symbols = kmalloc((end - start) * sizeof(module_symbol_t));
+	if (symbols == 0) {
+		return false;
+	}
+
+	for (const kernel_symbol_t* export = start; export < end; export++, symbols++) {
+		uint32_t bucket = module_hash(export->name);
+		symbols->name = export->name;
+		symbols->address = export->address;
+		symbols->next = module_symbols[bucket];
+		module_symbols[bucket] = symbols;
+	}
+
+	return true;
+}
+
+uint64_t module_symbol_lookup(const char* name) {
+
+	spin_lock(&module_lock);
+	module_symbol_t* symbol = module_symbol_find(name);
+	uint64_t address = symbol != 0 ? symbol->address : 0;
+	spin_unlock(&module_lock);
+
+	return address;
+}
+
+static elf_section_t* module_sections(const uint8_t* file) {
+	return (elf_section_t*)(file + ((elf_header_t*)file)->section_headers);
+}
+
+static const char* module_section_name(const uint8_t* file, elf_section_t* section) {
+	elf_header_t* header = (elf_header_t*)file;
+	return (const char*)file + module_sections(file)[header->section_names].offset + section->name;
+}
+
+// Whether a file is a relocatable x86-64 ELF object whose section headers are inside it
+static bool module_check(const uint8_t* file, uint64_t size) {
+
+	elf_header_t* header = (elf_header_t*)file;
+
+	if (size < sizeof(elf_header_t) || header->magic != ELF_MAGIC || header->class != ELF_CLASS_64 ||
+		header->data != ELF_DATA_LSB || header->type != ELF_TYPE_REL || header->machine != ELF_MACHINE_X86_64) {
+		return false;
+	}
+
+	return header->section_header_size == sizeof(elf_section_t) && header->section_names < header->section_header_count &&
+		header->section_headers + header->section_header_count * sizeof(elf_section_t) <= size;
+}
+
+static elf_section_t* module_find_section(const uint8_t* file, const char* name) {
+
+	elf_header_t* header = (elf_header_t*)file;
+	elf_section_t* sections = module_sections(file);
+
+	for (uint32_t i = 0; i < header->section_header_count; i++) {
+		if (strcmp(module_section_name(file, &sections[i]), name) == 0) {
+			return &sections[i];
+		}
+	}
+
+	return 0;
+}
+
+// Record a module found in the initrd, with the bus it drives read from its unrelocated driver_info_t
+static void module_add(const char* name, const uint8_t* file, uint64_t size) {
+
+	if (!module_check(file, size)) {
+		return;
+	}
+
+	elf_section_t* info = module_find_section(file, ".driverinfo");
+	if (info == 0 || info->size < sizeof(driver_info_t) || info->type != ELF_SECTION_PROGBITS) {
+		return;
+	}
+
+	module_t* module = kzalloc(sizeof(module_t));
+	if (module == 0) {
+		return;
+	}
+
+	const driver_info_t* driver = (const driver_info_t*)(file + info->offset);
+
+	memcpy(module->name, name, sizeof(module->name) - 1);
+	module->file = file;
+	module->file_size = size;
+	module->connection_type = driver->connection_type;
+	module->pci_vendor = driver->connection_data.pci.vendor;
+	module->pci_device = driver->connection_data.pci.device;
+	module->pci_class = driver->connection_data.pci.class_code;
+
+	module->next = module_list;
+	module_list = module;
+}
+
+void module_init(void) {
+
+	spin_lock(&module_lock);
+	module_export(__ksymtab_start, __ksymtab_end);
+	spin_unlock(&module_lock);
+
+	uint8_t* initrd = phys_to_virt(bootboot.initrd_ptr);
+	uint64_t offset = 0;
+
+	while (offset + TAR_BLOCK <= bootboot.initrd_size) {
+		tar_header_t* header = (tar_header_t*)(initrd + offset);
+		if (header->filename[0] == '\0') {
+			break;
+		}
+
+		uint64_t size = octal_string_to_int(header->size, 11);
+		uint64_t length = strlen(header->filename) < sizeof(header->filename) ? strlen(header->filename) : sizeof(header->filename);
+
+		bool regular = header->typeflag[0] == '0' || header->typeflag[0] == '\0';
+		if (regular && length > 3 && strncmp(&header->filename[length - 3], ".ko", 3) == 0 && offset + TAR_BLOCK + size <= bootboot.initrd_size) {
+			module_add(header->filename, initrd + offset + TAR_BLOCK, size);
+		}
+
+		offset += TAR_BLOCK + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+	}
+}
+
+// Unmap pages of the module area and free their frames. Called with module_lock held, which
+// is never taken with interrupts disabled, so flushing under it can not deadlock
+static void module_unmap(uint64_t base, uint64_t pages) {
+
+	tlb_batch_t batch;
+	uint64_t frames[MODULE_UNMAP_FRAMES];
+	uint32_t count = 0;
+
+	// Kernel half addresses, so the batch is global
+	tlb_batch_init(&batch, &kernel_address_space);
+
+	for (uint64_t i = 0; i < pages; i++) {
+		uint64_t frame = paging_unmap_batch(&kernel_address_space, base + i * PAGE_SIZE, &batch);
+		if (frame == 0) {
+			continue;
+		}
+
+		frames[count++] = frame;
+
+		if (count == MODULE_UNMAP_FRAMES) {
+			tlb_batch_flush(&batch);
+			for (uint32_t j = 0; j < count; j++) {
+				pmm_free_page(frames[j]);
+			}
+			count = 0;
+		}
+	}
+
+	tlb_batch_flush(&batch);
+	for (uint32_t j = 0; j < count; j++) {
+		pmm_free_page(frames[j]);
+	}
+}
+
+// Map size bytes of fresh pages in the module area. Called with module_lock held
+static uint64_t module_alloc(uint64_t size) {
+
+	uint64_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+	if (module_next + pages * PAGE_SIZE > MODULE_END) {
+		return 0;
+	}
+
+	uint64_t base = module_next;
+
+	for (uint64_t i = 0; i < pages; i++) {
+		uint64_t frame = pmm_alloc_page();
+		if (frame == 0 || paging_map(&kernel_address_space, base + i * PAGE_SIZE, frame, PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL) != 0) {
+			if (frame != 0) {
+				pmm_free_page(frame);
+			}
+
+			// The next module gets the same addresses, so nothing mapped so far may stay
+			module_unmap(base, i);
+			return 0;
+		}
+	}
+
+	module_next += pages * PAGE_SIZE;
+	return base;
+}
+
+// The address of a symbol, or 0 with *found cleared
+static uint64_t module_resolve(module_t* module, uint64_t* bases, uint32_t section_count, elf_symbol_t* symbol, const char* names, bool* found) {
+
+	*found = true;
+
+	if (symbol->section == ELF_SECTION_UNDEF) {
+		const char* name = names + symbol->name;
+		if (name[0] == '\0') {
+			return 0;
+		}
+
+		module_symbol_t* export = module_symbol_find(name);
+		if (export != 0) {
+			return export->address;
+		}
+
+		// Unresolved weak symbols are null
+		if (ELF_SYMBOL_BIND(symbol->info) == ELF_BIND_WEAK) {
+			return 0;
+		}
+
+		tty_print_string("Module ");
+		tty_print_string(module->name);
+		tty_print_string(" uses unknown symbol ");
+		tty_print_string((char*)name);
+		tty_print_string("\n");
+
+		*found = false;
+		return 0;
+	}
+
+	if (symbol->section == ELF_SECTION_ABS) {
+		return symbol->value;
+	}
+
+	// Common symbols need -fno-common, other reserved indices such as SHN_XINDEX are not
+	// supported, and other sections are not loaded
+	if (symbol->section == ELF_SECTION_COMMON || symbol->section >= section_count || bases[symbol->section] == 0) {
+		*found = false;
+		return 0;
+	}
+
+	return bases[symbol->section] + symbol->value;
+}
+
+static bool module_fits_signed(int64_t value) {
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Apply one RELA section. Called with module_lock held
+static uint8_t module_relocate(module_t* module, uint64_t* bases, uint32_t section_count, elf_section_t* rela, uint64_t** got) {
+
+	const uint8_t* file = module->file;
+	elf_section_t* sections = module_sections(file);
+	elf_section_t* symtab = &sections[rela->link];
+	elf_symbol_t* symbols = (elf_symbol_t*)(file + symtab->offset);
+	const char* names = (const char*)file + sections[symtab->link].offset;
+	uint64_t symbol_count = symtab->size / sizeof(elf_symbol_t);
+
+	elf_rela_t* relocations = (elf_rela_t*)(file + rela->offset);
+	uint64_t count = rela->size / sizeof(elf_rela_t);
+	uint64_t target = bases[rela->info];
+
+	for (uint64_t i = 0; i < count; i++) {
+		elf_rela_t* r = &relocations[i];
+		uint32_t type = ELF_RELOC_TYPE(r->info);
+		uint32_t index = ELF_RELOC_SYMBOL(r->info);
+
+		if (index >= symbol_count || r->offset >= sections[rela->info].size) {
+			return MODULE_ERROR_FORMAT;
+		}
+
+		bool found;
+		uint64_t s = module_resolve(module, bases, section_count, &symbols[index], names, &found);
+		if (!found) {
+			return MODULE_ERROR_SYMBOL;
+		}
+
+		uint64_t p = target + r->offset;
+		int64_t value;
+
+		switch (type) {
+			case R_X86_64_NONE:
+				break;
+			case R_X86_64_64:
+				*(uint64_t*)p = s + r->addend;
+				break;
+			case R_X86_64_PC64:
+				*(uint64_t*)p = s + r->addend - p;
+				break;
+			case R_X86_64_PC32:
+			case R_X86_64_PLT32:
+				value = (int64_t)(s + r->addend - p);
+				if (!module_fits_signed(value)) {
+					return MODULE_ERROR_RELOCATION;
+				}
+				*(int32_t*)p = (int32_t)value;
+				break;
+			case R_X86_64_32:
+				if (s + r->addend > UINT32_MAX) {
+					return MODULE_ERROR_RELOCATION;
+				}
+				*(uint32_t*)p = (uint32_t)(s + r->addend);
+				break;
+			case R_X86_64_32S:
+				value = (int64_t)(s + r->addend);
+				if (!module_fits_signed(value)) {
+					return MODULE_ERROR_RELOCATION;
+				}
+				*(int32_t*)p = (int32_t)value;
+				break;
+			case R_X86_64_GOTPCREL:
+			case R_X86_64_GOTPCRELX:
+			case R_X86_64_REX_GOTPCRELX:
+				**got = s;
+				value = (int64_t)((uint64_t)*got + r->addend - p);
+				(*got)++;
+				if (!module_fits_signed(value)) {
+					return MODULE_ERROR_RELOCATION;
+				}
+				*(int32_t*)p = (int32_t)value;
+				break;
+			default:
+				return MODULE_ERROR_RELOCATION;
+		}
+	}
+
+	return MODULE_SUCCESS;
+}
+
+// Lay out, copy and relocate a module. Called with module_lock held
+static uint8_t module_link(module_t* module) {
+
+	const uint8_t* file = module->file;
+	elf_header_t* header = (elf_header_t*)file;
+	elf_section_t* sections = module_sections(file);
+	uint32_t section_count = header->section_header_count;
+
+	uint64_t* bases = kzalloc(section_count * sizeof(uint64_t));
+	if (bases == 0) {
+		return MODULE_ERROR_MEMORY;
+	}
+
+	// Offsets of the allocated sections, then room for one GOT slot per GOT relocation
+	uint64_t size = 0;
+	uint64_t got_slots = 0;
+
+	for (uint32_t i = 0; i < section_count; i++) {
+		elf_section_t* section = &sections[i];
+
+		if (section->flags & ELF_SECTION_ALLOC) {
+			uint64_t alignment = section->alignment > 1 ? section->alignment : 1;
+			size = (size + alignment - 1) / alignment * alignment;
+			bases[i] = size;
+			size += section->size;
+		}
+		else if (section->type == ELF_SECTION_RELA && section->info < section_count && (sections[section->info].flags & ELF_SECTION_ALLOC)) {
+			elf_rela_t* relocations = (elf_rela_t*)(file + section->offset);
+			for (uint64_t r = 0; r < section->size / sizeof(elf_rela_t); r++) {
+				uint32_t type = ELF_RELOC_TYPE(relocations[r].info);
+				if (type == R_X86_64_GOTPCREL || type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX) {
+					got_slots++;
+				}
+			}
+		}
+	}
+
+	size = (size + 7) / 8 * 8;
+	uint64_t got_offset = size;
+	size += got_slots * sizeof(uint64_t);
+
+	uint64_t base = module_alloc(size);
+	if (base == 0) {
+		kfree(bases);
+		return MODULE_ERROR_MEMORY;
+	}
+
+	// Section offsets become addresses. Index 0 is never allocated, so 0 still means not loaded
+	for (uint32_t i = 0; i < section_count; i++) {
+		elf_section_t* section = &sections[i];
+		if (!(section->flags & ELF_SECTION_ALLOC)) {
+			continue;
+		}
+
+		bases[i] += base;
+		if (section->type == ELF_SECTION_NOBITS) {
+			memset((void*)bases[i], 0, section->size);
+		}
+		else {
+			memcpy((void*)bases[i], file + section->offset, section->size);
+		}
+	}
+
+	uint64_t* got = (uint64_t*)(base + got_offset);
+
+	for (uint32_t i = 0; i < section_count; i++) {
+		elf_section_t* section = &sections[i];
+
+		if (section->type != ELF_SECTION_RELA || section->info >= section_count || bases[section->info] == 0) {
+			continue;
+		}
+
+		uint8_t error = module_relocate(module, bases, section_count, section, &got);
+		if (error != MODULE_SUCCESS) {
+			kfree(bases);
+			return error;
+		}
+	}
+
+	module->base = base;
+	module->size = size;
+
+	// The driver's description, and anything it exports to later modules
+	elf_section_t* info = module_find_section(file, ".driverinfo");
+	elf_section_t* exports = module_find_section(file, ".ksymtab");
+
+	if (info == 0 || !(info->flags & ELF_SECTION_ALLOC)) {
+		kfree(bases);
+		return MODULE_ERROR_NO_INFO;
+	}
+	module->info = (driver_info_t*)bases[info - sections];
+
+	if (exports != 0 && (exports->flags & ELF_SECTION_ALLOC)) {
+		kernel_symbol_t* start = (kernel_symbol_t*)bases[exports - sections];
+		if (!module_export(start, start + exports->size / sizeof(kernel_symbol_t))) {
+			kfree(bases);
+			return MODULE_ERROR_MEMORY;
+		}
+	}
+
+	// Found by name in the module's own symbol table, so it does not have to be exported
+	elf_section_t* symtab = 0;
+	for (uint32_t i = 0; i < section_count; i++) {
+		if (sections[i].type == ELF_SECTION_SYMTAB) {
+			symtab = &sections[i];
+		}
+	}
+
+	if (symtab != 0) {
+		elf_symbol_t* symbols = (elf_symbol_t*)(file + symtab->offset);
+		const char* names = (const char*)file + sections[symtab->link].offset;
+
+		for (uint64_t i = 0; i < symtab->size / sizeof(elf_symbol_t); i++) {
+			if (symbols[i].section != ELF_SECTION_UNDEF && symbols[i].section < section_count &&
+				bases[symbols[i].section] != 0 && strcmp(names + symbols[i].name, "module_receive") == 0) {
+				module->receive = (uint8_t (*)(uint64_t))(bases[symbols[i].section] + symbols[i].value);
+			}
+		}
+	}
+
+	kfree(bases);
+	return MODULE_SUCCESS;
+}
+
+// Record how loading ended, for callers waiting in module_load
+static uint8_t module_finish(module_t* module, uint8_t error) {
+	module->error = error;
+	__atomic_store_n(&module->state, error == MODULE_SUCCESS ? MODULE_READY : MODULE_FAILED, __ATOMIC_RELEASE);
+	return error;
+}
+
+uint8_t module_load(module_t* module) {
+
+	spin_lock(&module_lock);
+
+	// Someone else is loading it or has, so only the result is left to wait for
+	if (module->state != MODULE_UNLOADED) {
+		spin_unlock(&module_lock);
+
+		uint8_t state;
+		while ((state = __atomic_load_n(&module->state, __ATOMIC_ACQUIRE)) == MODULE_INITIALIZING) {
+			pause();
+		}
+
+		return state == MODULE_READY ? MODULE_SUCCESS : module->error;
+	}
+
+	uint8_t error = module_link(module);
+	if (error != MODULE_SUCCESS) {
+		module_finish(module, error);
+		spin_unlock(&module_lock);
+
+		tty_print_string("Could not load module ");
+		tty_print_string(module->name);
+		tty_print_string(", error ");
+		print_dec(error);
+		tty_print_string("\n");
+		return error;
+	}
+
+	module->state = MODULE_INITIALIZING;
+	spin_unlock(&module_lock);
+
+	// Outside the lock, since init may load other modules or wait for other cores
+	uint8_t (*init)(void) = (uint8_t (*)(void))module->info->init;
+	if (init != 0 && init() != 0) {
+		return module_finish(module, MODULE_ERROR_INIT);
+	}
+
+	return module_finish(module, MODULE_SUCCESS);
+}
+
+uint32_t module_load_boot(void) {
+
+	uint32_t loaded = 0;
+
+	for (module_t* module = module_list; module != 0; module = module->next) {
+		// Bus drivers wait until a device they drive is found
+		if (module->connection_type == DEV_CONNECTION_PCI || module->connection_type == DEV_CONNECTION_USB) {
+			continue;
+		}
+
+		if (module_load(module) == MODULE_SUCCESS) {
+			loaded++;
+		}
+	}
+
+	return loaded;
+}
+
+module_t* module_find(const char* name) {
+
+	for (module_t* module = module_list; module != 0; module = module->next) {
+		if (strcmp(module->name, name) == 0 || (module->state == MODULE_READY && module->info->name != 0 && strcmp(module->info->name, name) == 0)) {
+			return module;
+		}
+	}
+
+	return 0;
+}
+
+uint8_t module_call_function(char* function_name) {
+
+	uint8_t (*function)(void) = (uint8_t (*)(void))module_symbol_lookup(function_name);
+	if (function == 0) {
+		return MODULE_ERROR_SYMBOL;
+	}
+
+	return function();
+}
 
-uint8_t module_load(driver_info_t* driver) {
+uint8_t module_send_value(char* module_name, uint64_t value) {
 
-	
+	module_t* module = module_find(module_name);
+	if (module == 0 || module->state != MODULE_READY || module->receive == 0) {
+		return MODULE_ERROR_SYMBOL;
+	}
 
-}
\ No newline at end of file
+	return module->receive(value);
+}
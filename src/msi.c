@@ -0,0 +1,252 @@
+/*
+ * evan-os/src/msi.c
+ *
+ * MSI and MSI-X. Both are programmed with a message address selecting
+ * the destination core and message data holding the vector, here always
+ * edge triggered with fixed delivery. MSI keeps them in its capability,
+ * MSI-X in a table of 16 byte entries in one of the device's BARs.
+ *
+ */
+
+#include <msi.h>
+
+#include <apic.h>
+#include <interrupt.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <paging.h>
+#include <pci.h>
+#include <percpu.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// MSI capability
+#define MSI_CONTROL        0x02
+#define MSI_ADDRESS_LOW    0x04
+#define MSI_ADDRESS_HIGH   0x08 // 64 bit capable devices only
+#define MSI_DATA_32        0x08
+#define MSI_DATA_64        0x0c
+
+#define MSI_CONTROL_ENABLE   (1 << 0)
+#define MSI_CONTROL_MULTIPLE (7 << 4) // Messages enabled, as a power of 2
+#define MSI_CONTROL_64       (1 << 7)
+
+// MSI-X capability
+#define MSIX_CONTROL 0x02
+#define MSIX_TABLE   0x04 // BAR in the bottom 3 bits, offset in the rest
+
+#define MSIX_CONTROL_SIZE   0x7ff // Entries minus 1
+#define MSIX_CONTROL_MASK   (1 << 14)
+#define MSIX_CONTROL_ENABLE (1 << 15)
+
+// MSI-X table entries, in 32 bit words
+#define MSIX_ENTRY_WORDS        4
+#define MSIX_ENTRY_ADDRESS_LOW  0
+#define MSIX_ENTRY_ADDRESS_HIGH 1
+#define MSIX_ENTRY_DATA         2
+#define MSIX_ENTRY_CONTROL      3
+
+#define MSIX_ENTRY_MASKED (1 << 0)
+
+// Where a device's MSI message is sent, so it can be freed
+typedef struct msi_route_t {
+	uint32_t cpu;
+	uint8_t  vector;
+} msi_route_t;
+
+// The message address for a core, or 0 if it can not be sent messages
+static uint32_t msi_address(uint32_t cpu) {
+
+	if (cpu >= cpu_count || !(apic_online & (1ull << cpu))) {
+		return 0;
+	}
+
+	uint32_t apic_id = per_cpu(apic_id, cpu);
+	if (apic_id > 0xff) {
+		return 0;
+	}
+
+	return MSI_ADDRESS_BASE | apic_id << 12;
+}
+
+static void msi_disable_intx(pci_device_t* device) {
+	pci_write16(device, PCI_COMMAND, pci_read16(device, PCI_COMMAND) | PCI_COMMAND_INTX_OFF);
+}
+
+bool msi_enable(pci_device_t* device, uint32_t cpu, interrupt_vector_handler_t handler, void* arg) {
+
+	uint16_t capability = pci_find_capability(device, PCI_CAPABILITY_MSI);
+	uint32_t address = msi_address(cpu);
+	if (capability == 0 || address == 0) {
+		return false;
+	}
+
+	msi_route_t* route = kmalloc(sizeof(msi_route_t));
+	if (route == 0) {
+		return false;
+	}
+
+	uint8_t vector;
+	if (!interrupt_alloc_vector(cpu, handler, arg, &vector)) {
+		kfree(route);
+		return false;
+	}
+
+	uint16_t control = pci_read16(device, capability + MSI_CONTROL);
+
+	// Only ever one message, so every vector of a multiple message device is the same
+	pci_write16(device, capability + MSI_CONTROL, control & ~(MSI_CONTROL_ENABLE | MSI_CONTROL_MULTIPLE));
+
+	pci_write32(device, capability + MSI_ADDRESS_LOW, address);
+	if (control & MSI_CONTROL_64) {
+		pci_write32(device, capability + MSI_ADDRESS_HIGH, 0);
+		pci_write16(device, capability + MSI_DATA_64, vector);
+	}
+	else {
+		pci_write16(device, capability + MSI_DATA_32, vector);
+	}
+
+	msi_route_t* old = device->msi_route;
+	route->cpu = cpu;
+	route->vector = vector;
+	device->msi_route = route;
+
+	msi_disable_intx(device);
+	pci_write16(device, capability + MSI_CONTROL, (control & ~MSI_CONTROL_MULTIPLE) | MSI_CONTROL_ENABLE);
+
+	// Calling it again moves the message, freeing the vector it was sent to before
+	if (old != 0) {
+		interrupt_free_vector(old->cpu, old->vector);
+		kfree(old);
+	}
+
+	return true;
+}
+EXPORT_SYMBOL(msi_enable);
+
+void msi_disable(pci_device_t* device) {
+
+	msi_route_t* route = device->msi_route;
+	if (route == 0) {
+		return;
+	}
+
+	uint16_t capability = pci_find_capability(device, PCI_CAPABILITY_MSI);
+	pci_write16(device, capability + MSI_CONTROL, pci_read16(device, capability + MSI_CONTROL) & ~MSI_CONTROL_ENABLE);
+
+	device->msi_route = 0;
+	interrupt_free_vector(route->cpu, route->vector);
+	kfree(route);
+}
+EXPORT_SYMBOL(msi_disable);
+
+msix_t* msix_enable(pci_device_t* device) {
+
+	uint16_t capability = pci_find_capability(device, PCI_CAPABILITY_MSIX);
+	if (capability == 0) {
+		return 0;
+	}
+
+	uint16_t control = pci_read16(device, capability + MSIX_CONTROL);
+	uint32_t table = pci_read32(device, capability + MSIX_TABLE);
+
+	uint64_t bar = pci_bar(device, table & 0x7, 0);
+	if (bar == 0) {
+		return 0;
+	}
+
+	msix_t* msix = kzalloc(sizeof(msix_t));
+	if (msix == 0) {
+		return 0;
+	}
+
+	msix->device = device;
+	msix->capability = capability;
+	msix->entries = (control & MSIX_CONTROL_SIZE) + 1;
+	msix->cpus = kzalloc(msix->entries * sizeof(uint32_t));
+	msix->vectors = kzalloc(msix->entries);
+	msix->table = paging_map_mmio(bar + (table & ~0x7u), msix->entries * MSIX_ENTRY_WORDS * 4);
+
+	if (msix->cpus == 0 || msix->vectors == 0 || msix->table == 0) {
+		kfree(msix->cpus);
+		kfree(msix->vectors);
+		kfree(msix);
+		return 0;
+	}
+
+	// Every entry is masked before the function mask comes off, so nothing fires half programmed
+	pci_enable(device);
+	pci_write16(device, capability + MSIX_CONTROL, control | MSIX_CONTROL_ENABLE | MSIX_CONTROL_MASK);
+
+	for (uint32_t entry = 0; entry < msix->entries; entry++) {
+		msix->table[entry * MSIX_ENTRY_WORDS + MSIX_ENTRY_CONTROL] |= MSIX_ENTRY_MASKED;
+	}
+
+	msi_disable_intx(device);
+	pci_write16(device, capability + MSIX_CONTROL, (control | MSIX_CONTROL_ENABLE) & ~MSIX_CONTROL_MASK);
+
+	return msix;
+}
+EXPORT_SYMBOL(msix_enable);
+
+void msix_set_masked(msix_t* msix, uint32_t entry, bool masked) {
+
+	if (entry >= msix->entries) {
+		return;
+	}
+
+	volatile uint32_t* control = &msix->table[entry * MSIX_ENTRY_WORDS + MSIX_ENTRY_CONTROL];
+	*control = masked ? *control | MSIX_ENTRY_MASKED : *control & ~MSIX_ENTRY_MASKED;
+}
+EXPORT_SYMBOL(msix_set_masked);
+
+bool msix_route(msix_t* msix, uint32_t entry, uint32_t cpu, interrupt_vector_handler_t handler, void* arg) {
+
+	uint32_t address = msi_address(cpu);
+	if (entry >= msix->entries || address == 0) {
+		return false;
+	}
+
+	uint8_t vector;
+	if (!interrupt_alloc_vector(cpu, handler, arg, &vector)) {
+		return false;
+	}
+
+	// Masked while the three words are inconsistent. A message raised meanwhile is held as pending
+	volatile uint32_t* words = &msix->table[entry * MSIX_ENTRY_WORDS];
+	msix_set_masked(msix, entry, true);
+
+	words[MSIX_ENTRY_ADDRESS_LOW] = address;
+	words[MSIX_ENTRY_ADDRESS_HIGH] = 0;
+	words[MSIX_ENTRY_DATA] = vector;
+
+	uint32_t old_cpu = msix->cpus[entry];
+	uint8_t old_vector = msix->vectors[entry];
+	msix->cpus[entry] = cpu;
+	msix->vectors[entry] = vector;
+
+	msix_set_masked(msix, entry, false);
+
+	if (old_vector != 0) {
+		interrupt_free_vector(old_cpu, old_vector);
+	}
+
+	return true;
+}
+EXPORT_SYMBOL(msix_route);
+
+uint32_t msix_route_queues(msix_t* msix, uint32_t queues, interrupt_vector_handler_t handler, void** args) {
+
+	uint32_t routed = 0;
+
+	for (uint32_t queue = 0; queue < queues && queue < msix->entries; queue++) {
+		if (!msix_route(msix, queue, queue % cpu_count, handler, args[queue])) {
+			break;
+		}
+		routed++;
+	}
+
+	return routed;
+}
+EXPORT_SYMBOL(msix_route_queues);
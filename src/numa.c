@@ -0,0 +1,257 @@
+/*
+ * evan-os/src/numa.c
+ *
+ * NUMA topology from the ACPI System Resource Affinity Table, which
+ * assigns memory ranges and cores to proximity domains, and the System
+ * Locality Information Table, which gives the distances between them.
+ *
+ */
+
+#include <numa.h>
+
+#include <acpi.h>
+#include <paging.h>
+#include <percpu.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cores the SRAT can assign to nodes
+#define NUMA_MAX_APICS 256
+
+// SRAT entry types
+#define SRAT_LOCAL_APIC   0
+#define SRAT_MEMORY       1
+#define SRAT_LOCAL_X2APIC 2
+
+#define SRAT_ENABLED (1 << 0)
+
+typedef struct srat_entry_t {
+	uint8_t type;
+	uint8_t length;
+} __attribute__((packed)) srat_entry_t;
+
+typedef struct srat_local_apic_t {
+	uint8_t  type;
+	uint8_t  length;
+	uint8_t  domain_low;
+	uint8_t  apic_id;
+	uint32_t flags;
+	uint8_t  sapic_eid;
+	uint8_t  domain_high[3];
+	uint32_t clock_domain;
+} __attribute__((packed)) srat_local_apic_t;
+
+typedef struct srat_memory_t {
+	uint8_t  type;
+	uint8_t  length;
+	uint32_t domain;
+	uint16_t reserved;
+	uint64_t base;
+	uint64_t size;
+	uint32_t reserved2;
+	uint32_t flags;
+	uint64_t reserved3;
+} __attribute__((packed)) srat_memory_t;
+
+typedef struct srat_local_x2apic_t {
+	uint8_t  type;
+	uint8_t  length;
+	uint16_t reserved;
+	uint32_t domain;
+	uint32_t x2apic_id;
+	uint32_t flags;
+	uint32_t clock_domain;
+	uint32_t reserved2;
+} __attribute__((packed)) srat_local_x2apic_t;
+
+typedef struct numa_apic_t {
+	uint32_t apic_id;
+	uint32_t node;
+} numa_apic_t;
+
+uint32_t numa_node_count = 1;
+
+numa_range_t numa_ranges[NUMA_MAX_RANGES];
+uint32_t numa_range_count;
+
+uint32_t numa_fallback[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+// The proximity domain of each node
+uint32_t numa_domains[NUMA_MAX_NODES];
+
+uint8_t numa_distances[NUMA_MAX_NODES][NUMA_MAX_NODES];
+
+numa_apic_t numa_apics[NUMA_MAX_APICS];
+uint32_t numa_apic_count;
+
+DEFINE_PER_CPU(uint32_t, numa_node);
+
+// The node for a proximity domain, adding one if it is new.
+// Domains past NUMA_MAX_NODES share the last node
+static uint32_t numa_node_of_domain(uint32_t domain) {
+
+	for (uint32_t node = 0; node < numa_node_count; node++) {
+		if (numa_domains[node] == domain) {
+			return node;
+		}
+	}
+
+	if (numa_node_count == NUMA_MAX_NODES) {
+		return NUMA_MAX_NODES - 1;
+	}
+
+	numa_domains[numa_node_count] = domain;
+	return numa_node_count++;
+}
+
+static void numa_add_apic(uint32_t apic_id, uint32_t domain) {
+
+	if (numa_apic_count == NUMA_MAX_APICS) {
+		return;
+	}
+
+	numa_apics[numa_apic_count].apic_id = apic_id;
+	numa_apics[numa_apic_count].node = numa_node_of_domain(domain);
+	numa_apic_count++;
+}
+
+static void numa_add_range(uint64_t base, uint64_t size, uint32_t domain) {
+
+	// Only whole frames
+	uint64_t start = (base + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	uint64_t end = (base + size) >> PAGE_SHIFT;
+
+	if (numa_range_count == NUMA_MAX_RANGES || end <= start) {
+		return;
+	}
+
+	numa_ranges[numa_range_count].start = start;
+	numa_ranges[numa_range_count].end = end;
+	numa_ranges[numa_range_count].node = numa_node_of_domain(domain);
+	numa_range_count++;
+}
+
+static void numa_parse_srat(acpi_header_t* srat) {
+
+	// The entries follow 12 reserved bytes after the header
+	uint8_t* entry = (uint8_t*)srat + sizeof(acpi_header_t) + 12;
+	uint8_t* end = (uint8_t*)srat + srat->length;
+
+	// Domains are only counted once something in them is found
+	numa_node_count = 0;
+
+	while (entry + sizeof(srat_entry_t) <= end && ((srat_entry_t*)entry)->length != 0) {
+		srat_entry_t* header = (srat_entry_t*)entry;
+
+		if (header->type == SRAT_LOCAL_APIC) {
+			srat_local_apic_t* apic = (srat_local_apic_t*)entry;
+			if (apic->flags & SRAT_ENABLED) {
+				uint32_t domain = apic->domain_low | (uint32_t)apic->domain_high[0] << 8 | (uint32_t)apic->domain_high[1] << 16 | (uint32_t)apic->domain_high[2] << 24;
+				numa_add_apic(apic->apic_id, domain);
+			}
+		}
+		else if (header->type == SRAT_MEMORY) {
+			srat_memory_t* memory = (srat_memory_t*)entry;
+			if (memory->flags & SRAT_ENABLED) {
+				numa_add_range(memory->base, memory->size, memory->domain);
+			}
+		}
+		else if (header->type == SRAT_LOCAL_X2APIC) {
+			srat_local_x2apic_t* apic = (srat_local_x2apic_t*)entry;
+			if (apic->flags & SRAT_ENABLED) {
+				numa_add_apic(apic->x2apic_id, apic->domain);
+			}
+		}
+
+		entry += header->length;
+	}
+
+	// An SRAT with nothing enabled in it
+	if (numa_node_count == 0) {
+		numa_node_count = 1;
+	}
+}
+
+static void numa_parse_slit(acpi_header_t* slit) {
+
+	uint64_t localities = *(uint64_t*)((uint8_t*)slit + sizeof(acpi_header_t));
+	uint8_t* matrix = (uint8_t*)slit + sizeof(acpi_header_t) + 8;
+
+	if (sizeof(acpi_header_t) + 8 + localities * localities > slit->length) {
+		return;
+	}
+
+	for (uint32_t a = 0; a < numa_node_count; a++) {
+		for (uint32_t b = 0; b < numa_node_count; b++) {
+			if (numa_domains[a] < localities && numa_domains[b] < localities) {
+				numa_distances[a][b] = matrix[numa_domains[a] * localities + numa_domains[b]];
+			}
+		}
+	}
+}
+
+void numa_init(void) {
+
+	acpi_header_t* srat = acpi_find_table(ACPI_SIGNATURE('S', 'R', 'A', 'T'), 0);
+	if (srat != 0) {
+		numa_parse_srat(srat);
+	}
+
+	for (uint32_t a = 0; a < NUMA_MAX_NODES; a++) {
+		for (uint32_t b = 0; b < NUMA_MAX_NODES; b++) {
+			numa_distances[a][b] = a == b ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+		}
+	}
+
+	acpi_header_t* slit = acpi_find_table(ACPI_SIGNATURE('S', 'L', 'I', 'T'), 0);
+	if (slit != 0) {
+		numa_parse_slit(slit);
+	}
+
+	// Order every node's fallbacks by distance. Insertion sort keeps ties in node order
+	for (uint32_t node = 0; node < numa_node_count; node++) {
+		uint32_t* order = numa_fallback[node];
+
+		for (uint32_t i = 0; i < numa_node_count; i++) {
+			uint32_t j = i;
+			while (j > 0 && numa_distances[node][order[j - 1]] > numa_distances[node][i]) {
+				order[j] = order[j - 1];
+				j--;
+			}
+			order[j] = i;
+		}
+	}
+}
+
+void numa_cpu_init(void) {
+
+	uint32_t apic_id = this_cpu_read(apic_id);
+	uint32_t node = 0;
+
+	for (uint32_t i = 0; i < numa_apic_count; i++) {
+		if (numa_apics[i].apic_id == apic_id) {
+			node = numa_apics[i].node;
+			break;
+		}
+	}
+
+	this_cpu_write(numa_node, node);
+}
+
+uint32_t numa_node_of_frame(uint64_t frame) {
+
+	frame >>= PAGE_SHIFT;
+
+	for (uint32_t i = 0; i < numa_range_count; i++) {
+		if (frame >= numa_ranges[i].start && frame < numa_ranges[i].end) {
+			return numa_ranges[i].node;
+		}
+	}
+
+	return 0;
+}
+
+uint32_t numa_distance(uint32_t a, uint32_t b) {
+	return numa_distances[a][b];
+}
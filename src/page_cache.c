@@ -0,0 +1,236 @@
+/*
+ * evan-os/src/page_cache.c
+ *
+ * Page cache. Cached pages are kept in a small hash table per cache, and
+ * the cache holds one reference to each frame on top of any mappings.
+ * Dirty pages are only found by walking the table, which writeback does
+ * a batch at a time rather than for every page.
+ *
+ */
+
+#include <page_cache.h>
+
+#include <asm.h>
+#include <kmalloc.h>
+#include <paging.h>
+#include <pmm.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static inline page_cache_entry_t** page_cache_bucket(page_cache_t* cache, uint64_t index) {
+	return &cache->buckets[index % PAGE_CACHE_BUCKETS];
+}
+
+static page_cache_entry_t* page_cache_find(page_cache_t* cache, uint64_t index) {
+
+	for (page_cache_entry_t* entry = *page_cache_bucket(cache, index); entry != 0; entry = entry->next) {
+		if (entry->index == index) {
+			return entry;
+		}
+	}
+
+	return 0;
+}
+
+void page_cache_init(page_cache_t* cache, page_cache_read_t read_page, void* owner) {
+
+	cache->read_page = read_page;
+	cache->owner = owner;
+	cache->pages = 0;
+	cache->dirty = 0;
+	for (uint32_t i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+		cache->buckets[i] = 0;
+	}
+	spin_lock_init(&cache->lock);
+}
+
+uint64_t page_cache_peek(page_cache_t* cache, uint64_t index) {
+
+	uint64_t frame = 0;
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	page_cache_entry_t* entry = page_cache_find(cache, index);
+	if (entry != 0) {
+		frame = entry->frame;
+		pmm_page_get(frame);
+	}
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return frame;
+}
+
+uint64_t page_cache_add(page_cache_t* cache, uint64_t index, uint64_t frame) {
+
+	page_cache_entry_t* entry = kmalloc(sizeof(page_cache_entry_t));
+	if (entry == 0) {
+		pmm_page_put(frame);
+		return 0;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	// Another core may have read the same page in the meantime
+	page_cache_entry_t* existing = page_cache_find(cache, index);
+	if (existing != 0) {
+		uint64_t existing_frame = existing->frame;
+		pmm_page_get(existing_frame);
+		spin_unlock_irqrestore(&cache->lock, flags);
+
+		kfree(entry);
+		pmm_page_put(frame);
+		return existing_frame;
+	}
+
+	entry->index = index;
+	entry->frame = frame;
+	entry->dirtied = 0;
+	entry->next = *page_cache_bucket(cache, index);
+	*page_cache_bucket(cache, index) = entry;
+	cache->pages++;
+
+	// One reference for the cache, one for the caller
+	pmm_page_get(frame);
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return frame;
+}
+
+uint64_t page_cache_get(page_cache_t* cache, uint64_t index) {
+
+	uint64_t frame = page_cache_peek(cache, index);
+	if (frame != 0) {
+		return frame;
+	}
+
+	// Read without holding the lock, since it can take a while
+	frame = pmm_alloc_page();
+	if (frame == 0) {
+		return 0;
+	}
+
+	if (cache->read_page(cache, index, phys_to_virt(frame)) != 0) {
+		pmm_page_put(frame);
+		return 0;
+	}
+
+	return page_cache_add(cache, index, frame);
+}
+
+uint64_t page_cache_get_new(page_cache_t* cache, uint64_t index) {
+
+	uint64_t frame = page_cache_peek(cache, index);
+	if (frame != 0) {
+		return frame;
+	}
+
+	frame = pmm_alloc_zeroed();
+	if (frame == 0) {
+		return 0;
+	}
+
+	return page_cache_add(cache, index, frame);
+}
+
+bool page_cache_set_dirty(page_cache_t* cache, uint64_t index) {
+
+	bool clean = false;
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	page_cache_entry_t* entry = page_cache_find(cache, index);
+	if (entry != 0 && entry->dirtied == 0) {
+		entry->dirtied = rdtsc();
+		cache->dirty++;
+		clean = true;
+	}
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return clean;
+}
+
+uint64_t page_cache_take_dirty(page_cache_t* cache, uint64_t before, page_cache_entry_t* pages, uint64_t count) {
+
+	uint64_t taken = 0;
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	for (uint32_t i = 0; i < PAGE_CACHE_BUCKETS && taken < count && cache->dirty != 0; i++) {
+		for (page_cache_entry_t* entry = cache->buckets[i]; entry != 0 && taken < count; entry = entry->next) {
+			if (entry->dirtied != 0 && entry->dirtied <= before) {
+				pages[taken++] = *entry;
+				pmm_page_get(entry->frame);
+
+				entry->dirtied = 0;
+				cache->dirty--;
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return taken;
+}
+
+uint64_t page_cache_oldest_dirty(page_cache_t* cache) {
+
+	uint64_t oldest = 0;
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	for (uint32_t i = 0; i < PAGE_CACHE_BUCKETS && cache->dirty != 0; i++) {
+		for (page_cache_entry_t* entry = cache->buckets[i]; entry != 0; entry = entry->next) {
+			if (entry->dirtied != 0 && (oldest == 0 || entry->dirtied < oldest)) {
+				oldest = entry->dirtied;
+			}
+		}
+	}
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return oldest;
+}
+
+void page_cache_shrink(page_cache_t* cache, uint64_t target) {
+
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	for (uint32_t i = 0; i < PAGE_CACHE_BUCKETS && cache->pages > target; i++) {
+		page_cache_entry_t** link = &cache->buckets[i];
+
+		while (*link != 0 && cache->pages > target) {
+			page_cache_entry_t* entry = *link;
+
+			// Mapped pages, and pages being copied or written back, have other references
+			if (entry->dirtied != 0 || pmm_page_count(entry->frame) != 1) {
+				link = &entry->next;
+				continue;
+			}
+
+			*link = entry->next;
+			pmm_page_put(entry->frame);
+			kfree(entry);
+			cache->pages--;
+		}
+	}
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+void page_cache_release(page_cache_t* cache) {
+
+	uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+	for (uint32_t i = 0; i < PAGE_CACHE_BUCKETS; i++) {
+		page_cache_entry_t* entry = cache->buckets[i];
+		cache->buckets[i] = 0;
+
+		while (entry != 0) {
+			page_cache_entry_t* next = entry->next;
+			pmm_page_put(entry->frame);
+			kfree(entry);
+			entry = next;
+		}
+	}
+	cache->pages = 0;
+	cache->dirty = 0;
+
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
@@ -1,13 +1,551 @@
 /*
- * evan-os/include/paging.h 
- * 
+ * evan-os/src/paging.c
+ *
  * Contains functions for manipulating memory paging structures.
- * The paging structures contain information that maps virtual 
+ * The paging structures contain information that maps virtual
  * address spaces to the physical RAM.
- * 
+ *
+ * With PCIDs, each core caches PCID_SLOTS address spaces, each tagged with
+ * its own PCID (1 to PCID_SLOTS, 0 is only used while booting). Switching
+ * to a cached address space sets the no flush bit in CR3 and its TLB
+ * entries are reused. A slot remembers the address space's tlb_gen from
+ * when its entries were last known to be good, and when that is behind
+ * the address space's current tlb_gen the switch flushes the PCID instead.
+ *
  */
 
 #include <paging.h>
 
+#include <bootboot.h>
+#include <asm.h>
+#include <cpu.h>
+#include <module.h>
+#include <pmm.h>
+#include <percpu.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tlb.h>
+#include <trace.h>
+
 #include <stdint.h>
+#include <stdbool.h>
+
+#define CR3_NOFLUSH (1ull << 63) // Keep the TLB entries tagged with the new PCID
+#define CR3_PCID_MASK 0xfff
+
+#define CR4_PGE   (1 << 7)  // Global pages
+#define CR4_PCIDE (1 << 17) // Process context identifiers
+
+#define PCID_SLOTS 6
+
+#define PAGE_SIZE_2M (1ull << 21)
+#define PAGE_SIZE_1G (1ull << 30)
+
+// Lowest address mapped directly, below this is always covered so MMIO under 4 GiB is reachable
+#define PHYS_MAP_MIN (4ull << 30)
+
+typedef struct pcid_slot_t {
+	uint64_t space_id; // 0 when empty
+	uint64_t tlb_gen;  // The address space's tlb_gen when this core's entries were last good
+} pcid_slot_t;
+
+typedef struct pcid_cache_t {
+	pcid_slot_t slots[PCID_SLOTS];
+	uint32_t    next_victim; // Slots are replaced round robin
+} pcid_cache_t;
+
+address_space_t kernel_address_space;
+
+bool paging_pcid_enabled;
+bool paging_invpcid;
+
+uint64_t phys_map_base;
+EXPORT_SYMBOL(phys_map_base);
+
+// The next address space id. 0 marks an empty PCID slot
+volatile uint64_t paging_next_id = 1;
+
+volatile bool paging_ready;
+
+// The next free address in the MMIO window
+volatile uint64_t paging_mmio_next = MMIO_BASE;
+
+DEFINE_PER_CPU(address_space_t*, current_space);
+DEFINE_PER_CPU(pcid_cache_t, pcid_cache);
+
+extern BOOTBOOT bootboot;
+
+static inline uint64_t* table_virt(uint64_t entry) {
+	return phys_to_virt(entry & PAGE_ADDRESS_MASK);
+}
+
+// Allocate a cleared page table, returning its physical address or 0
+static uint64_t paging_alloc_table(void) {
+	return pmm_alloc_zeroed();
+}
+
+// Map all physical memory at PHYS_MAP_BASE with the largest pages available
+static void paging_build_direct_map(void) {
+
+	MMapEnt* mmap_ent = &bootboot.mmap;
+	MMapEnt* mmap_end = (MMapEnt*)((uint8_t*)&bootboot + bootboot.size);
+
+	uint64_t top = PHYS_MAP_MIN;
+	for (; mmap_ent < mmap_end; mmap_ent++) {
+		uint64_t end = MMapEnt_Ptr(mmap_ent) + MMapEnt_Size(mmap_ent);
+		if (MMapEnt_Type(mmap_ent) != MMAP_MMIO && end > top) {
+			top = end;
+		}
+	}
+	top = (top + PAGE_SIZE_1G - 1) & ~(PAGE_SIZE_1G - 1);
+
+	uint64_t* pml4 = table_virt(kernel_address_space.pml4);
+	uint64_t flags = PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL;
+	bool huge_1g = cpu_has(CPU_FEATURE_PAGE_1GB);
+
+	for (uint64_t address = 0; address < top; address += PAGE_SIZE_1G) {
+		uint64_t virt = PHYS_MAP_BASE + address;
+		uint64_t* pml4e = &pml4[(virt >> 39) & 511];
+
+		if (!(*pml4e & PAGE_PRESENT)) {
+			*pml4e = paging_alloc_table() | PAGE_PRESENT | PAGE_WRITE;
+		}
+
+		uint64_t* pdpte = &table_virt(*pml4e)[(virt >> 30) & 511];
+
+		if (huge_1g) {
+			*pdpte = address | flags | PAGE_HUGE;
+			continue;
+		}
+
+		uint64_t pd = paging_alloc_table();
+		uint64_t* pd_virt = phys_to_virt(pd);
+		for (uint64_t i = 0; i < 512; i++) {
+			pd_virt[i] = (address + i * PAGE_SIZE_2M) | flags | PAGE_HUGE;
+		}
+		*pdpte = pd | PAGE_PRESENT | PAGE_WRITE;
+	}
+}
+
+void paging_init(void) {
+
+	bool bsp = cpu_id() == 0;
+
+	if (bsp) {
+		kernel_address_space.pml4 = read_cr3() & PAGE_ADDRESS_MASK;
+		kernel_address_space.id = paging_next_id++;
+		spin_lock_init(&kernel_address_space.lock);
+		rwlock_init(&kernel_address_space.vma_lock);
+
+		paging_build_direct_map();
+		phys_map_base = PHYS_MAP_BASE;
+
+		// Address spaces copy the kernel half's top level, so its tables must exist before any are created
+		uint64_t* pml4 = table_virt(kernel_address_space.pml4);
+		uint64_t* mmio_entry = &pml4[(MMIO_BASE >> 39) & 511];
+		if (!(*mmio_entry & PAGE_PRESENT)) {
+			*mmio_entry = paging_alloc_table() | PAGE_PRESENT | PAGE_WRITE;
+		}
+
+		paging_pcid_enabled = cpu_has(CPU_FEATURE_PCID);
+		paging_invpcid = cpu_has(CPU_FEATURE_INVPCID);
+
+		__atomic_store_n(&paging_ready, true, __ATOMIC_RELEASE);
+	}
+	else {
+		while (!paging_ready) {
+			pause();
+		}
+	}
+
+	uint64_t cr4 = read_cr4();
+	if (cpu_has(CPU_FEATURE_PGE)) {
+		cr4 |= CR4_PGE;
+	}
+	if (cpu_has(CPU_FEATURE_PCID)) {
+		// PCIDs can only be turned on while running with PCID 0
+		write_cr3(read_cr3() & ~(uint64_t)CR3_PCID_MASK);
+		cr4 |= CR4_PCIDE;
+	}
+	write_cr4(cr4);
+
+	memset(this_cpu_ptr(pcid_cache), 0, sizeof(pcid_cache_t));
+	this_cpu_write(current_space, &kernel_address_space);
+	__atomic_or_fetch(&kernel_address_space.cpus, 1ull << cpu_id(), __ATOMIC_SEQ_CST);
+}
+
+bool paging_create(address_space_t* space) {
+
+	uint64_t pml4 = paging_alloc_table();
+	if (pml4 == 0) {
+		return false;
+	}
+
+	// Share the kernel half. Its top level entries all exist by now, so they never need to be synced
+	uint64_t* kernel_pml4 = table_virt(kernel_address_space.pml4);
+	memcpy((uint64_t*)phys_to_virt(pml4) + 256, kernel_pml4 + 256, 256 * sizeof(uint64_t));
+
+	space->pml4 = pml4;
+	space->id = __atomic_fetch_add(&paging_next_id, 1, __ATOMIC_SEQ_CST);
+	space->tlb_gen = 0;
+	space->cpus = 0;
+	spin_lock_init(&space->lock);
+	space->vmas = 0;
+	rwlock_init(&space->vma_lock);
+
+	return true;
+}
+
+// Free a page table and the tables below it. level is 4 for the PML4, down to 1 for page tables
+static void paging_free_table(uint64_t table, uint32_t level, uint32_t entries) {
+
+	uint64_t* virt = phys_to_virt(table);
+
+	if (level > 1) {
+		for (uint32_t i = 0; i < entries; i++) {
+			if ((virt[i] & PAGE_PRESENT) && !(virt[i] & PAGE_HUGE)) {
+				paging_free_table(virt[i] & PAGE_ADDRESS_MASK, level - 1, 512);
+			}
+		}
+	}
+
+	pmm_free_page(table);
+}
+
+void paging_destroy(address_space_t* space) {
+
+	// Only the lower half belongs to this address space
+	paging_free_table(space->pml4, 4, 256);
+	space->pml4 = 0;
+}
+
+// Find the page table entry for virt, creating tables on the way if asked to.
+// Returns 0 if it does not exist, or if a huge page is in the way
+static uint64_t* paging_walk(address_space_t* space, uint64_t virt, bool create) {
+
+	uint64_t* table = table_virt(space->pml4);
+
+	// Tables in the lower half can hold user pages, the final entry decides
+	uint64_t table_flags = PAGE_PRESENT | PAGE_WRITE;
+	if (virt < KERNEL_HALF_BASE) {
+		table_flags |= PAGE_USER;
+	}
+
+	for (uint32_t shift = 39; shift > 12; shift -= 9) {
+		uint64_t* entry = &table[(virt >> shift) & 511];
+
+		if (!(*entry & PAGE_PRESENT)) {
+			if (!create) {
+				return 0;
+			}
+
+			uint64_t new_table = paging_alloc_table();
+			if (new_table == 0) {
+				return 0;
+			}
+			*entry = new_table | table_flags;
+		}
+		else if (*entry & PAGE_HUGE) {
+			return 0;
+		}
+
+		table = table_virt(*entry);
+	}
+
+	return &table[(virt >> 12) & 511];
+}
+
+uint64_t paging_map(address_space_t* space, uint64_t virt, uint64_t phys, uint64_t flags) {
+
+	uint64_t irq_flags = spin_lock_irqsave(&space->lock);
+
+	uint64_t* entry = paging_walk(space, virt, true);
+	if (entry == 0) {
+		spin_unlock_irqrestore(&space->lock, irq_flags);
+
+		// Either the walk ran out of frames or it ran into a huge page
+		return paging_translate(space, virt) != 0 ? PAGING_ERROR_HUGE_PAGE : PAGING_ERROR_NO_MEMORY;
+	}
+
+	uint64_t old = *entry;
+	*entry = (phys & PAGE_ADDRESS_MASK) | flags | PAGE_PRESENT;
+
+	spin_unlock_irqrestore(&space->lock, irq_flags);
+
+	// Adding a mapping never leaves stale entries, changing one might
+	if (old & PAGE_PRESENT) {
+		paging_invalidate(space, virt);
+	}
+
+	return 0;
+}
+
+uint64_t paging_unmap_batch(address_space_t* space, uint64_t virt, tlb_batch_t* batch) {
+
+	uint64_t irq_flags = spin_lock_irqsave(&space->lock);
+
+	uint64_t* entry = paging_walk(space, virt, false);
+	uint64_t old = 0;
+	if (entry != 0) {
+		old = *entry;
+		*entry = 0;
+	}
+
+	spin_unlock_irqrestore(&space->lock, irq_flags);
+
+	if (!(old & PAGE_PRESENT)) {
+		return 0;
+	}
+
+	tlb_batch_add(batch, virt);
+
+	return old & PAGE_ADDRESS_MASK;
+}
+
+uint64_t paging_unmap(address_space_t* space, uint64_t virt) {
+
+	tlb_batch_t batch;
+	tlb_batch_init(&batch, space);
+
+	uint64_t frame = paging_unmap_batch(space, virt, &batch);
+	tlb_batch_flush(&batch);
+
+	return frame;
+}
+
+uint64_t paging_entry(address_space_t* space, uint64_t virt) {
+
+	uint64_t irq_flags = spin_lock_irqsave(&space->lock);
+
+	uint64_t* entry = paging_walk(space, virt, false);
+	uint64_t value = entry != 0 ? *entry : 0;
+
+	spin_unlock_irqrestore(&space->lock, irq_flags);
+
+	return value;
+}
+
+uint64_t paging_replace(address_space_t* space, uint64_t virt, uint64_t old_entry, uint64_t new_entry, tlb_batch_t* batch) {
+
+	uint64_t irq_flags = spin_lock_irqsave(&space->lock);
+
+	// Only create tables when filling an empty entry
+	uint64_t* entry = paging_walk(space, virt, old_entry == 0);
+	if (entry == 0) {
+		spin_unlock_irqrestore(&space->lock, irq_flags);
+		return old_entry == 0 ? PAGING_ERROR_NO_MEMORY : PAGING_ERROR_CHANGED;
+	}
+
+	if (*entry != old_entry) {
+		spin_unlock_irqrestore(&space->lock, irq_flags);
+		return PAGING_ERROR_CHANGED;
+	}
+
+	*entry = new_entry;
+
+	spin_unlock_irqrestore(&space->lock, irq_flags);
+
+	if (old_entry & PAGE_PRESENT) {
+		if (batch != 0) {
+			tlb_batch_add(batch, virt);
+		}
+		else {
+			paging_invalidate(space, virt);
+		}
+	}
+
+	return 0;
+}
+
+uint64_t paging_translate(address_space_t* space, uint64_t virt) {
+
+	uint64_t* table = table_virt(space->pml4);
+
+	for (uint32_t shift = 39; shift >= 12; shift -= 9) {
+		uint64_t entry = table[(virt >> shift) & 511];
+
+		if (!(entry & PAGE_PRESENT)) {
+			return 0;
+		}
+
+		// A huge page or the final level ends the walk
+		if (shift == 12 || (shift < 39 && (entry & PAGE_HUGE))) {
+			uint64_t offset_mask = (1ull << shift) - 1;
+			return (entry & PAGE_ADDRESS_MASK & ~offset_mask) | (virt & offset_mask);
+		}
+
+		table = table_virt(entry);
+	}
+
+	return 0;
+}
+
+// The slot holding space in this core's PCID cache, or -1
+static int32_t pcid_find(pcid_cache_t* cache, address_space_t* space) {
+
+	for (int32_t i = 0; i < PCID_SLOTS; i++) {
+		if (cache->slots[i].space_id == space->id) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// Flush every global entry, which is also every entry under every PCID
+static void paging_flush_global(void) {
+
+	if (paging_invpcid) {
+		invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+		return;
+	}
+
+	uint64_t cr4 = read_cr4();
+	if (cr4 & CR4_PGE) {
+		write_cr4(cr4 & ~(uint64_t)CR4_PGE);
+		write_cr4(cr4);
+	}
+	else {
+		write_cr3(read_cr3());
+	}
+}
+
+void paging_flush_local(tlb_batch_t* batch, uint64_t gen) {
+
+	address_space_t* space = batch->space;
+	bool full = batch->full || batch->pages > TLB_FLUSH_THRESHOLD;
+
+	// Kernel half entries are global, and invlpg drops those under every PCID
+	if (batch->global) {
+		if (full) {
+			paging_flush_global();
+			return;
+		}
+
+		for (uint32_t i = 0; i < batch->count; i++) {
+			for (uint64_t page = 0; page < batch->ranges[i].pages; page++) {
+				invlpg((void*)(batch->ranges[i].start + page * PAGE_SIZE));
+			}
+		}
+		return;
+	}
+
+	pcid_cache_t* cache = this_cpu_ptr(pcid_cache);
+	int32_t slot = pcid_find(cache, space);
+	bool flushed = false;
+
+	if (this_cpu_read(current_space) == space) {
+		if (full) {
+			// Reloading CR3 without the no flush bit clears the running PCID
+			write_cr3(read_cr3());
+		}
+		else {
+			for (uint32_t i = 0; i < batch->count; i++) {
+				for (uint64_t page = 0; page < batch->ranges[i].pages; page++) {
+					invlpg((void*)(batch->ranges[i].start + page * PAGE_SIZE));
+				}
+			}
+		}
+
+		// Both only reach the running PCID, which is not the slot's while PCIDs are turned off
+		flushed = (read_cr3() & CR3_PCID_MASK) == (uint64_t)(slot + 1);
+	}
+	else if (slot >= 0 && paging_invpcid) {
+		// Clean up the cached PCID now instead of flushing all of it on the next switch
+		if (full) {
+			invpcid(INVPCID_CONTEXT, slot + 1, 0);
+		}
+		else {
+			for (uint32_t i = 0; i < batch->count; i++) {
+				for (uint64_t page = 0; page < batch->ranges[i].pages; page++) {
+					invpcid(INVPCID_ADDRESS, slot + 1, (void*)(batch->ranges[i].start + page * PAGE_SIZE));
+				}
+			}
+		}
+		flushed = true;
+	}
+
+	// If nothing else changed since the slot was last good, it still is
+	if (flushed && slot >= 0 && cache->slots[slot].tlb_gen == gen - 1) {
+		cache->slots[slot].tlb_gen = gen;
+	}
+}
+
+void paging_invalidate(address_space_t* space, uint64_t virt) {
+
+	tlb_batch_t batch;
+	tlb_batch_init(&batch, space);
+	tlb_batch_add(&batch, virt);
+	tlb_batch_flush(&batch);
+}
+
+void paging_switch(address_space_t* space) {
+
+	uint64_t flags = irq_save();
+
+	address_space_t* prev = this_cpu_read(current_space);
+	if (prev == space) {
+		irq_restore(flags);
+		return;
+	}
+
+	trace(TRACE_CONTEXT_SWITCH, prev->id, space->id);
+
+	uint64_t cpu_bit = 1ull << cpu_id();
+
+	// Join the address space before reading its tlb_gen, so any change made after
+	// the read either sees this core in cpus or is caught by the next switch
+	__atomic_or_fetch(&space->cpus, cpu_bit, __ATOMIC_SEQ_CST);
+	uint64_t gen = __atomic_load_n(&space->tlb_gen, __ATOMIC_SEQ_CST);
+
+	uint64_t cr3 = space->pml4;
+
+	if (paging_pcid_enabled) {
+		pcid_cache_t* cache = this_cpu_ptr(pcid_cache);
+		int32_t slot = pcid_find(cache, space);
+
+		if (slot >= 0 && cache->slots[slot].tlb_gen == gen) {
+			// Nothing changed since this core last ran in it
+			cr3 |= CR3_NOFLUSH;
+		}
+		else if (slot < 0) {
+			slot = cache->next_victim;
+			cache->next_victim = (cache->next_victim + 1) % PCID_SLOTS;
+			cache->slots[slot].space_id = space->id;
+		}
+
+		// Without the no flush bit, loading CR3 clears whatever the PCID held before
+		cache->slots[slot].tlb_gen = gen;
+		cr3 |= slot + 1;
+	}
+
+	write_cr3(cr3);
+
+	this_cpu_write(current_space, space);
+	__atomic_and_fetch(&prev->cpus, ~cpu_bit, __ATOMIC_SEQ_CST);
+
+	irq_restore(flags);
+}
+
+void* paging_map_mmio(uint64_t phys, uint64_t size) {
+
+	uint64_t offset = phys & (PAGE_SIZE - 1);
+	uint64_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	// MMIO mappings are never removed, so the window is handed out in order
+	uint64_t virt = __atomic_fetch_add(&paging_mmio_next, pages * PAGE_SIZE, __ATOMIC_SEQ_CST);
+	uint64_t flags = PAGE_WRITE | PAGE_PCD | PAGE_PWT | PAGE_GLOBAL;
+
+	for (uint64_t i = 0; i < pages; i++) {
+		if (paging_map(&kernel_address_space, virt + i * PAGE_SIZE, phys - offset + i * PAGE_SIZE, flags) != 0) {
+			return 0;
+		}
+	}
+
+	return (void*)(virt + offset);
+}
+EXPORT_SYMBOL(paging_map_mmio);
 
+address_space_t* paging_current(void) {
+	return this_cpu_read(current_space);
+}
@@ -0,0 +1,604 @@
+/*
+ * evan-os/src/pci.c
+ *
+ * PCI enumeration and driver matching. Each ECAM window gives every
+ * function 4 KiB of memory mapped configuration space. The windows are
+ * mapped one bus (1 MiB) at a time, the first time a bus is touched, so
+ * empty buses cost no page tables.
+ *
+ * The legacy ports select a register with one write and then access it
+ * with another, so they are used under a lock.
+ *
+ */
+
+#include <pci.h>
+
+#include <acpi.h>
+#include <asm.h>
+#include <idle.h>
+#include <kernel.h>
+#include <kmalloc.h>
+#include <module.h>
+#include <paging.h>
+#include <percpu.h>
+#include <procfs.h>
+#include <spinlock.h>
+#include <tty.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA    0xcfc
+
+#define PCI_ECAM_BUS_SIZE (1 << 20)
+
+#define PCI_HEADER_MULTIFUNCTION 0x80
+#define PCI_HEADER_BRIDGE        0x01
+
+#define PCI_CLASS_BRIDGE        0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+#define PCI_BAR_IO      0x1
+#define PCI_BAR_64      0x4 // Memory BAR type bits
+#define PCI_BAR_TYPE    0x6
+
+typedef struct mcfg_entry_t {
+	uint64_t base;
+	uint16_t segment;
+	uint8_t  start_bus;
+	uint8_t  end_bus;
+	uint32_t reserved;
+} __attribute__((packed)) mcfg_entry_t;
+
+typedef struct pci_ecam_t {
+	uint64_t          base;      // Physical address of bus 0, even if the window starts later
+	uint16_t          segment;
+	uint8_t           start_bus;
+	uint8_t           end_bus;
+	volatile uint8_t* buses[256]; // Mapped buses
+} pci_ecam_t;
+
+typedef struct pci_driver_t pci_driver_t;
+
+struct pci_driver_t {
+	uint32_t      id; // Vendor in the top 16 bits and device in the bottom, or the class for class drivers
+	module_t*     module;
+	pci_driver_t* next;
+};
+
+pci_ecam_t pci_ecams[PCI_ECAM_MAX];
+uint32_t pci_ecam_count;
+bool pci_ecam_enabled;
+
+// Protects mapping ECAM buses, and the legacy ports
+spinlock_t pci_config_lock;
+
+pci_device_t* pci_devices;
+pci_device_t* pci_devices_tail;
+uint32_t pci_device_count;
+
+// Buses already scanned, so a misconfigured bridge can not make the scan loop
+uint64_t pci_scanned[PCI_ECAM_MAX][4];
+
+pci_driver_t* pci_drivers[PCI_DRIVER_BUCKETS];
+
+// Drivers matching on class, a short list
+pci_driver_t* pci_class_drivers;
+
+// Probes queued or running
+volatile uint32_t pci_probes_pending;
+
+static uint32_t pci_driver_hash(uint32_t id) {
+	return (id * 2654435761u) >> (32 - PCI_DRIVER_HASH_BITS);
+}
+
+static pci_ecam_t* pci_ecam_of(uint16_t segment, uint8_t bus) {
+
+	for (uint32_t i = 0; i < pci_ecam_count; i++) {
+		if (pci_ecams[i].segment == segment && bus >= pci_ecams[i].start_bus && bus <= pci_ecams[i].end_bus) {
+			return &pci_ecams[i];
+		}
+	}
+
+	return 0;
+}
+
+// A function's configuration space through ECAM, or 0 if no window covers it
+static volatile uint8_t* pci_ecam_config(uint16_t segment, uint8_t bus, uint8_t slot, uint8_t function) {
+
+	pci_ecam_t* ecam = pci_ecam_of(segment, bus);
+	if (ecam == 0) {
+		return 0;
+	}
+
+	volatile uint8_t* mapped = __atomic_load_n(&ecam->buses[bus], __ATOMIC_ACQUIRE);
+
+	if (mapped == 0) {
+		uint64_t flags = spin_lock_irqsave(&pci_config_lock);
+
+		mapped = ecam->buses[bus];
+		if (mapped == 0) {
+			mapped = paging_map_mmio(ecam->base + (uint64_t)bus * PCI_ECAM_BUS_SIZE, PCI_ECAM_BUS_SIZE);
+			__atomic_store_n(&ecam->buses[bus], mapped, __ATOMIC_RELEASE);
+		}
+
+		spin_unlock_irqrestore(&pci_config_lock, flags);
+
+		if (mapped == 0) {
+			return 0;
+		}
+	}
+
+	return mapped + ((uint32_t)slot << 15 | (uint32_t)function << 12);
+}
+
+static uint32_t pci_legacy_address(uint8_t bus, uint8_t slot, uint8_t function, uint16_t offset) {
+	return 0x80000000 | (uint32_t)bus << 16 | (uint32_t)slot << 11 | (uint32_t)function << 8 | (offset & 0xfc);
+}
+
+// Read a register of size 1, 2 or 4 bytes. Anything nothing answers reads as all ones
+static uint32_t pci_config_read(uint16_t segment, uint8_t bus, uint8_t slot, uint8_t function, uint16_t offset, uint8_t size) {
+
+	if (pci_ecam_enabled) {
+		volatile uint8_t* config = pci_ecam_config(segment, bus, slot, function);
+		if (config == 0 || offset >= 4096) {
+			return 0xffffffff;
+		}
+
+		switch (size) {
+			case 1:
+				return *(volatile uint8_t*)(config + offset);
+			case 2:
+				return *(volatile uint16_t*)(config + offset);
+			default:
+				return *(volatile uint32_t*)(config + offset);
+		}
+	}
+
+	if (segment != 0 || offset >= 256) {
+		return 0xffffffff;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&pci_config_lock);
+
+	outportl(PCI_CONFIG_ADDRESS, pci_legacy_address(bus, slot, function, offset));
+	uint32_t value = inportl(PCI_CONFIG_DATA) >> ((offset & 3) * 8);
+
+	spin_unlock_irqrestore(&pci_config_lock, flags);
+
+	if (size == 1) {
+		return value & 0xff;
+	}
+	if (size == 2) {
+		return value & 0xffff;
+	}
+	return value;
+}
+
+static void pci_config_write(uint16_t segment, uint8_t bus, uint8_t slot, uint8_t function, uint16_t offset, uint8_t size, uint32_t value) {
+
+	if (pci_ecam_enabled) {
+		volatile uint8_t* config = pci_ecam_config(segment, bus, slot, function);
+		if (config == 0 || offset >= 4096) {
+			return;
+		}
+
+		switch (size) {
+			case 1:
+				*(volatile uint8_t*)(config + offset) = value;
+				break;
+			case 2:
+				*(volatile uint16_t*)(config + offset) = value;
+				break;
+			default:
+				*(volatile uint32_t*)(config + offset) = value;
+				break;
+		}
+		return;
+	}
+
+	if (segment != 0 || offset >= 256) {
+		return;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&pci_config_lock);
+
+	outportl(PCI_CONFIG_ADDRESS, pci_legacy_address(bus, slot, function, offset));
+
+	// Narrow writes go to the matching bytes of the data port, leaving the rest of the register alone
+	switch (size) {
+		case 1:
+			outportb(PCI_CONFIG_DATA + (offset & 3), value);
+			break;
+		case 2:
+			outportw(PCI_CONFIG_DATA + (offset & 2), value);
+			break;
+		default:
+			outportl(PCI_CONFIG_DATA, value);
+			break;
+	}
+
+	spin_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+uint8_t pci_read8(pci_device_t* device, uint16_t offset) {
+	return pci_config_read(device->segment, device->bus, device->slot, device->function, offset, 1);
+}
+EXPORT_SYMBOL(pci_read8);
+
+uint16_t pci_read16(pci_device_t* device, uint16_t offset) {
+	return pci_config_read(device->segment, device->bus, device->slot, device->function, offset, 2);
+}
+EXPORT_SYMBOL(pci_read16);
+
+uint32_t pci_read32(pci_device_t* device, uint16_t offset) {
+	return pci_config_read(device->segment, device->bus, device->slot, device->function, offset, 4);
+}
+EXPORT_SYMBOL(pci_read32);
+
+void pci_write8(pci_device_t* device, uint16_t offset, uint8_t value) {
+	pci_config_write(device->segment, device->bus, device->slot, device->function, offset, 1, value);
+}
+EXPORT_SYMBOL(pci_write8);
+
+void pci_write16(pci_device_t* device, uint16_t offset, uint16_t value) {
+	pci_config_write(device->segment, device->bus, device->slot, device->function, offset, 2, value);
+}
+EXPORT_SYMBOL(pci_write16);
+
+void pci_write32(pci_device_t* device, uint16_t offset, uint32_t value) {
+	pci_config_write(device->segment, device->bus, device->slot, device->function, offset, 4, value);
+}
+EXPORT_SYMBOL(pci_write32);
+
+void pci_enable(pci_device_t* device) {
+	uint16_t command = pci_read16(device, PCI_COMMAND);
+	pci_write16(device, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
+EXPORT_SYMBOL(pci_enable);
+
+uint16_t pci_find_next_capability(pci_device_t* device, uint16_t from, uint8_t id) {
+
+	if (!(pci_read16(device, PCI_STATUS) & PCI_STATUS_CAPABILITIES)) {
+		return 0;
+	}
+
+	// Each capability starts with its id and the offset of the next. The limit stops a looping list
+	uint16_t offset = (from != 0 ? pci_read8(device, from + 1) : pci_read8(device, PCI_CAPABILITIES)) & 0xfc;
+	for (uint32_t i = 0; offset != 0 && i < 48; i++) {
+		if (pci_read8(device, offset) == id) {
+			return offset;
+		}
+		offset = pci_read8(device, offset + 1) & 0xfc;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(pci_find_next_capability);
+
+uint16_t pci_find_capability(pci_device_t* device, uint8_t id) {
+	return pci_find_next_capability(device, 0, id);
+}
+EXPORT_SYMBOL(pci_find_capability);
+
+uint64_t pci_bar(pci_device_t* device, uint8_t index, uint64_t* size) {
+
+	// Bridges only have two
+	uint8_t count = device->header_type == PCI_HEADER_BRIDGE ? 2 : 6;
+	if (index >= count) {
+		return 0;
+	}
+
+	uint16_t offset = PCI_BAR0 + index * 4;
+	uint32_t low = pci_read32(device, offset);
+	bool io = low & PCI_BAR_IO;
+	bool wide = !io && (low & PCI_BAR_TYPE) == PCI_BAR_64 && index + 1 < count;
+
+	uint64_t address = io ? low & ~0x3u : low & ~0xfu;
+	if (wide) {
+		address |= (uint64_t)pci_read32(device, offset + 4) << 32;
+	}
+
+	if (size != 0) {
+		// Writing all ones reads back the bits the device decodes. Decoding is off meanwhile,
+		// so the BAR briefly pointing somewhere else is never used
+		uint16_t command = pci_read16(device, PCI_COMMAND);
+		pci_write16(device, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+		pci_write32(device, offset, 0xffffffff);
+		uint64_t mask = pci_read32(device, offset) & (io ? ~0x3u : ~0xfu);
+		pci_write32(device, offset, low);
+
+		if (wide) {
+			uint32_t high = pci_read32(device, offset + 4);
+			pci_write32(device, offset + 4, 0xffffffff);
+			mask |= (uint64_t)pci_read32(device, offset + 4) << 32;
+			pci_write32(device, offset + 4, high);
+		}
+		else {
+			mask |= io ? 0xffffffffffff0000 : 0xffffffff00000000;
+		}
+
+		pci_write16(device, PCI_COMMAND, command);
+		*size = mask == 0 ? 0 : ~mask + 1;
+	}
+
+	return address;
+}
+EXPORT_SYMBOL(pci_bar);
+
+pci_device_t* pci_find_device(uint16_t vendor, uint16_t device, pci_device_t* from) {
+
+	for (pci_device_t* found = from != 0 ? from->next : pci_devices; found != 0; found = found->next) {
+		if (found->vendor == vendor && found->device == device) {
+			return found;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(pci_find_device);
+
+static void pci_scan_bus(uint16_t segment, uint32_t ecam, uint8_t bus);
+
+static void pci_add_function(uint16_t segment, uint32_t ecam, uint8_t bus, uint8_t slot, uint8_t function) {
+
+	pci_device_t* device = kzalloc(sizeof(pci_device_t));
+	if (device == 0) {
+		return;
+	}
+
+	device->segment = segment;
+	device->bus = bus;
+	device->slot = slot;
+	device->function = function;
+
+	uint32_t id = pci_read32(device, PCI_VENDOR_ID);
+	uint32_t class = pci_read32(device, PCI_REVISION);
+
+	device->vendor = id & 0xffff;
+	device->device = id >> 16;
+	device->revision = class & 0xff;
+	device->prog_if = (class >> 8) & 0xff;
+	device->subclass = (class >> 16) & 0xff;
+	device->class_code = class >> 24;
+	device->header_type = pci_read8(device, PCI_HEADER_TYPE) & ~PCI_HEADER_MULTIFUNCTION;
+	device->interrupt_line = pci_read8(device, PCI_INTERRUPT_LINE);
+	device->interrupt_pin = pci_read8(device, PCI_INTERRUPT_PIN);
+
+	if (pci_devices_tail != 0) {
+		pci_devices_tail->next = device;
+	}
+	else {
+		pci_devices = device;
+	}
+	pci_devices_tail = device;
+	pci_device_count++;
+
+	if (device->header_type == PCI_HEADER_BRIDGE && device->class_code == PCI_CLASS_BRIDGE && device->subclass == PCI_SUBCLASS_PCI_BRIDGE) {
+		pci_scan_bus(segment, ecam, pci_read8(device, PCI_SECONDARY_BUS));
+	}
+}
+
+static void pci_scan_bus(uint16_t segment, uint32_t ecam, uint8_t bus) {
+
+	if (pci_scanned[ecam][bus / 64] & (1ull << (bus % 64))) {
+		return;
+	}
+	pci_scanned[ecam][bus / 64] |= 1ull << (bus % 64);
+
+	for (uint8_t slot = 0; slot < 32; slot++) {
+		if (pci_config_read(segment, bus, slot, 0, PCI_VENDOR_ID, 2) == 0xffff) {
+			continue;
+		}
+
+		bool multifunction = pci_config_read(segment, bus, slot, 0, PCI_HEADER_TYPE, 1) & PCI_HEADER_MULTIFUNCTION;
+
+		for (uint8_t function = 0; function < (multifunction ? 8 : 1); function++) {
+			if (pci_config_read(segment, bus, slot, function, PCI_VENDOR_ID, 2) != 0xffff) {
+				pci_add_function(segment, ecam, bus, slot, function);
+			}
+		}
+	}
+}
+
+// Scan from a segment's first bus. A multi-function host bridge has a root bus for each function
+static void pci_scan_segment(uint16_t segment, uint32_t ecam, uint8_t start_bus) {
+
+	if (pci_config_read(segment, start_bus, 0, 0, PCI_HEADER_TYPE, 1) & PCI_HEADER_MULTIFUNCTION) {
+		for (uint8_t function = 0; function < 8; function++) {
+			if (pci_config_read(segment, start_bus, 0, function, PCI_VENDOR_ID, 2) != 0xffff) {
+				pci_scan_bus(segment, ecam, start_bus + function);
+			}
+		}
+	}
+	else {
+		pci_scan_bus(segment, ecam, start_bus);
+	}
+}
+
+static void pci_show_devices(procfs_buffer_t* buffer) {
+
+	procfs_print(buffer, "Segment  Bus  Slot  Function  Vendor  Device  Class  Driver\n");
+
+	for (pci_device_t* device = pci_devices; device != 0; device = device->next) {
+		procfs_print_dec(buffer, device->segment, 7);
+		procfs_print_dec(buffer, device->bus, 5);
+		procfs_print_dec(buffer, device->slot, 6);
+		procfs_print_dec(buffer, device->function, 10);
+		procfs_print(buffer, "  ");
+		procfs_print_hex(buffer, device->vendor);
+		procfs_print(buffer, "  ");
+		procfs_print_hex(buffer, device->device);
+		procfs_print(buffer, "  ");
+		procfs_print_hex(buffer, (uint32_t)device->class_code << 16 | (uint32_t)device->subclass << 8 | device->prog_if);
+		procfs_print(buffer, "  ");
+
+		if (device->driver == 0) {
+			procfs_print(buffer, "-");
+		}
+		else {
+			procfs_print(buffer, device->driver->info->name);
+			if (device->probe_state == PCI_PROBE_FAILED) {
+				procfs_print(buffer, " (failed)");
+			}
+		}
+		procfs_print(buffer, "\n");
+	}
+}
+
+void pci_init(void) {
+
+	acpi_header_t* mcfg = acpi_find_table(ACPI_SIGNATURE('M', 'C', 'F', 'G'), 0);
+
+	if (mcfg != 0) {
+		// The entries follow 8 reserved bytes after the header
+		mcfg_entry_t* entry = (mcfg_entry_t*)((uint8_t*)mcfg + sizeof(acpi_header_t) + 8);
+		mcfg_entry_t* end = (mcfg_entry_t*)((uint8_t*)mcfg + mcfg->length);
+
+		for (; entry + 1 <= end && pci_ecam_count < PCI_ECAM_MAX; entry++) {
+			pci_ecam_t* ecam = &pci_ecams[pci_ecam_count++];
+			ecam->base = entry->base;
+			ecam->segment = entry->segment;
+			ecam->start_bus = entry->start_bus;
+			ecam->end_bus = entry->end_bus;
+		}
+	}
+
+	pci_ecam_enabled = pci_ecam_count != 0;
+
+	if (pci_ecam_enabled) {
+		for (uint32_t i = 0; i < pci_ecam_count; i++) {
+			pci_scan_segment(pci_ecams[i].segment, i, pci_ecams[i].start_bus);
+		}
+	}
+	else {
+		pci_scan_segment(0, 0, 0);
+	}
+
+	procfs_register("pci", &pci_show_devices);
+
+	print_dec(pci_device_count);
+	tty_print_string(pci_ecam_enabled ? " PCI function(s) found through ECAM\n" : " PCI function(s) found through port I/O\n");
+}
+
+// Add every PCI driver module to the id hash table
+static void pci_hash_drivers(void) {
+
+	for (module_t* module = module_list; module != 0; module = module->next) {
+		if (module->connection_type != DEV_CONNECTION_PCI) {
+			continue;
+		}
+
+		pci_driver_t* driver = kmalloc(sizeof(pci_driver_t));
+		if (driver == 0) {
+			return;
+		}
+
+		driver->module = module;
+
+		if (module->pci_vendor == PCI_ANY_ID && module->pci_device == PCI_ANY_ID) {
+			driver->id = module->pci_class;
+			driver->next = pci_class_drivers;
+			pci_class_drivers = driver;
+			continue;
+		}
+
+		driver->id = (uint32_t)module->pci_vendor << 16 | module->pci_device;
+
+		uint32_t bucket = pci_driver_hash(driver->id);
+		driver->next = pci_drivers[bucket];
+		pci_drivers[bucket] = driver;
+	}
+}
+
+static module_t* pci_match(pci_device_t* device) {
+
+	uint32_t id = (uint32_t)device->vendor << 16 | device->device;
+
+	for (pci_driver_t* driver = pci_drivers[pci_driver_hash(id)]; driver != 0; driver = driver->next) {
+		if (driver->id == id) {
+			return driver->module;
+		}
+	}
+
+	// Then drivers for every device of a vendor, which check the device id in their probe
+	id |= PCI_ANY_ID;
+
+	for (pci_driver_t* driver = pci_drivers[pci_driver_hash(id)]; driver != 0; driver = driver->next) {
+		if (driver->id == id) {
+			return driver->module;
+		}
+	}
+
+	// Drivers for a whole class, such as AHCI controllers, are only used if nothing matches the id
+	uint32_t class = (uint32_t)device->class_code << 16 | (uint32_t)device->subclass << 8 | device->prog_if;
+
+	for (pci_driver_t* driver = pci_class_drivers; driver != 0; driver = driver->next) {
+		if (driver->id == class) {
+			return driver->module;
+		}
+	}
+
+	return 0;
+}
+
+// Run a device's probe, unless another core already has
+static void pci_probe(void* arg) {
+
+	pci_device_t* device = arg;
+
+	uint8_t state = PCI_PROBE_QUEUED;
+	if (!__atomic_compare_exchange_n(&device->probe_state, &state, PCI_PROBE_RUNNING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	pci_probe_t probe = (pci_probe_t)device->driver->info->connection_data.pci.probe;
+	uint8_t error = probe(device);
+
+	__atomic_store_n(&device->probe_state, error == 0 ? PCI_PROBE_DONE : PCI_PROBE_FAILED, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&pci_probes_pending, 1, __ATOMIC_RELEASE);
+}
+
+void pci_probe_drivers(void) {
+
+	pci_hash_drivers();
+
+	// Modules are linked one at a time anyway, so load them all before probing anything
+	for (pci_device_t* device = pci_devices; device != 0; device = device->next) {
+		module_t* module = pci_match(device);
+		if (module == 0 || module_load(module) != MODULE_SUCCESS || module->info->connection_data.pci.probe == 0) {
+			continue;
+		}
+
+		device->driver = module;
+		device->probe_state = PCI_PROBE_QUEUED;
+		pci_probes_pending++;
+	}
+
+	// Hand the probes to the other cores in turn
+	uint32_t cpu = 0;
+	if (cpu_count > 1) {
+		for (pci_device_t* device = pci_devices; device != 0; device = device->next) {
+			if (device->probe_state != PCI_PROBE_QUEUED) {
+				continue;
+			}
+
+			cpu = cpu % (cpu_count - 1) + 1;
+			device->probe_work.func = &pci_probe;
+			device->probe_work.arg = device;
+			idle_queue_work(cpu, &device->probe_work);
+		}
+	}
+
+	// Other cores may be busy with something that waits for this one, so take any probe
+	// none of them has started yet. The work left queued finds it done and returns
+	for (pci_device_t* device = pci_devices; device != 0; device = device->next) {
+		pci_probe(device);
+	}
+
+	while (__atomic_load_n(&pci_probes_pending, __ATOMIC_ACQUIRE) != 0) {
+		pause();
+	}
+}
@@ -0,0 +1,80 @@
+/*
+ * evan-os/src/percpu.c
+ *
+ * Sets up the per-CPU data areas. The .percpu section linked into the
+ * kernel is only a template, every core (including the bootstrap core)
+ * copies it into its own area reserved at the end of .bss.
+ *
+ */
+
+#include <percpu.h>
+
+#include <bootboot.h>
+#include <asm.h>
+#include <module.h>
+#include <string.h>
+
+#include <stdint.h>
+
+#define MSR_GS_BASE 0xC0000101
+
+DEFINE_PER_CPU(uint64_t, offset);
+EXPORT_SYMBOL(percpu_offset);
+DEFINE_PER_CPU(uint32_t, cpu_id);
+EXPORT_SYMBOL(percpu_cpu_id);
+DEFINE_PER_CPU(uint32_t, apic_id);
+
+uint64_t percpu_offsets[CPU_MAX];
+EXPORT_SYMBOL(percpu_offsets);
+
+volatile uint32_t cpu_count;
+EXPORT_SYMBOL(cpu_count);
+
+// The next id handed out to an application processor
+volatile uint32_t percpu_next_id = 1;
+
+// Symbols from the linker script
+extern uint8_t __percpu_start[];
+extern uint8_t __percpu_end[];
+extern uint8_t __percpu_areas[];
+
+extern BOOTBOOT bootboot;
+
+void percpu_init(void) {
+
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	uint32_t apic_id = ebx >> 24;
+
+	// The bootstrap core is always core 0, the others are numbered as they arrive
+	uint32_t id = 0;
+	if (apic_id != bootboot.bspid) {
+		id = __atomic_fetch_add(&percpu_next_id, 1, __ATOMIC_SEQ_CST);
+	}
+
+	// There is no area for this core, so it can not run the kernel
+	if (id >= CPU_MAX) {
+		while (1) {
+			cli();
+			hlt();
+		}
+	}
+
+	uint64_t size = (uint64_t)(__percpu_end - __percpu_start);
+	uint8_t* area = __percpu_areas + id * size;
+
+	// Copy the template's initial values
+	memcpy(area, __percpu_start, size);
+
+	uint64_t offset = (uint64_t)(area - __percpu_start);
+	percpu_offsets[id] = offset;
+
+	// Point GS at the area. Loading a segment selector would reset this
+	wrmsr(MSR_GS_BASE, (uint32_t)(offset & 0xffffffff), (uint32_t)(offset >> 32));
+
+	this_cpu_write(offset, offset);
+	this_cpu_write(cpu_id, id);
+	this_cpu_write(apic_id, apic_id);
+
+	__atomic_add_fetch(&cpu_count, 1, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,528 @@
+/*
+ * evan-os/src/pmm.c
+ *
+ * Physical page frame allocator. A set bit in the bitmap marks a frame
+ * that is in use or does not exist. The bitmap itself is placed in the
+ * first free region big enough to hold it, followed by the reference counts.
+ *
+ * Searches start in the SRAT ranges of the requesting core's node, then
+ * move on to the nearest other nodes, and finally scan the whole bitmap
+ * for memory the SRAT does not mention. Each core keeps a small stack
+ * of frames from its own node, so most single frame allocations and
+ * frees do not take the bitmap lock.
+ *
+ * Idle cores clear frames ahead of time into their node's zero pool.
+ * Frames in the pools and the per-CPU caches count as allocated, and
+ * pool frames are only taken back when memory runs out.
+ *
+ */
+
+#include <pmm.h>
+
+#include <bootboot.h>
+#include <module.h>
+#include <numa.h>
+#include <paging.h>
+#include <percpu.h>
+#include <spinlock.h>
+#include <string.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frames below this are left to firmware and real mode leftovers
+#define PMM_LOW_LIMIT 0x100000
+
+// Frames cleared by each pmm_zero_refill, so idle cores notice new work quickly
+#define PMM_ZERO_BATCH 8
+
+// Frames each core keeps, and how many move to or from the bitmap at a time
+#define PMM_CACHE_SIZE  32
+#define PMM_CACHE_BATCH 16
+
+typedef struct pmm_cache_t {
+	uint32_t count;
+	uint64_t frames[PMM_CACHE_SIZE]; // The most recently freed on top, still warm in the cache
+} pmm_cache_t;
+
+uint64_t pmm_total_frames;
+volatile uint64_t pmm_free_frames;
+
+uint64_t pmm_bitmap_phys;
+uint64_t pmm_counts_phys;
+
+// Frame numbers below which there are no free frames, for the whole bitmap and each SRAT range
+uint64_t pmm_hint;
+uint64_t pmm_range_hints[NUMA_MAX_RANGES];
+
+spinlock_t pmm_lock = SPINLOCK_INIT;
+
+DEFINE_PER_CPU(pmm_cache_t, pmm_cache);
+
+// Stacks of cleared frames. They can not hold a free list link without dirtying them
+uint64_t pmm_zero_pool[NUMA_MAX_NODES][PMM_ZERO_POOL_SIZE];
+volatile uint32_t pmm_zero_count[NUMA_MAX_NODES];
+spinlock_t pmm_zero_lock = SPINLOCK_INIT;
+
+volatile uint64_t pmm_zero_hits;
+volatile uint64_t pmm_zero_misses;
+
+extern BOOTBOOT bootboot;
+
+static inline uint64_t* pmm_bitmap(void) {
+	return phys_to_virt(pmm_bitmap_phys);
+}
+
+static inline volatile uint32_t* pmm_count(uint64_t frame) {
+	return (volatile uint32_t*)phys_to_virt(pmm_counts_phys) + frame / PAGE_SIZE;
+}
+
+static inline bool pmm_test(uint64_t frame) {
+	return (pmm_bitmap()[frame / 64] >> (frame % 64)) & 1;
+}
+
+static void pmm_mark(uint64_t frame, uint64_t count, bool used) {
+
+	uint64_t* bitmap = pmm_bitmap();
+
+	while (count != 0) {
+		// Whole words at once where possible
+		if (frame % 64 == 0 && count >= 64) {
+			bitmap[frame / 64] = used ? ~0ull : 0;
+			frame += 64;
+			count -= 64;
+			continue;
+		}
+
+		if (used) {
+			bitmap[frame / 64] |= 1ull << (frame % 64);
+		}
+		else {
+			bitmap[frame / 64] &= ~(1ull << (frame % 64));
+		}
+		frame++;
+		count--;
+	}
+}
+
+void pmm_init(void) {
+
+	MMapEnt* mmap_ent = &bootboot.mmap;
+	MMapEnt* mmap_end = (MMapEnt*)((uint8_t*)&bootboot + bootboot.size);
+
+	// Size the bitmap to cover the highest free frame
+	uint64_t top = 0;
+	for (MMapEnt* entry = mmap_ent; entry < mmap_end; entry++) {
+		uint64_t end = MMapEnt_Ptr(entry) + MMapEnt_Size(entry);
+		if (MMapEnt_IsFree(entry) && end > top) {
+			top = end;
+		}
+	}
+
+	pmm_total_frames = top / PAGE_SIZE;
+	uint64_t bitmap_size = (pmm_total_frames + 63) / 64 * 8;
+	uint64_t counts_size = pmm_total_frames * sizeof(uint32_t);
+	uint64_t metadata_size = ((bitmap_size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1)) + counts_size;
+
+	// Find a home for the bitmap and counts
+	for (MMapEnt* entry = mmap_ent; entry < mmap_end; entry++) {
+		uint64_t start = (MMapEnt_Ptr(entry) + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+		uint64_t end = MMapEnt_Ptr(entry) + MMapEnt_Size(entry);
+
+		if (start < PMM_LOW_LIMIT) {
+			start = PMM_LOW_LIMIT;
+		}
+
+		if (MMapEnt_IsFree(entry) && end > start && end - start >= metadata_size) {
+			pmm_bitmap_phys = start;
+			pmm_counts_phys = start + metadata_size - counts_size;
+			break;
+		}
+	}
+
+	// Everything starts used, then the free regions are released
+	memset(pmm_bitmap(), 0xff, bitmap_size);
+	memset(phys_to_virt(pmm_counts_phys), 0, counts_size);
+
+	for (MMapEnt* entry = mmap_ent; entry < mmap_end; entry++) {
+		if (!MMapEnt_IsFree(entry)) {
+			continue;
+		}
+
+		// Only whole frames can be handed out
+		uint64_t start = (MMapEnt_Ptr(entry) + PAGE_SIZE - 1) / PAGE_SIZE;
+		uint64_t end = (MMapEnt_Ptr(entry) + MMapEnt_Size(entry)) / PAGE_SIZE;
+
+		if (start < PMM_LOW_LIMIT / PAGE_SIZE) {
+			start = PMM_LOW_LIMIT / PAGE_SIZE;
+		}
+
+		if (end > start) {
+			pmm_mark(start, end - start, false);
+			pmm_free_frames += end - start;
+		}
+	}
+
+	uint64_t metadata_frames = (metadata_size + PAGE_SIZE - 1) / PAGE_SIZE;
+	pmm_mark(pmm_bitmap_phys / PAGE_SIZE, metadata_frames, true);
+	pmm_free_frames -= metadata_frames;
+
+	for (uint32_t i = 0; i < numa_range_count; i++) {
+		pmm_range_hints[i] = numa_ranges[i].start;
+	}
+}
+
+// Take the first free frame number in [start, end), searching from *hint. Returns 0 if there is none.
+// Called with pmm_lock held
+static uint64_t pmm_take_range(uint64_t start, uint64_t end, uint64_t* hint) {
+
+	uint64_t* bitmap = pmm_bitmap();
+
+	if (end > pmm_total_frames) {
+		end = pmm_total_frames;
+	}
+
+	for (uint64_t frame = *hint > start ? *hint : start; frame < end; frame = (frame & ~63ull) + 64) {
+		uint64_t free = ~bitmap[frame / 64] & (~0ull << (frame % 64));
+		if (free == 0) {
+			continue;
+		}
+
+		frame = (frame & ~63ull) + __builtin_ctzll(free);
+		if (frame >= end) {
+			break;
+		}
+
+		bitmap[frame / 64] |= 1ull << (frame % 64);
+		pmm_free_frames--;
+		*hint = frame;
+		return frame;
+	}
+
+	*hint = end;
+	return 0;
+}
+
+// Take a free frame number, preferring node and then the nodes nearest to it. Called with pmm_lock held
+static uint64_t pmm_take(uint32_t node) {
+
+	for (uint32_t i = 0; i < numa_node_count; i++) {
+		uint32_t near = numa_fallback[node][i];
+
+		for (uint32_t range = 0; range < numa_range_count; range++) {
+			if (numa_ranges[range].node != near) {
+				continue;
+			}
+
+			uint64_t frame = pmm_take_range(numa_ranges[range].start, numa_ranges[range].end, &pmm_range_hints[range]);
+			if (frame != 0) {
+				return frame;
+			}
+		}
+	}
+
+	// Memory outside the SRAT, or everything when there is none
+	return pmm_take_range(0, pmm_total_frames, &pmm_hint);
+}
+
+// Lower the search hints after frames were freed. Called with pmm_lock held
+static void pmm_lower_hints(uint64_t frame, uint64_t count) {
+
+	if (frame < pmm_hint) {
+		pmm_hint = frame;
+	}
+
+	for (uint32_t i = 0; i < numa_range_count; i++) {
+		uint64_t start = numa_ranges[i].start > frame ? numa_ranges[i].start : frame;
+		if (start < numa_ranges[i].end && start < frame + count && start < pmm_range_hints[i]) {
+			pmm_range_hints[i] = start;
+		}
+	}
+}
+
+// Fill frames with up to count frame addresses from the bitmap, returning how many were found
+static uint32_t pmm_alloc_batch(uint32_t node, uint64_t* frames, uint32_t count) {
+
+	uint32_t found = 0;
+	uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+	while (found < count) {
+		uint64_t frame = pmm_take(node);
+		if (frame == 0) {
+			break;
+		}
+		frames[found++] = frame * PAGE_SIZE;
+	}
+
+	spin_unlock_irqrestore(&pmm_lock, flags);
+
+	return found;
+}
+
+static void pmm_free_batch(uint64_t* frames, uint32_t count) {
+
+	uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t frame = frames[i] / PAGE_SIZE;
+		pmm_mark(frame, 1, false);
+		pmm_lower_hints(frame, 1);
+	}
+	pmm_free_frames += count;
+
+	spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+// Take a frame from a node's zero pool, or return 0 if it is empty
+static uint64_t pmm_zero_take(uint32_t node) {
+
+	uint64_t frame = 0;
+	uint64_t flags = spin_lock_irqsave(&pmm_zero_lock);
+
+	if (pmm_zero_count[node] != 0) {
+		frame = pmm_zero_pool[node][--pmm_zero_count[node]];
+	}
+
+	spin_unlock_irqrestore(&pmm_zero_lock, flags);
+
+	if (frame != 0) {
+		*pmm_count(frame) = 1;
+	}
+
+	return frame;
+}
+
+// Out of memory, except for the frames waiting in the zero pools
+static uint64_t pmm_zero_reclaim(uint32_t node) {
+
+	for (uint32_t i = 0; i < numa_node_count; i++) {
+		uint64_t frame = pmm_zero_take(numa_fallback[node][i]);
+		if (frame != 0) {
+			return frame;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t pmm_alloc_page(void) {
+
+	uint64_t frame = 0;
+	uint64_t flags = irq_save();
+
+	pmm_cache_t* cache = this_cpu_ptr(pmm_cache);
+	if (cache->count == 0) {
+		cache->count = pmm_alloc_batch(numa_node(), cache->frames, PMM_CACHE_BATCH);
+	}
+	if (cache->count != 0) {
+		frame = cache->frames[--cache->count];
+	}
+
+	irq_restore(flags);
+
+	if (frame == 0) {
+		return pmm_zero_reclaim(numa_node());
+	}
+
+	*pmm_count(frame) = 1;
+	return frame;
+}
+EXPORT_SYMBOL(pmm_alloc_page);
+
+uint64_t pmm_alloc_page_node(uint32_t node) {
+
+	uint64_t frame;
+	if (pmm_alloc_batch(node, &frame, 1) == 0) {
+		return pmm_zero_reclaim(node);
+	}
+
+	*pmm_count(frame) = 1;
+	return frame;
+}
+
+uint64_t pmm_alloc_zeroed(void) {
+
+	// A cleared frame from another node would cost more on every access than clearing a local one now
+	uint64_t frame = pmm_zero_take(numa_node());
+	if (frame != 0) {
+		__atomic_add_fetch(&pmm_zero_hits, 1, __ATOMIC_RELAXED);
+		return frame;
+	}
+
+	__atomic_add_fetch(&pmm_zero_misses, 1, __ATOMIC_RELAXED);
+
+	frame = pmm_alloc_page();
+	if (frame != 0) {
+		// A cached clear, since whoever asked is about to use the frame
+		memset(phys_to_virt(frame), 0, PAGE_SIZE);
+	}
+
+	return frame;
+}
+
+bool pmm_zero_refill(void) {
+
+	uint32_t node = numa_node();
+	bool cleared = false;
+
+	for (uint32_t i = 0; i < PMM_ZERO_BATCH && pmm_zero_count[node] < PMM_ZERO_POOL_SIZE; i++) {
+
+		// Leave the last free frames for real allocations
+		if (pmm_free_frames < PMM_ZERO_POOL_SIZE) {
+			return cleared;
+		}
+
+		uint64_t frame;
+		if (pmm_alloc_batch(node, &frame, 1) == 0) {
+			return cleared;
+		}
+
+		// The node has run out, and the frame came from a farther one
+		if (numa_node_of_frame(frame) != node) {
+			pmm_free_batch(&frame, 1);
+			return cleared;
+		}
+
+		// Nobody will read the frame soon, so keep it out of the cache
+		clear_page(phys_to_virt(frame));
+
+		uint64_t flags = spin_lock_irqsave(&pmm_zero_lock);
+		bool stored = pmm_zero_count[node] < PMM_ZERO_POOL_SIZE;
+		if (stored) {
+			pmm_zero_pool[node][pmm_zero_count[node]++] = frame;
+		}
+		spin_unlock_irqrestore(&pmm_zero_lock, flags);
+
+		// Another idle core filled the pool first
+		if (!stored) {
+			pmm_free_batch(&frame, 1);
+			return cleared;
+		}
+		cleared = true;
+	}
+
+	return cleared;
+}
+
+// First fit run of count frames in [start, end). Called with pmm_lock held
+static uint64_t pmm_take_run(uint64_t start, uint64_t end, uint64_t count) {
+
+	if (end > pmm_total_frames) {
+		end = pmm_total_frames;
+	}
+
+	uint64_t run = 0;
+	for (uint64_t frame = start; frame < end; frame++) {
+		if (pmm_test(frame)) {
+			run = 0;
+			continue;
+		}
+
+		if (++run == count) {
+			uint64_t first = frame + 1 - count;
+			pmm_mark(first, count, true);
+			pmm_free_frames -= count;
+			return first;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t pmm_alloc_pages_node(uint32_t node, uint64_t count) {
+
+	if (count == 1) {
+		return pmm_alloc_page_node(node);
+	}
+
+	uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+	// Only drivers and early setup ask for contiguous runs, so this does not need to be fast
+	uint64_t first = 0;
+	for (uint32_t i = 0; i < numa_node_count && first == 0; i++) {
+		uint32_t near = numa_fallback[node][i];
+
+		for (uint32_t range = 0; range < numa_range_count && first == 0; range++) {
+			if (numa_ranges[range].node == near) {
+				first = pmm_take_run(pmm_range_hints[range], numa_ranges[range].end, count);
+			}
+		}
+	}
+
+	if (first == 0) {
+		first = pmm_take_run(pmm_hint, pmm_total_frames, count);
+	}
+
+	spin_unlock_irqrestore(&pmm_lock, flags);
+
+	for (uint64_t i = 0; first != 0 && i < count; i++) {
+		*pmm_count((first + i) * PAGE_SIZE) = 1;
+	}
+
+	return first * PAGE_SIZE;
+}
+
+uint64_t pmm_alloc_pages(uint64_t count) {
+
+	if (count == 1) {
+		return pmm_alloc_page();
+	}
+
+	return pmm_alloc_pages_node(numa_node(), count);
+}
+EXPORT_SYMBOL(pmm_alloc_pages);
+
+void pmm_free_pages(uint64_t frame, uint64_t count) {
+
+	if (count == 1) {
+		pmm_free_page(frame);
+		return;
+	}
+
+	uint64_t flags = spin_lock_irqsave(&pmm_lock);
+
+	frame /= PAGE_SIZE;
+	pmm_mark(frame, count, false);
+	pmm_free_frames += count;
+	pmm_lower_hints(frame, count);
+
+	spin_unlock_irqrestore(&pmm_lock, flags);
+}
+EXPORT_SYMBOL(pmm_free_pages);
+
+void pmm_free_page(uint64_t frame) {
+
+	// Frames from other nodes go straight back, so the cache only ever hands out local memory
+	if (numa_node_of_frame(frame) != numa_node()) {
+		pmm_free_batch(&frame, 1);
+		return;
+	}
+
+	uint64_t flags = irq_save();
+
+	pmm_cache_t* cache = this_cpu_ptr(pmm_cache);
+	if (cache->count == PMM_CACHE_SIZE) {
+		// Give back the coldest frames from the bottom of the stack
+		pmm_free_batch(cache->frames, PMM_CACHE_BATCH);
+		memmove(cache->frames, cache->frames + PMM_CACHE_BATCH, (PMM_CACHE_SIZE - PMM_CACHE_BATCH) * sizeof(uint64_t));
+		cache->count -= PMM_CACHE_BATCH;
+	}
+	cache->frames[cache->count++] = frame;
+
+	irq_restore(flags);
+}
+EXPORT_SYMBOL(pmm_free_page);
+
+void pmm_page_get(uint64_t frame) {
+	__atomic_add_fetch(pmm_count(frame), 1, __ATOMIC_RELAXED);
+}
+
+void pmm_page_put(uint64_t frame) {
+	if (__atomic_sub_fetch(pmm_count(frame), 1, __ATOMIC_ACQ_REL) == 0) {
+		pmm_free_page(frame);
+	}
+}
+
+uint32_t pmm_page_count(uint64_t frame) {
+	return __atomic_load_n(pmm_count(frame), __ATOMIC_RELAXED);
+}
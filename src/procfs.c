@@ -0,0 +1,176 @@
+/*
+ * evan-os/src/procfs.c
+ *
+ * The process filesystem. Every open gets its own node and snapshot of
+ * the file, so readers never see a file change part way through.
+ *
+ */
+
+#include <procfs.h>
+
+#include <kmalloc.h>
+#include <module.h>
+#include <spinlock.h>
+#include <string.h>
+#include <vfs.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct procfs_file_t {
+	char          name[46];
+	procfs_show_t show;
+} procfs_file_t;
+
+procfs_file_t procfs_files[PROCFS_FILES];
+spinlock_t procfs_lock;
+
+superblock_t procfs_superblock;
+
+static inode_t* procfs_lookup(superblock_t* superblock, const char* path) {
+
+	procfs_show_t show = 0;
+	uint32_t id = 0;
+
+	spin_lock(&procfs_lock);
+	for (uint32_t i = 0; i < PROCFS_FILES; i++) {
+		if (procfs_files[i].show != 0 && strcmp(procfs_files[i].name, path) == 0) {
+			show = procfs_files[i].show;
+			id = i + 1;
+			break;
+		}
+	}
+	spin_unlock(&procfs_lock);
+
+	if (show == 0) {
+		return 0;
+	}
+
+	inode_t* inode = kzalloc(sizeof(inode_t));
+	procfs_buffer_t* buffer = kmalloc(sizeof(procfs_buffer_t));
+	char* data = kmalloc(PROCFS_BUFFER_SIZE);
+
+	if (inode == 0 || buffer == 0 || data == 0) {
+		kfree(inode);
+		kfree(buffer);
+		kfree(data);
+		return 0;
+	}
+
+	buffer->data = data;
+	buffer->length = 0;
+	show(buffer);
+
+	inode->id = id;
+	inode->type = FS_FILE;
+	inode->size = buffer->length;
+	inode->link_count = 1;
+	inode->superblock = superblock;
+	inode->private_data = buffer;
+
+	return inode;
+}
+
+static void procfs_release(inode_t* inode) {
+
+	procfs_buffer_t* buffer = inode->private_data;
+
+	kfree(buffer->data);
+	kfree(buffer);
+	kfree(inode);
+}
+
+static uint64_t procfs_read(inode_t* inode, uint32_t offset, uint32_t size, uint8_t* buffer) {
+
+	procfs_buffer_t* contents = inode->private_data;
+
+	if (offset >= contents->length) {
+		return FS_ERROR_END_OF_FILE;
+	}
+
+	if (size > contents->length - offset) {
+		size = contents->length - offset;
+	}
+
+	memcpy(buffer, contents->data + offset, size);
+
+	return FS_ERROR_SUCCESS;
+}
+
+void procfs_init(void) {
+
+	memcpy(procfs_superblock.fs_type, "procfs", 7);
+	procfs_superblock.ops.read_inode = &procfs_read;
+	procfs_superblock.ops.lookup = &procfs_lookup;
+	procfs_superblock.ops.release = &procfs_release;
+
+	vfs_mount("/proc", &procfs_superblock);
+}
+
+uint64_t procfs_register(const char* name, procfs_show_t show) {
+
+	if (strlen(name) >= sizeof(procfs_files[0].name)) {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	spin_lock(&procfs_lock);
+
+	for (uint32_t i = 0; i < PROCFS_FILES; i++) {
+		if (procfs_files[i].show == 0) {
+			memcpy(procfs_files[i].name, name, strlen(name) + 1);
+			procfs_files[i].show = show;
+
+			spin_unlock(&procfs_lock);
+			return FS_ERROR_SUCCESS;
+		}
+	}
+
+	spin_unlock(&procfs_lock);
+	return FS_ERROR_FAILURE;
+}
+EXPORT_SYMBOL(procfs_register);
+
+void procfs_print(procfs_buffer_t* buffer, const char* string) {
+
+	while (*string != '\0' && buffer->length < PROCFS_BUFFER_SIZE) {
+		buffer->data[buffer->length++] = *string++;
+	}
+}
+EXPORT_SYMBOL(procfs_print);
+
+void procfs_print_dec(procfs_buffer_t* buffer, uint64_t value, uint32_t width) {
+
+	char digits[21];
+	int i = 20;
+	digits[i] = '\0';
+
+	do {
+		digits[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+
+	for (uint32_t length = 20 - i; length < width; length++) {
+		procfs_print(buffer, " ");
+	}
+
+	procfs_print(buffer, &digits[i]);
+}
+EXPORT_SYMBOL(procfs_print_dec);
+
+void procfs_print_hex(procfs_buffer_t* buffer, uint64_t value) {
+
+	char digits[19];
+	int i = 18;
+	digits[i] = '\0';
+
+	do {
+		digits[--i] = "0123456789abcdef"[value & 0xf];
+		value >>= 4;
+	} while (value != 0);
+
+	digits[--i] = 'x';
+	digits[--i] = '0';
+
+	procfs_print(buffer, &digits[i]);
+}
+EXPORT_SYMBOL(procfs_print_hex);
@@ -0,0 +1,203 @@
+/*
+ * evan-os/src/profile.c
+ *
+ * Timer driven sampling profiler. Samples are raw instruction pointers,
+ * only resolved to functions through the symbol table when printed, so
+ * the timer interrupt stays short.
+ *
+ */
+
+#include <profile.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <buffer_cache.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <kmalloc.h>
+#include <paging.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <rcu.h>
+#include <serial.h>
+#include <spinlock.h>
+#include <string.h>
+#include <symbols.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct profile_cpu_t {
+	uint64_t* samples; // Interrupted instruction pointers
+	uint32_t  count;
+	uint64_t  dropped; // Samples taken after the buffer filled
+	bool      running;
+} profile_cpu_t;
+
+DEFINE_PER_CPU(profile_cpu_t, profile_cpu);
+
+uint32_t profile_hz;
+
+// Set by profile_stop, so each core stops its own timer on its next tick
+volatile bool profile_stopping;
+volatile uint32_t profile_running;
+
+// Stop the running core's timer. Called with interrupts disabled
+static void profile_stop_cpu(profile_cpu_t* profile) {
+
+	if (!profile->running) {
+		return;
+	}
+
+	apic_timer_stop();
+	profile->running = false;
+	__atomic_sub_fetch(&profile_running, 1, __ATOMIC_RELEASE);
+
+	// Hand the timer back to the flushers
+	buffer_cache_tick();
+}
+
+__attribute__((interrupt))
+static void profile_interrupt(struct interrupt_frame* frame) {
+
+	uint64_t start = rdtsc();
+	rcu_irq_enter();
+	profile_cpu_t* profile = this_cpu_ptr(profile_cpu);
+
+	if (profile_stopping) {
+		profile_stop_cpu(profile);
+	}
+	else if (profile->count < PROFILE_SAMPLES) {
+		profile->samples[profile->count++] = frame->ip;
+	}
+	else {
+		profile->dropped++;
+	}
+
+	// The flushers' one shot timer is replaced by this one while sampling, so check them every tick
+	buffer_cache_tick();
+
+	apic_eoi();
+	interrupt_account(INTERRUPT_VECTOR_TIMER, start);
+	rcu_irq_exit();
+}
+
+bool profile_start(uint32_t hz) {
+
+	profile_cpu_t* profile = this_cpu_ptr(profile_cpu);
+
+	// From the core's own node, since only it writes to the buffer
+	if (profile->samples == 0) {
+		uint64_t frames = pmm_alloc_pages(PROFILE_SAMPLES * sizeof(uint64_t) / PAGE_SIZE);
+		if (frames == 0) {
+			return false;
+		}
+		profile->samples = phys_to_virt(frames);
+	}
+
+	profile->count = 0;
+	profile->dropped = 0;
+	profile_hz = hz;
+
+	interrupt_set_gate(INTERRUPT_VECTOR_TIMER, (uint64_t)&profile_interrupt, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+
+	uint64_t flags = irq_save();
+	profile->running = true;
+	__atomic_add_fetch(&profile_running, 1, __ATOMIC_SEQ_CST);
+	apic_timer_periodic(INTERRUPT_VECTOR_TIMER, hz);
+	irq_restore(flags);
+
+	return true;
+}
+
+void profile_stop(void) {
+
+	__atomic_store_n(&profile_stopping, true, __ATOMIC_SEQ_CST);
+
+	uint64_t flags = irq_save();
+	profile_stop_cpu(this_cpu_ptr(profile_cpu));
+	irq_restore(flags);
+
+	// Even sleeping cores wake for their timer, so this only takes one tick
+	while (__atomic_load_n(&profile_running, __ATOMIC_ACQUIRE) != 0) {
+		pause();
+	}
+
+	profile_stopping = false;
+}
+
+bool profile_owns_timer(void) {
+	return this_cpu_ptr(profile_cpu)->running;
+}
+
+static void profile_print(const char* string) {
+	serial_write_string(string, strlen(string));
+}
+
+static void profile_print_dec(uint64_t value) {
+
+	char digits[21];
+	int i = 20;
+	digits[i] = '\0';
+
+	do {
+		digits[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+
+	profile_print(&digits[i]);
+}
+
+void profile_dump(void) {
+
+	// One counter per function, and one more for addresses before the first
+	uint32_t* counts = kmalloc((symbol_count + 1) * sizeof(uint32_t));
+	if (counts == 0) {
+		profile_print("PROFILE FAILED, no memory\n");
+		return;
+	}
+
+	profile_print("PROFILE BEGIN ");
+	profile_print_dec(profile_hz);
+	profile_print(" Hz\n");
+
+	for (uint32_t cpu = 0; cpu < cpu_count && cpu < CPU_MAX; cpu++) {
+		profile_cpu_t* profile = per_cpu_ptr(profile_cpu, cpu);
+		if (profile->samples == 0) {
+			continue;
+		}
+
+		memset(counts, 0, (symbol_count + 1) * sizeof(uint32_t));
+
+		for (uint32_t i = 0; i < profile->count; i++) {
+			int64_t index = symbol_find(profile->samples[i]);
+			counts[index < 0 ? symbol_count : (uint64_t)index]++;
+		}
+
+		for (uint64_t i = 0; i <= symbol_count; i++) {
+			if (counts[i] == 0) {
+				continue;
+			}
+
+			profile_print("cpu");
+			profile_print_dec(cpu);
+			profile_print(";");
+			profile_print(i < symbol_count ? &symbol_names[symbol_table[i].name] : "[unknown]");
+			profile_print(" ");
+			profile_print_dec(counts[i]);
+			profile_print("\n");
+		}
+
+		if (profile->dropped != 0) {
+			profile_print("# cpu");
+			profile_print_dec(cpu);
+			profile_print(" dropped ");
+			profile_print_dec(profile->dropped);
+			profile_print(" samples\n");
+		}
+	}
+
+	profile_print("PROFILE END\n");
+
+	kfree(counts);
+}
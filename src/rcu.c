@@ -0,0 +1,214 @@
+/*
+ * evan-os/src/rcu.c
+ *
+ * Read-copy-update grace period tracking.
+ * Every core records the newest grace period number it has seen while in
+ * a quiescent state in its own cache line. A grace period is over once the
+ * oldest number recorded by any online core has reached it, so readers and
+ * quiescent state reporting never need atomic instructions.
+ *
+ * A sleeping core can not report quiescent states, so while it is idle
+ * it is left out of grace periods altogether, except while it handles
+ * interrupts woken from its sleep.
+ *
+ */
+
+#include <rcu.h>
+
+#include <asm.h>
+#include <module.h>
+#include <percpu.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Per core state, padded to a cache line so cores never write to each other's lines
+typedef struct rcu_cpu_t {
+	volatile uint64_t qs_seq; // The newest grace period this core has seen while quiescent
+	rcu_head_t*  next_list;   // Callbacks that have not started waiting for a grace period
+	rcu_head_t** next_tail;
+	rcu_head_t*  wait_list;   // Callbacks waiting for grace period wait_seq to end
+	uint64_t     wait_seq;
+	volatile bool idle;       // Between rcu_idle_enter and rcu_idle_exit, outside interrupts
+	uint32_t     irq_depth;   // Nested interrupt handlers
+	bool         irq_idle;    // The outermost one was taken while idle
+} __attribute__((aligned(64))) rcu_cpu_t;
+
+DEFINE_PER_CPU(rcu_cpu_t, rcu_cpu);
+
+// Bitmap of the cores that take part in grace periods, indexed by cpu id
+volatile uint64_t rcu_online;
+
+volatile uint64_t rcu_gp_seq;       // The newest grace period that has been started
+volatile uint64_t rcu_gp_completed; // The newest grace period every core has passed
+
+// Find the newest grace period that every online core has passed
+static uint64_t rcu_update_completed(void) {
+
+	// Nothing can have completed past the newest started grace period
+	uint64_t oldest = rcu_gp_seq;
+
+	uint64_t mask = rcu_online;
+
+	while (mask != 0) {
+		uint32_t cpu = __builtin_ctzll(mask);
+		rcu_cpu_t* state = per_cpu_ptr(rcu_cpu, cpu);
+		uint64_t seq = state->qs_seq;
+
+		// Idle cores hold no references
+		if (!__atomic_load_n(&state->idle, __ATOMIC_SEQ_CST) && seq < oldest) {
+			oldest = seq;
+		}
+		mask &= mask - 1;
+	}
+
+	// Other cores may be advancing the counter at the same time, and it must never move backwards
+	uint64_t completed = rcu_gp_completed;
+	while (completed < oldest) {
+		if (__atomic_compare_exchange_n(&rcu_gp_completed, &completed, oldest, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			return oldest;
+		}
+	}
+
+	return completed;
+}
+
+void rcu_cpu_online(void) {
+
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+
+	cpu->next_list = 0;
+	cpu->next_tail = &cpu->next_list;
+	cpu->wait_list = 0;
+
+	// A core that just came online holds no old references
+	cpu->qs_seq = rcu_gp_seq;
+
+	__atomic_fetch_or(&rcu_online, 1ull << cpu_id(), __ATOMIC_SEQ_CST);
+}
+
+void rcu_quiescent_state(void) {
+
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+
+	// Loads from earlier read-side sections can not be reordered after this store
+	cpu->qs_seq = rcu_gp_seq;
+
+	// The fast path is done unless callbacks are waiting
+	if (cpu->wait_list == 0 && cpu->next_list == 0) {
+		return;
+	}
+
+	// call_rcu can be used by interrupt handlers on this core
+	uint64_t flags = irq_save();
+
+	rcu_head_t* ready = 0;
+
+	if (cpu->wait_list != 0 && rcu_update_completed() >= cpu->wait_seq) {
+		ready = cpu->wait_list;
+		cpu->wait_list = 0;
+	}
+
+	// Start a grace period for the callbacks queued since the last one
+	if (cpu->wait_list == 0 && cpu->next_list != 0) {
+		cpu->wait_list = cpu->next_list;
+		cpu->next_list = 0;
+		cpu->next_tail = &cpu->next_list;
+		cpu->wait_seq = __atomic_add_fetch(&rcu_gp_seq, 1, __ATOMIC_SEQ_CST);
+	}
+
+	irq_restore(flags);
+
+	// Run the callbacks whose grace period has ended
+	while (ready != 0) {
+		rcu_head_t* next = ready->next;
+		ready->func(ready);
+		ready = next;
+	}
+}
+
+bool rcu_idle_enter(void) {
+
+	rcu_quiescent_state();
+
+	// Callbacks only advance while the core reports quiescent states
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+	if (cpu->wait_list != 0 || cpu->next_list != 0) {
+		return false;
+	}
+
+	__atomic_store_n(&cpu->idle, true, __ATOMIC_SEQ_CST);
+	return true;
+}
+
+void rcu_idle_exit(void) {
+
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+
+	// Leaving idle has to be visible before any read-side section loads a pointer, and a grace
+	// period started while the core slept must not wait for it, so it counts as quiescent right away
+	__atomic_store_n(&cpu->idle, false, __ATOMIC_SEQ_CST);
+	cpu->qs_seq = rcu_gp_seq;
+}
+
+void rcu_irq_enter(void) {
+
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+
+	if (cpu->irq_depth++ != 0 || !cpu->idle) {
+		return;
+	}
+
+	// Like waking up, the handler's loads must not move before the store
+	cpu->irq_idle = true;
+	__atomic_store_n(&cpu->idle, false, __ATOMIC_SEQ_CST);
+	cpu->qs_seq = rcu_gp_seq;
+}
+
+void rcu_irq_exit(void) {
+
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+
+	if (--cpu->irq_depth != 0 || !cpu->irq_idle) {
+		return;
+	}
+
+	// Back to sleep, after the handler's last load
+	cpu->irq_idle = false;
+	__atomic_store_n(&cpu->idle, true, __ATOMIC_SEQ_CST);
+}
+
+void synchronize_rcu(void) {
+
+	// Starting the grace period is a full barrier, so every pointer published
+	// before this call is visible to cores that see the new number
+	uint64_t target = __atomic_add_fetch(&rcu_gp_seq, 1, __ATOMIC_SEQ_CST);
+
+	while (1) {
+		rcu_quiescent_state();
+
+		if (rcu_update_completed() >= target) {
+			return;
+		}
+
+		pause();
+	}
+}
+EXPORT_SYMBOL(synchronize_rcu);
+
+void call_rcu(rcu_head_t* head, rcu_callback_t func) {
+
+	head->next = 0;
+	head->func = func;
+
+	uint64_t flags = irq_save();
+
+	// Append to this core's list, so callbacks run in the order they were queued
+	rcu_cpu_t* cpu = this_cpu_ptr(rcu_cpu);
+	*cpu->next_tail = head;
+	cpu->next_tail = &head->next;
+
+	irq_restore(flags);
+}
+EXPORT_SYMBOL(call_rcu);
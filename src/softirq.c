@@ -0,0 +1,78 @@
+/*
+ * evan-os/src/softirq.c
+ *
+ * Softirqs. Each core counts how deeply it is nested in interrupt
+ * handlers, with one more level while it runs softirqs, so a softirq
+ * raised anywhere inside waits for the outermost level to finish.
+ *
+ */
+
+#include <softirq.h>
+
+#include <module.h>
+#include <percpu.h>
+#include <rcu.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+softirq_handler_t softirq_handlers[SOFTIRQ_COUNT];
+
+DEFINE_PER_CPU(uint32_t, softirq_pending);
+DEFINE_PER_CPU(uint32_t, softirq_depth);
+
+void softirq_register(uint32_t number, softirq_handler_t handler) {
+	if (number < SOFTIRQ_COUNT) {
+		softirq_handlers[number] = handler;
+	}
+}
+
+// Run softirqs until none are pending, including ones raised meanwhile
+static void softirq_run(void) {
+
+	this_cpu_inc(softirq_depth);
+
+	uint32_t* pending = this_cpu_ptr(softirq_pending);
+	for (uint32_t run = __atomic_exchange_n(pending, 0, __ATOMIC_ACQUIRE); run != 0; run = __atomic_exchange_n(pending, 0, __ATOMIC_ACQUIRE)) {
+		for (; run != 0; run &= run - 1) {
+			softirq_handler_t handler = softirq_handlers[__builtin_ctz(run)];
+			if (handler != 0) {
+				handler();
+			}
+		}
+	}
+
+	this_cpu_add(softirq_depth, -1);
+}
+
+void softirq_raise(uint32_t number) {
+
+	__atomic_or_fetch(this_cpu_ptr(softirq_pending), 1u << number, __ATOMIC_RELEASE);
+
+	if (this_cpu_read(softirq_depth) == 0) {
+		softirq_run();
+	}
+}
+EXPORT_SYMBOL(softirq_raise);
+
+void irq_enter(void) {
+	rcu_irq_enter();
+	this_cpu_inc(softirq_depth);
+}
+
+void irq_exit(void) {
+
+	this_cpu_add(softirq_depth, -1);
+
+	if (this_cpu_read(softirq_depth) == 0 && this_cpu_read(softirq_pending) != 0) {
+		softirq_run();
+	}
+
+	// Softirqs are read-side sections too
+	rcu_irq_exit();
+}
+
+bool in_interrupt(void) {
+	return this_cpu_read(softirq_depth) != 0;
+}
+EXPORT_SYMBOL(in_interrupt);
@@ -0,0 +1,148 @@
+/*
+ * evan-os/src/static_key.c
+ *
+ * Code patching for static keys. A 5 byte write is not atomic for a core
+ * fetching the same instructions, so every other core is first brought
+ * into an interrupt handler that spins until the patch is done, then
+ * serializes before it returns to the changed code.
+ *
+ */
+
+#include <static_key.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <paging.h>
+#include <percpu.h>
+#include <rcu.h>
+#include <spinlock.h>
+#include <tlb.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define STATIC_KEY_JMP   0xe9 // jmp rel32
+
+// Branch sites from every static_branch(), see linker.ld
+extern static_key_entry_t __static_keys_start[];
+extern static_key_entry_t __static_keys_end[];
+
+static const uint8_t static_key_nop[5] = {0x0f, 0x1f, 0x44, 0x00, 0x00};
+
+spinlock_t static_key_lock;
+
+// Cores that have not stopped yet
+volatile uint64_t static_key_waiting;
+// Incremented after each patch, releasing the stopped cores
+volatile uint64_t static_key_generation;
+
+// Execute a serializing instruction, so no instructions fetched before the patch are run
+static void static_key_serialize(void) {
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+}
+
+__attribute__((interrupt))
+static void static_key_interrupt(__attribute__((unused)) struct interrupt_frame* frame) {
+
+	uint64_t start = rdtsc();
+	rcu_irq_enter();
+
+	// Read before reporting in, so the patching core can not release this one before it waits
+	uint64_t generation = __atomic_load_n(&static_key_generation, __ATOMIC_ACQUIRE);
+	__atomic_and_fetch(&static_key_waiting, ~(1ull << cpu_id()), __ATOMIC_SEQ_CST);
+
+	while (__atomic_load_n(&static_key_generation, __ATOMIC_ACQUIRE) == generation) {
+		tlb_shootdown_poll();
+		pause();
+	}
+
+	static_key_serialize();
+	apic_eoi();
+	interrupt_account(INTERRUPT_VECTOR_PATCH, start);
+	rcu_irq_exit();
+}
+
+void static_key_init(void) {
+	interrupt_set_gate(INTERRUPT_VECTOR_PATCH, (uint64_t)&static_key_interrupt, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+}
+
+// Write code through the direct map, since the kernel's own mapping of it may be read only
+static void static_key_write(uint64_t address, const uint8_t* bytes, uint32_t size) {
+
+	for (uint32_t i = 0; i < size; i++) {
+		// The instruction may cross a page boundary, so each byte is translated
+		uint64_t phys = paging_translate(&kernel_address_space, address + i);
+		*(volatile uint8_t*)phys_to_virt(phys) = bytes[i];
+	}
+}
+
+static void static_key_patch(static_key_entry_t* entry, bool enabled) {
+
+	if (!enabled) {
+		static_key_write(entry->site, static_key_nop, sizeof(static_key_nop));
+		return;
+	}
+
+	int32_t offset = (int32_t)(entry->target - (entry->site + 5));
+
+	uint8_t jmp[5];
+	jmp[0] = STATIC_KEY_JMP;
+	jmp[1] = offset & 0xff;
+	jmp[2] = (offset >> 8) & 0xff;
+	jmp[3] = (offset >> 16) & 0xff;
+	jmp[4] = (offset >> 24) & 0xff;
+
+	static_key_write(entry->site, jmp, sizeof(jmp));
+}
+
+static void static_key_set(static_key_t* key, bool enabled) {
+
+	// Waiting for the lock with interrupts enabled lets the holder stop this core
+	spin_lock(&static_key_lock);
+
+	if (key->enabled == enabled) {
+		spin_unlock(&static_key_lock);
+		return;
+	}
+
+	uint64_t flags = irq_save();
+
+	uint64_t others = __atomic_load_n(&apic_online, __ATOMIC_ACQUIRE) & ~(1ull << cpu_id());
+	__atomic_store_n(&static_key_waiting, others, __ATOMIC_SEQ_CST);
+
+	for (uint32_t cpu = 0; cpu < CPU_MAX; cpu++) {
+		if (others & (1ull << cpu)) {
+			apic_send_ipi(cpu, INTERRUPT_VECTOR_PATCH);
+		}
+	}
+
+	while (__atomic_load_n(&static_key_waiting, __ATOMIC_SEQ_CST) != 0) {
+		tlb_shootdown_poll();
+		pause();
+	}
+
+	for (static_key_entry_t* entry = __static_keys_start; entry < __static_keys_end; entry++) {
+		if (entry->key == key) {
+			static_key_patch(entry, enabled);
+		}
+	}
+
+	key->enabled = enabled;
+
+	static_key_serialize();
+	__atomic_add_fetch(&static_key_generation, 1, __ATOMIC_RELEASE);
+
+	irq_restore(flags);
+	spin_unlock(&static_key_lock);
+}
+
+void static_key_enable(static_key_t* key) {
+	static_key_set(key, true);
+}
+
+void static_key_disable(static_key_t* key) {
+	static_key_set(key, false);
+}
@@ -0,0 +1,298 @@
+/*
+ * evan-os/src/string.c
+ *
+ * Memory copying and filling routines.
+ * The kernel is built without optimization, so the copy loops are written
+ * in assembly. At boot, string_init picks between rep movsb/stosb (on cpus
+ * with enhanced or fast short rep movsb), unrolled 64 bit loops, and
+ * non-temporal stores for copies too large to be worth caching.
+ *
+ */
+
+#include <string.h>
+
+#include <cpu.h>
+#include <module.h>
+#include <paging.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Copies at least this large use rep movsb and rep stosb. Set by string_init
+size_t string_erms_threshold = SIZE_MAX;
+
+// Enhanced rep movsb has a startup cost that loops beat on short copies
+#define STRING_ERMS_MIN 256
+
+void string_init(void) {
+
+	if (cpu_has(CPU_FEATURE_FSRM)) {
+		string_erms_threshold = 0;
+	}
+	else if (cpu_has(CPU_FEATURE_ERMS)) {
+		string_erms_threshold = STRING_ERMS_MIN;
+	}
+	else {
+		string_erms_threshold = SIZE_MAX;
+	}
+}
+
+// Helpers for the last few bytes of a copy or fill
+
+static inline void copy_tail(uint8_t* dest, const uint8_t* src, size_t n) {
+	size_t qwords = n >> 3;
+	size_t bytes = n & 7;
+
+	asm volatile ("	test %2, %2; jz 2f; \
+		1: movq (%1), %%r8; movq %%r8, (%0); \
+		add $8, %1; add $8, %0; dec %2; jnz 1b; \
+		2: test %3, %3; jz 4f; \
+		3: movb (%1), %%r8b; movb %%r8b, (%0); \
+		inc %1; inc %0; dec %3; jnz 3b; \
+		4:" : "+r"(dest), "+r"(src), "+r"(qwords), "+r"(bytes) : : "r8", "memory", "cc");
+}
+
+static inline void set_tail(uint8_t* dest, uint64_t pattern, size_t n) {
+	size_t qwords = n >> 3;
+	size_t bytes = n & 7;
+
+	asm volatile ("	test %1, %1; jz 2f; \
+		1: movq %3, (%0); add $8, %0; dec %1; jnz 1b; \
+		2: test %2, %2; jz 4f; \
+		3: movb %b3, (%0); inc %0; dec %2; jnz 3b; \
+		4:" : "+r"(dest), "+r"(qwords), "+r"(bytes) : "r"(pattern) : "memory", "cc");
+}
+
+// Repeat a byte across all 8 bytes of a quadword
+static inline uint64_t set_pattern(int value) {
+	return (uint64_t)(uint8_t)value * 0x0101010101010101ull;
+}
+
+// memcpy variants
+
+void* memcpy_erms(void* dest, const void* src, size_t n) {
+	void* start = dest;
+	asm volatile ("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+
+	return start;
+}
+
+void* memcpy_unrolled(void* dest, const void* src, size_t n) {
+	void* start = dest;
+	size_t blocks = n >> 6;
+
+	// Each loop moves 64 bytes, loading 32 bytes before storing them.
+	// The stores never reach bytes that have not been loaded yet, so this is also a safe forward memmove
+	if (blocks != 0) {
+		asm volatile ("1: \
+			movq  0(%1), %%r8;  movq  8(%1), %%r9;  movq 16(%1), %%r10; movq 24(%1), %%r11; \
+			movq %%r8,  0(%0);  movq %%r9,  8(%0);  movq %%r10, 16(%0); movq %%r11, 24(%0); \
+			movq 32(%1), %%r8;  movq 40(%1), %%r9;  movq 48(%1), %%r10; movq 56(%1), %%r11; \
+			movq %%r8, 32(%0);  movq %%r9, 40(%0);  movq %%r10, 48(%0); movq %%r11, 56(%0); \
+			add $64, %1; add $64, %0; dec %2; jnz 1b"
+			: "+r"(dest), "+r"(src), "+r"(blocks) : : "r8", "r9", "r10", "r11", "memory", "cc");
+	}
+
+	copy_tail(dest, src, n & 63);
+
+	return start;
+}
+
+void* memcpy_nt(void* dest, const void* src, size_t n) {
+	void* start = dest;
+
+	// Align the destination so the non-temporal stores fill whole cache lines
+	size_t head = (64 - ((uintptr_t)dest & 63)) & 63;
+	if (head > n) {
+		head = n;
+	}
+	copy_tail(dest, src, head);
+	dest = (uint8_t*)dest + head;
+	src = (const uint8_t*)src + head;
+	n -= head;
+
+	size_t blocks = n >> 6;
+	if (blocks != 0) {
+		asm volatile ("1: \
+			movq  0(%1), %%r8;  movq  8(%1), %%r9;  movq 16(%1), %%r10; movq 24(%1), %%r11; \
+			movnti %%r8,  0(%0); movnti %%r9,  8(%0); movnti %%r10, 16(%0); movnti %%r11, 24(%0); \
+			movq 32(%1), %%r8;  movq 40(%1), %%r9;  movq 48(%1), %%r10; movq 56(%1), %%r11; \
+			movnti %%r8, 32(%0); movnti %%r9, 40(%0); movnti %%r10, 48(%0); movnti %%r11, 56(%0); \
+			add $64, %1; add $64, %0; dec %2; jnz 1b; \
+			sfence"
+			: "+r"(dest), "+r"(src), "+r"(blocks) : : "r8", "r9", "r10", "r11", "memory", "cc");
+	}
+
+	copy_tail(dest, src, n & 63);
+
+	return start;
+}
+
+// memset variants
+
+void* memset_erms(void* dest, int value, size_t n) {
+	void* start = dest;
+	asm volatile ("rep stosb" : "+D"(dest), "+c"(n) : "a"(value) : "memory");
+
+	return start;
+}
+
+void* memset_unrolled(void* dest, int value, size_t n) {
+	void* start = dest;
+	uint64_t pattern = set_pattern(value);
+	size_t blocks = n >> 6;
+
+	if (blocks != 0) {
+		asm volatile ("1: \
+			movq %2,  0(%0); movq %2,  8(%0); movq %2, 16(%0); movq %2, 24(%0); \
+			movq %2, 32(%0); movq %2, 40(%0); movq %2, 48(%0); movq %2, 56(%0); \
+			add $64, %0; dec %1; jnz 1b"
+			: "+r"(dest), "+r"(blocks) : "r"(pattern) : "memory", "cc");
+	}
+
+	set_tail(dest, pattern, n & 63);
+
+	return start;
+}
+
+void* memset_nt(void* dest, int value, size_t n) {
+	void* start = dest;
+	uint64_t pattern = set_pattern(value);
+
+	size_t head = (64 - ((uintptr_t)dest & 63)) & 63;
+	if (head > n) {
+		head = n;
+	}
+	set_tail(dest, pattern, head);
+	dest = (uint8_t*)dest + head;
+	n -= head;
+
+	size_t blocks = n >> 6;
+	if (blocks != 0) {
+		asm volatile ("1: \
+			movnti %2,  0(%0); movnti %2,  8(%0); movnti %2, 16(%0); movnti %2, 24(%0); \
+			movnti %2, 32(%0); movnti %2, 40(%0); movnti %2, 48(%0); movnti %2, 56(%0); \
+			add $64, %0; dec %1; jnz 1b; \
+			sfence"
+			: "+r"(dest), "+r"(blocks) : "r"(pattern) : "memory", "cc");
+	}
+
+	set_tail(dest, pattern, n & 63);
+
+	return start;
+}
+
+// Dispatching entry points
+
+void* memcpy(void* dest, const void* src, size_t n) {
+
+	if (n >= STRING_NT_THRESHOLD) {
+		return memcpy_nt(dest, src, n);
+	}
+	else if (n >= string_erms_threshold) {
+		return memcpy_erms(dest, src, n);
+	}
+	return memcpy_unrolled(dest, src, n);
+}
+EXPORT_SYMBOL(memcpy);
+
+void* memset(void* dest, int value, size_t n) {
+
+	if (n >= STRING_NT_THRESHOLD) {
+		return memset_nt(dest, value, n);
+	}
+	else if (n >= string_erms_threshold) {
+		return memset_erms(dest, value, n);
+	}
+	return memset_unrolled(dest, value, n);
+}
+EXPORT_SYMBOL(memset);
+
+void* memmove(void* dest, const void* src, size_t n) {
+
+	uint8_t* d = dest;
+	const uint8_t* s = src;
+
+	// Copying forwards is safe unless the destination starts inside the source.
+	// Non-temporal copies are skipped, since they are not safe with overlap
+	if (d <= s || d >= s + n) {
+		if (n >= string_erms_threshold) {
+			return memcpy_erms(dest, src, n);
+		}
+		return memcpy_unrolled(dest, src, n);
+	}
+
+	// Copy backwards, first the bytes past the last whole quadword
+	d += n;
+	s += n;
+	while ((n & 7) != 0) {
+		*--d = *--s;
+		n--;
+	}
+
+	size_t qwords = n >> 3;
+	asm volatile ("	test %2, %2; jz 2f; \
+		1: sub $8, %1; sub $8, %0; movq (%1), %%r8; movq %%r8, (%0); \
+		dec %2; jnz 1b; \
+		2:" : "+r"(d), "+r"(s), "+r"(qwords) : : "r8", "memory", "cc");
+
+	return dest;
+}
+EXPORT_SYMBOL(memmove);
+
+int memcmp(const void* a, const void* b, size_t n) {
+	const uint8_t* x = a;
+	const uint8_t* y = b;
+
+	for (size_t i = 0; i < n; i++) {
+		if (x[i] != y[i]) {
+			return x[i] < y[i] ? -1 : 1;
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(memcmp);
+
+// Page routines
+
+void clear_page(void* page) {
+	memset_nt(page, 0, PAGE_SIZE);
+}
+
+void copy_page(void* dest, const void* src) {
+	memcpy_nt(dest, src, PAGE_SIZE);
+}
+
+// Strings
+
+size_t strlen(const char* s) {
+	size_t length = 0;
+	while (s[length] != '\0') {
+		length++;
+	}
+
+	return length;
+}
+EXPORT_SYMBOL(strlen);
+
+int strcmp(const char* a, const char* b) {
+	while (*a != '\0' && *a == *b) {
+		a++;
+		b++;
+	}
+
+	return (uint8_t)*a - (uint8_t)*b;
+}
+EXPORT_SYMBOL(strcmp);
+
+int strncmp(const char* a, const char* b, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		if (a[i] != b[i] || a[i] == '\0') {
+			return (uint8_t)a[i] - (uint8_t)b[i];
+		}
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(strncmp);
@@ -0,0 +1,47 @@
+/*
+ * evan-os/src/symbols.c
+ *
+ * Kernel symbol lookup.
+ *
+ */
+
+#include <symbols.h>
+
+#include <stdint.h>
+
+// From the linker script
+extern uint8_t __text_end[];
+
+int64_t symbol_find(uint64_t address) {
+
+	if (address >= (uint64_t)__text_end) {
+		return -1;
+	}
+
+	// The last symbol starting at or before the address
+	int64_t low = 0, high = (int64_t)symbol_count - 1, found = -1;
+	while (low <= high) {
+		int64_t middle = (low + high) / 2;
+
+		if (symbol_table[middle].address <= address) {
+			found = middle;
+			low = middle + 1;
+		}
+		else {
+			high = middle - 1;
+		}
+	}
+
+	return found;
+}
+
+const char* symbol_lookup(uint64_t address, uint64_t* offset) {
+
+	int64_t index = symbol_find(address);
+	if (index < 0) {
+		return 0;
+	}
+
+	*offset = address - symbol_table[index].address;
+	return &symbol_names[symbol_table[index].name];
+}
@@ -11,6 +11,8 @@
 #include <tty.h>
 #include <asm.h>
 #include <kernel.h>
+#include <rcu.h>
+#include <trace.h>
 
 #include <stdint.h>
 
@@ -23,7 +25,8 @@ struct registers {
 };
 
 // 256 entry long list of syscalls with a 64 bit return value and argument,
-// for passing sinlge values or struct pointers
+// for passing sinlge values or struct pointers.
+// Entries are protected by RCU, so dispatching never takes a lock
 syscall_t syscall_table[256];
 
 __attribute__((naked))
@@ -40,15 +43,31 @@ void syscall_and_return(void) {
 
 uint64_t execute_syscall(uint64_t id, uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3) {
 
+	trace(TRACE_SYSCALL_ENTRY, id, arg0);
+
+	// Check that the id is inside the table before reading it
+	if (id >= 256) {
+		trace(TRACE_SYSCALL_EXIT, id, 0);
+		return 0;
+	}
+
+	// The syscall is an RCU read-side section, so the entry stays valid until it returns
+	rcu_read_lock();
+	syscall_t syscall = rcu_dereference(syscall_table[id]);
+
+	uint64_t return_value = 0;
+
 	// Check that the syscall exists
-	if (syscall_table[id] != 0 && id < 256) {
+	if (syscall != 0) {
 		// If it does, call the syscall
-		return syscall_table[id](arg0, arg1, arg2, arg3);
-	}
-	else {
-		// If it doesn't, return nothing
-		return 0;
+		return_value = syscall(arg0, arg1, arg2, arg3);
 	}
+
+	rcu_read_unlock();
+
+	trace(TRACE_SYSCALL_EXIT, id, return_value);
+
+	return return_value;
 }
 
 void syscall_init(void) {
@@ -63,7 +82,8 @@ void syscall_init(void) {
 	// TODO: Add file system syscalls
 
 	// Set the syscall bit
-    wrmsr(0xC0000080, rdmsr_low(0xC0000080) | 1, rdmsr_high(0xC0000080));
+	uint64_t efer = rdmsr(0xC0000080) | 1;
+	wrmsr(0xC0000080, (uint32_t)efer, (uint32_t)(efer >> 32));
 
 	// Set the segments that syscall will set
 	// Set STAR to the segment selectors
@@ -78,10 +98,16 @@ uint64_t syscall_register(uint64_t id, uint64_t (*new_syscall) (uint64_t, uint64
 	__attribute__ ((unused)) uint64_t arg2, __attribute__ ((unused)) uint64_t arg3) {
 
 	// TODO: Permission checking and error codes
-	if (id >= 4) {
-		// Set the system call to the passed function pointer
+	if (id >= 4 && id < 256) {
+		// Set the system call to the passed function pointer.
+		// Swapping atomically gives concurrent writers each their own old entry
 		tty_print_string("Added a syscall\n");
-		syscall_table[id] = new_syscall;
+		syscall_t old_syscall = __atomic_exchange_n(&syscall_table[id], new_syscall, __ATOMIC_SEQ_CST);
+
+		// Wait for cores still running the replaced syscall, so its owner can free it
+		if (old_syscall != 0) {
+			synchronize_rcu();
+		}
 		return 0;
 	}
 
@@ -93,9 +119,16 @@ uint64_t syscall_unregister(uint64_t id, __attribute__ ((unused)) uint64_t arg1,
 
 	// TODO: Permission checking
 
+	// Dont remove the baseline syscalls
+	if (id < 4 || id >= 256) {
+		return 1;
+	}
+
 	// Void the system call
-	syscall_table[id] = 0;
+	rcu_assign_pointer(syscall_table[id], 0);
 
+	// Once no core can still be running it, the syscall's code and data can be freed
+	synchronize_rcu();
 
 	return 0;
 }
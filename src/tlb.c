@@ -0,0 +1,177 @@
+/*
+ * evan-os/src/tlb.c
+ *
+ * TLB shootdowns through inter-processor interrupts.
+ *
+ * The core starting a shootdown publishes the batch in its per-CPU
+ * request, sets its own bit in each target's pending mask, and sends
+ * each target an IPI. Targets flush, then clear their bit in the
+ * request's waiting mask. The sender spins until that mask is empty,
+ * handling any shootdowns sent to itself meanwhile. Only cores that
+ * have enabled interrupts are targeted, since a core still booting with
+ * them off would hold up the sender, and flushes everything once when
+ * it joins instead.
+ *
+ */
+
+#include <tlb.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <interrupt.h>
+#include <interrupt_stats.h>
+#include <paging.h>
+#include <percpu.h>
+#include <rcu.h>
+#include <spinlock.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct tlb_request_t {
+	tlb_batch_t*      batch;
+	uint64_t          gen;     // The address space's tlb_gen after this change
+	volatile uint64_t waiting; // Targets that have not flushed yet
+} tlb_request_t;
+
+// The shootdown this core is sending
+DEFINE_PER_CPU(tlb_request_t, tlb_request);
+// Cores with a shootdown for this core to handle
+DEFINE_PER_CPU(volatile uint64_t, tlb_pending);
+
+volatile uint64_t tlb_online;
+
+__attribute__((interrupt))
+static void tlb_shootdown_interrupt(__attribute__((unused)) struct interrupt_frame* frame) {
+	uint64_t start = rdtsc();
+	rcu_irq_enter();
+	tlb_shootdown_poll();
+	apic_eoi();
+	interrupt_account(INTERRUPT_VECTOR_TLB_SHOOTDOWN, start);
+	rcu_irq_exit();
+}
+
+void tlb_init(void) {
+	interrupt_set_gate(INTERRUPT_VECTOR_TLB_SHOOTDOWN, (uint64_t)&tlb_shootdown_interrupt, INTERRUPT_PRESENT | INTERRUPT_INTERRUPT_GATE);
+}
+
+void tlb_cpu_online(void) {
+
+	// Joined before flushing, so every change is either flushed here or sent to this core
+	__atomic_or_fetch(&tlb_online, 1ull << cpu_id(), __ATOMIC_SEQ_CST);
+
+	tlb_batch_t batch;
+	tlb_batch_init(&batch, 0);
+	batch.full = true;
+	batch.global = true;
+
+	uint64_t flags = irq_save();
+	paging_flush_local(&batch, 0);
+	irq_restore(flags);
+}
+
+void tlb_batch_init(tlb_batch_t* batch, address_space_t* space) {
+	batch->space = space;
+	batch->count = 0;
+	batch->pages = 0;
+	batch->full = false;
+	batch->global = false;
+}
+
+void tlb_batch_add(tlb_batch_t* batch, uint64_t virt) {
+
+	virt &= ~(uint64_t)(PAGE_SIZE - 1);
+
+	if (virt >= KERNEL_HALF_BASE) {
+		batch->global = true;
+	}
+	batch->pages++;
+
+	if (batch->full) {
+		return;
+	}
+
+	// Extend the last run when pages are unmapped in order, which is the usual case
+	if (batch->count != 0) {
+		tlb_range_t* last = &batch->ranges[batch->count - 1];
+		if (last->start + last->pages * PAGE_SIZE == virt) {
+			last->pages++;
+			return;
+		}
+	}
+
+	if (batch->count == TLB_BATCH_RANGES) {
+		batch->full = true;
+		return;
+	}
+
+	batch->ranges[batch->count].start = virt;
+	batch->ranges[batch->count].pages = 1;
+	batch->count++;
+}
+
+void tlb_shootdown_poll(void) {
+
+	volatile uint64_t* pending = this_cpu_ptr(tlb_pending);
+	uint64_t senders = __atomic_exchange_n(pending, 0, __ATOMIC_SEQ_CST);
+	uint64_t cpu_bit = 1ull << cpu_id();
+
+	while (senders != 0) {
+		uint32_t sender = __builtin_ctzll(senders);
+		senders &= senders - 1;
+
+		tlb_request_t* request = per_cpu_ptr(tlb_request, sender);
+		paging_flush_local(request->batch, request->gen);
+
+		__atomic_and_fetch(&request->waiting, ~cpu_bit, __ATOMIC_SEQ_CST);
+	}
+}
+
+void tlb_batch_flush(tlb_batch_t* batch) {
+
+	if (batch->pages == 0) {
+		return;
+	}
+
+	uint64_t flags = irq_save();
+
+	address_space_t* space = batch->space;
+	uint64_t cpu_bit = 1ull << cpu_id();
+
+	// Bump the generation before reading cpus, see paging_switch
+	uint64_t gen = __atomic_add_fetch(&space->tlb_gen, 1, __ATOMIC_SEQ_CST);
+
+	uint64_t targets;
+	if (batch->global) {
+		targets = __atomic_load_n(&tlb_online, __ATOMIC_SEQ_CST);
+	}
+	else {
+		targets = __atomic_load_n(&space->cpus, __ATOMIC_SEQ_CST) & __atomic_load_n(&tlb_online, __ATOMIC_SEQ_CST);
+	}
+	targets &= ~cpu_bit;
+
+	paging_flush_local(batch, gen);
+
+	if (targets != 0) {
+		tlb_request_t* request = this_cpu_ptr(tlb_request);
+		request->batch = batch;
+		request->gen = gen;
+		__atomic_store_n(&request->waiting, targets, __ATOMIC_SEQ_CST);
+
+		for (uint64_t remaining = targets; remaining != 0; remaining &= remaining - 1) {
+			uint32_t target = __builtin_ctzll(remaining);
+
+			__atomic_or_fetch(per_cpu_ptr(tlb_pending, target), cpu_bit, __ATOMIC_SEQ_CST);
+			apic_send_ipi(target, INTERRUPT_VECTOR_TLB_SHOOTDOWN);
+		}
+
+		while (request->waiting != 0) {
+			tlb_shootdown_poll();
+			pause();
+		}
+	}
+
+	tlb_batch_init(batch, space);
+
+	irq_restore(flags);
+}
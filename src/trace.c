@@ -0,0 +1,123 @@
+/*
+ * evan-os/src/trace.c
+ *
+ * Per-CPU trace rings. Only the owning core writes to its ring, with
+ * interrupts disabled so a tracepoint in an interrupt handler can not
+ * interleave with one it interrupted.
+ *
+ */
+
+#include <trace.h>
+
+#include <apic.h>
+#include <asm.h>
+#include <paging.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <serial.h>
+#include <spinlock.h>
+#include <static_key.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct trace_cpu_t {
+	trace_record_t* records;
+	uint64_t        head;    // Records written so far, the next is at head % TRACE_RECORDS
+} trace_cpu_t;
+
+DEFINE_PER_CPU(trace_cpu_t, trace_cpu);
+
+static_key_t trace_key;
+
+// Cores that have called trace_start
+volatile uint32_t trace_cpus_started;
+
+void trace_record(uint32_t event, uint64_t arg0, uint64_t arg1) {
+
+	uint64_t flags = irq_save();
+
+	trace_cpu_t* trace = this_cpu_ptr(trace_cpu);
+
+	if (trace->records != 0) {
+		trace_record_t* record = &trace->records[trace->head % TRACE_RECORDS];
+		record->tsc = rdtsc();
+		record->event = event;
+		record->cpu = cpu_id();
+		record->arg0 = arg0;
+		record->arg1 = arg1;
+		trace->head++;
+	}
+
+	irq_restore(flags);
+}
+
+bool trace_start(void) {
+
+	trace_cpu_t* trace = this_cpu_ptr(trace_cpu);
+	bool allocated = true;
+
+	// From the core's own node, since only it writes to the ring
+	if (trace->records == 0) {
+		uint64_t frames = pmm_alloc_pages(TRACE_RECORDS * sizeof(trace_record_t) / PAGE_SIZE);
+		if (frames != 0) {
+			trace->records = phys_to_virt(frames);
+		}
+		else {
+			allocated = false;
+		}
+	}
+
+	trace->head = 0;
+	__atomic_add_fetch(&trace_cpus_started, 1, __ATOMIC_SEQ_CST);
+
+	// Enable the tracepoints once every ring is ready
+	if (cpu_id() == 0) {
+		while (__atomic_load_n(&trace_cpus_started, __ATOMIC_ACQUIRE) < cpu_count) {
+			pause();
+		}
+
+		static_key_enable(&trace_key);
+	}
+
+	return allocated;
+}
+
+void trace_stop(void) {
+	// No core can be part way through a record after this, since they are written with interrupts disabled
+	static_key_disable(&trace_key);
+}
+
+static void trace_write(const void* data, uint64_t size) {
+	serial_write_string((const char*)data, size);
+}
+
+void trace_dump(void) {
+
+	trace_header_t header;
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.cpu_count = cpu_count < CPU_MAX ? cpu_count : CPU_MAX;
+	header.record_size = sizeof(trace_record_t);
+	header.tsc_frequency = tsc_frequency;
+	trace_write(&header, sizeof(header));
+
+	for (uint32_t cpu = 0; cpu < header.cpu_count; cpu++) {
+		trace_cpu_t* trace = per_cpu_ptr(trace_cpu, cpu);
+
+		// Once the ring has wrapped, only the newest TRACE_RECORDS are left
+		uint64_t count = trace->head < TRACE_RECORDS ? trace->head : TRACE_RECORDS;
+		if (trace->records == 0) {
+			count = 0;
+		}
+
+		trace_cpu_header_t cpu_header;
+		cpu_header.cpu = cpu;
+		cpu_header.count = count;
+		trace_write(&cpu_header, sizeof(cpu_header));
+
+		for (uint64_t i = trace->head - count; i < trace->head; i++) {
+			trace_write(&trace->records[i % TRACE_RECORDS], sizeof(trace_record_t));
+		}
+	}
+}
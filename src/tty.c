@@ -1,8 +1,11 @@
 
 #include <bootboot.h>
 
+#include <module.h>
 #include <serial.h>
 #include <tty.h>
+#include <spinlock.h>
+#include <string.h>
 
 #include <stdint.h>
 
@@ -27,6 +30,9 @@ typedef struct {
 volatile psf2_t *font = (psf2_t *)&_binary_font_psf_start;
 
 uint32_t char_x, char_y;
+
+// Keeps lines printed by different cores (or interrupts) from mixing
+spinlock_t tty_lock = SPINLOCK_INIT;
 uint32_t fg_color = 0x00ffffff, bg_color = 0x00000000;
 
 uint32_t max_x = 50, max_y = 25;
@@ -88,6 +94,30 @@ void tty_put_char_at(char c, uint32_t xpos, uint32_t ypos) {
 	}
 }
 
+// Move every line of text up by one and clear the bottom line
+void tty_scroll(void) {
+
+	uint32_t scanline = bootboot.fb_scanline;
+	uint64_t line_bytes = (uint64_t)scanline * font->height;
+	uint8_t* last_line = (uint8_t *)&fb + line_bytes * (max_y - 1);
+
+	memmove(&fb, (uint8_t *)&fb + line_bytes, line_bytes * (max_y - 1));
+
+	if (bg_color == 0) {
+		memset(last_line, 0, line_bytes);
+	}
+	else {
+		for (uint32_t y = 0; y < font->height; y++) {
+			uint32_t* pixel = (uint32_t *)(last_line + scanline * y);
+			for (uint32_t x = 0; x < bootboot.fb_width; x++) {
+				pixel[x] = bg_color;
+			}
+		}
+	}
+
+	char_y = max_y - 1;
+}
+
 void tty_print_char(char c) {
 
 	switch (c) {
@@ -105,13 +135,21 @@ void tty_print_char(char c) {
 			char_x = 0;
 			char_y++;
 		}
+
+		// Scroll instead of drawing past the bottom of the framebuffer
+		if (char_y >= max_y) {
+			tty_scroll();
+		}
 }
+EXPORT_SYMBOL(tty_print_char);
 
 void tty_print_string(char *s) {
 	
 	// The index of the chracter in the string
 	uint32_t c = 0;
 
+	uint64_t flags = spin_lock_irqsave(&tty_lock);
+
 	while (s[c] != 0x0) {
 		serial_write(s[c]);
 		// Print the character
@@ -119,7 +157,10 @@ void tty_print_string(char *s) {
 		// Select the next character
 		c++;
 	}
+
+	spin_unlock_irqrestore(&tty_lock, flags);
 }
+EXPORT_SYMBOL(tty_print_string);
 
 void puts_at_pos(char *s, uint32_t xpos, uint32_t ypos) {
 
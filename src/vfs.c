@@ -7,7 +7,20 @@
 
 #include <vfs.h>
 
+#include <kmalloc.h>
+#include <module.h>
+#include <spinlock.h>
+#include <string.h>
+#include <trace.h>
+
 #include <stdint.h>
+#include <stdbool.h>
+
+typedef struct vfs_mount_t {
+	char          path[46];
+	uint64_t      length;
+	superblock_t* superblock;
+} vfs_mount_t;
 
 
 dentry_t* fs_root = (dentry_t*)0x0;
@@ -17,36 +30,330 @@ inode_t* mount_roots[30];  // The root diredctory of mounted devices
 						   // are not available
 inode_t* mount_points[30]; // Where devices are mounted
 
+// Filesystems attached by path, found by vfs_open
+vfs_mount_t vfs_mounts[VFS_MOUNTS];
+spinlock_t vfs_mount_lock;
+
 uint64_t read_fs(dentry_t* file, uint64_t offset, uint64_t size, uint8_t* buffer) {
 
+	trace(TRACE_VFS_READ_ENTRY, offset, size);
+
 	// Find the inode of the passed dentry
 	inode_t* inode = (file->inode_ptr);
 
+	uint64_t status = FS_ERROR_SUCCESS;
+
 	// If the inode pointer is null
-	if (inode == 0)       { return FS_ERROR_NULL_BUFFER; }
+	if (inode == 0)       { status = FS_ERROR_NULL_BUFFER; }
 	// If the buffer pointer is null
-	else if (buffer == 0) { return FS_ERROR_NULL_BUFFER; }
+	else if (buffer == 0) { status = FS_ERROR_NULL_BUFFER; }
 	// If the caller requested 8 bytes
-	else if (size == 0)   { return FS_ERROR_FAILURE; }
+	else if (size == 0)   { status = FS_ERROR_FAILURE; }
 	// If the offset is outside the file size
-	// Remove when real file reading is implemenet
-	else if (inode->size < offset) { return FS_ERROR_END_OF_FILE; }
-
+	else if (inode->size < offset) { status = FS_ERROR_END_OF_FILE; }
 	// Use the filesystem's functions to read the file into the buffer
+	else if (inode->superblock != 0 && inode->superblock->ops.read_inode != 0) {
+		status = inode->superblock->ops.read_inode(inode, offset, size, buffer);
+	}
 
-	// TODO: implement file reading
+	trace(TRACE_VFS_READ_EXIT, offset, status);
 
 	// Return the success
-	return FS_ERROR_SUCCESS;
+	return status;
 }
+EXPORT_SYMBOL(read_fs);
+
+uint64_t write_fs(dentry_t* file, uint64_t offset, uint64_t size, uint8_t* buffer) {
+
+	inode_t* inode = file->inode_ptr;
+
+	if (inode == 0)       { return FS_ERROR_NULL_FILE; }
+	if (buffer == 0)      { return FS_ERROR_NULL_BUFFER; }
+	if (size == 0)        { return FS_ERROR_FAILURE; }
+	if (offset + size > UINT32_MAX) { return FS_ERROR_FAILURE; }
+
+	if (inode->superblock == 0 || inode->superblock->ops.write_inode == 0) {
+		return FS_ERROR_INVALID_PERMISSIONS;
+	}
+
+	return inode->superblock->ops.write_inode(inode, offset, size, buffer);
+}
+EXPORT_SYMBOL(write_fs);
+
+uint64_t sync_fs(dentry_t* file) {
+
+	inode_t* inode = file->inode_ptr;
+
+	if (inode == 0) { return FS_ERROR_NULL_FILE; }
+
+	// Filesystems that write straight through have nothing to wait for
+	if (inode->superblock == 0 || inode->superblock->ops.write_inode_disk == 0) {
+		return FS_ERROR_SUCCESS;
+	}
+
+	return inode->superblock->ops.write_inode_disk(inode);
+}
+EXPORT_SYMBOL(sync_fs);
 
 uint64_t mount_root(char* file) {
 
 	// If the string is null or 0 length
 	if (file == 0 || file[0] == '\0') {
+		trace(TRACE_VFS_MOUNT, FS_ERROR_INVALID_PATH, 0);
 		return FS_ERROR_INVALID_PATH;
 	}
 
 	// Return an error, since mounting is not supported yet
+	trace(TRACE_VFS_MOUNT, FS_ERROR_FAILURE, 0);
+	return FS_ERROR_FAILURE;
+}
+
+uint64_t vfs_mount(const char* path, superblock_t* superblock) {
+
+	uint64_t length = strlen(path);
+
+	if (path[0] != '/' || length >= sizeof(vfs_mounts[0].path)) {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	// The root is stored as an empty path, so every other path can be matched followed by a '/'
+	if (length == 1) {
+		length = 0;
+	}
+
+	spin_lock(&vfs_mount_lock);
+
+	for (uint32_t i = 0; i < VFS_MOUNTS; i++) {
+		if (vfs_mounts[i].superblock == 0) {
+			memcpy(vfs_mounts[i].path, path, length);
+			vfs_mounts[i].path[length] = '\0';
+			vfs_mounts[i].length = length;
+			vfs_mounts[i].superblock = superblock;
+
+			spin_unlock(&vfs_mount_lock);
+			return FS_ERROR_SUCCESS;
+		}
+	}
+
+	spin_unlock(&vfs_mount_lock);
 	return FS_ERROR_FAILURE;
-}
\ No newline at end of file
+}
+EXPORT_SYMBOL(vfs_mount);
+
+uint64_t vfs_sync(void) {
+
+	uint64_t status = FS_ERROR_SUCCESS;
+
+	// Mounts are never taken away, so each can be synced without holding the lock
+	for (uint32_t i = 0; i < VFS_MOUNTS; i++) {
+		spin_lock(&vfs_mount_lock);
+		superblock_t* superblock = vfs_mounts[i].superblock;
+		spin_unlock(&vfs_mount_lock);
+
+		if (superblock != 0 && superblock->ops.write_fs_disk != 0 && superblock->ops.write_fs_disk(superblock) != FS_ERROR_SUCCESS) {
+			status = FS_ERROR_FAILURE;
+		}
+	}
+
+	return status;
+}
+EXPORT_SYMBOL(vfs_sync);
+
+// The filesystem an absolute path is on, setting relative to the rest of the path, or 0
+static superblock_t* vfs_resolve(const char* path, const char** relative) {
+
+	// The mount with the longest path the file is under
+	spin_lock(&vfs_mount_lock);
+
+	vfs_mount_t* mount = 0;
+	for (uint32_t i = 0; i < VFS_MOUNTS; i++) {
+		vfs_mount_t* candidate = &vfs_mounts[i];
+
+		if (candidate->superblock == 0 || (mount != 0 && candidate->length <= mount->length)) {
+			continue;
+		}
+
+		if (strncmp(path, candidate->path, candidate->length) == 0 && (path[candidate->length] == '/' || path[candidate->length] == '\0')) {
+			mount = candidate;
+		}
+	}
+
+	superblock_t* superblock = mount != 0 ? mount->superblock : 0;
+	*relative = mount != 0 ? path + mount->length : 0;
+
+	spin_unlock(&vfs_mount_lock);
+
+	while (*relative != 0 && **relative == '/') {
+		(*relative)++;
+	}
+
+	return superblock;
+}
+
+uint64_t vfs_open(const char* path, dentry_t* file) {
+
+	if (path == 0 || path[0] != '/') {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	const char* relative;
+	superblock_t* superblock = vfs_resolve(path, &relative);
+
+	if (superblock == 0 || superblock->ops.lookup == 0) {
+		return FS_ERROR_DOES_NOT_EXIST;
+	}
+
+	inode_t* inode = superblock->ops.lookup(superblock, relative);
+	if (inode == 0) {
+		return FS_ERROR_DOES_NOT_EXIST;
+	}
+
+	// Name the entry after the last part of the path
+	const char* name = path;
+	for (const char* c = path; *c != '\0'; c++) {
+		if (*c == '/' && c[1] != '\0') {
+			name = c + 1;
+		}
+	}
+
+	uint64_t length = 0;
+	while (name[length] != '\0' && name[length] != '/' && length < sizeof(file->name) - 1) {
+		file->name[length] = name[length];
+		length++;
+	}
+	file->name[length] = '\0';
+
+	file->inode_id = inode->id;
+	file->inode_ptr = inode;
+
+	return FS_ERROR_SUCCESS;
+}
+EXPORT_SYMBOL(vfs_open);
+
+void vfs_close(dentry_t* file) {
+
+	inode_t* inode = file->inode_ptr;
+
+	if (inode != 0 && inode->superblock != 0 && inode->superblock->ops.release != 0) {
+		inode->superblock->ops.release(inode);
+	}
+
+	file->inode_ptr = 0;
+}
+EXPORT_SYMBOL(vfs_close);
+
+// Open the directory a path is in, and find where the last part of the path starts
+static uint64_t vfs_open_parent(const char* path, dentry_t* directory, const char** name) {
+
+	if (path == 0 || path[0] != '/') {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	uint64_t length = strlen(path);
+	while (length > 1 && path[length - 1] == '/') {
+		length--;
+	}
+
+	uint64_t slash = length - 1;
+	while (path[slash] != '/') {
+		slash--;
+	}
+
+	// The name is copied into a dentry, and can not have a trailing '/'
+	*name = path + slash + 1;
+	if (length - slash - 1 == 0 || length - slash - 1 >= sizeof(directory->name) || path[length] != '\0') {
+		return FS_ERROR_INVALID_PATH;
+	}
+
+	char* parent = kmalloc(slash + 2);
+	if (parent == 0) {
+		return FS_ERROR_FAILURE;
+	}
+
+	memcpy(parent, path, slash + 1);
+	parent[slash == 0 ? 1 : slash] = '\0';
+
+	uint64_t status = vfs_open(parent, directory);
+	kfree(parent);
+
+	if (status == FS_ERROR_SUCCESS && directory->inode_ptr->type != FS_DIRECTORY) {
+		vfs_close(directory);
+		status = FS_ERROR_NODE_TYPE;
+	}
+
+	return status;
+}
+
+uint64_t vfs_create(const char* path, uint8_t type, dentry_t* file) {
+
+	dentry_t directory;
+	const char* name;
+
+	uint64_t status = vfs_open_parent(path, &directory, &name);
+	if (status != FS_ERROR_SUCCESS) {
+		return status;
+	}
+
+	inode_t* parent = directory.inode_ptr;
+	operations_t* ops = &parent->superblock->ops;
+
+	memcpy(file->name, name, strlen(name) + 1);
+	file->inode_ptr = 0;
+
+	if (ops->make_inode == 0 || ops->make_dentry == 0) {
+		status = FS_ERROR_INVALID_PERMISSIONS;
+	}
+	else if (ops->find_name != 0 && ops->find_name(parent, file->name) != 0) {
+		status = FS_ERROR_FAILURE;
+	}
+	else {
+		inode_t* inode = ops->make_inode(parent, type);
+
+		if (inode == 0) {
+			status = FS_ERROR_FAILURE;
+		}
+		else {
+			file->inode_id = inode->id;
+			file->inode_ptr = inode;
+
+			// Released with nothing linking to it, the new node is freed again
+			status = ops->make_dentry(parent, file);
+			if (status != FS_ERROR_SUCCESS) {
+				vfs_close(file);
+			}
+		}
+	}
+
+	vfs_close(&directory);
+	return status;
+}
+EXPORT_SYMBOL(vfs_create);
+
+uint64_t vfs_remove(const char* path) {
+
+	dentry_t directory;
+	dentry_t file;
+	const char* name;
+
+	uint64_t status = vfs_open_parent(path, &directory, &name);
+	if (status != FS_ERROR_SUCCESS) {
+		return status;
+	}
+
+	inode_t* parent = directory.inode_ptr;
+
+	memcpy(file.name, name, strlen(name) + 1);
+	file.inode_id = 0;
+	file.inode_ptr = 0;
+
+	if (parent->superblock->ops.remove_dentry == 0) {
+		status = FS_ERROR_INVALID_PERMISSIONS;
+	}
+	else {
+		status = parent->superblock->ops.remove_dentry(parent, &file);
+	}
+
+	vfs_close(&directory);
+	return status;
+}
+EXPORT_SYMBOL(vfs_remove);
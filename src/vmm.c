@@ -0,0 +1,385 @@
+/*
+ * evan-os/src/vmm.c
+ *
+ * Virtual memory regions, demand paging and copy-on-write.
+ *
+ * Each mapped page holds a reference to its frame, so a frame shared by
+ * several address spaces or still in a page cache is only freed once
+ * the last of them lets go. A private page that is read only while its
+ * region is writable is copy-on-write.
+ *
+ */
+
+#include <vmm.h>
+
+#include <asm.h>
+#include <kmalloc.h>
+#include <paging.h>
+#include <page_cache.h>
+#include <pmm.h>
+#include <spinlock.h>
+#include <string.h>
+#include <tlb.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frames gathered by an unmap before its batch is flushed and they can be freed
+#define VMM_UNMAP_FRAMES 16
+
+// Mapped read only wherever anonymous memory is read before it is written
+uint64_t vmm_zero_frame;
+
+void vmm_init(void) {
+
+	// This reference is never dropped, so the zero page is never freed
+	vmm_zero_frame = pmm_alloc_zeroed();
+}
+
+// The page table flags for pages of a region
+static uint64_t vmm_page_flags(vma_t* vma) {
+
+	uint64_t flags = PAGE_PRESENT;
+	if (vma->flags & VMA_WRITE) {
+		flags |= PAGE_WRITE;
+	}
+	if (vma->flags & VMA_USER) {
+		flags |= PAGE_USER;
+	}
+
+	return flags;
+}
+
+static vma_t* vmm_find(address_space_t* space, uint64_t address) {
+
+	for (vma_t* vma = space->vmas; vma != 0 && vma->start <= address; vma = vma->next) {
+		if (address < vma->end) {
+			return vma;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t vmm_map(address_space_t* space, uint64_t start, uint64_t size, uint64_t flags, page_cache_t* cache, uint64_t offset) {
+
+	uint64_t end = start + size;
+	if (size == 0 || (start | size | offset) & (PAGE_SIZE - 1) || end > KERNEL_HALF_BASE || end < start) {
+		return VMM_ERROR_INVALID;
+	}
+
+	vma_t* new_vma = kmalloc(sizeof(vma_t));
+	if (new_vma == 0) {
+		return VMM_ERROR_NO_MEMORY;
+	}
+
+	new_vma->start = start;
+	new_vma->end = end;
+	new_vma->flags = flags;
+	new_vma->cache = cache;
+	new_vma->offset = offset;
+
+	write_lock(&space->vma_lock);
+
+	// Find the first region after the new one, making sure none overlap it
+	vma_t** link = &space->vmas;
+	while (*link != 0 && (*link)->end <= start) {
+		link = &(*link)->next;
+	}
+
+	if (*link != 0 && (*link)->start < end) {
+		write_unlock(&space->vma_lock);
+		kfree(new_vma);
+		return VMM_ERROR_OVERLAP;
+	}
+
+	new_vma->next = *link;
+	*link = new_vma;
+
+	write_unlock(&space->vma_lock);
+
+	return 0;
+}
+
+// Unmap the pages in a range and drop their references
+static void vmm_unmap_pages(address_space_t* space, uint64_t start, uint64_t end) {
+
+	tlb_batch_t batch;
+	uint64_t frames[VMM_UNMAP_FRAMES];
+	uint32_t count = 0;
+
+	tlb_batch_init(&batch, space);
+
+	for (uint64_t page = start; page < end; page += PAGE_SIZE) {
+		uint64_t frame = paging_unmap_batch(space, page, &batch);
+		if (frame == 0) {
+			continue;
+		}
+
+		frames[count++] = frame;
+
+		// Other cores may use a frame until the flush, so it can not be freed before
+		if (count == VMM_UNMAP_FRAMES) {
+			tlb_batch_flush(&batch);
+			for (uint32_t i = 0; i < count; i++) {
+				pmm_page_put(frames[i]);
+			}
+			count = 0;
+		}
+	}
+
+	tlb_batch_flush(&batch);
+	for (uint32_t i = 0; i < count; i++) {
+		pmm_page_put(frames[i]);
+	}
+}
+
+void vmm_unmap(address_space_t* space, uint64_t start, uint64_t size) {
+
+	uint64_t end = (start + size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+	start &= ~(uint64_t)(PAGE_SIZE - 1);
+
+	write_lock(&space->vma_lock);
+
+	vma_t** link = &space->vmas;
+	while (*link != 0 && (*link)->start < end) {
+		vma_t* vma = *link;
+
+		if (vma->end <= start) {
+			link = &vma->next;
+			continue;
+		}
+
+		uint64_t from = vma->start > start ? vma->start : start;
+		uint64_t to = vma->end < end ? vma->end : end;
+
+		vmm_unmap_pages(space, from, to);
+
+		if (from == vma->start && to == vma->end) {
+			// The whole region goes
+			*link = vma->next;
+			kfree(vma);
+			continue;
+		}
+
+		if (from == vma->start) {
+			vma->offset += to - vma->start;
+			vma->start = to;
+		}
+		else if (to == vma->end) {
+			vma->end = from;
+		}
+		else {
+			// Split around the hole. If that fails, the region is left whole and
+			// touching the hole faults in fresh pages, which is safe if wasteful
+			vma_t* tail = kmalloc(sizeof(vma_t));
+			if (tail != 0) {
+				*tail = *vma;
+				tail->offset += to - vma->start;
+				tail->start = to;
+				vma->end = from;
+				vma->next = tail;
+				link = &tail->next;
+				continue;
+			}
+		}
+
+		link = &vma->next;
+	}
+
+	write_unlock(&space->vma_lock);
+}
+
+uint64_t vmm_clone(address_space_t* child, address_space_t* parent) {
+
+	uint64_t result = 0;
+	tlb_batch_t batch;
+	tlb_batch_init(&batch, parent);
+
+	// No faults can change the parent's pages while this holds the lock
+	write_lock(&parent->vma_lock);
+	write_lock(&child->vma_lock);
+
+	vma_t** child_link = &child->vmas;
+
+	for (vma_t* vma = parent->vmas; vma != 0 && result == 0; vma = vma->next) {
+
+		vma_t* copy = kmalloc(sizeof(vma_t));
+		if (copy == 0) {
+			result = VMM_ERROR_NO_MEMORY;
+			break;
+		}
+		*copy = *vma;
+		copy->next = 0;
+		*child_link = copy;
+		child_link = &copy->next;
+
+		for (uint64_t page = vma->start; page < vma->end; page += PAGE_SIZE) {
+			uint64_t entry = paging_entry(parent, page);
+			if (!(entry & PAGE_PRESENT)) {
+				continue;
+			}
+
+			// Private pages are write protected in the parent, so both sides copy on their next write.
+			// The processor can set the accessed and dirty bits meanwhile, so retry until the entry holds still
+			if (!(vma->flags & VMA_SHARED) && (entry & PAGE_WRITE)) {
+				while (paging_replace(parent, page, entry, entry & ~PAGE_WRITE, &batch) == PAGING_ERROR_CHANGED) {
+					entry = paging_entry(parent, page);
+				}
+				entry &= ~PAGE_WRITE;
+			}
+
+			uint64_t frame = entry & PAGE_ADDRESS_MASK;
+			uint64_t flags = entry & ~PAGE_ADDRESS_MASK & ~(PAGE_ACCESSED | PAGE_DIRTY);
+
+			pmm_page_get(frame);
+			if (paging_map(child, page, frame, flags) != 0) {
+				pmm_page_put(frame);
+				result = VMM_ERROR_NO_MEMORY;
+				break;
+			}
+		}
+	}
+
+	write_unlock(&child->vma_lock);
+	write_unlock(&parent->vma_lock);
+
+	// Cores running the parent may still have writable entries cached
+	tlb_batch_flush(&batch);
+
+	return result;
+}
+
+void vmm_destroy(address_space_t* space) {
+
+	vmm_unmap(space, 0, KERNEL_HALF_BASE);
+	paging_destroy(space);
+}
+
+// Map a missing page
+static bool vmm_fault_missing(address_space_t* space, vma_t* vma, uint64_t page, bool write) {
+
+	uint64_t flags = vmm_page_flags(vma);
+	uint64_t frame;
+
+	if (vma->cache == 0) {
+		if (write) {
+			// Demand zero, usually from a frame an idle core already cleared
+			frame = pmm_alloc_zeroed();
+			if (frame == 0) {
+				return false;
+			}
+		}
+		else {
+			// Reads share the zero page until the first write copies it
+			frame = vmm_zero_frame;
+			pmm_page_get(frame);
+			flags &= ~PAGE_WRITE;
+		}
+	}
+	else {
+		uint64_t index = (vma->offset + page - vma->start) / PAGE_SIZE;
+		frame = page_cache_get(vma->cache, index);
+		if (frame == 0) {
+			return false;
+		}
+
+		if (!(vma->flags & VMA_SHARED)) {
+			if (write) {
+				// Private mappings never write to the cached page
+				uint64_t copy = pmm_alloc_page();
+				if (copy == 0) {
+					pmm_page_put(frame);
+					return false;
+				}
+				memcpy(phys_to_virt(copy), phys_to_virt(frame), PAGE_SIZE);
+				pmm_page_put(frame);
+				frame = copy;
+			}
+			else {
+				flags &= ~PAGE_WRITE;
+			}
+		}
+	}
+
+	uint64_t result = paging_replace(space, page, 0, frame | flags, 0);
+	if (result != 0) {
+		pmm_page_put(frame);
+	}
+
+	// If another core mapped the page first, the access can simply be retried
+	return result == 0 || result == PAGING_ERROR_CHANGED;
+}
+
+// Give a copy-on-write page its own frame
+static bool vmm_fault_cow(address_space_t* space, vma_t* vma, uint64_t page, uint64_t entry) {
+
+	uint64_t old_frame = entry & PAGE_ADDRESS_MASK;
+	uint64_t result;
+
+	// Nothing else maps the frame any more, so it can just be made writable
+	if (old_frame != vmm_zero_frame && pmm_page_count(old_frame) == 1) {
+		result = paging_replace(space, page, entry, entry | PAGE_WRITE, 0);
+		return result == 0 || result == PAGING_ERROR_CHANGED;
+	}
+
+	uint64_t frame;
+	if (old_frame == vmm_zero_frame) {
+		frame = pmm_alloc_zeroed();
+	}
+	else {
+		frame = pmm_alloc_page();
+		if (frame != 0) {
+			memcpy(phys_to_virt(frame), phys_to_virt(old_frame), PAGE_SIZE);
+		}
+	}
+
+	if (frame == 0) {
+		return false;
+	}
+
+	result = paging_replace(space, page, entry, frame | vmm_page_flags(vma), 0);
+	if (result == 0) {
+		pmm_page_put(old_frame);
+	}
+	else {
+		pmm_page_put(frame);
+	}
+
+	return result == 0 || result == PAGING_ERROR_CHANGED;
+}
+
+bool vmm_handle_fault(uint64_t address, uint64_t error_code) {
+
+	address_space_t* space = address >= KERNEL_HALF_BASE ? &kernel_address_space : paging_current();
+	uint64_t page = address & ~(uint64_t)(PAGE_SIZE - 1);
+	bool write = (error_code & FAULT_WRITE) != 0;
+
+	// Faults run with interrupts disabled, so keep answering shootdowns from a core holding the lock
+	while (!read_trylock(&space->vma_lock)) {
+		tlb_shootdown_poll();
+		pause();
+	}
+
+	vma_t* vma = vmm_find(space, address);
+	bool handled = false;
+
+	if (vma != 0 && (!write || (vma->flags & VMA_WRITE)) && (!(error_code & FAULT_USER) || (vma->flags & VMA_USER))) {
+		uint64_t entry = paging_entry(space, page);
+
+		if (!(entry & PAGE_PRESENT)) {
+			handled = vmm_fault_missing(space, vma, page, write);
+		}
+		else if (write && !(entry & PAGE_WRITE)) {
+			handled = vmm_fault_cow(space, vma, page, entry);
+		}
+		else {
+			// Another core already fixed the page, and the fault dropped the stale TLB entry
+			handled = true;
+		}
+	}
+
+	read_unlock(&space->vma_lock);
+
+	return handled;
+}
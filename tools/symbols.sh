@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# evan-os/tools/symbols.sh
+#
+# Prints the C source of the kernel symbol table, from the functions in a
+# linked kernel. With no kernel given, prints an empty table for the first link.
+#
+
+echo "// Generated by tools/symbols.sh, do not edit"
+echo
+echo "#include <symbols.h>"
+echo
+
+if [ -z "$1" ]; then
+	echo "const uint64_t symbol_count = 0;"
+	echo "const symbol_t symbol_table[] = { { 0, 0 } };"
+	echo "const char symbol_names[] = \"\";"
+	exit 0
+fi
+
+# Code and data share one section, so only symbols between the linker script's markers are functions
+${NM:-nm} -n --defined-only "$1" | awk '
+	BEGIN { count = 0 }
+	$3 == "__text_start" { text = 1; next }
+	$3 == "__text_end" { text = 0; next }
+	text && NF == 3 && $2 ~ /^[tTwW]$/ {
+		address[count] = $1
+		name[count] = $3
+		count++
+	}
+	END {
+		print "const uint64_t symbol_count = " count ";"
+		print ""
+		print "const symbol_t symbol_table[] = {"
+		offset = 0
+		for (i = 0; i < count; i++) {
+			print "\t{ 0x" address[i] ", " offset " },"
+			offset += length(name[i]) + 1
+		}
+		print "};"
+		print ""
+		print "const char symbol_names[] ="
+		for (i = 0; i < count; i++) {
+			print "\t\"" name[i] "\\0\""
+		}
+		print "\t\"\";"
+	}
+'
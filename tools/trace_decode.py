@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+#
+# evan-os/tools/trace_decode.py
+#
+# Decodes the trace rings a TRACE=1 kernel dumps over the serial port
+# (see include/trace.h) into a timeline. The capture may contain other
+# serial output, everything before the "EVTR" header is skipped.
+#
+#   tools/trace_decode.py serial.log
+#   tools/trace_decode.py serial.log --chrome trace.json
+#
+# The JSON file opens in chrome://tracing or ui.perfetto.dev.
+#
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = b"EVTR"
+TRACE_VERSION = 1
+
+HEADER = struct.Struct("<4sIIIQ")
+CPU_HEADER = struct.Struct("<II")
+RECORD = struct.Struct("<QIIQQ")
+
+# Event ids to names and argument labels, as in include/trace.h
+EVENTS = {
+    1: ("interrupt", "entry", ("vector", None)),
+    2: ("interrupt", "exit", ("vector", None)),
+    3: ("syscall", "entry", ("id", "arg0")),
+    4: ("syscall", "exit", ("id", "return")),
+    5: ("page_fault", "entry", ("address", "error")),
+    6: ("page_fault", "exit", ("address", "handled")),
+    7: ("context_switch", None, ("prev", "next")),
+    8: ("vfs_read", "entry", ("offset", "size")),
+    9: ("vfs_read", "exit", ("offset", "status")),
+    10: ("vfs_mount", None, ("status", None)),
+}
+
+
+def parse(data):
+    start = data.find(TRACE_MAGIC)
+    if start < 0:
+        sys.exit("no trace found")
+
+    magic, version, cpu_count, record_size, tsc_hz = HEADER.unpack_from(data, start)
+    if version != TRACE_VERSION or record_size != RECORD.size:
+        sys.exit("unsupported trace version %d, record size %d" % (version, record_size))
+
+    offset = start + HEADER.size
+    records = []
+
+    for _ in range(cpu_count):
+        cpu, count = CPU_HEADER.unpack_from(data, offset)
+        offset += CPU_HEADER.size
+
+        for _ in range(count):
+            if offset + RECORD.size > len(data):
+                sys.exit("trace is truncated")
+            tsc, event, record_cpu, arg0, arg1 = RECORD.unpack_from(data, offset)
+            records.append((tsc, record_cpu, event, arg0, arg1))
+            offset += RECORD.size
+
+    records.sort()
+    return tsc_hz, records
+
+
+def describe(event, arg0, arg1):
+    name, phase, labels = EVENTS.get(event, ("event%d" % event, None, ("arg0", "arg1")))
+    args = {}
+    for label, value in zip(labels, (arg0, arg1)):
+        if label is not None:
+            args[label] = value
+    return name, phase, args
+
+
+def format_args(args):
+    return " ".join("%s=%#x" % (label, value) for label, value in args.items())
+
+
+def print_timeline(tsc_hz, records):
+    if not records:
+        print("empty trace")
+        return
+
+    base = records[0][0]
+    ticks_per_us = tsc_hz / 1e6 if tsc_hz else 1.0
+    unit = "us" if tsc_hz else "ticks"
+
+    # Open entries per core and event, for durations on the exits
+    open_entries = {}
+
+    for tsc, cpu, event, arg0, arg1 in records:
+        name, phase, args = describe(event, arg0, arg1)
+        time = (tsc - base) / ticks_per_us
+        line = "%14.3f %s  cpu%-2d %-14s %-5s %s" % (time, unit, cpu, name, phase or "", format_args(args))
+
+        stack = open_entries.setdefault((cpu, name), [])
+        if phase == "entry":
+            stack.append(tsc)
+        elif phase == "exit" and stack:
+            line += "  (%.3f %s)" % ((tsc - stack.pop()) / ticks_per_us, unit)
+
+        print(line)
+
+
+def write_chrome(tsc_hz, records, path):
+    base = records[0][0] if records else 0
+    ticks_per_us = tsc_hz / 1e6 if tsc_hz else 1.0
+    events = []
+
+    for tsc, cpu, event, arg0, arg1 in records:
+        name, phase, args = describe(event, arg0, arg1)
+        events.append({
+            "name": name,
+            "ph": {"entry": "B", "exit": "E"}.get(phase, "i"),
+            "ts": (tsc - base) / ticks_per_us,
+            "pid": 0,
+            "tid": cpu,
+            "s": "t",
+            "args": args,
+        })
+
+    with open(path, "w") as output:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an evan-os trace dump")
+    parser.add_argument("capture", help="serial port output containing the dump")
+    parser.add_argument("--chrome", metavar="FILE", help="also write Chrome trace event JSON")
+    arguments = parser.parse_args()
+
+    with open(arguments.capture, "rb") as capture:
+        data = capture.read()
+
+    tsc_hz, records = parse(data)
+    print_timeline(tsc_hz, records)
+
+    if arguments.chrome:
+        write_chrome(tsc_hz, records, arguments.chrome)
+
+
+if __name__ == "__main__":
+    main()